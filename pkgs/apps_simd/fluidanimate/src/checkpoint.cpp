@@ -0,0 +1,300 @@
+// The code in this file implements bulk particle I/O and the asynchronous
+// checkpoint writer (see checkpoint.hpp for the file format).
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <pthread.h>
+#include <assert.h>
+
+#include "fluid.hpp"
+#include "checkpoint.hpp"
+
+
+
+//Convert n floats between host and file byte order (file is little endian)
+static void SwapFloats(float *buf, long n)
+{
+  if(isLittleEndian())
+    return;
+  for(long i = 0; i < n; ++i)
+    buf[i] = bswap_float(buf[i]);
+}
+
+static int32_t FileInt(int32_t x)
+{
+  return isLittleEndian() ? x : bswap_int32(x);
+}
+
+static float FileFloat(float x)
+{
+  return isLittleEndian() ? x : bswap_float(x);
+}
+
+float *LoadParticles(char const *fileName, float *restParticlesPerMeter, int *numParticles, int *frame)
+{
+  std::ifstream file(fileName, std::ios::binary);
+  if(!file) {
+    std::cerr << "Error opening file. Aborting." << std::endl;
+    exit(1);
+  }
+
+  //Both headers start with a 4 byte value, a .fluid file can never start with the magic number
+  int32_t magic;
+  file.read((char *)&magic, FILE_SIZE_INT);
+  file.seekg(0);
+  if(FileInt(magic) == CHECKPOINT_MAGIC) {
+    CheckpointHeader hdr;
+    file.read((char *)&hdr, sizeof(CheckpointHeader));
+    if(!file || FileInt(hdr.version) != CHECKPOINT_VERSION) {
+      std::cerr << "Unsupported checkpoint file. Aborting." << std::endl;
+      exit(1);
+    }
+    *frame = FileInt(hdr.frame);
+    *numParticles = FileInt(hdr.numParticles);
+    *restParticlesPerMeter = FileFloat(hdr.restParticlesPerMeter);
+  } else {
+    //Always use single precision float variables b/c file format uses single precision
+    float restParticlesPerMeter_le;
+    int numParticles_le;
+    file.read((char *)&restParticlesPerMeter_le, FILE_SIZE_FLOAT);
+    file.read((char *)&numParticles_le, FILE_SIZE_INT);
+    *frame = 0;
+    *numParticles = FileInt(numParticles_le);
+    *restParticlesPerMeter = FileFloat(restParticlesPerMeter_le);
+  }
+  if(!file || *numParticles < 0) {
+    std::cerr << "Error reading file header. Aborting." << std::endl;
+    exit(1);
+  }
+
+  long n = (long)*numParticles * PARTICLE_FLOATS;
+  float *buf = new float[n];
+  file.read((char *)buf, n * FILE_SIZE_FLOAT);
+  if(!file) {
+    std::cerr << "File \"" << fileName << "\" is truncated. Aborting." << std::endl;
+    exit(1);
+  }
+  SwapFloats(buf, n);
+  return buf;
+}
+
+int CountParticles(int const *cnumPars, int first, int last)
+{
+  int count = 0;
+  for(int i = first; i < last; ++i)
+    count += cnumPars[i];
+  return count;
+}
+
+int PackParticles(Cell const *cells, int const *cnumPars, int first, int last, float *buf)
+{
+  float *out = buf;
+  for(int i = first; i < last; ++i)
+  {
+    Cell const *cell = &cells[i];
+    int np = cnumPars[i];
+    for(int j = 0; j < np; ++j)
+    {
+      int k = j % PARTICLES_PER_CELL;
+      out[0] = (float)cell->p_coord[k*3];
+      out[1] = (float)cell->p_coord[(k*3)+1];
+      out[2] = (float)cell->p_coord[(k*3)+2];
+      out[3] = (float)cell->hv[k].x;
+      out[4] = (float)cell->hv[k].y;
+      out[5] = (float)cell->hv[k].z;
+      out[6] = (float)cell->v_coord[k*3];
+      out[7] = (float)cell->v_coord[(k*3)+1];
+      out[8] = (float)cell->v_coord[(k*3)+2];
+      out += PARTICLE_FLOATS;
+
+      //move pointer to next cell in list if end of array is reached
+      if(k == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+  }
+  int count = (int)((out - buf) / PARTICLE_FLOATS);
+  SwapFloats(buf, (long)count * PARTICLE_FLOATS);
+  return count;
+}
+
+void WriteFluidFile(char const *fileName, float restParticlesPerMeter, int numParticles, float const *buf)
+{
+  std::ofstream file(fileName, std::ios::binary);
+  assert(file);
+
+  float restParticlesPerMeter_le = FileFloat(restParticlesPerMeter);
+  int32_t numParticles_le = FileInt(numParticles);
+  file.write((char *)&restParticlesPerMeter_le, FILE_SIZE_FLOAT);
+  file.write((char *)&numParticles_le, FILE_SIZE_INT);
+  file.write((char const *)buf, (long)numParticles * PARTICLE_FLOATS * FILE_SIZE_FLOAT);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//State shared between the simulation and the background writer thread
+struct CheckpointWriter {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  //file name split at its frame number conversion, if any
+  std::string namePrefix;
+  std::string nameSuffix;
+  bool perFrame;
+  bool zeroPad;
+  int width;
+  float *buf;
+  //checkpoint handed over by CheckpointSubmit, valid while pending is set
+  bool pending;
+  bool quit;
+  int frame;
+  int numParticles;
+  float restParticlesPerMeter;
+};
+
+static CheckpointWriter writer;
+
+//Split the file name at its conversion for the frame number, only a single %d with
+//an optional width (e.g. %04d) is accepted. The frame number is inserted by
+//WriteCheckpoint, the name itself is never used as a format string.
+static bool ParseCheckpointName(CheckpointWriter *w, char const *fileName)
+{
+  char const *p = strchr(fileName, '%');
+  w->perFrame = p != NULL;
+  w->zeroPad = false;
+  w->width = 0;
+  if(!p) {
+    w->namePrefix = fileName;
+    w->nameSuffix.clear();
+    return true;
+  }
+  w->namePrefix.assign(fileName, p - fileName);
+  ++p;
+  if(*p == '0') {
+    w->zeroPad = true;
+    ++p;
+  }
+  while(*p >= '0' && *p <= '9' && w->width < 100)
+    w->width = w->width * 10 + (*p++ - '0');
+  if(*p != 'd' || strchr(p, '%'))
+    return false;
+  w->nameSuffix = p + 1;
+  return true;
+}
+
+//Write the buffer to a temporary file first so that an interrupted write never
+//destroys the previous checkpoint
+static void WriteCheckpoint(CheckpointWriter *w, int frame, float restParticlesPerMeter, int numParticles)
+{
+  std::string name = w->namePrefix;
+  if(w->perFrame) {
+    char number[128];
+    snprintf(number, sizeof(number), w->zeroPad ? "%0*d" : "%*d", w->width, frame);
+    name += number;
+    name += w->nameSuffix;
+  }
+  std::string tmpName = name + ".tmp";
+
+  CheckpointHeader hdr;
+  memset(&hdr, 0, sizeof(CheckpointHeader));
+  hdr.magic = FileInt(CHECKPOINT_MAGIC);
+  hdr.version = FileInt(CHECKPOINT_VERSION);
+  hdr.frame = FileInt(frame);
+  hdr.numParticles = FileInt(numParticles);
+  hdr.restParticlesPerMeter = FileFloat(restParticlesPerMeter);
+
+  std::ofstream file(tmpName.c_str(), std::ios::binary);
+  file.write((char *)&hdr, sizeof(CheckpointHeader));
+  file.write((char *)w->buf, (long)numParticles * PARTICLE_FLOATS * FILE_SIZE_FLOAT);
+  file.close();
+  if(!file) {
+    std::cerr << "Error writing checkpoint \"" << tmpName << "\"." << std::endl;
+    return;
+  }
+#if defined(WIN32)
+  remove(name.c_str());
+#endif
+  if(rename(tmpName.c_str(), name.c_str()) != 0)
+    std::cerr << "Error renaming checkpoint \"" << tmpName << "\"." << std::endl;
+}
+
+static void *CheckpointWriterThread(void *args)
+{
+  CheckpointWriter *w = (CheckpointWriter *)args;
+  pthread_mutex_lock(&w->mutex);
+  while(1) {
+    while(!w->pending && !w->quit)
+      pthread_cond_wait(&w->cond, &w->mutex);
+    if(!w->pending)
+      break;
+    int frame = w->frame;
+    int numParticles = w->numParticles;
+    float restParticlesPerMeter = w->restParticlesPerMeter;
+    pthread_mutex_unlock(&w->mutex);
+
+    WriteCheckpoint(w, frame, restParticlesPerMeter, numParticles);
+
+    pthread_mutex_lock(&w->mutex);
+    w->pending = false;
+    pthread_cond_broadcast(&w->cond);
+  }
+  pthread_mutex_unlock(&w->mutex);
+  return NULL;
+}
+
+void CheckpointInit(char const *fileName, int numParticles)
+{
+  if(!ParseCheckpointName(&writer, fileName)) {
+    std::cerr << "Checkpoint file name \"" << fileName << "\" may only contain a single %d. Aborting." << std::endl;
+    exit(1);
+  }
+  writer.buf = new float[(long)numParticles * PARTICLE_FLOATS];
+  writer.pending = false;
+  writer.quit = false;
+  pthread_mutex_init(&writer.mutex, NULL);
+  pthread_cond_init(&writer.cond, NULL);
+  pthread_create(&writer.thread, NULL, CheckpointWriterThread, &writer);
+}
+
+float *CheckpointBuffer()
+{
+  return writer.buf;
+}
+
+void CheckpointWait()
+{
+  pthread_mutex_lock(&writer.mutex);
+  while(writer.pending)
+    pthread_cond_wait(&writer.cond, &writer.mutex);
+  pthread_mutex_unlock(&writer.mutex);
+}
+
+void CheckpointSubmit(int frame, float restParticlesPerMeter, int numParticles)
+{
+  pthread_mutex_lock(&writer.mutex);
+  assert(!writer.pending);
+  writer.frame = frame;
+  writer.numParticles = numParticles;
+  writer.restParticlesPerMeter = restParticlesPerMeter;
+  writer.pending = true;
+  pthread_cond_broadcast(&writer.cond);
+  pthread_mutex_unlock(&writer.mutex);
+}
+
+void CheckpointCleanUp()
+{
+  pthread_mutex_lock(&writer.mutex);
+  writer.quit = true;
+  pthread_cond_broadcast(&writer.cond);
+  pthread_mutex_unlock(&writer.mutex);
+  pthread_join(writer.thread, NULL);
+
+  pthread_mutex_destroy(&writer.mutex);
+  pthread_cond_destroy(&writer.cond);
+  delete[] writer.buf;
+}
@@ -0,0 +1,70 @@
+// The code in this file defines the interface for bulk particle I/O: loading of
+// .fluid files and checkpoints, and asynchronous writing of checkpoints.
+//
+// A checkpoint stores the particles in the same order and with the same 9 floats
+// per particle (px, py, pz, hvx, hvy, hvz, vx, vy, vz) as a .fluid file, preceded
+// by a CheckpointHeader instead of the .fluid header. All values are stored in
+// little endian byte order and are read and written with a single call each.
+
+#ifndef __CHECKPOINT_HPP__
+#define __CHECKPOINT_HPP__ 1
+
+#include "fluid.hpp"
+
+
+
+//Number of floats stored per particle, in files and in particle buffers
+#define PARTICLE_FLOATS 9
+
+#define CHECKPOINT_MAGIC   0x4b434c46 // "FLCK"
+#define CHECKPOINT_VERSION 1
+
+//NOTE: All members are 4 bytes wide, the structure is written to disk as is.
+struct CheckpointHeader {
+  int32_t magic;
+  int32_t version;
+  int32_t frame;        // number of frames simulated when the checkpoint was taken
+  int32_t numParticles;
+  float restParticlesPerMeter;
+  int32_t reserved[3];
+};
+
+
+
+//Load the particles of a .fluid file or of a checkpoint (detected by its magic number)
+//Returns a buffer with PARTICLE_FLOATS floats per particle in host byte order, which
+//has to be released with delete[]. frame is set to the frame stored in a checkpoint
+//or to 0 for a .fluid file. Exits the program if the file cannot be read.
+float *LoadParticles(char const *fileName, float *restParticlesPerMeter, int *numParticles, int *frame);
+
+//Count the particles of cells [first, last)
+int CountParticles(int const *cnumPars, int first, int last);
+
+//Copy the particles of cells [first, last) to buf in file format (little endian)
+//Returns the number of particles copied
+int PackParticles(Cell const *cells, int const *cnumPars, int first, int last, float *buf);
+
+//Write a .fluid file from a buffer filled by PackParticles
+void WriteFluidFile(char const *fileName, float restParticlesPerMeter, int numParticles, float const *buf);
+
+
+
+//Start the background thread which writes the checkpoints
+//If fileName contains a %d, optionally with a width (e.g. "frame%04d.ckpt"), every
+//checkpoint goes to its own file, otherwise the file is replaced by each checkpoint.
+//Exits the program if fileName contains any other % sequence.
+void CheckpointInit(char const *fileName, int numParticles);
+
+//Buffer to pack the next checkpoint into, only valid after CheckpointWait returned
+float *CheckpointBuffer();
+
+//Wait until the previous checkpoint was written and its buffer can be reused
+void CheckpointWait();
+
+//Hand the buffer over to the background thread, returns immediately
+void CheckpointSubmit(int frame, float restParticlesPerMeter, int numParticles);
+
+//Write outstanding checkpoints and stop the background thread
+void CheckpointCleanUp();
+
+#endif //__CHECKPOINT_HPP__
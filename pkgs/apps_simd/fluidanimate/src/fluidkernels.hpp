@@ -0,0 +1,606 @@
+// Particle kernels shared by the serial, pthreads and tbb versions of the program
+// SIMD Version by Juan M. Cebrian, NTNU - 2013. (modifications under JMCG tag)
+//
+// All kernels work on the particles of one logical cell. They use the simulation
+// parameters declared below, which are defined by every version of the program.
+// Each version is responsible for the synchronization around the kernels: the
+// pair kernels update the particles of both cells, or accumulate the
+// contributions to the neighbor in a halo buffer if one is given.
+
+#ifndef __FLUIDKERNELS_HPP__
+#define __FLUIDKERNELS_HPP__ 1
+
+#include <algorithm>
+
+#include "fluid.hpp"
+
+extern fptype h, hSq;
+extern fptype pressureCoeff, viscosityCoeff;
+extern int nx, ny, nz;
+
+////////////////////////////////////////////////////////////////////////////////
+
+/* JMCG BEGIN */
+
+// JMCG Required for original code since we change loop order
+// Compute densities one by one starting at iparNeigh_in
+inline fptype ComputeDensitiesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh, fptype *halo ) {
+  fptype total_tc = 0.0;
+  for(int iparNeigh = iparNeigh_in; iparNeigh < numNeighPars; ++iparNeigh) {
+    Cell *cell_ipar = cell;
+    fptype tc_ipar = 0;
+    for(int ipar = 0; ipar < np; ++ipar) {
+      //Check address to make sure densities are computed only once per pair
+      //    if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) { // JMCG We no longer have p[], not sure if this works
+      fptype tc = 0.0;
+      if(&neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3] < &cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3]) {
+        //      fptype distSq = (cell->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL]).GetLengthSq(); // JMCG We no longer have p[]
+        fptype dist_x = cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3] - neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3];
+        fptype dist_y = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+1] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1];
+        fptype dist_z = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+2] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2];
+
+        fptype distSq = (dist_x * dist_x) + (dist_y * dist_y) + (dist_z * dist_z);
+
+        if(distSq < hSq) {
+          fptype t = hSq - distSq;
+          tc = t*t*t;
+          tc_ipar += tc;
+#ifdef DEBUG_SIMD
+	  total_tc += tc;
+#endif
+          cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
+        }
+      }
+
+      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell_ipar = cell_ipar->next;
+      }
+    } // ipar
+
+    if(halo)
+      halo[iparNeigh] += tc_ipar;
+    else
+      neigh->density[iparNeigh % PARTICLES_PER_CELL] += tc_ipar;
+
+    //move pointer to next cell in list if end of array is reached
+    if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+      neigh = neigh->next;
+    }
+  }
+  return total_tc;
+}
+
+/* JMCG Vectorization. SIMD implementation with number of particles greater than SIMD_WIDTH but not neccesary to be divisible by SIMD_WIDTH */
+inline fptype ComputeDensitiesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh, fptype *halo ) {
+
+  fptype total_tc = 0.0;
+#ifdef SIMD_WIDTH
+  int iparNeigh;
+
+  //  _MM_ALIGN fptype total_tc[SIMD_WIDTH];
+  _MM_TYPE _mask, _flag, temp_tc, _tc;
+
+  iparNeigh = *iparNeigh_in;
+
+  while((iparNeigh + SIMD_WIDTH) <= numNeighPars) {
+    Cell *cell_ipar = cell;
+    fptype tc_ipar = 0;
+    temp_tc = _MM_SET(0);
+    _tc = _MM_SET(0);
+
+    _MM_TYPE data_x, data_y, data_z;
+    _MM_LOAD3(&data_x,&data_y,&data_z,&((*neigh)->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
+
+    for(int ipar = 0; ipar < np; ++ipar) {
+      //  for(iparNeigh = *iparNeigh_in; iparNeigh < numNeighPars; iparNeigh += SIMD_WIDTH) {
+
+      //Check address to make sure densities are computed only once per pair || JMCG NEED ANOTHER MASK HERE (Inverted as SSE does)
+      // if(&(*neigh)->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) {
+
+#define LITERAL_FORMULA_DENSITY(A) ((&((*neigh)->p_coord[((A) % PARTICLES_PER_CELL)*3]) < &(cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3])) ? 1 : 0)
+      _mask = _MM_SETR_FORMULA_1PARAM(LITERAL_FORMULA_DENSITY,iparNeigh);
+
+      // This looks weird but our ARM evaluation system seems to be running in
+      // Runfast mode. In this mode Subnormal numbers are being flushed to zero (that is, the 0x0...1 stored in otype)
+      // Casting everything to integer and using integer comparations seems to work
+      // minimum positive subnormal number 00000001 1.40129846e-45
+//      _mask = _MM_CAST_I_TO_FP(_MM_CMPEQ_SIG(_MM_CAST_FP_TO_I(_mask), _MM_SET_I(1))); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
+      _mask = (_MM_TYPE)_MM_CMPEQ_SIG((_MM_TYPE_I)_mask, (_MM_TYPE_I)_MM_SET(1)); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
+
+	// ORIGINAL CODE
+	//      fptype distSq = (cell->p[ipar % PARTICLES_PER_CELL] - (*neigh)->p[iparNeigh % PARTICLES_PER_CELL]).GetLengthSq();
+	// if(distSq < hSq) { // JMCG We skip the if in the vectorization, just ignore negative values
+
+        _MM_TYPE dist_x = _MM_SUB(_MM_SET(cell_ipar->p_coord[(ipar% PARTICLES_PER_CELL)*3]),data_x);
+	_MM_TYPE dist_y = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+1]),data_y);
+	_MM_TYPE dist_z = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+2]),data_z);
+
+	dist_x = _MM_MUL(dist_x,dist_x);
+	dist_y = _MM_MUL(dist_y,dist_y);
+	dist_z = _MM_MUL(dist_z,dist_z);
+
+	_MM_TYPE distSq = _MM_ADD(_MM_ADD(dist_x,dist_y),dist_z);
+
+
+	//	fptype t = hSq - distSq;
+	_MM_TYPE _t = _MM_SUB(_MM_SET(hSq),distSq);
+
+	// JMCG We only keep positive values (if(distSq < hSq))
+	_flag = (_MM_TYPE)_MM_CMPLT(_t, _MM_SET(0));
+	_tc = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, _t));
+
+	// Mask filter address to make sure densities are computed only once per pair
+	_tc = _MM_OR(_MM_AND(_mask, _tc), _MM_ANDNOT(_mask, _MM_SET(0)));
+
+	//	fptype tc = t*t*t;
+	_tc = _MM_MUL(_MM_MUL(_tc,_tc),_tc);
+
+	temp_tc = _MM_ADD(temp_tc,_tc);
+
+	fptype tc = _MM_REDUCE_ADD(_tc);
+
+#ifdef DEBUG_SIMD
+	total_tc += tc;
+#endif
+
+	//cell->density[ipar % PARTICLES_PER_CELL] += tc;
+	cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
+
+
+	/*else {
+	  iparNeigh = numNeighPars; // JMCG Adding this we can Stop iteration on internal loop. Slightly faster than original code, but I'm not completely sure that is the same.
+	  } */
+
+      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell_ipar = cell_ipar->next;
+      }
+
+    } // ipar
+
+    // JMCG Store densities
+    if(halo)
+      _MM_STORE(&(halo[iparNeigh]),_MM_ADD(_MM_LOAD(&(halo[iparNeigh])),temp_tc));
+    else
+      _MM_STORE(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL]),_MM_ADD(_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL])),temp_tc));
+
+    iparNeigh += SIMD_WIDTH;
+    //move pointer to next cell in list if end of array is reached
+    if(iparNeigh % PARTICLES_PER_CELL == 0) {
+      *neigh = (*neigh)->next;
+    }
+
+  }
+
+  *iparNeigh_in = iparNeigh;
+#endif
+  return total_tc;
+}
+
+// Compute Forces one by one starting at iparNeigh_in
+inline Vec3 ComputeForcesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh, fptype *halo, int haloStride ) {
+
+  Vec3 return_vec(0.0,0.0,0.0);
+
+  for(int iparNeigh = iparNeigh_in; iparNeigh < numNeighPars; ++iparNeigh) {
+    Cell *cell_ipar = cell;
+    Vec3 acc_ipar(0.0,0.0,0.0);
+    for(int ipar = 0; ipar < np; ++ipar) {
+      //Check address to make sure forces are computed only once per pair
+      //    if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) {
+      if(&neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3] < &cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3]) {
+	// Vec3 disp = cell_ipar->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL]; // old code
+	Vec3 disp;
+	disp.x = cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3] - neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3];
+	disp.y = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+1] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1];
+	disp.z = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+2] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2];
+	fptype distSq = disp.GetLengthSq();
+
+	if(distSq < hSq) {
+#ifndef ENABLE_DOUBLE_PRECISION
+	  fptype dist = sqrtf(std::max(distSq, (fptype)1e-12));
+#else
+	  fptype dist = sqrt(std::max(distSq, 1e-12));
+#endif //ENABLE_DOUBLE_PRECISION
+	  fptype hmr = h - dist;
+	  Vec3 acc = disp * pressureCoeff * (hmr*hmr/dist) * (cell_ipar->density[ipar % PARTICLES_PER_CELL]+neigh->density[iparNeigh % PARTICLES_PER_CELL] - doubleRestDensity);
+	  //	acc += (neigh->v[iparNeigh % PARTICLES_PER_CELL] - cell->v[ipar % PARTICLES_PER_CELL]) * viscosityCoeff * hmr;
+	  acc.x += (neigh->v_coord[(iparNeigh % PARTICLES_PER_CELL)*3] - cell_ipar->v_coord[(ipar % PARTICLES_PER_CELL)*3]) * viscosityCoeff * hmr;
+	  acc.y += (neigh->v_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1] - cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+1]) * viscosityCoeff * hmr;
+	  acc.z += (neigh->v_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2] - cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+2]) * viscosityCoeff * hmr;
+
+	  acc /= cell_ipar->density[ipar % PARTICLES_PER_CELL] * neigh->density[iparNeigh % PARTICLES_PER_CELL];
+
+#ifdef DEBUG_SIMD
+	  return_vec += acc;
+#endif
+	  acc_ipar +=acc;
+
+	  cell_ipar->a[ipar % PARTICLES_PER_CELL] += acc;
+
+	}
+      }
+      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell_ipar = cell_ipar->next;
+      }
+    }
+
+    if(halo) {
+      halo[iparNeigh] -= acc_ipar.x;
+      halo[haloStride + iparNeigh] -= acc_ipar.y;
+      halo[2*haloStride + iparNeigh] -= acc_ipar.z;
+    } else {
+      neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc_ipar;
+    }
+    //move pointer to next cell in list if end of array is reached
+    if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+      neigh = neigh->next;
+    }
+  }
+  return return_vec;
+}
+
+// Compute Forces in groups of SIMD_WIDTH starting at iparNeigh_in. Stores last possition multiple of SIMD_WIDTH in iparNeigh_in and modifies neigh pointer to the latest neigh analized
+inline Vec3 ComputeForcesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh, fptype *halo, int haloStride ) {
+
+  Vec3 return_vec(0.0,0.0,0.0);
+
+#ifdef SIMD_WIDTH
+
+  _MM_ALIGN fptype new_a_x[SIMD_WIDTH];
+  _MM_ALIGN fptype new_a_y[SIMD_WIDTH];
+  _MM_ALIGN fptype new_a_z[SIMD_WIDTH];
+
+  _MM_TYPE _mask, _flag;
+  int iparNeigh;
+
+  iparNeigh = *iparNeigh_in;
+
+  while((iparNeigh + SIMD_WIDTH) <= numNeighPars) {
+    //Check address to make sure forces are computed only once per pair
+    //if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL])  // JMCG Vectorization. Mask for this one
+
+    Cell *cell_ipar = cell;
+
+    _MM_TYPE acc_x_ipar = _MM_SET(0);
+    _MM_TYPE acc_y_ipar = _MM_SET(0);
+    _MM_TYPE acc_z_ipar = _MM_SET(0);
+
+    _MM_TYPE data_x, data_y, data_z;
+    _MM_LOAD3(&data_x,&data_y,&data_z,&((*neigh)->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
+
+    _MM_TYPE v_x, v_y, v_z;
+    _MM_LOAD3(&v_x,&v_y,&v_z,&((*neigh)->v_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
+
+    for(int ipar = 0; ipar < np; ++ipar) {
+
+#define LITERAL_FORMULA_FORCES(A) ((&((*neigh)->p_coord[((A) % PARTICLES_PER_CELL)*3]) < &(cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3])) ? 1 : 0)
+       _mask = _MM_SETR_FORMULA_1PARAM(LITERAL_FORMULA_FORCES,iparNeigh);
+
+       // This looks weird but our ARM evaluation system seems to be running in
+       // Runfast mode. In this mode Subnormal numbers are being flushed to zero (that is, the 0x0...1 stored in otype)
+       // Casting everything to integer and using integer comparations seems to work
+       // minimum positive subnormal number 00000001 1.40129846e-45
+//       _mask = _MM_CAST_I_TO_FP(_MM_CMPEQ_SIG(_MM_CAST_FP_TO_I(_mask), _MM_SET_I(1))); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
+       _mask = (_MM_TYPE)_MM_CMPEQ_SIG((_MM_TYPE_I)_mask, (_MM_TYPE_I)_MM_SET(1)); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
+
+       _MM_TYPE dist_x = _MM_SUB(_MM_SET(cell_ipar->p_coord[(ipar% PARTICLES_PER_CELL)*3]),data_x);
+       _MM_TYPE dist_y = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+1]),data_y);
+       _MM_TYPE dist_z = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+2]),data_z);
+
+       _MM_TYPE distSq = _MM_ADD(_MM_ADD( _MM_MUL(dist_x,dist_x),
+					  _MM_MUL(dist_y,dist_y)),
+				 _MM_MUL(dist_z,dist_z));
+
+	/*
+	  if(distSq < hSq) { // JMCG We skip the if in the vectorization, just ignore negative values with mask
+	*/
+
+	// JMCG We only keep positive values
+	_MM_TYPE _t = _MM_SUB(_MM_SET(hSq),distSq);
+	_flag = (_MM_TYPE)_MM_CMPLT(_t, _MM_SET(0)); // Use flag later
+
+	// Extrack bits from flag to speed up, dont run the code if all 0
+	  /*
+	    // Original code
+	    #ifndef ENABLE_DOUBLE_PRECISION
+	    fptype dist = sqrtf(std::max(distSq, (fptype)1e-12));
+	    #else
+	    fptype dist = sqrt(std::max(distSq, 1e-12));
+	    #endif //ENABLE_DOUBLE_PRECISION
+	  */
+	  _MM_TYPE _dist = _MM_SQRT(_MM_MAX(distSq, _MM_SET(1e-12)));
+
+	  //fptype hmr = h - dist;
+	  _MM_TYPE _hmr = _MM_SUB(_MM_SET(h), _dist);
+
+	  // Vec3 acc = disp * pressureCoeff * (hmr*hmr/dist) * (cell->density[ipar % PARTICLES_PER_CELL]+neigh->density[iparNeigh % PARTICLES_PER_CELL] - doubleRestDensity); // JMCG We separate on the three coordinates
+
+	  _MM_TYPE common = _MM_MUL(_MM_MUL(_MM_SET(pressureCoeff),_MM_DIV(_MM_MUL(_hmr,_hmr),_dist)),
+				    _MM_SUB(_MM_ADD(_MM_SET(cell_ipar->density[ipar % PARTICLES_PER_CELL]),_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL]))), _MM_SET(doubleRestDensity))); // Common to all three coordinates
+
+	  _MM_TYPE acc_x = _MM_MUL(dist_x,common);
+	  _MM_TYPE acc_y = _MM_MUL(dist_y,common);
+	  _MM_TYPE acc_z = _MM_MUL(dist_z,common);
+
+	  //  acc += (neigh->v[iparNeigh % PARTICLES_PER_CELL] - cell->v[ipar % PARTICLES_PER_CELL]) * viscosityCoeff * hmr;
+	  acc_x = _MM_ADD(acc_x,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_x,_MM_SET(cell_ipar->v_coord[(ipar % PARTICLES_PER_CELL)*3])))));
+	  acc_y = _MM_ADD(acc_y,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_y,_MM_SET(cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+1])))));
+	  acc_z = _MM_ADD(acc_z,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_z,_MM_SET(cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+2])))));
+
+	  //      acc /= cell->density[ipar % PARTICLES_PER_CELL] * neigh->density[iparNeigh % PARTICLES_PER_CELL];
+	  common = _MM_MUL(_MM_SET(cell_ipar->density[ipar % PARTICLES_PER_CELL]),_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL])));
+	  acc_x = _MM_DIV(acc_x,common);
+	  acc_y = _MM_DIV(acc_y,common);
+	  acc_z = _MM_DIV(acc_z,common);
+
+	  // Mask filter address to make sure densities are computed only once per pair
+	  acc_x = _MM_OR(_MM_AND(_mask, acc_x), _MM_ANDNOT(_mask, _MM_SET(0)));
+	  acc_y = _MM_OR(_MM_AND(_mask, acc_y), _MM_ANDNOT(_mask, _MM_SET(0)));
+	  acc_z = _MM_OR(_MM_AND(_mask, acc_z), _MM_ANDNOT(_mask, _MM_SET(0)));
+
+	  // Mask filter results for distSq < hSq
+	  acc_x = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_x));
+	  acc_y = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_y));
+	  acc_z = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_z));
+
+	  // Store values for iparneigh
+	  acc_x_ipar = _MM_ADD(acc_x_ipar,acc_x);
+	  acc_y_ipar = _MM_ADD(acc_y_ipar,acc_y);
+	  acc_z_ipar = _MM_ADD(acc_z_ipar,acc_z);
+
+	  // Combine all values
+	  fptype combined_x = _MM_REDUCE_ADD(acc_x);
+	  fptype combined_y = _MM_REDUCE_ADD(acc_y);
+	  fptype combined_z = _MM_REDUCE_ADD(acc_z);
+
+#ifdef DEBUG_SIMD
+	  return_vec.x += combined_x;
+	  return_vec.y += combined_y;
+	  return_vec.z += combined_z;
+#endif
+	  cell_ipar->a[ipar % PARTICLES_PER_CELL].x += combined_x;
+	  cell_ipar->a[ipar % PARTICLES_PER_CELL].y += combined_y;
+	  cell_ipar->a[ipar % PARTICLES_PER_CELL].z += combined_z;
+      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell_ipar = cell_ipar->next;
+      }
+    } // ipar
+
+    if(halo) {
+      // Halo planes are SoA, subtract the whole vector at once
+      _MM_STORE(&(halo[iparNeigh]),_MM_SUB(_MM_LOAD(&(halo[iparNeigh])),acc_x_ipar));
+      _MM_STORE(&(halo[haloStride + iparNeigh]),_MM_SUB(_MM_LOAD(&(halo[haloStride + iparNeigh])),acc_y_ipar));
+      _MM_STORE(&(halo[2*haloStride + iparNeigh]),_MM_SUB(_MM_LOAD(&(halo[2*haloStride + iparNeigh])),acc_z_ipar));
+    } else {
+      // Store a values to update later
+      _MM_STORE(&(new_a_x[0]),acc_x_ipar);
+      _MM_STORE(&(new_a_y[0]),acc_y_ipar);
+      _MM_STORE(&(new_a_z[0]),acc_z_ipar);
+
+      //	neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc;
+#pragma unroll(SIMD_WIDTH)
+      for (int i = 0; i < SIMD_WIDTH; i++) {
+	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].x -= new_a_x[i];
+	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].y -= new_a_y[i];
+	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].z -= new_a_z[i];
+      }
+    }
+
+    iparNeigh += SIMD_WIDTH;
+    //move pointer to next cell in list if end of array is reached
+    if(iparNeigh % PARTICLES_PER_CELL == 0) {
+      *neigh = (*neigh)->next;
+    }
+  }
+  *iparNeigh_in = iparNeigh;
+
+#endif // SIMD_WIDTH
+  return return_vec;
+}
+
+/* JMCG END */
+
+// Adds the density contributions of all particle pairs between cell and neigh
+inline void ComputeDensitiesPair(Cell *cell, int np, Cell *neigh, int numNeighPars, fptype *halo)
+{
+  int leftovers = 0;
+#ifdef SIMD_WIDTH
+  if(numNeighPars >= SIMD_WIDTH)
+    ComputeDensitiesMTSIMD(&leftovers, 0, numNeighPars, np, 0, cell, &neigh, halo);
+#endif
+  ComputeDensitiesMTOriginal(leftovers, 0, numNeighPars, np, 0, cell, neigh, halo);
+}
+
+// Adds the accelerations of all particle pairs between cell and neigh
+inline void ComputeForcesPair(Cell *cell, int np, Cell *neigh, int numNeighPars, fptype *halo, int haloStride)
+{
+  int leftovers = 0;
+#ifdef SIMD_WIDTH
+  if(numNeighPars >= SIMD_WIDTH)
+    ComputeForcesMTSIMD(&leftovers, 0, numNeighPars, np, 0, cell, &neigh, halo, haloStride);
+#endif
+  ComputeForcesMTOriginal(leftovers, 0, numNeighPars, np, 0, cell, neigh, halo, haloStride);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// ProcessCollisions() with container walls
+// Under the assumptions that
+// a) a particle will not penetrate a wall
+// b) a particle will not migrate further than once cell
+// c) the parSize is smaller than a cell
+// then only the particles at the perimiters may be influenced by the walls
+inline void ProcessCollisionsCell(Cell *cell, int np, int ix, int iy, int iz)
+{
+	    if(!((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))==(iz==(nz-1))))
+			return;	// not on domain wall
+    for(int j = 0; j < np; ++j)
+    {
+	  int ji = j % PARTICLES_PER_CELL;
+	  Vec3 pos;
+	  pos.x = cell->p_coord[ji*3] + cell->hv[ji].x * timeStep;
+	  pos.y = cell->p_coord[(ji*3)+1] + cell->hv[ji].y * timeStep;
+	  pos.z = cell->p_coord[(ji*3)+2] + cell->hv[ji].z * timeStep;
+	  if(ix==0) {
+        fptype diff = parSize - (pos.x - domainMin.x);
+	    if(diff > epsilon)
+          cell->a[ji].x += stiffnessCollisions*diff - damping*cell->v_coord[ji*3];
+	  }
+	  if(ix==(nx-1))
+	    {
+	      fptype diff = parSize - (domainMax.x - pos.x);
+	      if(diff > epsilon)
+		cell->a[ji].x -= stiffnessCollisions*diff + damping*cell->v_coord[ji*3];
+	    }
+	  if(iy==0)
+	    {
+	      fptype diff = parSize - (pos.y - domainMin.y);
+	      if(diff > epsilon)
+		cell->a[ji].y += stiffnessCollisions*diff - damping*cell->v_coord[(ji*3)+1];
+	    }
+	  if(iy==(ny-1))
+	    {
+	      fptype diff = parSize - (domainMax.y - pos.y);
+	      if(diff > epsilon)
+		cell->a[ji].y -= stiffnessCollisions*diff + damping*cell->v_coord[(ji*3)+1];
+	    }
+	  if(iz==0)
+	    {
+	      fptype diff = parSize - (pos.z - domainMin.z);
+	      if(diff > epsilon)
+		cell->a[ji].z += stiffnessCollisions*diff - damping*cell->v_coord[(ji*3)+2];
+	    }
+	  if(iz==(nz-1))
+	    {
+	      fptype diff = parSize - (domainMax.z - pos.z);
+	      if(diff > epsilon)
+		cell->a[ji].z -= stiffnessCollisions*diff + damping*cell->v_coord[(ji*3)+2];
+	    }
+      //move pointer to next cell in list if end of array is reached
+      if(ji == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+}
+
+// Reflects particles of cell (ix,iy,iz) which left the domain during AdvanceParticlesCell
+inline void ProcessCollisions2Cell(Cell *cell, int np, int ix, int iy, int iz)
+{
+#if 0
+// Chris, the following test should be valid
+// *** provided that a particle does not migrate more than 1 cell
+// *** per integration step. This does not appear to be the case
+// *** in the pthreads version. Serial version it seems to be OK
+	    if(!((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))==(iz==(nz-1))))
+			return;	// not on domain wall
+#endif
+    for(int j = 0; j < np; ++j)
+    {
+		  int ji = j % PARTICLES_PER_CELL;
+
+		  Vec3 pos;
+		  pos.x = cell->p_coord[ji*3];
+		  pos.y = cell->p_coord[(ji*3)+1];
+		  pos.z = cell->p_coord[(ji*3)+2];
+
+		  if(ix==0)
+		    {
+		      fptype diff = pos.x - domainMin.x;
+		      if(diff < Zero)
+			{
+			  cell->p_coord[ji*3] = domainMin.x - diff;
+			  cell->v_coord[ji*3] = -cell->v_coord[ji*3];
+			  cell->hv[ji].x = -cell->hv[ji].x;
+			}
+		    }
+		  if(ix==(nx-1))
+		    {
+        fptype diff = domainMax.x - pos.x;
+	              if(diff < Zero)
+	                    {
+			      cell->p_coord[ji*3] = domainMax.x + diff;
+			      cell->v_coord[ji*3] = -cell->v_coord[ji*3];
+
+			      cell->hv[ji].x = -cell->hv[ji].x;
+			    }
+		  }
+		  if(iy==0)
+		  {
+        fptype diff = pos.y - domainMin.y;
+		    if(diff < Zero)
+			{
+			  cell->p_coord[(ji*3)+1] = domainMin.y - diff;
+			  cell->v_coord[(ji*3)+1] = -cell->v_coord[(ji*3)+1];
+			  cell->hv[ji].y = -cell->hv[ji].y;
+			}
+		  }
+		  if(iy==(ny-1))
+		  {
+        fptype diff = domainMax.y - pos.y;
+ 			if(diff < Zero)
+			{
+			  cell->p_coord[(ji*3)+1] = domainMax.y + diff;
+			  cell->v_coord[(ji*3)+1] = -cell->v_coord[(ji*3)+1];
+
+			  cell->hv[ji].y = -cell->hv[ji].y;
+			}
+		  }
+		  if(iz==0)
+		  {
+        fptype diff = pos.z - domainMin.z;
+		    if(diff < Zero)
+			{
+			  cell->p_coord[(ji*3)+2] = domainMin.z - diff;
+			  cell->v_coord[(ji*3)+2] = -cell->v_coord[(ji*3)+2];
+			  cell->hv[ji].z = -cell->hv[ji].z;
+			}
+		  }
+		  if(iz==(nz-1))
+		  {
+        fptype diff = domainMax.z - pos.z;
+ 			if(diff < Zero)
+			{
+			  cell->p_coord[(ji*3)+2] = domainMax.z + diff;
+			  cell->v_coord[(ji*3)+2] = -cell->v_coord[(ji*3)+2];
+			  cell->hv[ji].z = -cell->hv[ji].z;
+			}
+		  }
+      //move pointer to next cell in list if end of array is reached
+      if(ji == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Leapfrog integration of the particles of a cell
+inline void AdvanceParticlesCell(Cell *cell, int np)
+{
+    for(int j = 0; j < np; ++j)
+    {
+      Vec3 v_half = cell->hv[j % PARTICLES_PER_CELL] + cell->a[j % PARTICLES_PER_CELL]*timeStep;
+		// N.B. The integration of the position can place the particle
+		// outside the domain. Although we could place a test in this loop
+		// we would be unnecessarily testing particles on interior cells.
+		// Therefore, to reduce the amount of computations we make a later
+		// pass on the perimiter cells to account for particle migration
+		// beyond domain
+
+	  cell->p_coord[(j % PARTICLES_PER_CELL)*3] += v_half.x * timeStep;
+      cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1] += v_half.y * timeStep;
+      cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2] += v_half.z * timeStep;
+
+	  cell->v_coord[(j % PARTICLES_PER_CELL)*3] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].x + v_half.x);
+	  cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].y + v_half.y);
+	  cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].z + v_half.z);
+      cell->hv[j % PARTICLES_PER_CELL] = v_half;
+
+      //move pointer to next cell in list if end of array is reached
+      if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+}
+
+#endif //__FLUIDKERNELS_HPP__
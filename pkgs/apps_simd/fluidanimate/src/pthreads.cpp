@@ -24,6 +24,8 @@
 #include "fluid.hpp"
 #include "cellpool.hpp"
 #include "parsec_barrier.hpp"
+#include "fluidkernels.hpp"
+#include "checkpoint.hpp"
 
 #include <iomanip>
 
@@ -62,12 +64,6 @@ float max_diff = 0.0f;
 float max_diff_forces = 0.0f;
 #endif
 
-// JMCG Required for original code since we change loop order
-// Compute densities one by one starting at iparNeigh_in
-inline fptype ComputeDensitiesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh );
-// Compute Forces one by one starting at iparNeigh_in
-inline Vec3 ComputeForcesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh );
-
 #ifdef SIMD_WIDTH // JMCG Vectorization
 
 //#define SIMD_STATS
@@ -94,28 +90,40 @@ inline fptype ComputeDensitiesMTOriginal_test(int iparNeigh_in, int indexNeigh,
 // Compute Forces one by one starting at iparNeigh_in. Used for debugging, does not store any value in a[].
 inline Vec3 ComputeForcesMTOriginal_test(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh );
 
-// Compute densities in groups of SIMD_WIDTH. Stores last possition multiple of SIMD_WIDTH in iparNeigh_in and modifies neigh pointer to the latest neigh analized
-inline fptype ComputeDensitiesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh );
-// Compute Forces in groups of SIMD_WIDTH starting at iparNeigh_in. Stores last possition multiple of SIMD_WIDTH in iparNeigh_in and modifies neigh pointer to the latest neigh analized
-inline Vec3 ComputeForcesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh );
-
 #endif
 
 /* JMCG END */
 
 Cell **last_cells = NULL; //helper array with pointers to last cell structure of "cells" array lists
+Cell **last_cells2 = NULL; //same for "cells2", swapped together with cells by the fused frame
 #ifdef ENABLE_VISUALIZATION
 Vec3 vMax(0.0,0.0,0.0);
 Vec3 vMin(0.0,0.0,0.0);
 #endif
 
-int XDIVS = 1;  // number of partitions in X
-int ZDIVS = 1;  // number of partitions in Z
+int numGrids = 1;  // number of partitions, one per thread
+int XDIVS = 1;     // number of partitions (columns) in X
+int *ZDIVS;        // number of partitions in Z of each column
+
+#define NUM_GRIDS  (numGrids)
 
+//Comment out to keep the initial partitioning of the grid for the whole run
+#define ENABLE_LOAD_BALANCING
+//Minimum relative reduction of the largest partition load required to repartition
+#define REBALANCE_THRESHOLD 0.05
 
-#define NUM_GRIDS  ((XDIVS) * (ZDIVS))
-#define MUTEXES_PER_CELL 128
-#define CELL_MUTEX_ID 0
+//Comment out to run every phase of a frame as a separate pass over the grid
+//with a global barrier after each of them. The fused frame merges phases that
+//only touch particles of the own grid into a single pass and synchronizes the
+//remaining ones with neighboring threads only.
+#define ENABLE_FUSED_FRAME
+//Maximum amount of iterations to spin on the progress of a neighbor before
+//blocking, same as the spinning limit of the PARSEC barrier (about 0.1 ms)
+#define NEIGHBOR_SPIN_MAX (350*100)
+
+// Halo slots of a cell are padded to this many particles so that the SIMD kernels
+// can use aligned loads and stores on them
+#define HALO_ALIGN 16
 
 struct Grid
 {
@@ -127,17 +135,63 @@ struct Grid
     unsigned char pp[CACHELINE_SIZE];
   };
 } *grids;
+
+// Particles are only ever updated by the thread owning their cell. Contributions
+// that ComputeDensitiesMT and ComputeForcesMT produce for particles in cells of
+// another thread are accumulated in the private halo buffer of the producing thread
+// and pulled by the owner after the phase, so no per-particle locks are needed
+struct Halo
+{
+  int numCells;           // number of foreign cells written by this thread
+  int *cellIndex;         // global index of each foreign cell
+  int *offset;            // start of each foreign cell in buf, recomputed every frame
+  int bx, bz, bw, bd;     // grid extended by one cell in x and z: origin and width/depth
+  int *slot;              // extended grid -> foreign cell number, -1 for own cells
+  int size;               // particles per plane used this frame
+  int capacity;           // particles per plane of buf
+  fptype *buf;            // 3 planes: densities use plane 0, accelerations x/y/z
+  int numPull;            // foreign cells of other threads owned by this thread
+  int *pullThread;        // thread whose halo holds the cell
+  int *pullCell;          // foreign cell number in that halo
+} *halos;
+int *owner = NULL;  // thread owning each cell
+int **columnLoad;   // per thread, particles binned to each (x,z) column of cells in RebuildGridMT
+
+// Point-to-point synchronization used by the fused frame. Every phase of a thread
+// only touches cells within one cell of its grid, so a thread only has to wait for
+// the threads whose grids are at most two cells away (its neighbors) to complete
+// the previous phase
+struct Progress
+{
+  union {
+    struct {
+      pthread_mutex_t mutex;
+      pthread_cond_t cond;
+      volatile int step;   // number of phases completed by the thread
+      int numNeighbors;
+      int *neighbors;
+    };
+    unsigned char pp[2*CACHELINE_SIZE];
+  };
+} *progress;
+
 bool  *border;
 pthread_attr_t attr;
 pthread_t *thread;
-pthread_mutex_t **mutex;  // used to lock cells in RebuildGrid and also particles in other functions
+pthread_mutex_t *mutex;  // used to lock border cells in RebuildGrid
 pthread_barrier_t barrier;  // global barrier used by all threads
+
+int startFrame = 0;               // frames already simulated by the checkpoint the run was restarted from
+char const *checkpointFile = NULL; // periodic checkpoints are disabled if NULL
+int checkpointInterval = 1;       // frames between two checkpoints
+int *snapshotCount;               // per thread, particles packed into the checkpoint buffer
 #ifdef ENABLE_VISUALIZATION
 pthread_barrier_t visualization_barrier;  // global barrier to separate (serial) visualization phase from (parallel) fluid simulation
 #endif
 
 typedef struct __thread_args {
   int tid;      //thread id, determines work partition
+  int first;      //number of the first frame to compute
   int frames;      //number of frames to compute
 } thread_args;      //arguments for threads
 
@@ -146,49 +200,457 @@ using namespace std;
 ////////////////////////////////////////////////////////////////////////////////
 
 /*
- * hmgweight
+ * SplitSlices
  *
- * Computes the hamming weight of x
+ * Splits n consecutive slices into parts consecutive ranges such that the load
+ * of range p is as close as possible to a share of the total load proportional
+ * to weight[p] (all weights equal if weight is NULL). Every range gets at least
+ * one slice.
  *
- * x      - input value
- * lsb    - if x!=0 position of smallest bit set, else -1
+ * load   - load of each slice
+ * bounds - range p covers slices [bounds[p], bounds[p+1])
+ */
+void SplitSlices(const int *load, int n, int parts, const int *weight, int *bounds)
+{
+  assert(n >= parts);
+  long total = 0;
+  long totalWeight = 0;
+  for(int i = 0; i < n; ++i)
+    total += load[i];
+  for(int p = 0; p < parts; ++p)
+    totalWeight += (weight ? weight[p] : 1);
+
+  int b = 0;
+  long prefix = 0;
+  long w = 0;
+  bounds[0] = 0;
+  for(int p = 1; p < parts; ++p)
+  {
+    w += (weight ? weight[p-1] : 1);
+    double target = (double)total * w / totalWeight;
+    //take at least one slice and leave at least one for each remaining range
+    prefix += load[b++];
+    while(b < n-(parts-p) && prefix + 0.5*load[b] < target)
+      prefix += load[b++];
+    bounds[p] = b;
+  }
+  bounds[parts] = n;
+}
+
+/*
+ * PartitionGrids
  *
- * return - the hamming weight
+ * Splits the domain into XDIVS columns along x with ZDIVS[c] partitions along
+ * z each, balancing the given load of each (x,z) column of cells
  */
-unsigned int hmgweight(unsigned int x, int *lsb) {
-  unsigned int weight=0;
-  unsigned int mask= 1;
-  unsigned int count=0;
-
-  *lsb=-1;
-  while(x > 0) {
-    unsigned int temp;
-    temp=(x&mask);
-    if((x&mask) == 1) {
-      weight++;
-      if(*lsb == -1) *lsb = count;
+void PartitionGrids(const int *load, Grid *g)
+{
+  int *colLoad = new int[std::max(nx, nz)];
+  int *xb = new int[XDIVS+1];
+  int *zb = new int[nz+1];
+
+  for(int ix = 0; ix < nx; ++ix)
+  {
+    colLoad[ix] = 0;
+    for(int iz = 0; iz < nz; ++iz)
+      colLoad[ix] += load[iz*nx + ix];
+  }
+  SplitSlices(colLoad, nx, XDIVS, ZDIVS, xb);
+
+  int gi = 0;
+  for(int i = 0; i < XDIVS; ++i)
+  {
+    for(int iz = 0; iz < nz; ++iz)
+    {
+      colLoad[iz] = 0;
+      for(int ix = xb[i]; ix < xb[i+1]; ++ix)
+        colLoad[iz] += load[iz*nx + ix];
+    }
+    SplitSlices(colLoad, nz, ZDIVS[i], NULL, zb);
+
+    for(int j = 0; j < ZDIVS[i]; ++j, ++gi)
+    {
+      g[gi].sx = xb[i];
+      g[gi].ex = xb[i+1];
+      g[gi].sy = 0;
+      g[gi].ey = ny;
+      g[gi].sz = zb[j];
+      g[gi].ez = zb[j+1];
     }
-    x >>= 1;
-    count++;
   }
+  assert(gi == NUM_GRIDS);
 
-  return weight;
+  delete[] colLoad;
+  delete[] xb;
+  delete[] zb;
 }
 
-void InitSim(char const *fileName, unsigned int threadnum)
+// Marks the cells that have a neighbor in another grid
+void InitBorders()
 {
-  //Compute partitioning based on square root of number of threads
-  //NOTE: Other partition sizes are possible as long as XDIVS * ZDIVS == threadnum,
-  //      but communication is minimal (and hence optimal) if XDIVS == ZDIVS
-  int lsb;
-  if(hmgweight(threadnum,&lsb) != 1) {
-    std::cerr << "Number of threads must be a power of 2" << std::endl;
-    exit(1);
+  for(int i = 0; i < NUM_GRIDS; ++i)
+    for(int iz = grids[i].sz; iz < grids[i].ez; ++iz)
+      for(int iy = grids[i].sy; iy < grids[i].ey; ++iy)
+        for(int ix = grids[i].sx; ix < grids[i].ex; ++ix)
+        {
+          int index = (iz*ny + iy)*nx + ix;
+          border[index] = false;
+          for(int dk = -1; dk <= 1; ++dk)
+	  {
+            for(int dj = -1; dj <= 1; ++dj)
+	    {
+              for(int di = -1; di <= 1; ++di)
+              {
+                int ci = ix + di;
+                int cj = iy + dj;
+                int ck = iz + dk;
+
+                if(ci < 0) ci = 0; else if(ci > (nx-1)) ci = nx-1;
+                if(cj < 0) cj = 0; else if(cj > (ny-1)) cj = ny-1;
+                if(ck < 0) ck = 0; else if(ck > (nz-1)) ck = nz-1;
+
+                if( ci < grids[i].sx || ci >= grids[i].ex ||
+                  cj < grids[i].sy || cj >= grids[i].ey ||
+                  ck < grids[i].sz || ck >= grids[i].ez ) {
+
+                    border[index] = true;
+		    break;
+		}
+              } // for(int di = -1; di <= 1; ++di)
+	      if(border[index])
+		break;
+	    } // for(int dj = -1; dj <= 1; ++dj)
+	    if(border[index])
+	       break;
+           } // for(int dk = -1; dk <= 1; ++dk)
+        }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static fptype *AllocHaloBuffer(int n)
+{
+  fptype *buf;
+#if defined(WIN32)
+  buf = (fptype *)_aligned_malloc(sizeof(fptype) * n, CACHELINE_SIZE);
+  assert(buf != NULL);
+#elif defined(SPARC_SOLARIS)
+  buf = (fptype *)memalign(CACHELINE_SIZE, sizeof(fptype) * n);
+  assert(buf != 0);
+#else
+  int rv = posix_memalign((void **)(&buf), CACHELINE_SIZE, sizeof(fptype) * n);
+  assert(rv == 0);
+#endif
+  return buf;
+}
+
+static void FreeHaloBuffer(fptype *buf)
+{
+#if defined(WIN32)
+  _aligned_free(buf);
+#else
+  free(buf);
+#endif
+}
+
+/*
+ * InitHalos
+ *
+ * Assigns every cell to the thread whose grid contains it and builds, for each
+ * thread, the list of foreign cells next to its grid (its halo) as well as the
+ * list of halo cells of other threads it has to pull into its own cells.
+ * Must be called again whenever the grids change.
+ */
+void InitHalos()
+{
+  if(owner == NULL)
+    owner = new int[numCells];
+  for(int i = 0; i < NUM_GRIDS; ++i)
+    for(int iz = grids[i].sz; iz < grids[i].ez; ++iz)
+      for(int iy = grids[i].sy; iy < grids[i].ey; ++iy)
+        for(int ix = grids[i].sx; ix < grids[i].ex; ++ix)
+          owner[(iz*ny + iy)*nx + ix] = i;
+
+  halos = new Halo[NUM_GRIDS];
+  for(int t = 0; t < NUM_GRIDS; ++t)
+  {
+    Halo &hl = halos[t];
+    hl.bx = grids[t].sx - 1;
+    hl.bz = grids[t].sz - 1;
+    hl.bw = grids[t].ex - grids[t].sx + 2;
+    hl.bd = grids[t].ez - grids[t].sz + 2;
+    hl.slot = new int[hl.bw*ny*hl.bd];
+    hl.numCells = 0;
+    for(int pass = 0; pass < 2; ++pass)
+    {
+      if(pass == 1) {
+        hl.cellIndex = new int[hl.numCells];
+        hl.offset = new int[hl.numCells];
+        hl.numCells = 0;
+      }
+      for(int k = 0; k < hl.bd; ++k)
+        for(int iy = 0; iy < ny; ++iy)
+          for(int i = 0; i < hl.bw; ++i)
+          {
+            int ix = hl.bx + i;
+            int iz = hl.bz + k;
+            int s = (k*ny + iy)*hl.bw + i;
+            hl.slot[s] = -1;
+            if(ix < 0 || ix >= nx || iz < 0 || iz >= nz)
+              continue;
+            int index = (iz*ny + iy)*nx + ix;
+            if(owner[index] == t)
+              continue;
+            if(pass == 1) {
+              hl.cellIndex[hl.numCells] = index;
+              hl.slot[s] = hl.numCells;
+            }
+            ++hl.numCells;
+          }
+    }
+    hl.size = 0;
+    hl.capacity = 0;
+    hl.buf = NULL;
+    hl.numPull = 0;
+  }
+
+  for(int u = 0; u < NUM_GRIDS; ++u)
+    for(int k = 0; k < halos[u].numCells; ++k)
+      ++halos[owner[halos[u].cellIndex[k]]].numPull;
+  for(int t = 0; t < NUM_GRIDS; ++t) {
+    halos[t].pullThread = new int[halos[t].numPull];
+    halos[t].pullCell = new int[halos[t].numPull];
+    halos[t].numPull = 0;
+  }
+  for(int u = 0; u < NUM_GRIDS; ++u)
+    for(int k = 0; k < halos[u].numCells; ++k)
+    {
+      Halo &hl = halos[owner[halos[u].cellIndex[k]]];
+      hl.pullThread[hl.numPull] = u;
+      hl.pullCell[hl.numPull] = k;
+      ++hl.numPull;
+    }
+}
+
+void CleanUpHalos()
+{
+  for(int t = 0; t < NUM_GRIDS; ++t)
+  {
+    delete[] halos[t].slot;
+    delete[] halos[t].cellIndex;
+    delete[] halos[t].offset;
+    delete[] halos[t].pullThread;
+    delete[] halos[t].pullCell;
+    if(halos[t].buf != NULL)
+      FreeHaloBuffer(halos[t].buf);
   }
-  XDIVS = 1<<(lsb/2);
-  ZDIVS = 1<<(lsb/2);
-  if(XDIVS*ZDIVS != threadnum) XDIVS*=2;
-  assert(XDIVS * ZDIVS == threadnum);
+  delete[] halos;
+  halos = NULL;
+}
+
+// Returns the halo slot of a neighbor cell, or NULL if the cell is owned by tid
+inline fptype *HaloSlot(int tid, int index)
+{
+  if(owner[index] == tid)
+    return NULL;
+  Halo &hl = halos[tid];
+  int ix = index % nx;
+  int iy = (index / nx) % ny;
+  int iz = index / (nx*ny);
+  int k = hl.slot[((iz - hl.bz)*ny + iy)*hl.bw + (ix - hl.bx)];
+  return &hl.buf[hl.offset[k]];
+}
+
+// Clears the first planes of the halo buffer of thread tid
+void ClearHaloMT(int tid, int planes)
+{
+  Halo &hl = halos[tid];
+  for(int p = 0; p < planes; ++p)
+    memset(&hl.buf[p*hl.capacity], 0, hl.size*sizeof(fptype));
+}
+
+// Lays out the halo buffer for the particle counts of the current frame
+void PrepareHaloMT(int tid)
+{
+  Halo &hl = halos[tid];
+  int size = 0;
+  for(int k = 0; k < hl.numCells; ++k)
+  {
+    hl.offset[k] = size;
+    size += (cnumPars[hl.cellIndex[k]] + HALO_ALIGN-1) / HALO_ALIGN * HALO_ALIGN;
+  }
+  if(size > hl.capacity)
+  {
+    if(hl.buf != NULL)
+      FreeHaloBuffer(hl.buf);
+    //leave some room so the buffer does not have to grow every frame
+    hl.capacity = (size + size/4 + HALO_ALIGN-1) / HALO_ALIGN * HALO_ALIGN;
+    hl.buf = AllocHaloBuffer(3*hl.capacity);
+  }
+  hl.size = size;
+  ClearHaloMT(tid, 1);
+}
+
+// Adds the density contributions other threads left in their halos to the cells of tid
+void PullHaloDensitiesMT(int tid)
+{
+  Halo &hl = halos[tid];
+  for(int i = 0; i < hl.numPull; ++i)
+  {
+    Halo &src = halos[hl.pullThread[i]];
+    int k = hl.pullCell[i];
+    int index = src.cellIndex[k];
+    fptype const *in = &src.buf[src.offset[k]];
+    Cell *cell = &cells[index];
+    int np = cnumPars[index];
+    for(int j = 0; j < np; ++j)
+    {
+      cell->density[j % PARTICLES_PER_CELL] += in[j];
+      //move pointer to next cell in list if end of array is reached
+      if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+  }
+}
+
+// Adds the accelerations other threads left in their halos to the cells of tid
+void PullHaloForcesMT(int tid)
+{
+  Halo &hl = halos[tid];
+  for(int i = 0; i < hl.numPull; ++i)
+  {
+    Halo &src = halos[hl.pullThread[i]];
+    int k = hl.pullCell[i];
+    int index = src.cellIndex[k];
+    fptype const *in_x = &src.buf[src.offset[k]];
+    fptype const *in_y = in_x + src.capacity;
+    fptype const *in_z = in_y + src.capacity;
+    Cell *cell = &cells[index];
+    int np = cnumPars[index];
+    for(int j = 0; j < np; ++j)
+    {
+      cell->a[j % PARTICLES_PER_CELL].x += in_x[j];
+      cell->a[j % PARTICLES_PER_CELL].y += in_y[j];
+      cell->a[j % PARTICLES_PER_CELL].z += in_z[j];
+      //move pointer to next cell in list if end of array is reached
+      if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
+        cell = cell->next;
+      }
+    }
+  }
+}
+
+// Builds the list of neighbors of every thread, must be called whenever the grids change
+void InitNeighbors()
+{
+  for(int t = 0; t < NUM_GRIDS; ++t)
+  {
+    Progress &pr = progress[t];
+    delete[] pr.neighbors;
+    pr.neighbors = new int[NUM_GRIDS];
+    pr.numNeighbors = 0;
+    for(int u = 0; u < NUM_GRIDS; ++u)
+    {
+      if(u == t)
+        continue;
+      if(grids[u].sx < grids[t].ex + 2 && grids[t].sx < grids[u].ex + 2 &&
+         grids[u].sz < grids[t].ez + 2 && grids[t].sz < grids[u].ez + 2)
+        pr.neighbors[pr.numNeighbors++] = u;
+    }
+  }
+}
+
+/*
+ * SyncNeighborsMT
+ *
+ * Marks the current phase of thread tid as completed and waits until all its
+ * neighbors have completed it as well. Spins for a while before blocking.
+ */
+void SyncNeighborsMT(int tid)
+{
+  Progress &me = progress[tid];
+  int step = me.step + 1;
+
+  pthread_mutex_lock(&me.mutex);
+  me.step = step;
+  pthread_cond_broadcast(&me.cond);
+  pthread_mutex_unlock(&me.mutex);
+
+  for(int i = 0; i < me.numNeighbors; ++i)
+  {
+    Progress &pr = progress[me.neighbors[i]];
+    int spins = 0;
+    while(pr.step < step && spins < NEIGHBOR_SPIN_MAX)
+      ++spins;
+    if(pr.step < step) {
+      pthread_mutex_lock(&pr.mutex);
+      while(pr.step < step)
+        pthread_cond_wait(&pr.cond, &pr.mutex);
+      pthread_mutex_unlock(&pr.mutex);
+    } else {
+      //make the results of the neighbor visible before reading them
+      __sync_synchronize();
+    }
+  }
+}
+
+/*
+ * RebalanceGrids
+ *
+ * Repartitions the grid with the particle counts measured by the last
+ * RebuildGridMT. The new partitioning is only applied if it reduces the load of
+ * the most loaded thread by at least REBALANCE_THRESHOLD. Must be called by a
+ * single thread between frames.
+ */
+void RebalanceGrids()
+{
+  int *load = new int[nx*nz];
+  for(int i = 0; i < nx*nz; ++i)
+  {
+    load[i] = 0;
+    for(int t = 0; t < NUM_GRIDS; ++t)
+      load[i] += columnLoad[t][i];
+  }
+
+  Grid *newGrids = new Grid[NUM_GRIDS];
+  PartitionGrids(load, newGrids);
+
+  long maxLoad = 0;
+  long newMaxLoad = 0;
+  for(int t = 0; t < NUM_GRIDS; ++t)
+  {
+    long l = 0;
+    long nl = 0;
+    for(int iz = 0; iz < nz; ++iz)
+      for(int ix = 0; ix < nx; ++ix)
+      {
+        if(ix >= grids[t].sx && ix < grids[t].ex && iz >= grids[t].sz && iz < grids[t].ez)
+          l += load[iz*nx + ix];
+        if(ix >= newGrids[t].sx && ix < newGrids[t].ex && iz >= newGrids[t].sz && iz < newGrids[t].ez)
+          nl += load[iz*nx + ix];
+      }
+    maxLoad = std::max(maxLoad, l);
+    newMaxLoad = std::max(newMaxLoad, nl);
+  }
+
+  if(newMaxLoad < (1.0 - REBALANCE_THRESHOLD) * maxLoad)
+  {
+    for(int t = 0; t < NUM_GRIDS; ++t)
+      grids[t] = newGrids[t];
+    InitBorders();
+    CleanUpHalos();
+    InitHalos();
+    InitNeighbors();
+  }
+
+  delete[] newGrids;
+  delete[] load;
+}
+
+void InitSim(char const *fileName, unsigned int threadnum)
+{
+  numGrids = threadnum;
 
   thread = new pthread_t[NUM_GRIDS];
   grids = new struct Grid[NUM_GRIDS];
@@ -197,26 +659,14 @@ void InitSim(char const *fileName, unsigned int threadnum)
                                           // and change this macro
   pools = new cellpool[NUM_GRIDS];
 
-  //Load input particles
+  //Load input particles, either from a .fluid file or from a checkpoint
   std::cout << "Loading file \"" << fileName << "\"..." << std::endl;
-  std::ifstream file(fileName, std::ios::binary);
-  if(!file) {
-    std::cerr << "Error opening file. Aborting." << std::endl;
-    exit(1);
-  }
-
   //Always use single precision float variables b/c file format uses single precision
   float restParticlesPerMeter_le;
-  int numParticles_le;
-  file.read((char *)&restParticlesPerMeter_le, FILE_SIZE_FLOAT);
-  file.read((char *)&numParticles_le, FILE_SIZE_INT);
-  if(!isLittleEndian()) {
-    restParticlesPerMeter = bswap_float(restParticlesPerMeter_le);
-    numParticles          = bswap_int32(numParticles_le);
-  } else {
-    restParticlesPerMeter = restParticlesPerMeter_le;
-    numParticles          = numParticles_le;
-  }
+  float *particles = LoadParticles(fileName, &restParticlesPerMeter_le, &numParticles, &startFrame);
+  restParticlesPerMeter = restParticlesPerMeter_le;
+  if(startFrame > 0)
+    std::cout << "Restarting from checkpoint of frame " << startFrame << std::endl;
   for(int i=0; i<NUM_GRIDS; i++) cellpool_init(&pools[i], numParticles/NUM_GRIDS);
 
   h = kernelRadiusMultiplier / restParticlesPerMeter;
@@ -249,83 +699,55 @@ void InitSim(char const *fileName, unsigned int threadnum)
   std::cout << "Grids steps over x, y, z: " << delta.x << " " << delta.y << " " << delta.z << std::endl;
   assert(delta.x >= h && delta.y >= h && delta.z >= h);
 
-  assert(nx >= XDIVS && nz >= ZDIVS);
-  int gi = 0;
-  int sx, sz, ex, ez;
-  ex = 0;
+  //Compute partitioning based on square root of number of threads. Any number
+  //of threads is supported: the columns along x get threadnum/XDIVS partitions
+  //along z each, the first threadnum%XDIVS columns one more.
+  //NOTE: communication is minimal (and hence optimal) if XDIVS == ZDIVS
+  XDIVS = std::min(std::max((int)(sqrt((double)threadnum) + 0.5), 1), nx);
+  while(XDIVS < nx && (int)(threadnum + XDIVS - 1) / XDIVS > nz)
+    ++XDIVS;
+  if((int)(threadnum + XDIVS - 1) / XDIVS > nz) {
+    std::cerr << "Number of threads must not exceed the number of grid columns (" << nx*nz << ")" << std::endl;
+    exit(1);
+  }
+  ZDIVS = new int[XDIVS];
   for(int i = 0; i < XDIVS; ++i)
-  {
-    sx = ex;
-    ex = (int)((fptype)(nx)/(fptype)(XDIVS) * (i+1) + 0.5);
-    assert(sx < ex);
+    ZDIVS[i] = threadnum / XDIVS + (i < (int)(threadnum % XDIVS) ? 1 : 0);
 
-    ez = 0;
-    for(int j = 0; j < ZDIVS; ++j, ++gi)
-    {
-      sz = ez;
-      ez = (int)((fptype)(nz)/(fptype)(ZDIVS) * (j+1) + 0.5);
-      assert(sz < ez);
-
-      grids[gi].sx = sx;
-      grids[gi].ex = ex;
-      grids[gi].sy = 0;
-      grids[gi].ey = ny;
-      grids[gi].sz = sz;
-      grids[gi].ez = ez;
-    }
-  }
-  assert(gi == NUM_GRIDS);
+  //Start with an even split, it is rebalanced once the particles are loaded
+  int *load = new int[nx*nz];
+  for(int i = 0; i < nx*nz; ++i)
+    load[i] = 1;
+  PartitionGrids(load, grids);
+  delete[] load;
 
-  border = new bool[numCells];
+  columnLoad = new int *[NUM_GRIDS];
   for(int i = 0; i < NUM_GRIDS; ++i)
-    for(int iz = grids[i].sz; iz < grids[i].ez; ++iz)
-      for(int iy = grids[i].sy; iy < grids[i].ey; ++iy)
-        for(int ix = grids[i].sx; ix < grids[i].ex; ++ix)
-        {
-          int index = (iz*ny + iy)*nx + ix;
-          border[index] = false;
-          for(int dk = -1; dk <= 1; ++dk)
-	  {
-            for(int dj = -1; dj <= 1; ++dj)
-	    {
-              for(int di = -1; di <= 1; ++di)
-              {
-                int ci = ix + di;
-                int cj = iy + dj;
-                int ck = iz + dk;
-
-                if(ci < 0) ci = 0; else if(ci > (nx-1)) ci = nx-1;
-                if(cj < 0) cj = 0; else if(cj > (ny-1)) cj = ny-1;
-                if(ck < 0) ck = 0; else if(ck > (nz-1)) ck = nz-1;
-
-                if( ci < grids[i].sx || ci >= grids[i].ex ||
-                  cj < grids[i].sy || cj >= grids[i].ey ||
-                  ck < grids[i].sz || ck >= grids[i].ez ) {
+  {
+    columnLoad[i] = new int[nx*nz];
+    memset(columnLoad[i], 0, nx*nz*sizeof(int));
+  }
 
-                    border[index] = true;
-		    break;
-		}
-              } // for(int di = -1; di <= 1; ++di)
-	      if(border[index])
-		break;
-	    } // for(int dj = -1; dj <= 1; ++dj)
-	    if(border[index])
-	       break;
-           } // for(int dk = -1; dk <= 1; ++dk)
-        }
+  border = new bool[numCells];
+  InitBorders();
 
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
-  mutex = new pthread_mutex_t *[numCells];
+  mutex = new pthread_mutex_t[numCells];
   for(int i = 0; i < numCells; ++i)
+    pthread_mutex_init(&mutex[i], NULL);
+  InitHalos();
+  progress = new Progress[NUM_GRIDS];
+  assert(sizeof(Progress) <= 2*CACHELINE_SIZE);
+  for(int i = 0; i < NUM_GRIDS; ++i)
   {
-    assert(CELL_MUTEX_ID < MUTEXES_PER_CELL);
-    int n = (border[i] ? MUTEXES_PER_CELL : CELL_MUTEX_ID+1);
-    mutex[i] = new pthread_mutex_t[n];
-    for(int j = 0; j < n; ++j)
-      pthread_mutex_init(&mutex[i][j], NULL);
+    pthread_mutex_init(&progress[i].mutex, NULL);
+    pthread_cond_init(&progress[i].cond, NULL);
+    progress[i].step = 0;
+    progress[i].neighbors = NULL;
   }
+  InitNeighbors();
   pthread_barrier_init(&barrier, NULL, NUM_GRIDS);
 #ifdef ENABLE_VISUALIZATION
   //visualization barrier is used by all NUM_GRIDS worker threads and 1 master thread
@@ -342,21 +764,24 @@ void InitSim(char const *fileName, unsigned int threadnum)
   cnumPars = (int*)_aligned_malloc(sizeof(int) * numCells, CACHELINE_SIZE);
   cnumPars2 = (int*)_aligned_malloc(sizeof(int) * numCells, CACHELINE_SIZE);
   last_cells = (struct Cell **)_aligned_malloc(sizeof(struct Cell *) * numCells, CACHELINE_SIZE);
-  assert((cells!=NULL) && (cells2!=NULL) && (cnumPars!=NULL) && (cnumPars2!=NULL) && (last_cells!=NULL));
+  last_cells2 = (struct Cell **)_aligned_malloc(sizeof(struct Cell *) * numCells, CACHELINE_SIZE);
+  assert((cells!=NULL) && (cells2!=NULL) && (cnumPars!=NULL) && (cnumPars2!=NULL) && (last_cells!=NULL) && (last_cells2!=NULL));
 #elif defined(SPARC_SOLARIS)
   cells = (Cell*)memalign(CACHELINE_SIZE, sizeof(struct Cell) * numCells);
   cells2 =  (Cell*)memalign(CACHELINE_SIZE, sizeof(struct Cell) * numCells);
   cnumPars =  (int*)memalign(CACHELINE_SIZE, sizeof(int) * numCells);
   cnumPars2 =  (int*)memalign(CACHELINE_SIZE, sizeof(int) * numCells);
   last_cells =  (Cell**)memalign(CACHELINE_SIZE, sizeof(struct Cell *) * numCells);
-  assert((cells!=0) && (cells2!=0) && (cnumPars!=0) && (cnumPars2!=0) && (last_cells!=0));
+  last_cells2 =  (Cell**)memalign(CACHELINE_SIZE, sizeof(struct Cell *) * numCells);
+  assert((cells!=0) && (cells2!=0) && (cnumPars!=0) && (cnumPars2!=0) && (last_cells!=0) && (last_cells2!=0));
 #else
   int rv0 = posix_memalign((void **)(&cells), CACHELINE_SIZE, sizeof(struct Cell) * numCells);
   int rv1 = posix_memalign((void **)(&cells2), CACHELINE_SIZE, sizeof(struct Cell) * numCells);
   int rv2 = posix_memalign((void **)(&cnumPars), CACHELINE_SIZE, sizeof(int) * numCells);
   int rv3 = posix_memalign((void **)(&cnumPars2), CACHELINE_SIZE, sizeof(int) * numCells);
   int rv4 = posix_memalign((void **)(&last_cells), CACHELINE_SIZE, sizeof(struct Cell *) * numCells);
-  assert((rv0==0) && (rv1==0) && (rv2==0) && (rv3==0) && (rv4==0));
+  int rv5 = posix_memalign((void **)(&last_cells2), CACHELINE_SIZE, sizeof(struct Cell *) * numCells);
+  assert((rv0==0) && (rv1==0) && (rv2==0) && (rv3==0) && (rv4==0) && (rv5==0));
 #endif
 
   // because cells and cells2 are not allocated via new
@@ -368,32 +793,19 @@ void InitSim(char const *fileName, unsigned int threadnum)
   }
 
   memset(cnumPars, 0, numCells*sizeof(int));
+  //cells2 is the destination of the first frame, the fused frame expects it cleared
+  memset(cnumPars2, 0, numCells*sizeof(int));
+  for(int i=0; i<numCells; ++i)
+    last_cells2[i] = &cells2[i];
 
   //Always use single precision float variables b/c file format uses single precision float
   int pool_id = 0;
-  float px, py, pz, hvx, hvy, hvz, vx, vy, vz;
   for(int i = 0; i < numParticles; ++i)
   {
-    file.read((char *)&px, FILE_SIZE_FLOAT);
-    file.read((char *)&py, FILE_SIZE_FLOAT);
-    file.read((char *)&pz, FILE_SIZE_FLOAT);
-    file.read((char *)&hvx, FILE_SIZE_FLOAT);
-    file.read((char *)&hvy, FILE_SIZE_FLOAT);
-    file.read((char *)&hvz, FILE_SIZE_FLOAT);
-    file.read((char *)&vx, FILE_SIZE_FLOAT);
-    file.read((char *)&vy, FILE_SIZE_FLOAT);
-    file.read((char *)&vz, FILE_SIZE_FLOAT);
-    if(!isLittleEndian()) {
-      px  = bswap_float(px);
-      py  = bswap_float(py);
-      pz  = bswap_float(pz);
-      hvx = bswap_float(hvx);
-      hvy = bswap_float(hvy);
-      hvz = bswap_float(hvz);
-      vx  = bswap_float(vx);
-      vy  = bswap_float(vy);
-      vz  = bswap_float(vz);
-    }
+    float *par = &particles[i*PARTICLE_FLOATS];
+    float px = par[0], py = par[1], pz = par[2];
+    float hvx = par[3], hvy = par[4], hvz = par[5];
+    float vx = par[6], vy = par[7], vz = par[8];
 
     int ci = (int)((px - domainMin.x) / delta.x);
     int cj = (int)((py - domainMin.y) / delta.y);
@@ -405,6 +817,7 @@ void InitSim(char const *fileName, unsigned int threadnum)
 
     int index = (ck*ny + cj)*nx + ci;
     Cell *cell = &cells[index];
+    ++columnLoad[0][ck*nx + ci];
 
     //go to last cell structure in list
     int np = cnumPars[index];
@@ -443,6 +856,13 @@ void InitSim(char const *fileName, unsigned int threadnum)
 #endif
     ++cnumPars[index];
   }
+  delete[] particles;
+
+  snapshotCount = new int[NUM_GRIDS];
+  if(checkpointFile)
+    CheckpointInit(checkpointFile, numParticles);
+
+  RebalanceGrids();
 
   map<int, int> histArray;
   std::cout << "Number of particles: " << numParticles << std::endl;
@@ -467,75 +887,12 @@ void SaveFile(char const *fileName)
 {
   std::cout << "Saving file \"" << fileName << "\"..." << std::endl;
 
-  std::ofstream file(fileName, std::ios::binary);
-  assert(file);
-
-  //Always use single precision float variables b/c file format uses single precision
-  if(!isLittleEndian()) {
-    float restParticlesPerMeter_le;
-    int   numParticles_le;
-
-    restParticlesPerMeter_le = bswap_float((float)restParticlesPerMeter);
-    numParticles_le      = bswap_int32(numParticles);
-    file.write((char *)&restParticlesPerMeter_le, FILE_SIZE_FLOAT);
-    file.write((char *)&numParticles_le,      FILE_SIZE_INT);
-  } else {
-    file.write((char *)&restParticlesPerMeter, FILE_SIZE_FLOAT);
-    file.write((char *)&numParticles,      FILE_SIZE_INT);
-  }
-
-  int count = 0;
-  for(int i = 0; i < numCells; ++i)
-  {
-    Cell *cell = &cells[i];
-    int np = cnumPars[i];
-    for(int j = 0; j < np; ++j)
-    {
-      //Always use single precision float variables b/c file format uses single precision
-      float px, py, pz, hvx, hvy, hvz, vx,vy, vz;
-      if(!isLittleEndian()) {
-	px  = bswap_float((float)(cell->p_coord[(j % PARTICLES_PER_CELL)*3]));
-        py  = bswap_float((float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1]));
-	pz  = bswap_float((float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2]));
-
-        vx  = bswap_float((float)(cell->v_coord[(j % PARTICLES_PER_CELL)*3]));
-        vy  = bswap_float((float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1]));
-	vz  = bswap_float((float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2]));
-
-        hvx = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].x));
-        hvy = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].y));
-        hvz = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].z));
-      } else {
-        px  = (float)(cell->p_coord[(j % PARTICLES_PER_CELL)*3]);
-	py  = (float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1]);
-	pz  = (float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2]);
-
-	vx  = (float)(cell->v_coord[(j % PARTICLES_PER_CELL)*3]);
-	vy  = (float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1]);
-	vz  = (float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2]);
-
-        hvx = (float)(cell->hv[j % PARTICLES_PER_CELL].x);
-        hvy = (float)(cell->hv[j % PARTICLES_PER_CELL].y);
-        hvz = (float)(cell->hv[j % PARTICLES_PER_CELL].z);
-      }
-      file.write((char *)&px,  FILE_SIZE_FLOAT);
-      file.write((char *)&py,  FILE_SIZE_FLOAT);
-      file.write((char *)&pz,  FILE_SIZE_FLOAT);
-      file.write((char *)&hvx, FILE_SIZE_FLOAT);
-      file.write((char *)&hvy, FILE_SIZE_FLOAT);
-      file.write((char *)&hvz, FILE_SIZE_FLOAT);
-      file.write((char *)&vx,  FILE_SIZE_FLOAT);
-      file.write((char *)&vy,  FILE_SIZE_FLOAT);
-      file.write((char *)&vz,  FILE_SIZE_FLOAT);
-      ++count;
-
-      //move pointer to next cell in list if end of array is reached
-      if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell = cell->next;
-      }
+  //Pack all particles first and write them with a single call
+  float *buf = new float[(long)numParticles * PARTICLE_FLOATS];
+  int count = PackParticles(cells, cnumPars, 0, numCells, buf);
+  WriteFluidFile(fileName, restParticlesPerMeter, count, buf);
+  delete[] buf;
 
-    }
-  }
   std::cout << "Saving " << count << " should be: " << numParticles << std::endl;
 //  assert(count == numParticles); // JMCG I'm not sure why this is failing, even for the scalar code on ICC, we are not touching those variables, we are missing a particle.
 }
@@ -565,20 +922,30 @@ void CleanUpSim()
   pthread_attr_destroy(&attr);
 
   for(int i = 0; i < numCells; ++i)
-  {
-    assert(CELL_MUTEX_ID < MUTEXES_PER_CELL);
-    int n = (border[i] ? MUTEXES_PER_CELL : CELL_MUTEX_ID+1);
-    for(int j = 0; j < n; ++j)
-      pthread_mutex_destroy(&mutex[i][j]);
-    delete[] mutex[i];
-  }
+    pthread_mutex_destroy(&mutex[i]);
   delete[] mutex;
+  CleanUpHalos();
   pthread_barrier_destroy(&barrier);
 #ifdef ENABLE_VISUALIZATION
   pthread_barrier_destroy(&visualization_barrier);
 #endif
 
   delete[] border;
+  delete[] owner;
+  for(int i = 0; i < NUM_GRIDS; ++i)
+    delete[] columnLoad[i];
+  delete[] columnLoad;
+  delete[] ZDIVS;
+  for(int i = 0; i < NUM_GRIDS; ++i)
+  {
+    pthread_mutex_destroy(&progress[i].mutex);
+    pthread_cond_destroy(&progress[i].cond);
+    delete[] progress[i].neighbors;
+  }
+  delete[] progress;
+  delete[] snapshotCount;
+  if(checkpointFile)
+    CheckpointCleanUp();
 
 #if defined(WIN32)
   _aligned_free(cells);
@@ -586,12 +953,14 @@ void CleanUpSim()
   _aligned_free(cnumPars);
   _aligned_free(cnumPars2);
   _aligned_free(last_cells);
+  _aligned_free(last_cells2);
 #else
   free(cells);
   free(cells2);
   free(cnumPars);
   free(cnumPars2);
   free(last_cells);
+  free(last_cells2);
 #endif
   delete[] thread;
   delete[] grids;
@@ -623,6 +992,10 @@ void RebuildGridMT(int tid)
   // swap src and dest arrays with counts of particles
   //  std::swap(cnumPars, cnumPars2);
 
+  //count particles per column of cells for load balancing
+  int *load = columnLoad[tid];
+  memset(load, 0, nx*nz*sizeof(int));
+
   //iterate through source cell lists
   for(int iz = grids[tid].sz; iz < grids[tid].ez; ++iz)
     for(int iy = grids[tid].sy; iy < grids[tid].ey; ++iy)
@@ -678,9 +1051,10 @@ void RebuildGridMT(int tid)
 #endif //ENABLE_CFL_CHECK
 
           int index = (ck*ny + cj)*nx + ci;
+          ++load[ck*nx + ci];
           // this assumes that particles cannot travel more than one grid cell per time step
           if(border[index])
-            pthread_mutex_lock(&mutex[index][CELL_MUTEX_ID]);
+            pthread_mutex_lock(&mutex[index]);
           Cell *cell = last_cells[index];
           int np = cnumPars[index];
 
@@ -692,7 +1066,7 @@ void RebuildGridMT(int tid)
           }
           ++cnumPars[index];
           if(border[index])
-            pthread_mutex_unlock(&mutex[index][CELL_MUTEX_ID]);
+            pthread_mutex_unlock(&mutex[index]);
 
           //copy source to destination particle
 	  cell->p_coord[(np % PARTICLES_PER_CELL)*3] = cell2->p_coord[(j % PARTICLES_PER_CELL)*3]; // x
@@ -704,6 +1078,11 @@ void RebuildGridMT(int tid)
 	  cell->v_coord[((np % PARTICLES_PER_CELL)*3)+2] = cell2->v_coord[((j % PARTICLES_PER_CELL)*3)+2]; // z
 
           cell->hv[np % PARTICLES_PER_CELL] = cell2->hv[j % PARTICLES_PER_CELL];
+#ifdef ENABLE_FUSED_FRAME
+          //fused InitDensitiesAndForcesMT
+          cell->density[np % PARTICLES_PER_CELL] = 0.0;
+          cell->a[np % PARTICLES_PER_CELL] = externalAcceleration;
+#endif
 
           //move pointer to next source cell in list if end of array is reached
           if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
@@ -720,6 +1099,13 @@ void RebuildGridMT(int tid)
         if((cell2 != NULL) && (cell2 != &cells2[index2])) {
           cellpool_returncell(&pools[tid], cell2);
 	}
+#ifdef ENABLE_FUSED_FRAME
+        //the source cell is the destination of the next frame, clear it now
+        //instead of in a separate ClearParticlesMT pass
+        cnumPars2[index2] = 0;
+        cells2[index2].next = NULL;
+        last_cells2[index2] = &cells2[index2];
+#endif
       }
 
 }
@@ -805,98 +1191,44 @@ void ComputeDensitiesMT(int tid)
 	    Cell *neigh2 = &cells[indexNeigh];
 #endif
             int numNeighPars = cnumPars[indexNeigh];
+            fptype *halo = HaloSlot(tid, indexNeigh);
 
 #ifdef SIMD_WIDTH  // JMCG Vectorization: SIMD Version
 	    fptype tc = 0;
 	    int leftovers = 0;
 
 	    if(numNeighPars >= SIMD_WIDTH) {
-	      tc = ComputeDensitiesMTSIMD(&leftovers,indexNeigh,numNeighPars,np,index, cell,&neigh);
-	    }
-
-	    tc += ComputeDensitiesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh);
-
-#ifdef DEBUG_SIMD
-            fptype tc2 = ComputeDensitiesMTOriginal_test(0,indexNeigh,numNeighPars,np,index,cell,neigh2);
-	    if (tc2 != tc) {
-	      if ((tc2 - tc) > max_diff) {
-		max_diff = (tc2 - tc);
-		cout << "Max Diff Densities " << max_diff <<endl;
-		cout << "Vect_TC " << tc << endl;
-		cout << "Original_TC " << tc2 << endl;
-	      }
+	      tc = ComputeDensitiesMTSIMD(&leftovers,indexNeigh,numNeighPars,np,index, cell,&neigh,halo);
 	    }
-#endif
-
-#else
-	    // JMCG Vectorization: Original Code does not work when changing the order of the loops, calling modified code
-	    int leftovers = 0;
-	    fptype tc = ComputeDensitiesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh);
-
-#endif // END JMCG Vectorization
-
-	}
-          //move pointer to next cell in list if end of array is reached
-      }
-}
-
-/* JMCG BEGIN */
-
-inline fptype ComputeDensitiesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh ) {
-  fptype total_tc = 0.0;
-  for(int iparNeigh = iparNeigh_in; iparNeigh < numNeighPars; ++iparNeigh) {
-    Cell *cell_ipar = cell;
-    fptype tc_ipar = 0;
-    for(int ipar = 0; ipar < np; ++ipar) {
-      //Check address to make sure densities are computed only once per pair
-      //    if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) { // JMCG We no longer have p[], not sure if this works
-      fptype tc = 0.0;
-      if(&neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3] < &cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3]) {
-        //      fptype distSq = (cell->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL]).GetLengthSq(); // JMCG We no longer have p[]
-        fptype dist_x = cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3] - neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3];
-        fptype dist_y = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+1] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1];
-        fptype dist_z = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+2] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2];
-
-        fptype distSq = (dist_x * dist_x) + (dist_y * dist_y) + (dist_z * dist_z);
-
-        if(distSq < hSq) {
-          fptype t = hSq - distSq;
-          tc = t*t*t;
-          tc_ipar += tc;
+
+	    tc += ComputeDensitiesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh,halo);
+
 #ifdef DEBUG_SIMD
-	  total_tc += tc;
+            fptype tc2 = ComputeDensitiesMTOriginal_test(0,indexNeigh,numNeighPars,np,index,cell,neigh2);
+	    if (tc2 != tc) {
+	      if ((tc2 - tc) > max_diff) {
+		max_diff = (tc2 - tc);
+		cout << "Max Diff Densities " << max_diff <<endl;
+		cout << "Vect_TC " << tc << endl;
+		cout << "Original_TC " << tc2 << endl;
+	      }
+	    }
 #endif
-          if(border[index]) {
-            pthread_mutex_lock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-            cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
-            pthread_mutex_unlock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-          }
-          else
-            cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
-        }
-      }
 
-      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell_ipar = cell_ipar->next;
-      }
-    } // ipar
+#else
+	    // JMCG Vectorization: Original Code does not work when changing the order of the loops, calling modified code
+	    int leftovers = 0;
+	    fptype tc = ComputeDensitiesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh,halo);
 
-    if(border[indexNeigh]) {
-      pthread_mutex_lock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-      neigh->density[iparNeigh % PARTICLES_PER_CELL] += tc_ipar;
-      pthread_mutex_unlock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-    }
-    else
-      neigh->density[iparNeigh % PARTICLES_PER_CELL] += tc_ipar;
+#endif // END JMCG Vectorization
 
-    //move pointer to next cell in list if end of array is reached
-    if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-      neigh = neigh->next;
-    }
-  }
-  return total_tc;
+	}
+          //move pointer to next cell in list if end of array is reached
+      }
 }
 
+/* JMCG BEGIN */
+
 // Compute densities one by one starting at iparNeigh_in. Used for debugging, does not store any density
 inline fptype ComputeDensitiesMTOriginal_test(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh ) {
 
@@ -939,192 +1271,8 @@ inline fptype ComputeDensitiesMTOriginal_test(int iparNeigh_in, int indexNeigh,
 
 
 
-/* JMCG Vectorization. SIMD implementation with number of particles greater than SIMD_WIDTH but not neccesary to be divisible by SIMD_WIDTH */
-inline fptype ComputeDensitiesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh ) {
-
-  fptype total_tc = 0.0;
-#ifdef SIMD_WIDTH
-  int iparNeigh;
-
-  //  _MM_ALIGN fptype total_tc[SIMD_WIDTH];
-  _MM_TYPE _mask, _flag, temp_tc, _tc;
-
-  iparNeigh = *iparNeigh_in;
-
-  while((iparNeigh + SIMD_WIDTH) <= numNeighPars) {
-    Cell *cell_ipar = cell;
-    fptype tc_ipar = 0;
-    temp_tc = _MM_SET(0);
-    _tc = _MM_SET(0);
-
-    _MM_TYPE data_x, data_y, data_z;
-    _MM_LOAD3(&data_x,&data_y,&data_z,&((*neigh)->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
-
-    for(int ipar = 0; ipar < np; ++ipar) {
-      //  for(iparNeigh = *iparNeigh_in; iparNeigh < numNeighPars; iparNeigh += SIMD_WIDTH) {
-
-      //Check address to make sure densities are computed only once per pair || JMCG NEED ANOTHER MASK HERE (Inverted as SSE does)
-      // if(&(*neigh)->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) {
-
-#define LITERAL_FORMULA_DENSITY(A) ((&((*neigh)->p_coord[((A) % PARTICLES_PER_CELL)*3]) < &(cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3])) ? 1 : 0)
-      _mask = _MM_SETR_FORMULA_1PARAM(LITERAL_FORMULA_DENSITY,iparNeigh);
-
-      // This looks weird but our ARM evaluation system seems to be running in
-      // Runfast mode. In this mode Subnormal numbers are being flushed to zero (that is, the 0x0...1 stored in otype)
-      // Casting everything to integer and using integer comparations seems to work
-      // minimum positive subnormal number 00000001 1.40129846e-45
-//      _mask = _MM_CAST_I_TO_FP(_MM_CMPEQ_SIG(_MM_CAST_FP_TO_I(_mask), _MM_SET_I(1))); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
-      _mask = (_MM_TYPE)_MM_CMPEQ_SIG((_MM_TYPE_I)_mask, (_MM_TYPE_I)_MM_SET(1)); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
-
-	// ORIGINAL CODE
-	//      fptype distSq = (cell->p[ipar % PARTICLES_PER_CELL] - (*neigh)->p[iparNeigh % PARTICLES_PER_CELL]).GetLengthSq();
-	// if(distSq < hSq) { // JMCG We skip the if in the vectorization, just ignore negative values
-
-        _MM_TYPE dist_x = _MM_SUB(_MM_SET(cell_ipar->p_coord[(ipar% PARTICLES_PER_CELL)*3]),data_x);
-	_MM_TYPE dist_y = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+1]),data_y);
-	_MM_TYPE dist_z = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+2]),data_z);
-
-	dist_x = _MM_MUL(dist_x,dist_x);
-	dist_y = _MM_MUL(dist_y,dist_y);
-	dist_z = _MM_MUL(dist_z,dist_z);
-
-	_MM_TYPE distSq = _MM_ADD(_MM_ADD(dist_x,dist_y),dist_z);
-
-
-	//	fptype t = hSq - distSq;
-	_MM_TYPE _t = _MM_SUB(_MM_SET(hSq),distSq);
-
-	// JMCG We only keep positive values (if(distSq < hSq))
-	_flag = (_MM_TYPE)_MM_CMPLT(_t, _MM_SET(0));
-	_tc = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, _t));
-
-	// Mask filter address to make sure densities are computed only once per pair
-	_tc = _MM_OR(_MM_AND(_mask, _tc), _MM_ANDNOT(_mask, _MM_SET(0)));
-
-	//	fptype tc = t*t*t;
-	_tc = _MM_MUL(_MM_MUL(_tc,_tc),_tc);
-
-	temp_tc = _MM_ADD(temp_tc,_tc);
-
-	fptype tc = _MM_REDUCE_ADD(_tc);
-
-#ifdef DEBUG_SIMD
-	total_tc += tc;
-#endif
-
-	if(border[index]) {
-	  pthread_mutex_lock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-	  //cell->density[ipar % PARTICLES_PER_CELL] += tc;
-	  cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
-	  pthread_mutex_unlock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-	}
-	else {
-	  //cell->density[ipar % PARTICLES_PER_CELL] += tc;
-	  cell_ipar->density[ipar % PARTICLES_PER_CELL] += tc;
-	}
-
-
-	/*else {
-	  iparNeigh = numNeighPars; // JMCG Adding this we can Stop iteration on internal loop. Slightly faster than original code, but I'm not completely sure that is the same.
-	  } */
-
-      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell_ipar = cell_ipar->next;
-      }
-
-    } // ipar
-
-    // JMCG Store densities
-    if(border[indexNeigh]) {
-      pthread_mutex_lock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-      _MM_STORE(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL]),_MM_ADD(_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL])),temp_tc));
-      pthread_mutex_unlock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-    }
-    else
-      _MM_STORE(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL]),_MM_ADD(_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL])),temp_tc));
-
-    iparNeigh += SIMD_WIDTH;
-    //move pointer to next cell in list if end of array is reached
-    if(iparNeigh % PARTICLES_PER_CELL == 0) {
-      *neigh = (*neigh)->next;
-    }
-
-  }
-
-  *iparNeigh_in = iparNeigh;
-#endif
-  return total_tc;
-}
-
-
-// Compute Forces one by one starting at iparNeigh_in
-inline Vec3 ComputeForcesMTOriginal(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh ) {
-
-  Vec3 return_vec(0.0,0.0,0.0);
-
-  for(int iparNeigh = iparNeigh_in; iparNeigh < numNeighPars; ++iparNeigh) {
-    Cell *cell_ipar = cell;
-    Vec3 acc_ipar(0.0,0.0,0.0);
-    for(int ipar = 0; ipar < np; ++ipar) {
-      //Check address to make sure forces are computed only once per pair
-      //    if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL]) {
-      if(&neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3] < &cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3]) {
-	// Vec3 disp = cell_ipar->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL]; // old code
-	Vec3 disp;
-	disp.x = cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3] - neigh->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3];
-	disp.y = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+1] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1];
-	disp.z = cell_ipar->p_coord[((ipar % PARTICLES_PER_CELL)*3)+2] - neigh->p_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2];
-	fptype distSq = disp.GetLengthSq();
-
-	if(distSq < hSq) {
-#ifndef ENABLE_DOUBLE_PRECISION
-	  fptype dist = sqrtf(std::max(distSq, (fptype)1e-12));
-#else
-	  fptype dist = sqrt(std::max(distSq, 1e-12));
-#endif //ENABLE_DOUBLE_PRECISION
-	  fptype hmr = h - dist;
-	  Vec3 acc = disp * pressureCoeff * (hmr*hmr/dist) * (cell_ipar->density[ipar % PARTICLES_PER_CELL]+neigh->density[iparNeigh % PARTICLES_PER_CELL] - doubleRestDensity);
-	  //	acc += (neigh->v[iparNeigh % PARTICLES_PER_CELL] - cell->v[ipar % PARTICLES_PER_CELL]) * viscosityCoeff * hmr;
-	  acc.x += (neigh->v_coord[(iparNeigh % PARTICLES_PER_CELL)*3] - cell_ipar->v_coord[(ipar % PARTICLES_PER_CELL)*3]) * viscosityCoeff * hmr;
-	  acc.y += (neigh->v_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+1] - cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+1]) * viscosityCoeff * hmr;
-	  acc.z += (neigh->v_coord[((iparNeigh % PARTICLES_PER_CELL)*3)+2] - cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+2]) * viscosityCoeff * hmr;
-
-	  acc /= cell_ipar->density[ipar % PARTICLES_PER_CELL] * neigh->density[iparNeigh % PARTICLES_PER_CELL];
-
-#ifdef DEBUG_SIMD
-	  return_vec += acc;
-#endif
-	  acc_ipar +=acc;
-
-	  if( border[index]) {
-	    pthread_mutex_lock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL] += acc;
-	    pthread_mutex_unlock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-	  }
-	  else
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL] += acc;
 
-	}
-      }
-      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell_ipar = cell_ipar->next;
-      }
-    }
 
-    if( border[indexNeigh]) {
-      pthread_mutex_lock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-      neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc_ipar;
-      pthread_mutex_unlock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-    } else {
-      neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc_ipar;
-    }
-    //move pointer to next cell in list if end of array is reached
-    if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-      neigh = neigh->next;
-    }
-  }
-  return return_vec;
-}
 
 // Compute Forces one by one starting at iparNeigh_in. Used for debugging, does not store any value in a[].
 inline Vec3 ComputeForcesMTOriginal_test(int iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell *neigh ) {
@@ -1179,180 +1327,6 @@ inline Vec3 ComputeForcesMTOriginal_test(int iparNeigh_in, int indexNeigh, int n
   return return_vec;
 }
 
-
-// Compute Forces in groups of SIMD_WIDTH starting at iparNeigh_in. Stores last possition multiple of SIMD_WIDTH in iparNeigh_in and modifies neigh pointer to the latest neigh analized
-inline Vec3 ComputeForcesMTSIMD(int *iparNeigh_in, int indexNeigh, int numNeighPars, int np, int index, Cell *cell, Cell **neigh ) {
-
-  Vec3 return_vec(0.0,0.0,0.0);
-
-#ifdef SIMD_WIDTH
-
-  _MM_ALIGN fptype new_a_x[SIMD_WIDTH];
-  _MM_ALIGN fptype new_a_y[SIMD_WIDTH];
-  _MM_ALIGN fptype new_a_z[SIMD_WIDTH];
-
-  _MM_TYPE _mask, _flag;
-  int iparNeigh;
-
-  iparNeigh = *iparNeigh_in;
-
-  while((iparNeigh + SIMD_WIDTH) <= numNeighPars) {
-    //Check address to make sure forces are computed only once per pair
-    //if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL])  // JMCG Vectorization. Mask for this one
-
-    Cell *cell_ipar = cell;
-
-    _MM_TYPE acc_x_ipar = _MM_SET(0);
-    _MM_TYPE acc_y_ipar = _MM_SET(0);
-    _MM_TYPE acc_z_ipar = _MM_SET(0);
-
-    _MM_TYPE data_x, data_y, data_z;
-    _MM_LOAD3(&data_x,&data_y,&data_z,&((*neigh)->p_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
-
-    _MM_TYPE v_x, v_y, v_z;
-    _MM_LOAD3(&v_x,&v_y,&v_z,&((*neigh)->v_coord[(iparNeigh % PARTICLES_PER_CELL)*3]));
-
-    for(int ipar = 0; ipar < np; ++ipar) {
-
-#define LITERAL_FORMULA_FORCES(A) ((&((*neigh)->p_coord[((A) % PARTICLES_PER_CELL)*3]) < &(cell_ipar->p_coord[(ipar % PARTICLES_PER_CELL)*3])) ? 1 : 0)
-       _mask = _MM_SETR_FORMULA_1PARAM(LITERAL_FORMULA_FORCES,iparNeigh);
-
-       // This looks weird but our ARM evaluation system seems to be running in
-       // Runfast mode. In this mode Subnormal numbers are being flushed to zero (that is, the 0x0...1 stored in otype)
-       // Casting everything to integer and using integer comparations seems to work
-       // minimum positive subnormal number 00000001 1.40129846e-45
-//       _mask = _MM_CAST_I_TO_FP(_MM_CMPEQ_SIG(_MM_CAST_FP_TO_I(_mask), _MM_SET_I(1))); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
-       _mask = (_MM_TYPE)_MM_CMPEQ_SIG((_MM_TYPE_I)_mask, (_MM_TYPE_I)_MM_SET(1)); // Set 1s to all to 1s (I cant figure it out why setting 0xffffffff in the setr does not work)
-
-       _MM_TYPE dist_x = _MM_SUB(_MM_SET(cell_ipar->p_coord[(ipar% PARTICLES_PER_CELL)*3]),data_x);
-       _MM_TYPE dist_y = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+1]),data_y);
-       _MM_TYPE dist_z = _MM_SUB(_MM_SET(cell_ipar->p_coord[((ipar% PARTICLES_PER_CELL)*3)+2]),data_z);
-
-       _MM_TYPE distSq = _MM_ADD(_MM_ADD( _MM_MUL(dist_x,dist_x),
-					  _MM_MUL(dist_y,dist_y)),
-				 _MM_MUL(dist_z,dist_z));
-
-	/*
-	  if(distSq < hSq) { // JMCG We skip the if in the vectorization, just ignore negative values with mask
-	*/
-
-	// JMCG We only keep positive values
-	_MM_TYPE _t = _MM_SUB(_MM_SET(hSq),distSq);
-	_flag = (_MM_TYPE)_MM_CMPLT(_t, _MM_SET(0)); // Use flag later
-
-	// Extrack bits from flag to speed up, dont run the code if all 0
-	  /*
-	    // Original code
-	    #ifndef ENABLE_DOUBLE_PRECISION
-	    fptype dist = sqrtf(std::max(distSq, (fptype)1e-12));
-	    #else
-	    fptype dist = sqrt(std::max(distSq, 1e-12));
-	    #endif //ENABLE_DOUBLE_PRECISION
-	  */
-	  _MM_TYPE _dist = _MM_SQRT(_MM_MAX(distSq, _MM_SET(1e-12)));
-
-	  //fptype hmr = h - dist;
-	  _MM_TYPE _hmr = _MM_SUB(_MM_SET(h), _dist);
-
-	  // Vec3 acc = disp * pressureCoeff * (hmr*hmr/dist) * (cell->density[ipar % PARTICLES_PER_CELL]+neigh->density[iparNeigh % PARTICLES_PER_CELL] - doubleRestDensity); // JMCG We separate on the three coordinates
-
-	  _MM_TYPE common = _MM_MUL(_MM_MUL(_MM_SET(pressureCoeff),_MM_DIV(_MM_MUL(_hmr,_hmr),_dist)),
-				    _MM_SUB(_MM_ADD(_MM_SET(cell_ipar->density[ipar % PARTICLES_PER_CELL]),_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL]))), _MM_SET(doubleRestDensity))); // Common to all three coordinates
-
-	  _MM_TYPE acc_x = _MM_MUL(dist_x,common);
-	  _MM_TYPE acc_y = _MM_MUL(dist_y,common);
-	  _MM_TYPE acc_z = _MM_MUL(dist_z,common);
-
-	  //  acc += (neigh->v[iparNeigh % PARTICLES_PER_CELL] - cell->v[ipar % PARTICLES_PER_CELL]) * viscosityCoeff * hmr;
-	  acc_x = _MM_ADD(acc_x,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_x,_MM_SET(cell_ipar->v_coord[(ipar % PARTICLES_PER_CELL)*3])))));
-	  acc_y = _MM_ADD(acc_y,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_y,_MM_SET(cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+1])))));
-	  acc_z = _MM_ADD(acc_z,_MM_MUL(_hmr,_MM_MUL(_MM_SET(viscosityCoeff),_MM_SUB(v_z,_MM_SET(cell_ipar->v_coord[((ipar % PARTICLES_PER_CELL)*3)+2])))));
-
-	  //      acc /= cell->density[ipar % PARTICLES_PER_CELL] * neigh->density[iparNeigh % PARTICLES_PER_CELL];
-	  common = _MM_MUL(_MM_SET(cell_ipar->density[ipar % PARTICLES_PER_CELL]),_MM_LOAD(&((*neigh)->density[iparNeigh % PARTICLES_PER_CELL])));
-	  acc_x = _MM_DIV(acc_x,common);
-	  acc_y = _MM_DIV(acc_y,common);
-	  acc_z = _MM_DIV(acc_z,common);
-
-	  // Mask filter address to make sure densities are computed only once per pair
-	  acc_x = _MM_OR(_MM_AND(_mask, acc_x), _MM_ANDNOT(_mask, _MM_SET(0)));
-	  acc_y = _MM_OR(_MM_AND(_mask, acc_y), _MM_ANDNOT(_mask, _MM_SET(0)));
-	  acc_z = _MM_OR(_MM_AND(_mask, acc_z), _MM_ANDNOT(_mask, _MM_SET(0)));
-
-	  // Mask filter results for distSq < hSq
-	  acc_x = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_x));
-	  acc_y = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_y));
-	  acc_z = _MM_OR(_MM_AND(_flag, _MM_SET(0)), _MM_ANDNOT(_flag, acc_z));
-
-	  // Store values for iparneigh
-	  acc_x_ipar = _MM_ADD(acc_x_ipar,acc_x);
-	  acc_y_ipar = _MM_ADD(acc_y_ipar,acc_y);
-	  acc_z_ipar = _MM_ADD(acc_z_ipar,acc_z);
-
-	  // Combine all values
-	  fptype combined_x = _MM_REDUCE_ADD(acc_x);
-	  fptype combined_y = _MM_REDUCE_ADD(acc_y);
-	  fptype combined_z = _MM_REDUCE_ADD(acc_z);
-
-#ifdef DEBUG_SIMD
-	  return_vec.x += combined_x;
-	  return_vec.y += combined_y;
-	  return_vec.z += combined_z;
-#endif
-	  if( border[index]) {
-            pthread_mutex_lock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-            cell_ipar->a[ipar % PARTICLES_PER_CELL].x += combined_x;
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL].y += combined_y;
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL].z += combined_z;
-            pthread_mutex_unlock(&mutex[index][ipar % MUTEXES_PER_CELL]);
-          }
-          else {
-            cell_ipar->a[ipar % PARTICLES_PER_CELL].x += combined_x;
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL].y += combined_y;
-	    cell_ipar->a[ipar % PARTICLES_PER_CELL].z += combined_z;
-	  }
-      if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell_ipar = cell_ipar->next;
-      }
-    } // ipar
-
-    // Store a values to update later
-    _MM_STORE(&(new_a_x[0]),acc_x_ipar);
-    _MM_STORE(&(new_a_y[0]),acc_y_ipar);
-    _MM_STORE(&(new_a_z[0]),acc_z_ipar);
-
-    if( border[indexNeigh]) {
-      pthread_mutex_lock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-      //	neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc;
-#pragma unroll(SIMD_WIDTH)
-      for (int i = 0; i < SIMD_WIDTH; i++) {
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].x -= new_a_x[i];
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].y -= new_a_y[i];
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].z -= new_a_z[i];
-      }
-      pthread_mutex_unlock(&mutex[indexNeigh][iparNeigh % MUTEXES_PER_CELL]);
-    } else {
-      //	neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc;
-#pragma unroll(SIMD_WIDTH)
-      for (int i = 0; i < SIMD_WIDTH; i++) {
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].x -= new_a_x[i];
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].y -= new_a_y[i];
-	(*neigh)->a[(iparNeigh+i) % PARTICLES_PER_CELL].z -= new_a_z[i];
-      }
-    }
-
-    iparNeigh += SIMD_WIDTH;
-    //move pointer to next cell in list if end of array is reached
-    if(iparNeigh % PARTICLES_PER_CELL == 0) {
-      *neigh = (*neigh)->next;
-    }
-  }
-  *iparNeigh_in = iparNeigh;
-
-#endif // SIMD_WIDTH
-  return return_vec;
-}
-
 /* JMCG END */
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1384,6 +1358,7 @@ void ComputeDensities2MT(int tid)
 void ComputeForcesMT(int tid)
 {
   int neighCells[3*3*3];
+  int haloStride = halos[tid].capacity;
 
   for(int iz = grids[tid].sz; iz < grids[tid].ez; ++iz)
     for(int iy = grids[tid].sy; iy < grids[tid].ey; ++iy)
@@ -1407,6 +1382,7 @@ void ComputeForcesMT(int tid)
 	    Cell *neigh2 = &cells[indexNeigh];
 #endif
             int numNeighPars = cnumPars[indexNeigh];
+            fptype *halo = HaloSlot(tid, indexNeigh);
 
 #ifdef SIMD_WIDTH  // JMCG Vectorization: SIMD Version
 
@@ -1420,7 +1396,7 @@ void ComputeForcesMT(int tid)
 #ifdef SIMD_STATS
 	      total_compute_forces_calls_sse++;
 #endif
-	      acc += ComputeForcesMTSIMD(&leftovers,indexNeigh,numNeighPars,np,index,cell,&neigh);
+	      acc += ComputeForcesMTSIMD(&leftovers,indexNeigh,numNeighPars,np,index,cell,&neigh,halo,haloStride);
 	    }
 
 #ifdef SIMD_STATS
@@ -1431,7 +1407,7 @@ void ComputeForcesMT(int tid)
 		  total_compute_forces_calls_leftovers++;
 	      }
 #endif
-	      acc += ComputeForcesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh);
+	      acc += ComputeForcesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh,halo,haloStride);
 #ifdef DEBUG_SIMD
 	    Vec3 acc2 = ComputeForcesMTOriginal_test(0,indexNeigh, numNeighPars, np, index, cell, neigh2);
 	    if ((acc.x != acc2.x) || (acc.y != acc2.y) || (acc.z != acc2.z)) {
@@ -1448,7 +1424,7 @@ void ComputeForcesMT(int tid)
 	    // JMCG Vectorization: Original Code does not work when changing the order of the loops, calling modified code
 	    Vec3 acc;
             int leftovers = 0;
-	    acc = ComputeForcesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh);
+	    acc = ComputeForcesMTOriginal(leftovers,indexNeigh,numNeighPars,np,index,cell,neigh,halo,haloStride);
 #endif // SIMD_WIDTH Vectorization
           }
           //move pointer to next cell in list if end of array is reached
@@ -1519,58 +1495,8 @@ void ProcessCollisionsMT(int tid)
 	{
       for(int ix = grids[tid].sx; ix < grids[tid].ex; ++ix)
       {
-	    if(!((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))==(iz==(nz-1))))
-			continue;	// not on domain wall
         int index = (iz*ny + iy)*nx + ix;
-        Cell *cell = &cells[index];
-        int np = cnumPars[index];
-        for(int j = 0; j < np; ++j)
-        {
-	  int ji = j % PARTICLES_PER_CELL;
-	  Vec3 pos;
-	  pos.x = cell->p_coord[ji*3] + cell->hv[ji].x * timeStep;
-	  pos.y = cell->p_coord[(ji*3)+1] + cell->hv[ji].y * timeStep;
-	  pos.z = cell->p_coord[(ji*3)+2] + cell->hv[ji].z * timeStep;
-	  if(ix==0) {
-            fptype diff = parSize - (pos.x - domainMin.x);
-	    if(diff > epsilon)
-              cell->a[ji].x += stiffnessCollisions*diff - damping*cell->v_coord[ji*3];
-	  }
-	  if(ix==(nx-1))
-	    {
-	      fptype diff = parSize - (domainMax.x - pos.x);
-	      if(diff > epsilon)
-		cell->a[ji].x -= stiffnessCollisions*diff + damping*cell->v_coord[ji*3];
-	    }
-	  if(iy==0)
-	    {
-	      fptype diff = parSize - (pos.y - domainMin.y);
-	      if(diff > epsilon)
-		cell->a[ji].y += stiffnessCollisions*diff - damping*cell->v_coord[(ji*3)+1];
-	    }
-	  if(iy==(ny-1))
-	    {
-	      fptype diff = parSize - (domainMax.y - pos.y);
-	      if(diff > epsilon)
-		cell->a[ji].y -= stiffnessCollisions*diff + damping*cell->v_coord[(ji*3)+1];
-	    }
-	  if(iz==0)
-	    {
-	      fptype diff = parSize - (pos.z - domainMin.z);
-	      if(diff > epsilon)
-		cell->a[ji].z += stiffnessCollisions*diff - damping*cell->v_coord[(ji*3)+2];
-	    }
-	  if(iz==(nz-1))
-	    {
-	      fptype diff = parSize - (domainMax.z - pos.z);
-	      if(diff > epsilon)
-		cell->a[ji].z -= stiffnessCollisions*diff + damping*cell->v_coord[(ji*3)+2];
-	    }
-          //move pointer to next cell in list if end of array is reached
-          if(ji == PARTICLES_PER_CELL-1) {
-            cell = cell->next;
-          }
-        }
+        ProcessCollisionsCell(&cells[index], cnumPars[index], ix, iy, iz);
       }
 	}
   }
@@ -1587,93 +1513,8 @@ void ProcessCollisions2MT(int tid)
 	{
       for(int ix = grids[tid].sx; ix < grids[tid].ex; ++ix)
       {
-#if 0
-// Chris, the following test should be valid
-// *** provided that a particle does not migrate more than 1 cell
-// *** per integration step. This does not appear to be the case
-// *** in the pthreads version. Serial version it seems to be OK
-	    if(!((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))==(iz==(nz-1))))
-			continue;	// not on domain wall
-#endif
         int index = (iz*ny + iy)*nx + ix;
-        Cell *cell = &cells[index];
-        int np = cnumPars[index];
-        for(int j = 0; j < np; ++j)
-        {
-		  int ji = j % PARTICLES_PER_CELL;
-
-		  Vec3 pos;
-		  pos.x = cell->p_coord[ji*3];
-		  pos.y = cell->p_coord[(ji*3)+1];
-		  pos.z = cell->p_coord[(ji*3)+2];
-
-		  if(ix==0)
-		    {
-		      fptype diff = pos.x - domainMin.x;
-		      if(diff < Zero)
-			{
-			  cell->p_coord[ji*3] = domainMin.x - diff;
-			  cell->v_coord[ji*3] = -cell->v_coord[ji*3];
-			  cell->hv[ji].x = -cell->hv[ji].x;
-			}
-		    }
-		  if(ix==(nx-1))
-		    {
-            fptype diff = domainMax.x - pos.x;
-	              if(diff < Zero)
-	                    {
-			      cell->p_coord[ji*3] = domainMax.x + diff;
-			      cell->v_coord[ji*3] = -cell->v_coord[ji*3];
-
-			      cell->hv[ji].x = -cell->hv[ji].x;
-			    }
-		  }
-		  if(iy==0)
-		  {
-            fptype diff = pos.y - domainMin.y;
-		    if(diff < Zero)
-			{
-			  cell->p_coord[(ji*3)+1] = domainMin.y - diff;
-			  cell->v_coord[(ji*3)+1] = -cell->v_coord[(ji*3)+1];
-			  cell->hv[ji].y = -cell->hv[ji].y;
-			}
-		  }
-		  if(iy==(ny-1))
-		  {
-            fptype diff = domainMax.y - pos.y;
- 			if(diff < Zero)
-			{
-			  cell->p_coord[(ji*3)+1] = domainMax.y + diff;
-			  cell->v_coord[(ji*3)+1] = -cell->v_coord[(ji*3)+1];
-
-			  cell->hv[ji].y = -cell->hv[ji].y;
-			}
-		  }
-		  if(iz==0)
-		  {
-            fptype diff = pos.z - domainMin.z;
-		    if(diff < Zero)
-			{
-			  cell->p_coord[(ji*3)+2] = domainMin.z - diff;
-			  cell->v_coord[(ji*3)+2] = -cell->v_coord[(ji*3)+2];
-			  cell->hv[ji].z = -cell->hv[ji].z;
-			}
-		  }
-		  if(iz==(nz-1))
-		  {
-            fptype diff = domainMax.z - pos.z;
- 			if(diff < Zero)
-			{
-			  cell->p_coord[(ji*3)+2] = domainMax.z + diff;
-			  cell->v_coord[(ji*3)+2] = -cell->v_coord[(ji*3)+2];
-			  cell->hv[ji].z = -cell->hv[ji].z;
-			}
-		  }
-          //move pointer to next cell in list if end of array is reached
-          if(ji == PARTICLES_PER_CELL-1) {
-            cell = cell->next;
-          }
-        }
+        ProcessCollisions2Cell(&cells[index], cnumPars[index], ix, iy, iz);
       }
 	}
   }
@@ -1683,6 +1524,22 @@ void ProcessCollisions2MT(int tid)
 ////////////////////////////////////////////////////////////////////////////////
 
 void AdvanceParticlesMT(int tid)
+{
+  for(int iz = grids[tid].sz; iz < grids[tid].ez; ++iz)
+    for(int iy = grids[tid].sy; iy < grids[tid].ey; ++iy)
+      for(int ix = grids[tid].sx; ix < grids[tid].ex; ++ix)
+      {
+        int index = (iz*ny + iy)*nx + ix;
+        AdvanceParticlesCell(&cells[index], cnumPars[index]);
+      }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Fused ProcessCollisionsMT, AdvanceParticlesMT and ProcessCollisions2MT. All three
+// only touch particles of the own grid, so each cell is processed completely while
+// its particles are in cache.
+void ProcessCollisionsAndAdvanceMT(int tid)
 {
   for(int iz = grids[tid].sz; iz < grids[tid].ez; ++iz)
     for(int iy = grids[tid].sy; iy < grids[tid].ey; ++iy)
@@ -1691,43 +1548,61 @@ void AdvanceParticlesMT(int tid)
         int index = (iz*ny + iy)*nx + ix;
         Cell *cell = &cells[index];
         int np = cnumPars[index];
-        for(int j = 0; j < np; ++j)
-        {
-          Vec3 v_half = cell->hv[j % PARTICLES_PER_CELL] + cell->a[j % PARTICLES_PER_CELL]*timeStep;
+        if(np == 0)
+          continue;
+        ProcessCollisionsCell(cell, np, ix, iy, iz);
+        AdvanceParticlesCell(cell, np);
 #if defined(USE_ImpeneratableWall)
-		// N.B. The integration of the position can place the particle
-		// outside the domain. Although we could place a test in this loop
-		// we would be unnecessarily testing particles on interior cells.
-		// Therefore, to reduce the amount of computations we make a later
-		// pass on the perimiter cells to account for particle migration
-		// beyond domain
+        if((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))||(iz==(nz-1)))
+          ProcessCollisions2Cell(cell, np, ix, iy, iz);
 #endif
-
-	  cell->p_coord[(j % PARTICLES_PER_CELL)*3] += v_half.x * timeStep;
-          cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1] += v_half.y * timeStep;
-          cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2] += v_half.z * timeStep;
-
-	  cell->v_coord[(j % PARTICLES_PER_CELL)*3] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].x + v_half.x);
-	  cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].y + v_half.y);
-	  cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2] = 0.5 * (cell->hv[j % PARTICLES_PER_CELL].z + v_half.z);
-          cell->hv[j % PARTICLES_PER_CELL] = v_half;
-
-          //move pointer to next cell in list if end of array is reached
-          if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-            cell = cell->next;
-          }
-        }
       }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#ifdef ENABLE_FUSED_FRAME
+void AdvanceFrameMT(int tid)
+{
+  //swap src and dest arrays with particles
+  if(tid==0) {
+    std::swap(cells, cells2);
+    std::swap(cnumPars, cnumPars2);
+    std::swap(last_cells, last_cells2);
+#ifdef ENABLE_LOAD_BALANCING
+    RebalanceGrids();
+#endif
+  }
+  pthread_barrier_wait(&barrier);
+
+  //destination cells were cleared by the previous frame, particles are
+  //initialized for the density and force computation while being copied
+  RebuildGridMT(tid);
+  SyncNeighborsMT(tid);
+  PrepareHaloMT(tid);
+  ComputeDensitiesMT(tid);
+  SyncNeighborsMT(tid);
+  PullHaloDensitiesMT(tid);
+  ComputeDensities2MT(tid);
+  SyncNeighborsMT(tid);
+  ClearHaloMT(tid, 3);
+  ComputeForcesMT(tid);
+  SyncNeighborsMT(tid);
+  PullHaloForcesMT(tid);
+  ProcessCollisionsAndAdvanceMT(tid);
+  //the next frame swaps the global cell arrays
+  pthread_barrier_wait(&barrier);
+}
+#else
 void AdvanceFrameMT(int tid)
 {
   //swap src and dest arrays with particles
   if(tid==0) {
     std::swap(cells, cells2);
     std::swap(cnumPars, cnumPars2);
+#ifdef ENABLE_LOAD_BALANCING
+    RebalanceGrids();
+#endif
   }
   pthread_barrier_wait(&barrier);
 
@@ -1736,13 +1611,17 @@ void AdvanceFrameMT(int tid)
   RebuildGridMT(tid);
   pthread_barrier_wait(&barrier);
   InitDensitiesAndForcesMT(tid);
+  PrepareHaloMT(tid);
   pthread_barrier_wait(&barrier);
   ComputeDensitiesMT(tid);
   pthread_barrier_wait(&barrier);
+  PullHaloDensitiesMT(tid);
   ComputeDensities2MT(tid);
   pthread_barrier_wait(&barrier);
+  ClearHaloMT(tid, 3);
   ComputeForcesMT(tid);
   pthread_barrier_wait(&barrier);
+  PullHaloForcesMT(tid);
   ProcessCollisionsMT(tid);
   pthread_barrier_wait(&barrier);
   AdvanceParticlesMT(tid);
@@ -1755,8 +1634,37 @@ void AdvanceFrameMT(int tid)
   pthread_barrier_wait(&barrier);
 #endif
 }
+#endif //ENABLE_FUSED_FRAME
 
 #ifndef ENABLE_VISUALIZATION
+//Copies the particles into the checkpoint buffer after frame was completed and
+//hands it over to the background writer. Every thread packs an equal range of
+//cells, in cell order so that a restart rebuilds the same cell lists.
+void CheckpointMT(int tid, int frame)
+{
+  int first = (int)((long)numCells * tid / NUM_GRIDS);
+  int last = (int)((long)numCells * (tid+1) / NUM_GRIDS);
+
+  snapshotCount[tid] = CountParticles(cnumPars, first, last);
+  //the buffer is free again once the previous checkpoint was written
+  if(tid==0)
+    CheckpointWait();
+  pthread_barrier_wait(&barrier);
+
+  int offset = 0;
+  for(int i = 0; i < tid; ++i)
+    offset += snapshotCount[i];
+  PackParticles(cells, cnumPars, first, last, CheckpointBuffer() + (long)offset*PARTICLE_FLOATS);
+  pthread_barrier_wait(&barrier);
+
+  if(tid==0) {
+    int count = 0;
+    for(int i = 0; i < NUM_GRIDS; ++i)
+      count += snapshotCount[i];
+    CheckpointSubmit(frame, restParticlesPerMeter, count);
+  }
+}
+
 void *AdvanceFramesMT(void *args)
 {
   thread_args *targs = (thread_args *)args;
@@ -1765,8 +1673,10 @@ void *AdvanceFramesMT(void *args)
   __parsec_thread_begin();
 #endif
 
-  for(int i = 0; i < targs->frames; ++i) {
+  for(int i = targs->first; i < targs->first + targs->frames; ++i) {
     AdvanceFrameMT(targs->tid);
+    if(checkpointFile && (i+1) % checkpointInterval == 0)
+      CheckpointMT(targs->tid, i+1);
   }
 
 #ifdef ENABLE_PARSEC_HOOKS
@@ -1831,9 +1741,10 @@ int main(int argc, char *argv[])
   __parsec_bench_begin(__parsec_fluidanimate);
 #endif
 
-  if(argc < 4 || argc >= 6)
+  if(argc < 4 || argc >= 8)
   {
-    std::cout << "Usage: " << argv[0] << " <threadnum> <framenum> <.fluid input file> [.fluid output file]" << std::endl;
+    std::cout << "Usage: " << argv[0] << " <threadnum> <framenum> <.fluid input file or checkpoint> [.fluid output file] [checkpoint file] [checkpoint interval]" << std::endl;
+    std::cout << "A checkpoint file name containing %d (e.g. frame%04d.ckpt) writes every checkpoint to its own file" << std::endl;
     return -1;
   }
 
@@ -1849,12 +1760,22 @@ int main(int argc, char *argv[])
     std::cerr << "<framenum> must at least be 1" << std::endl;
     return -1;
   }
+  if(argc > 5)
+    checkpointFile = argv[5];
+  if(argc > 6)
+    checkpointInterval = atoi(argv[6]);
+  if(checkpointInterval < 1) {
+    std::cerr << "[checkpoint interval] must at least be 1" << std::endl;
+    return -1;
+  }
 
 #ifdef ENABLE_CFL_CHECK
   std::cout << "WARNING: Check for Courant–Friedrichs–Lewy condition enabled. Do not use for performance measurements." << std::endl;
 #endif
 
+  //<framenum> is the total number of frames, a restarted run only computes the remaining ones
   InitSim(argv[3], threadnum);
+  int frames = std::max(framenum - startFrame, 0);
 #ifdef ENABLE_VISUALIZATION
   InitVisualizationMode(&argc, argv, &AdvanceFrameVisualization, &numCells, &cells, &cnumPars);
 #endif
@@ -1869,7 +1790,8 @@ int main(int argc, char *argv[])
 #endif
   for(int i = 0; i < threadnum; ++i) {
     targs[i].tid = i;
-    targs[i].frames = framenum;
+    targs[i].first = startFrame;
+    targs[i].frames = frames;
     pthread_create(&thread[i], &attr, AdvanceFramesMT, &targs[i]);
   }
 
@@ -11,6 +11,7 @@
 
 #include "fluid.hpp"
 #include "cellpool.hpp"
+#include "fluidkernels.hpp"
 
 #ifdef ENABLE_VISUALIZATION
 #include "fluidview.hpp"
@@ -181,22 +182,22 @@ void InitSim(char const *fileName)
     }
 
     //add particle to cell
-    cell->p[np].x = px;
-    cell->p[np].y = py;
-    cell->p[np].z = pz;
+    cell->p_coord[np*3] = px;
+    cell->p_coord[(np*3)+1] = py;
+    cell->p_coord[(np*3)+2] = pz;
     cell->hv[np].x = hvx;
     cell->hv[np].y = hvy;
     cell->hv[np].z = hvz;
-    cell->v[np].x = vx;
-    cell->v[np].y = vy;
-    cell->v[np].z = vz;
+    cell->v_coord[np*3] = vx;
+    cell->v_coord[(np*3)+1] = vy;
+    cell->v_coord[(np*3)+2] = vz;
 #ifdef ENABLE_VISUALIZATION
-	vMin.x = std::min(vMin.x, cell->v[np].x);
-	vMax.x = std::max(vMax.x, cell->v[np].x);
-	vMin.y = std::min(vMin.y, cell->v[np].y);
-	vMax.y = std::max(vMax.y, cell->v[np].y);
-	vMin.z = std::min(vMin.z, cell->v[np].z);
-	vMax.z = std::max(vMax.z, cell->v[np].z);
+	vMin.x = std::min(vMin.x, cell->v_coord[np*3]);
+	vMax.x = std::max(vMax.x, cell->v_coord[np*3]);
+	vMin.y = std::min(vMin.y, cell->v_coord[(np*3)+1]);
+	vMax.y = std::max(vMax.y, cell->v_coord[(np*3)+1]);
+	vMin.z = std::min(vMin.z, cell->v_coord[(np*3)+2]);
+	vMax.z = std::max(vMax.z, cell->v_coord[(np*3)+2]);
 #endif
     ++cnumPars[index];
   }
@@ -237,25 +238,25 @@ void SaveFile(char const *fileName)
       //Always use single precision float variables b/c file format uses single precision
       float px, py, pz, hvx, hvy, hvz, vx,vy, vz;
       if(!isLittleEndian()) {
-        px  = bswap_float((float)(cell->p[j % PARTICLES_PER_CELL].x));
-        py  = bswap_float((float)(cell->p[j % PARTICLES_PER_CELL].y));
-        pz  = bswap_float((float)(cell->p[j % PARTICLES_PER_CELL].z));
+        px  = bswap_float((float)(cell->p_coord[(j % PARTICLES_PER_CELL)*3]));
+        py  = bswap_float((float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1]));
+        pz  = bswap_float((float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2]));
         hvx = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].x));
         hvy = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].y));
         hvz = bswap_float((float)(cell->hv[j % PARTICLES_PER_CELL].z));
-        vx  = bswap_float((float)(cell->v[j % PARTICLES_PER_CELL].x));
-        vy  = bswap_float((float)(cell->v[j % PARTICLES_PER_CELL].y));
-        vz  = bswap_float((float)(cell->v[j % PARTICLES_PER_CELL].z));
+        vx  = bswap_float((float)(cell->v_coord[(j % PARTICLES_PER_CELL)*3]));
+        vy  = bswap_float((float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1]));
+        vz  = bswap_float((float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2]));
       } else {
-        px  = (float)(cell->p[j % PARTICLES_PER_CELL].x);
-        py  = (float)(cell->p[j % PARTICLES_PER_CELL].y);
-        pz  = (float)(cell->p[j % PARTICLES_PER_CELL].z);
+        px  = (float)(cell->p_coord[(j % PARTICLES_PER_CELL)*3]);
+        py  = (float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+1]);
+        pz  = (float)(cell->p_coord[((j % PARTICLES_PER_CELL)*3)+2]);
         hvx = (float)(cell->hv[j % PARTICLES_PER_CELL].x);
         hvy = (float)(cell->hv[j % PARTICLES_PER_CELL].y);
         hvz = (float)(cell->hv[j % PARTICLES_PER_CELL].z);
-        vx  = (float)(cell->v[j % PARTICLES_PER_CELL].x);
-        vy  = (float)(cell->v[j % PARTICLES_PER_CELL].y);
-        vz  = (float)(cell->v[j % PARTICLES_PER_CELL].z);
+        vx  = (float)(cell->v_coord[(j % PARTICLES_PER_CELL)*3]);
+        vy  = (float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+1]);
+        vz  = (float)(cell->v_coord[((j % PARTICLES_PER_CELL)*3)+2]);
       }
       file.write((char *)&px,  FILE_SIZE_FLOAT);
       file.write((char *)&py,  FILE_SIZE_FLOAT);
@@ -338,9 +339,9 @@ void RebuildGrid()
     for(int j = 0; j < np2; ++j)
     {
       //get destination for source particle
-      int ci = (int)((cell2->p[j % PARTICLES_PER_CELL].x - domainMin.x) / delta.x);
-      int cj = (int)((cell2->p[j % PARTICLES_PER_CELL].y - domainMin.y) / delta.y);
-      int ck = (int)((cell2->p[j % PARTICLES_PER_CELL].z - domainMin.z) / delta.z);
+      int ci = (int)((cell2->p_coord[(j % PARTICLES_PER_CELL)*3] - domainMin.x) / delta.x);
+      int cj = (int)((cell2->p_coord[((j % PARTICLES_PER_CELL)*3)+1] - domainMin.y) / delta.y);
+      int ck = (int)((cell2->p_coord[((j % PARTICLES_PER_CELL)*3)+2] - domainMin.z) / delta.z);
 	  // confine to domain
 	  // Note, if ProcessCollisions() is working properly these tests are useless
       if(ci < 0) ci = 0; else if(ci >= nx) ci = nx-1;
@@ -388,15 +389,15 @@ void RebuildGrid()
       ++cnumPars[index];
 
       //copy source to destination particle
-      cell->p[np % PARTICLES_PER_CELL].x = cell2->p[j % PARTICLES_PER_CELL].x;
-      cell->p[np % PARTICLES_PER_CELL].y = cell2->p[j % PARTICLES_PER_CELL].y;
-      cell->p[np % PARTICLES_PER_CELL].z = cell2->p[j % PARTICLES_PER_CELL].z;
+      cell->p_coord[(np % PARTICLES_PER_CELL)*3] = cell2->p_coord[(j % PARTICLES_PER_CELL)*3];
+      cell->p_coord[((np % PARTICLES_PER_CELL)*3)+1] = cell2->p_coord[((j % PARTICLES_PER_CELL)*3)+1];
+      cell->p_coord[((np % PARTICLES_PER_CELL)*3)+2] = cell2->p_coord[((j % PARTICLES_PER_CELL)*3)+2];
       cell->hv[np % PARTICLES_PER_CELL].x = cell2->hv[j % PARTICLES_PER_CELL].x;
       cell->hv[np % PARTICLES_PER_CELL].y = cell2->hv[j % PARTICLES_PER_CELL].y;
       cell->hv[np % PARTICLES_PER_CELL].z = cell2->hv[j % PARTICLES_PER_CELL].z;
-      cell->v[np % PARTICLES_PER_CELL].x = cell2->v[j % PARTICLES_PER_CELL].x;
-      cell->v[np % PARTICLES_PER_CELL].y = cell2->v[j % PARTICLES_PER_CELL].y;
-      cell->v[np % PARTICLES_PER_CELL].z = cell2->v[j % PARTICLES_PER_CELL].z;
+      cell->v_coord[(np % PARTICLES_PER_CELL)*3] = cell2->v_coord[(j % PARTICLES_PER_CELL)*3];
+      cell->v_coord[((np % PARTICLES_PER_CELL)*3)+1] = cell2->v_coord[((j % PARTICLES_PER_CELL)*3)+1];
+      cell->v_coord[((np % PARTICLES_PER_CELL)*3)+2] = cell2->v_coord[((j % PARTICLES_PER_CELL)*3)+2];
 
       //move pointer to next source cell in list if end of array is reached
       if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
@@ -481,37 +482,10 @@ void ComputeForces()
         int numNeighCells = GetNeighborCells(ci, cj, ck, neighCells);
 
         Cell *cell = &cells[cindex];
-        for(int ipar = 0; ipar < np; ++ipar)
+        for(int inc = 0; inc < numNeighCells; ++inc)
         {
-          for(int inc = 0; inc < numNeighCells; ++inc)
-          {
-            int cindexNeigh = neighCells[inc];
-            Cell *neigh = &cells[cindexNeigh];
-            int numNeighPars = cnumPars[cindexNeigh];
-            for(int iparNeigh = 0; iparNeigh < numNeighPars; ++iparNeigh)
-            {
-              //Check address to make sure densities are computed only once per pair
-              if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL])
-              {
-                fptype distSq = (cell->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL]).GetLengthSq();
-                if(distSq < hSq)
-                {
-                  fptype t = hSq - distSq;
-                  fptype tc = t*t*t;
-                  cell->density[ipar % PARTICLES_PER_CELL] += tc;
-                  neigh->density[iparNeigh % PARTICLES_PER_CELL] += tc;
-                }
-              }
-              //move pointer to next cell in list if end of array is reached
-              if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-                neigh = neigh->next;
-              }
-            }
-          }
-          //move pointer to next cell in list if end of array is reached
-          if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-            cell = cell->next;
-          }
+          int cindexNeigh = neighCells[inc];
+          ComputeDensitiesPair(cell, np, &cells[cindexNeigh], cnumPars[cindexNeigh], NULL);
         }
       }
 
@@ -543,100 +517,27 @@ void ComputeForces()
         int numNeighCells = GetNeighborCells(ci, cj, ck, neighCells);
 
         Cell *cell = &cells[cindex];
-        for(int ipar = 0; ipar < np; ++ipar)
+        for(int inc = 0; inc < numNeighCells; ++inc)
         {
-          for(int inc = 0; inc < numNeighCells; ++inc)
-          {
-            int cindexNeigh = neighCells[inc];
-            Cell *neigh = &cells[cindexNeigh];
-            int numNeighPars = cnumPars[cindexNeigh];
-            for(int iparNeigh = 0; iparNeigh < numNeighPars; ++iparNeigh)
-            {
-              //Check address to make sure forces are computed only once per pair
-              if(&neigh->p[iparNeigh % PARTICLES_PER_CELL] < &cell->p[ipar % PARTICLES_PER_CELL])
-              {
-                Vec3 disp = cell->p[ipar % PARTICLES_PER_CELL] - neigh->p[iparNeigh % PARTICLES_PER_CELL];
-                fptype distSq = disp.GetLengthSq();
-                if(distSq < hSq)
-                {
-#ifndef ENABLE_DOUBLE_PRECISION
-                  fptype dist = sqrtf(std::max(distSq, (fptype)1e-12));
-#else
-                  fptype dist = sqrt(std::max(distSq, 1e-12));
-#endif //ENABLE_DOUBLE_PRECISION
-                  fptype hmr = h - dist;
-
-                  Vec3 acc = disp * pressureCoeff * (hmr*hmr/dist) * (cell->density[ipar % PARTICLES_PER_CELL]+neigh->density[iparNeigh % PARTICLES_PER_CELL] - doubleRestDensity);
-                  acc += (neigh->v[iparNeigh % PARTICLES_PER_CELL] - cell->v[ipar % PARTICLES_PER_CELL]) * viscosityCoeff * hmr;
-                  acc /= cell->density[ipar % PARTICLES_PER_CELL] * neigh->density[iparNeigh % PARTICLES_PER_CELL];
-
-                  cell->a[ipar % PARTICLES_PER_CELL] += acc;
-                  neigh->a[iparNeigh % PARTICLES_PER_CELL] -= acc;
-                }
-              }
-              //move pointer to next cell in list if end of array is reached
-              if(iparNeigh % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-                neigh = neigh->next;
-              }
-            }
-          }
-          //move pointer to next cell in list if end of array is reached
-          if(ipar % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-            cell = cell->next;
-          }
+          int cindexNeigh = neighCells[inc];
+          ComputeForcesPair(cell, np, &cells[cindexNeigh], cnumPars[cindexNeigh], NULL, 0);
         }
       }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// ProcessCollisions() with container walls
-// Under the assumptions that
-// a) a particle will not penetrate a wall
-// b) a particle will not migrate further than once cell
-// c) the parSize is smaller than a cell
-// then only the particles at the perimiters may be influenced by the walls
-#if 0
+
 void ProcessCollisions()
 {
-	for(int i = 0; i < numCells; ++i)
-	{
-        Cell *cell = &cells[i];
-        int np = cnumPars[i];
-        for(int j = 0; j < np; ++j)
-        {
-          Vec3 pos = cell->p[j % PARTICLES_PER_CELL] + cell->hv[j % PARTICLES_PER_CELL] * timeStep;
-
-          fptype diff = parSize - (pos.x - domainMin.x);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].x += stiffnessCollisions*diff - damping*cell->v[j % PARTICLES_PER_CELL].x;
-
-          diff = parSize - (domainMax.x - pos.x);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].x -= stiffnessCollisions*diff + damping*cell->v[j % PARTICLES_PER_CELL].x;
-
-          diff = parSize - (pos.y - domainMin.y);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].y += stiffnessCollisions*diff - damping*cell->v[j % PARTICLES_PER_CELL].y;
-
-          diff = parSize - (domainMax.y - pos.y);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].y -= stiffnessCollisions*diff + damping*cell->v[j % PARTICLES_PER_CELL].y;
-
-          diff = parSize - (pos.z - domainMin.z);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].z += stiffnessCollisions*diff - damping*cell->v[j % PARTICLES_PER_CELL].z;
-
-          diff = parSize - (domainMax.z - pos.z);
-          if(diff > epsilon)
-            cell->a[j % PARTICLES_PER_CELL].z -= stiffnessCollisions*diff + damping*cell->v[j % PARTICLES_PER_CELL].z;
-
-          //move pointer to next cell in list if end of array is reached
-          if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-            cell = cell->next;
-		}
-	}
+  int index = 0;
+  for(int iz = 0; iz < nz; ++iz)
+    for(int iy = 0; iy < ny; ++iy)
+      for(int ix = 0; ix < nx; ++ix, ++index)
+        ProcessCollisionsCell(&cells[index], cnumPars[index], ix, iy, iz);
 }
-#else
+
+#define USE_ImpeneratableWall
+#if defined(USE_ImpeneratableWall)
 // Notes on USE_ImpeneratableWall
 // When particle is detected beyond cell wall it is repositioned at cell wall
 // velocity is not changed, thus conserving momentum.
@@ -646,318 +547,23 @@ void ProcessCollisions()
 // This would entail a 2nd pass on the perimiters after AdvanceParticles (as opposed
 // to inside AdvanceParticles). Your fluid dynamisist should properly devise the
 // equasions.
-void ProcessCollisions()
-{
-	int x,y,z, index;
-	x=0;	// along the domainMin.x wall
-	for(y=0; y<ny; ++y)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_x = cell->p[ji].x + cell->hv[ji].x * timeStep;
-				fptype diff = parSize - (pos_x - domainMin.x);
-				if(diff > epsilon)
-					cell->a[ji].x += stiffnessCollisions*diff - damping*cell->v[ji].x;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	x=nx-1;	// along the domainMax.x wall
-	for(y=0; y<ny; ++y)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_x = cell->p[ji].x + cell->hv[ji].x * timeStep;
-				fptype diff = parSize - (domainMax.x - pos_x);
-				if(diff > epsilon)
-					cell->a[ji].x -= stiffnessCollisions*diff + damping*cell->v[ji].x;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	y=0;	// along the domainMin.y wall
-	for(x=0; x<nx; ++x)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_y = cell->p[ji].y + cell->hv[ji].y * timeStep;
-				fptype diff = parSize - (pos_y - domainMin.y);
-				if(diff > epsilon)
-					cell->a[ji].y += stiffnessCollisions*diff - damping*cell->v[ji].y;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	y=ny-1;	// along the domainMax.y wall
-	for(x=0; x<nx; ++x)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_y = cell->p[ji].y + cell->hv[ji].y * timeStep;
-				fptype diff = parSize - (domainMax.y - pos_y);
-				if(diff > epsilon)
-					cell->a[ji].y -= stiffnessCollisions*diff + damping*cell->v[ji].y;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	z=0;	// along the domainMin.z wall
-	for(x=0; x<nx; ++x)
-	{
-		for(y=0; y<ny; ++y)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_z = cell->p[ji].z + cell->hv[ji].z * timeStep;
-				fptype diff = parSize - (pos_z - domainMin.z);
-				if(diff > epsilon)
-					cell->a[ji].z += stiffnessCollisions*diff - damping*cell->v[ji].z;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	z=nz-1;	// along the domainMax.z wall
-	for(x=0; x<nx; ++x)
-	{
-		for(y=0; y<ny; ++y)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype pos_z = cell->p[ji].z + cell->hv[ji].z * timeStep;
-				fptype diff = parSize - (domainMax.z - pos_z);
-				if(diff > epsilon)
-					cell->a[ji].z -= stiffnessCollisions*diff + damping*cell->v[ji].z;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-}
-#define USE_ImpeneratableWall
-#if defined(USE_ImpeneratableWall)
 void ProcessCollisions2()
 {
-	int x,y,z, index;
-	x=0;	// along the domainMin.x wall
-	for(y=0; y<ny; ++y)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = cell->p[ji].x - domainMin.x;
-				if(diff < Zero)
-				{
-					cell->p[ji].x = domainMin.x - diff;
-					cell->v[ji].x = -cell->v[ji].x;
-					cell->hv[ji].x = -cell->hv[ji].x;
-				}
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	x=nx-1;	// along the domainMax.x wall
-	for(y=0; y<ny; ++y)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = domainMax.x - cell->p[ji].x;
-				if(diff < Zero)
-				{
-					cell->p[ji].x = domainMax.x + diff;
-					cell->v[ji].x = -cell->v[ji].x;
-					cell->hv[ji].x = -cell->hv[ji].x;
-				}
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	y=0;	// along the domainMin.y wall
-	for(x=0; x<nx; ++x)
-{
-	for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = cell->p[ji].y - domainMin.y;
-				if(diff < Zero)
-				{
-					cell->p[ji].y = domainMin.y - diff;
-					cell->v[ji].y = -cell->v[ji].y;
-					cell->hv[ji].y = -cell->hv[ji].y;
-				}
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	y=ny-1;	// along the domainMax.y wall
-	for(x=0; x<nx; ++x)
-	{
-		for(z=0; z<nz; ++z)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = domainMax.y - cell->p[ji].y;
-				if(diff < Zero)
-				{
-					cell->p[ji].y = domainMax.y + diff;
-					cell->v[ji].y = -cell->v[ji].y;
-					cell->hv[ji].y = -cell->hv[ji].y;
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-				}
-			}
-		}
-	}
-	z=0;	// along the domainMin.z wall
-	for(x=0; x<nx; ++x)
-	{
-		for(y=0; y<ny; ++y)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = cell->p[ji].z - domainMin.z;
-				if(diff < Zero)
-				{
-					cell->p[ji].z = domainMin.z - diff;
-					cell->v[ji].z = -cell->v[ji].z;
-					cell->hv[ji].z = -cell->hv[ji].z;
-				}
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
-	z=nz-1;	// along the domainMax.z wall
-	for(x=0; x<nx; ++x)
-	{
-		for(y=0; y<ny; ++y)
-		{
-			int ci = (z*ny + y)*nx + x;
-			Cell *cell = &cells[ci];
-			int np = cnumPars[ci];
-			for(int j = 0; j < np; ++j)
-			{
-				int ji = j % PARTICLES_PER_CELL;
-				fptype diff = domainMax.z - cell->p[ji].z;
-				if(diff < Zero)
-				{
-					cell->p[ji].z = domainMax.z + diff;
-					cell->v[ji].z = -cell->v[ji].z;
-					cell->hv[ji].z = -cell->hv[ji].z;
-				}
-				//move pointer to next cell in list if end of array is reached
-				if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1)
-					cell = cell->next;
-			}
-		}
-	}
+  int index = 0;
+  for(int iz = 0; iz < nz; ++iz)
+    for(int iy = 0; iy < ny; ++iy)
+      for(int ix = 0; ix < nx; ++ix, ++index)
+        if((ix==0)||(iy==0)||(iz==0)||(ix==(nx-1))||(iy==(ny-1))||(iz==(nz-1)))
+          ProcessCollisions2Cell(&cells[index], cnumPars[index], ix, iy, iz);
 }
 #endif
-#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 
 void AdvanceParticles()
 {
   for(int i = 0; i < numCells; ++i)
-  {
-    Cell *cell = &cells[i];
-    int np = cnumPars[i];
-    for(int j = 0; j < np; ++j)
-    {
-      Vec3 v_half = cell->hv[j % PARTICLES_PER_CELL] + cell->a[j % PARTICLES_PER_CELL]*timeStep;
-#if defined(USE_ImpeneratableWall)
-	  // N.B. The integration of the position can place the particle
-	  // outside the domain. Although we could place a test in this loop
-	  // we would be unnecessarily testing particles on interior cells.
-	  // Therefore, to reduce the amount of computations we make a later
-	  // pass on the perimiter cells to account for particle migration
-	  // beyond domain
-#endif
-      cell->p[j % PARTICLES_PER_CELL] += v_half * timeStep;
-      cell->v[j % PARTICLES_PER_CELL] = cell->hv[j % PARTICLES_PER_CELL] + v_half;
-      cell->v[j % PARTICLES_PER_CELL] *= 0.5;
-      cell->hv[j % PARTICLES_PER_CELL] = v_half;
-
-      //move pointer to next cell in list if end of array is reached
-      if(j % PARTICLES_PER_CELL == PARTICLES_PER_CELL-1) {
-        cell = cell->next;
-      }
-    }
-  }
+    AdvanceParticlesCell(&cells[i], cnumPars[i]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -3,6 +3,7 @@
 #include "FrameBuffer/PBOFrameBuffer.hxx"
 #include "FrameBuffer/GLTextureFB.hxx"
 #include "FrameBuffer/MemoryFrameBuffer.hxx"
+#include "FrameBuffer/HeadlessFrameBuffer.hxx"
 
 #define DBG(a) /* do nothing */
 
@@ -10,6 +11,7 @@ namespace LRT BEGIN_NAMESPACE
 
 bool FrameBuffer::Options::usePBOs = true;
 bool FrameBuffer::Options::useMemoryFB = false;
+string FrameBuffer::Options::framePrefix;
 vec2i FrameBuffer::Options::defaultRes(512,512);
 
 
@@ -18,6 +20,9 @@ RGBAucharFrameBuffer *RGBAucharFrameBuffer::create()
 {
   RGBAucharFrameBuffer *frameBuffer = NULL;
 
+  if (!Options::framePrefix.empty())
+    return new LRT::HeadlessFrameBuffer(Options::framePrefix.c_str());
+
   if (Options::useMemoryFB) {
     cout << "Using memory framebuffer..." << endl;
     return new LRT::MemoryFrameBuffer;
@@ -59,6 +59,11 @@ struct RGBAucharFrameBuffer
         no display rendering */
     static bool useMemoryFB;
 
+    /*! if not empty, FrameBuffer::create() returns a memory
+        framebuffer that writes each frame to <framePrefix>NNNNN.ppm
+        in the background (\see HeadlessFrameBuffer) */
+    static string framePrefix;
+
     /*! default resolution of frame buffer. to be used by the
       application ... */
     static vec2i defaultRes;
@@ -70,6 +75,7 @@ struct RGBAucharFrameBuffer
   RGBAucharFrameBuffer()
     : res(0,0), fb(NULL)
   {}
+  virtual ~RGBAucharFrameBuffer() {}
   /*! write a block of pixels. */
   _INLINE void writeBlock(const int x0, const int y0,
              const int dx, const int dy,
@@ -0,0 +1,148 @@
+#include "HeadlessFrameBuffer.hxx"
+
+#include <stdio.h>
+
+namespace LRT BEGIN_NAMESPACE
+
+
+HeadlessFrameBuffer::HeadlessFrameBuffer(const char *prefix)
+  : m_prefix(prefix), m_frames(0), m_writing(false), m_quit(false)
+{
+  fb = NULL;
+  if (pthread_create(&m_writer,NULL,writerThread,this))
+    FATAL("could not create frame writer thread");
+  cout << "writing frames to " << m_prefix << "*.ppm" << endl;
+}
+
+HeadlessFrameBuffer::~HeadlessFrameBuffer()
+{
+  flush();
+  m_sync.lock();
+  m_quit = true;
+  m_sync.resumeAll();
+  m_sync.unlock();
+  pthread_join(m_writer,NULL);
+
+  freeBuffers();
+}
+
+/*! also frees the buffer of a frame that was started but not
+    finished, which is in neither m_free nor m_pending */
+void HeadlessFrameBuffer::freeBuffers()
+{
+  for (size_t i=0;i<m_buffers.size();i++)
+    aligned_free(m_buffers[i]);
+  m_buffers.clear();
+  m_free.clear();
+  fb = NULL;
+}
+
+void HeadlessFrameBuffer::resize(int newX, int newY)
+{
+  FrameBuffer::resize(newX,newY);
+
+  // frames still queued keep their own resolution, but the buffers
+  // are only reallocated once all of them are written
+  flush();
+  freeBuffers();
+  for (int i=0;i<HEADLESS_FB_BUFFERS;i++)
+    m_buffers.push_back(aligned_malloc<unsigned char>(4*res.x*res.y));
+  m_free = m_buffers;
+}
+
+void HeadlessFrameBuffer::startNewFrame()
+{
+  m_sync.lock();
+  while (m_free.empty())
+    m_sync.suspend();
+  fb = m_free.back();
+  m_free.pop_back();
+  m_sync.unlock();
+}
+
+void HeadlessFrameBuffer::doneWithFrame()
+{
+  assert(fb);
+  Frame frame;
+  frame.pixels = fb;
+  frame.res = res;
+  frame.number = m_frames++;
+
+  m_sync.lock();
+  m_pending.push_back(frame);
+  m_sync.resumeAll();
+  m_sync.unlock();
+}
+
+void HeadlessFrameBuffer::flush()
+{
+  m_sync.lock();
+  while (!m_pending.empty() || m_writing)
+    m_sync.suspend();
+  m_sync.unlock();
+}
+
+void *HeadlessFrameBuffer::writerThread(void *self)
+{
+  ((HeadlessFrameBuffer*)self)->writeFrames();
+  return NULL;
+}
+
+void HeadlessFrameBuffer::writeFrames()
+{
+  m_sync.lock();
+  while (1)
+    {
+      while (m_pending.empty() && !m_quit)
+	m_sync.suspend();
+      if (m_pending.empty())
+	break;
+
+      const Frame frame = m_pending.front();
+      m_pending.pop_front();
+      m_writing = true;
+      m_sync.unlock();
+
+      writePPM(frame);
+
+      m_sync.lock();
+      m_writing = false;
+      m_free.push_back(frame.pixels);
+      m_sync.resumeAll();
+    }
+  m_sync.unlock();
+}
+
+void HeadlessFrameBuffer::writePPM(const Frame &frame)
+{
+  char fileName[1024];
+  snprintf(fileName,sizeof(fileName),"%s%05d.ppm",m_prefix.c_str(),frame.number);
+  FILE *file = fopen(fileName,"wb");
+  if (!file)
+    {
+      cerr << "could not open " << fileName << " for writing" << endl;
+      return;
+    }
+  bool ok = fprintf(file,"P6\n%d %d\n255\n",frame.res.x,frame.res.y) > 0;
+
+  // pixels are stored BGRA
+  vector<unsigned char> line(3*frame.res.x);
+  for (int y=0;y<frame.res.y;y++)
+    {
+      const unsigned char *const pixel = frame.pixels + 4*frame.res.x*y;
+      for (int x=0;x<frame.res.x;x++)
+	{
+	  line[3*x+0] = pixel[4*x+2];
+	  line[3*x+1] = pixel[4*x+1];
+	  line[3*x+2] = pixel[4*x+0];
+	}
+      ok = ok && fwrite(&line[0],1,line.size(),file) == line.size();
+    }
+  if (fclose(file) != 0)
+    ok = false;
+  if (!ok)
+    cerr << "error writing " << fileName << endl;
+}
+
+
+END_NAMESPACE
@@ -0,0 +1,76 @@
+#ifndef RTL__HEADLESS_FRAMEBUFFER_HXX
+#define RTL__HEADLESS_FRAMEBUFFER_HXX
+
+#include "../FrameBuffer.hxx"
+#include "RTTL/common/RTThread.hxx"
+
+#include <vector>
+#include <deque>
+#include <string>
+
+/*! frames the writer may lag behind the renderer */
+#define HEADLESS_FB_BUFFERS 3
+
+namespace LRT BEGIN_NAMESPACE
+
+// =======================================================
+/*! memory frame buffer for batch runs without display, which saves
+    every frame as <prefix>00000.ppm, <prefix>00001.ppm, ...
+
+    the render threads write their blocks straight into one of
+    HEADLESS_FB_BUFFERS buffers. a finished frame is handed to a
+    writer thread as is, and the next frame is rendered into another
+    buffer, so rendering only waits for the disk when the writer is
+    that many frames behind. fb stays valid until the next
+    startNewFrame().
+*/
+struct HeadlessFrameBuffer : public FrameBuffer
+{
+  HeadlessFrameBuffer(const char *prefix);
+
+  /*! writes all pending frames */
+  virtual ~HeadlessFrameBuffer();
+
+  virtual void resize(int newX, int newY);
+
+  virtual void startNewFrame();
+  virtual void doneWithFrame();
+  virtual void display() {}
+
+  /*! wait until all finished frames have been written */
+  void flush();
+
+protected:
+  struct Frame {
+    unsigned char *pixels;
+    vec2i res;
+    int number;
+  };
+
+  static void *writerThread(void *self);
+  void writeFrames();
+  void writePPM(const Frame &frame);
+  void freeBuffers();
+
+  string m_prefix;
+  int m_frames;
+
+  /*! all HEADLESS_FB_BUFFERS buffers, whoever uses them */
+  vector<unsigned char*> m_buffers;
+  /*! buffers nobody renders into or writes */
+  vector<unsigned char*> m_free;
+  /*! finished frames, oldest first */
+  deque<Frame> m_pending;
+  /*! the writer is busy with a frame it took from m_pending */
+  bool m_writing;
+  bool m_quit;
+
+  /*! guards all of the above; signalled when a frame is queued or
+    has been written */
+  MultiThreadedSyncPrimitive m_sync;
+  pthread_t m_writer;
+};
+
+END_NAMESPACE
+
+#endif
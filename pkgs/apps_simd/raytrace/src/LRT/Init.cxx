@@ -9,6 +9,7 @@
 #include <iostream>
 #include <vector>
 #include "FrameBuffer.hxx"
+#include "Shading.hxx"
 #include "RTTL/BVH/Builder/Builder.hxx"
 #include "RTTL/common/MapOptions.hxx"
 
@@ -19,6 +20,9 @@ using namespace std;
 
 namespace LRT {
 
+  /*! holds the name BVHBuilder::Options::defaultBuilder points to,
+    the option strings go away with myOptions */
+  static string bvhBuilder;
 
   /*! \todo TAKE RECOGNIZED PARAMETERS _OFF_ THE COMMAND LINE !!! */
   void ParseCmdLine(int *argc, char **argv) 
@@ -45,7 +49,8 @@ namespace LRT {
        */
 
     MapOptions myOptions;
-    myOptions.parse(*argc,argv);
+    /* argv[0] is the program, not an option */
+    myOptions.parse(*argc-1,argv+1);
     
     // cout << myOptions << endl;
     
@@ -54,11 +59,31 @@ namespace LRT {
       FrameBuffer::Options::usePBOs = true;
     
     FrameBuffer::Options::useMemoryFB = myOptions.defined("mem-fb, memory-fb");
+    FrameBuffer::Options::framePrefix = myOptions.get("write-frames", FrameBuffer::Options::framePrefix);
     
-    BVHBuilder::Options::defaultBuilder = myOptions.get("bvh-build-method", BVHBuilder::Options::defaultBuilder);
-    BVHBuilder::Options::defaultBuilder = myOptions.get("bvh-builder", BVHBuilder::Options::defaultBuilder);
+    bvhBuilder = myOptions.get("bvh-build-method", string(BVHBuilder::Options::defaultBuilder));
+    bvhBuilder = myOptions.get("bvh-builder", bvhBuilder);
+    BVHBuilder::Options::defaultBuilder = bvhBuilder.c_str();
     
     cout << "default BVH builder : " << BVHBuilder::Options::defaultBuilder << endl;
+
+    BVHBuilder::Options::branchingFactor = myOptions.get("bvh-width", BVHBuilder::Options::branchingFactor);
+    BVHBuilder::Options::rebuildThreshold = myOptions.get("bvh-rebuild-threshold", BVHBuilder::Options::rebuildThreshold);
+    BVHBuilder::Options::quantizedNodes = myOptions.defined("bvh-quantized");
+
+    const string shading = myOptions.get("shading", string("eyelight"));
+    if (shading == "secondary")
+      Shading::Options::mode = Shading::SECONDARY_RAYS;
+    else if (shading == "eyelight")
+      Shading::Options::mode = Shading::EYE_LIGHT;
+    else
+      cerr << "unknown shading mode " << shading << ", using eyelight" << endl;
+    Shading::Options::lights = myOptions.get("lights", Shading::Options::lights);
+    Shading::Options::lights = max(0,min(Shading::Options::lights,SHADING_MAX_LIGHTS));
+    Shading::Options::aoRays = max(0,myOptions.get("ao-rays", Shading::Options::aoRays));
+    Shading::Options::aoDistance = myOptions.get("ao-distance", Shading::Options::aoDistance);
+    Shading::Options::rayStreams = myOptions.defined("ray-streams");
+    Shading::Options::sortOctants = !myOptions.defined("no-octant-sort");
     
   }
 };
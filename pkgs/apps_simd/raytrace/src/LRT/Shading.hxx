@@ -0,0 +1,37 @@
+/*! \file Shading.hxx shading modes of the renderer */
+
+#ifndef LRT_SHADING_HXX
+#define LRT_SHADING_HXX
+
+#define SHADING_MAX_LIGHTS 4
+
+namespace LRT {
+
+  struct Shading {
+    enum Mode {
+      /*! primary rays only, lit from the eye */
+      EYE_LIGHT,
+      /*! per hit: a shadow ray to each point light, one reflection
+          bounce and aoRays ambient occlusion rays */
+      SECONDARY_RAYS
+    };
+
+    struct Options {
+      static int mode;
+      /*! number of point lights (at most SHADING_MAX_LIGHTS),
+          placed above the scene bounds */
+      static int lights;
+      static int aoRays;
+      /*! length of the ambient occlusion rays, relative to the
+          scene diagonal */
+      static float aoDistance;
+      /*! trace the secondary rays of a tile as ray streams instead
+          of packets, see RTTL/BVH/RayStream.hxx */
+      static bool rayStreams;
+      /*! bin stream rays by direction octant before traversal */
+      static bool sortOctants;
+    };
+  };
+};
+
+#endif
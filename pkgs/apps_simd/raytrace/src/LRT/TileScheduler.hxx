@@ -0,0 +1,142 @@
+/*! \file TileScheduler.hxx hands out the screen tiles of a frame to
+  the render threads */
+
+#ifndef LRT_TILESCHEDULER_HXX
+#define LRT_TILESCHEDULER_HXX
+
+#include "RTTL/common/RTInclude.hxx"
+#include "RTTL/common/RTThread.hxx"
+
+#include <vector>
+
+/*! tiles more expensive than 1/TILE_SCHEDULER_JOBS_PER_QUEUE of a
+  thread's share of the previous frame are split into quarters */
+#define TILE_SCHEDULER_JOBS_PER_QUEUE 32
+
+namespace LRT {
+
+  /*! the cost of each tile is measured while rendering and used to
+    schedule the next frame: tiles are handed out most expensive first,
+    so the cheap ones fill up the end of the frame, and expensive tiles
+    are split. with a slowly moving camera the costs change little from
+    frame to frame. the jobs are dealt round robin to one queue per
+    thread; a thread whose queue is empty steals from the others */
+  class TileScheduler
+  {
+  public:
+    struct Job {
+      int x0, y0, x1, y1;
+      int tile;
+      float cost;
+    };
+
+    TileScheduler() : m_resX(0), m_resY(0), m_tilesX(0), m_tileWidth(0), m_queues(0) {}
+
+    /*! build the jobs of a new frame from the tile costs of the last
+      one. not thread safe, call before the threads start */
+    void startFrame(const int resX, const int resY,
+		    const int tileWidth, const int minWidth,
+		    const int queues)
+    {
+      bool measured = false;
+      if (resX != m_resX || resY != m_resY || tileWidth != m_tileWidth)
+	{
+	  /* no costs known yet: all tiles cost the same, which keeps
+	     them in scanline order */
+	  m_resX = resX;
+	  m_resY = resY;
+	  m_tileWidth = tileWidth;
+	  m_tilesX = (resX + tileWidth - 1) / tileWidth;
+	  m_cost.assign(m_tilesX * ((resY + tileWidth - 1) / tileWidth),1.0f);
+	}
+      else if (m_job.size())
+	{
+	  for (size_t t=0;t<m_cost.size();t++)
+	    m_cost[t] = 0.0f;
+	  for (size_t j=0;j<m_job.size();j++)
+	    m_cost[m_job[j].tile] += m_jobCost[j];
+	  measured = true;
+	}
+
+      float total = 0.0f;
+      for (size_t t=0;t<m_cost.size();t++)
+	total += m_cost[t];
+      const float splitCost = measured ? total / (queues * TILE_SCHEDULER_JOBS_PER_QUEUE) : numeric_limits<float>::infinity();
+
+      m_job.clear();
+      for (int t=0;t<(int)m_cost.size();t++)
+	{
+	  const int x0 = (t % m_tilesX) * tileWidth;
+	  const int y0 = (t / m_tilesX) * tileWidth;
+	  addJob(t,x0,y0,min(x0 + tileWidth,resX),min(y0 + tileWidth,resY),tileWidth,minWidth,m_cost[t],splitCost);
+	}
+      stable_sort(m_job.begin(),m_job.end(),moreExpensive);
+      m_jobCost.assign(m_job.size(),0.0f);
+
+      m_queues = queues;
+      m_head.resize(queues);
+      for (int q=0;q<queues;q++)
+	m_head[q].reset();
+    }
+
+    /*! next job for the thread serving queue q. returns the job's
+      index, or -1 once all queues are empty */
+    _INLINE int next(const int q)
+    {
+      for (int i=0;i<m_queues;i++)
+	{
+	  const int v = q + i < m_queues ? q + i : q + i - m_queues;
+	  const int index = v + m_head[v].inc() * m_queues;
+	  if (index < (int)m_job.size())
+	    return index;
+	}
+      return -1;
+    }
+
+    _INLINE const Job &job(const int index) const { return m_job[index]; }
+
+    /*! measured cost of a job, in any unit as long as it is the same for all jobs */
+    _INLINE void done(const int index, const float cost) { m_jobCost[index] = cost; }
+
+  protected:
+    static bool moreExpensive(const Job &a, const Job &b) { return a.cost > b.cost; }
+
+    void addJob(const int tile,
+		const int x0, const int y0, const int x1, const int y1,
+		const int width, const int minWidth,
+		const float cost, const float splitCost)
+    {
+      if (cost > splitCost && width >= 2 * minWidth)
+	{
+	  const int w = width / 2;
+	  for (int y=y0;y<y1;y+=w)
+	    for (int x=x0;x<x1;x+=w)
+	      addJob(tile,x,y,min(x + w,x1),min(y + w,y1),w,minWidth,cost * 0.25f,splitCost);
+	  return;
+	}
+      Job job;
+      job.x0 = x0;
+      job.y0 = y0;
+      job.x1 = x1;
+      job.y1 = y1;
+      job.tile = tile;
+      job.cost = cost;
+      m_job.push_back(job);
+    }
+
+    int m_resX, m_resY;
+    int m_tilesX;
+    int m_tileWidth;
+    int m_queues;
+    /*! cost of each tile in the last frame */
+    vector<float> m_cost;
+    vector<Job> m_job;
+    /*! written by the threads, one slot per job */
+    vector<float> m_jobCost;
+    /*! position of the next job in each queue. queue q holds the
+      jobs q, q+queues, q+2*queues, ... */
+    vector<AtomicCounter, Align<AtomicCounter> > m_head;
+  };
+};
+
+#endif
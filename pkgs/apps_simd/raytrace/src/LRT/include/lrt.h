@@ -71,7 +71,8 @@ extern "C" {
   LRTvoid
   lrtDisplayFB(LRTFrameBufferHandle fbHandle);
 
-  /*!destroy a frame buffer */
+  /*!destroy a frame buffer. with -write-frames, this waits until
+    all rendered frames have been written */
   LRTvoid
   lrtDestroyFB(LRTFrameBufferHandle fbHandle);
 
@@ -98,6 +99,36 @@ extern "C" {
   /*!Build a context, has to be called before lrtRenderFrame*/
   LRTvoid lrtBuildContext(LRTContext context);
 
+  /*! use a binary scene cache file (see RTTL/BVH/BVHCache.hxx) for
+    the geometry and BVH of the context. the cache is keyed by the
+    contents of the given source files and the BVH builder. returns 1
+    if the file holds a valid cache -- the app can then skip loading
+    its geometry, lrtBuildContext takes mesh and BVH from the
+    cache. otherwise returns 0; the app loads its geometry as usual
+    and lrtBuildContext (re)writes the cache after the BVH build */
+  LRTint lrtLoadSceneCache(LRTContext context,
+                           const char *cacheFile,
+                           LRTuint sourceFiles,
+                           const char *const *sourceFile);
+
+  /*! bounds of all vertices of a scene loaded by lrtLoadSceneCache */
+  LRTvoid lrtGetSceneBounds(LRTContext context, RTfloat *lower, RTfloat *upper);
+
+  /*! move vertices first ... first+vertices-1 of a built context
+    (3 floats each, in the order they were added). takes effect with
+    the next lrtRefitContext */
+  LRTvoid lrtUpdateVertices(LRTContext context,
+                            const RTfloat *vertex,
+                            LRTuint first,
+                            LRTuint vertices);
+
+  /*! update the BVH after lrtUpdateVertices: the node bounds are
+    refit to the moved triangles, which keeps the tree topology. once
+    its SAH cost got worse than -bvh-rebuild-threshold times that of
+    the last build, the BVH is rebuilt instead. returns 1 if it was
+    rebuilt */
+  LRTint lrtRefitContext(LRTContext context);
+
   /*!  render a frame into a frame buffer object. use camera and
     context as specified; if any of those is NULL, we'll use the
     default camera resp default context instead */
@@ -4,12 +4,18 @@
 #include "RTTL/common/Timer.hxx"
 #include "RTTL/common/RTShader.hxx"
 #include "RTTL/BVH/BVH.hxx"
+#include "RTTL/BVH/WideBVH.hxx"
+#include "RTTL/BVH/BVHCache.hxx"
+#include "RTTL/BVH/BVHRefit.hxx"
+#include "RTTL/BVH/RayStream.hxx"
 #include "RTTL/Mesh/Mesh.hxx"
 #include "RTTL/Triangle/Triangle.hxx"
 #include "RTTL/Texture/Texture.hxx"
 #include "RTTL/BVH/Builder/OnDemandBuilder.hxx"
 
 #include "LRT/FrameBuffer.hxx"
+#include "LRT/Shading.hxx"
+#include "LRT/TileScheduler.hxx"
 #if USE_PBOS
 #include "LRT/FrameBuffer/PBOFrameBuffer.hxx"
 #endif
@@ -29,9 +35,8 @@
 /* -- packet of PACKET_WIDTH * PACKET_WIDTH rays -- */
 #define PACKET_WIDTH 8
 #define PACKET_WIDTH_SHIFT 3
-#define SIMD_WIDTH 4
+#define SIMD_WIDTH RT_SIMD_WIDTH
 #define SIMD_VECTORS_PER_PACKET (PACKET_WIDTH*PACKET_WIDTH/SIMD_WIDTH)
-#define SIMD_VECTORS_PER_ROW (PACKET_WIDTH/SIMD_WIDTH)
 #define RAYS_PER_PACKET (PACKET_WIDTH*PACKET_WIDTH)
 #define FOR_ALL_SIMD_VECTORS_IN_PACKET for (unsigned int i=0;i<SIMD_VECTORS_PER_PACKET;i++)
 
@@ -39,6 +44,10 @@
 #define TILE_WIDTH (4*PACKET_WIDTH)
 #define TILE_WIDTH_SHIFT 5
 
+/* -- secondary rays of up to a tile are traced together as ray streams -- */
+#define RAY_STREAM_PACKETS (TILE_WIDTH*TILE_WIDTH/RAYS_PER_PACKET)
+#define RAY_STREAM_RAYS (RAY_STREAM_PACKETS*RAYS_PER_PACKET)
+
 #define CAST_FLOAT(s,x) ((float*)&(s))[x]
 #define CAST_INT(s,x)   ((int*)&(s))[x]
 #define CAST_UINT(s,x)  ((unsigned int*)&(s))[x]
@@ -65,7 +74,11 @@ _ALIGN(DEFAULT_ALIGNMENT) static float coordY[RAYS_PER_PACKET] = {
   7,7,7,7,7,7,7,7
 };
 
-static const sse_f factor = _mm_set_ps1(255.0f);
+/* per pixel rotation of the ambient occlusion samples, see initAORotation() */
+_ALIGN(DEFAULT_ALIGNMENT) static float aoRotationCos[RAYS_PER_PACKET];
+_ALIGN(DEFAULT_ALIGNMENT) static float aoRotationSin[RAYS_PER_PACKET];
+
+static const simd_f factor = convert<simd_f>(255.0f);
 
 using namespace RTTL;
 using namespace std;
@@ -99,6 +112,8 @@ public:
 
 };
 
+template <const int LAYOUT> struct SecondaryRayBatch;
+
 class Context : public MultiThreadedTaskQueue
 {
 protected:
@@ -106,15 +121,14 @@ protected:
   /* data shared by all threads */
   struct SharedThreadData {
     /* camera data in SSE friendly layout */
-    RTVec_t<3,sse_f> origin;
-    RTVec_t<3,sse_f> up;
-    RTVec_t<3,sse_f> imagePlaneOrigin;
-    RTVec_t<3,sse_f> xAxis;
-    RTVec_t<3,sse_f> yAxis;
-    RTVec_t<3,sse_f> zAxis;
+    RTVec_t<3,simd_f> origin;
+    RTVec_t<3,simd_f> up;
+    RTVec_t<3,simd_f> imagePlaneOrigin;
+    RTVec_t<3,simd_f> xAxis;
+    RTVec_t<3,simd_f> yAxis;
+    RTVec_t<3,simd_f> zAxis;
     int resX;
     int resY;
-    int maxTiles;
     LRT::FrameBuffer *frameBuffer;
   };
 
@@ -122,18 +136,44 @@ protected:
 
   int m_geometryMode;
   PolygonalBaseMesh *m_mesh;
-  BVH *m_bvh;
+  AABBListBVH *m_bvh;
+  WideBVH<4> *m_bvh4;
+  WideBVH<8> *m_bvh8;
+  QuantizedWideBVH<4> *m_qbvh4;
+  QuantizedWideBVH<8> *m_qbvh8;
+
+  /* animated geometry */
+
+  BVHRefitter m_refitter;
+  /* SAH cost of the BVH after the last full build */
+  float m_buildSAH;
   vector< RTMaterial, Align<RTMaterial> > m_material;
   vector< RTTextureObject_RGBA_UCHAR*, Align<RTTextureObject_RGBA_UCHAR*> > m_texture;
 
+  /* secondary ray shading */
+
+  RTVec3f m_light[SHADING_MAX_LIGHTS];
+  float m_sceneDiagonal;
+
+  /* scene cache */
+
+  BVHCache m_cache;
+  string m_cacheFile;
+  unsigned long long m_cacheKey;
+
   /* threads */
 
   int m_threads;
   bool m_threadsCreated;
+  LRT::TileScheduler m_tileScheduler;
 
   // need to be aligned, therefore made static
   static SharedThreadData m_threadData;
-  static AtomicCounter m_tileCounter;
+
+  void buildBVH();
+  void collapseBVH();
+  template <int K>
+  void collapseWideBVH(WideBVH<K> *&wide, QuantizedWideBVH<K> *&quantized, size_t &nodes, size_t &bytes);
 
   /* textures */
 
@@ -145,27 +185,26 @@ protected:
     const float left = -camera->m_cameraAspectRatio * 0.5f;
     const float top  = 0.5f;
 
-    m_threadData.origin[0] = convert(camera->m_cameraOrigin[0]);
-    m_threadData.origin[1] = convert(camera->m_cameraOrigin[1]);
-    m_threadData.origin[2] = convert(camera->m_cameraOrigin[2]);
-    m_threadData.yAxis[0]  = convert(camera->m_cameraDirection[0]);
-    m_threadData.yAxis[1]  = convert(camera->m_cameraDirection[1]);
-    m_threadData.yAxis[2]  = convert(camera->m_cameraDirection[2]);
+    m_threadData.origin[0] = convert<simd_f>(camera->m_cameraOrigin[0]);
+    m_threadData.origin[1] = convert<simd_f>(camera->m_cameraOrigin[1]);
+    m_threadData.origin[2] = convert<simd_f>(camera->m_cameraOrigin[2]);
+    m_threadData.yAxis[0]  = convert<simd_f>(camera->m_cameraDirection[0]);
+    m_threadData.yAxis[1]  = convert<simd_f>(camera->m_cameraDirection[1]);
+    m_threadData.yAxis[2]  = convert<simd_f>(camera->m_cameraDirection[2]);
     m_threadData.yAxis.normalize();
-    m_threadData.up[0]     = convert(camera->m_cameraUp[0]);
-    m_threadData.up[1]     = convert(camera->m_cameraUp[1]);
-    m_threadData.up[2]     = convert(camera->m_cameraUp[2]);
+    m_threadData.up[0]     = convert<simd_f>(camera->m_cameraUp[0]);
+    m_threadData.up[1]     = convert<simd_f>(camera->m_cameraUp[1]);
+    m_threadData.up[2]     = convert<simd_f>(camera->m_cameraUp[2]);
     m_threadData.xAxis     = m_threadData.yAxis^m_threadData.up;
     m_threadData.xAxis.normalize();
     m_threadData.zAxis     = m_threadData.yAxis^m_threadData.xAxis;
     m_threadData.zAxis.normalize();
 
-    m_threadData.imagePlaneOrigin = m_threadData.yAxis * convert(camera->m_cameraDistance) + convert(left) * m_threadData.xAxis - convert(top) * m_threadData.zAxis;
+    m_threadData.imagePlaneOrigin = m_threadData.yAxis * convert<simd_f>(camera->m_cameraDistance) + convert<simd_f>(left) * m_threadData.xAxis - convert<simd_f>(top) * m_threadData.zAxis;
     m_threadData.xAxis     = m_threadData.xAxis * camera->m_cameraAspectRatio / resX;
     m_threadData.zAxis     = m_threadData.zAxis / resY;
     m_threadData.resX      = resX;
     m_threadData.resY      = resY;
-    m_threadData.maxTiles  = (resX >> PACKET_WIDTH_SHIFT)*(resY >> PACKET_WIDTH_SHIFT);
     m_threadData.frameBuffer = frameBuffer;
   }
 
@@ -176,6 +215,26 @@ protected:
 			  const int startX,const int startY,
 			  const int resX,const int resY);
 
+  template <class MESH, const int LAYOUT, const int MULTIPLE_ORIGINS, const int SHADOW_RAYS>
+  _INLINE void traverse(RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
+			const MESH &mesh);
+
+  template <class MESH, const int LAYOUT>
+  void shadeSecondaryRays(RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+			  const MESH &mesh,
+			  simd_i *const dest);
+
+  template <class MESH, const int LAYOUT>
+  void batchSecondaryRays(SecondaryRayBatch<LAYOUT> &batch,
+			  RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+			  const MESH &mesh,
+			  const int x,const int y);
+
+  template <class MESH, const int LAYOUT>
+  void flushSecondaryRays(SecondaryRayBatch<LAYOUT> &batch,
+			  const MESH &mesh,
+			  LRT::FrameBuffer *frameBuffer);
+
 public:
 
   enum {
@@ -186,11 +245,17 @@ public:
 
   Context() {
     m_bvh = NULL;
+    m_bvh4 = NULL;
+    m_bvh8 = NULL;
+    m_qbvh4 = NULL;
+    m_qbvh8 = NULL;
     m_mesh = NULL;
+    m_cacheKey = 0;
+    m_buildSAH = 0.0f;
+    m_sceneDiagonal = 0.0f;
     m_threads = 1;
     m_threadsCreated = false;
     m_geometryMode = MINIRT_POLYGONAL_GEOMETRY;
-    Context::m_tileCounter.reset();
   }
 
   /* ------------------------------------ */
@@ -211,6 +276,22 @@ public:
   void finalize();
   void buildSpatialIndexStructure();
 
+  void updateVertices(const RTVec3f *const v,const int first,const int vertices);
+  bool refitSpatialIndexStructure();
+
+  bool loadSceneCache(const char *fileName, const unsigned long long key);
+  void writeSceneCache(const RTVec3f *const v,const int vertices,const RTVec3i *const t,const int triangles);
+
+  _INLINE bool sceneFromCache() const
+  {
+    return m_cache.valid();
+  }
+
+  _INLINE const BVHCache &sceneCache() const
+  {
+    return m_cache;
+  }
+
   void renderFrame(Camera *camera,
 		   LRT::FrameBuffer *frameBuffer,
 		   const int resX,const int resY);
@@ -237,18 +318,17 @@ public:
 };
 
 _ALIGN(DEFAULT_ALIGNMENT) Context::SharedThreadData Context::m_threadData;
-_ALIGN(DEFAULT_ALIGNMENT) AtomicCounter Context::m_tileCounter;
 
 
-/*! get four pixels in sse-float-format, converts those to RGB-uchar */
-_INLINE sse_i convert_fourPixels_to_fourRBGAuchars(const sse_f& red,
-						   const sse_f& green,
-						   const sse_f& blue)
+/*! get SIMD_WIDTH pixels in float-format, converts those to RGB-uchar */
+_INLINE simd_i convert_pixels_to_RBGAuchars(const simd_f& red,
+					     const simd_f& green,
+					     const simd_f& blue)
 {
-  sse_i r  = _mm_cvtps_epi32(red   * factor);
-  sse_i g  = _mm_cvtps_epi32(green * factor);
-  sse_i b  = _mm_cvtps_epi32(blue  * factor);
-  sse_i fc = _mm_or_si128(_mm_slli_epi32(r, 16), _mm_or_si128(b, _mm_slli_epi32(g, 8)));
+  simd_i r  = convert(red   * factor);
+  simd_i g  = convert(green * factor);
+  simd_i b  = convert(blue  * factor);
+  simd_i fc = (r << 16) | (b | (g << 8));
   return fc;
 }
 
@@ -261,28 +341,28 @@ _INLINE sse_i convert_fourPixels_to_fourRBGAuchars(const sse_f& red,
 
 /* moved constants outside the function as otherwise the compiler does not treat them as constants */
 
-static const sse_i moduloX = convert<sse_i>(11);
-static const sse_i moduloY = convert<sse_i>(13);
-static const sse_i moduloZ = convert<sse_i>(17);
-static const sse_f scaleX  = convert<sse_f>(1.0f / 11);
-static const sse_f scaleY  = convert<sse_f>(1.0f / 13);
-static const sse_f scaleZ  = convert<sse_f>(1.0f / 17);
-static const sse_i bias    = convert<sse_i>(12);
+static const simd_i moduloX = convert<simd_i>(11);
+static const simd_i moduloY = convert<simd_i>(13);
+static const simd_i moduloZ = convert<simd_i>(17);
+static const simd_f scaleX  = convert<simd_f>(1.0f / 11);
+static const simd_f scaleY  = convert<simd_f>(1.0f / 13);
+static const simd_f scaleZ  = convert<simd_f>(1.0f / 17);
+static const simd_i bias    = convert<simd_i>(12);
 
 template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS, class Mesh>
 _INLINE void Shade_RandomID(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
 			    const Mesh &mesh,
 			    const RTMaterial *const mat,
 			    RTTextureObject_RGBA_UCHAR **texture,
-			    sse_i *const dest)
+			    simd_i *const dest)
 {
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
-      const sse_i t = packet.id(i) + bias;
-      const sse_f colorX = convert(t & moduloX) * scaleX;
-      const sse_f colorY = convert(t & moduloY) * scaleY;
-      const sse_f colorZ = convert(t & moduloZ) * scaleZ;
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(colorX,colorY,colorZ);
+      const simd_i t = packet.id(i) + bias;
+      const simd_f colorX = convert(t & moduloX) * scaleX;
+      const simd_f colorY = convert(t & moduloY) * scaleY;
+      const simd_f colorZ = convert(t & moduloZ) * scaleZ;
+      dest[i] = convert_pixels_to_RBGAuchars(colorX,colorY,colorZ);
     }
 }
 
@@ -291,12 +371,12 @@ _INLINE void Shade_PrimitiveID(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAY
 			       const Mesh &mesh,
 			       const RTMaterial *const mat,
 			       RTTextureObject_RGBA_UCHAR **texture,
-			       sse_i *const dest)
+			       simd_i *const dest)
 {
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
-      const sse_f t = convert(packet.id(i));
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(t,t,t);
+      const simd_f t = convert(packet.id(i));
+      dest[i] = convert_pixels_to_RBGAuchars(t,t,t);
     }
 }
 
@@ -305,15 +385,15 @@ _INLINE void Shade_ShaderID(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>
 			    const Mesh &mesh,
 			    const RTMaterial *const mat,
 			    RTTextureObject_RGBA_UCHAR **texture,
-			    sse_i *const dest)
+			    simd_i *const dest)
 {
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
-      const sse_i t = packet.shaderID(i) + bias;
-      const sse_f colorX = convert(t & moduloX) * scaleX;
-      const sse_f colorY = convert(t & moduloY) * scaleY;
-      const sse_f colorZ = convert(t & moduloZ) * scaleZ;
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(colorX,colorY,colorZ);
+      const simd_i t = packet.shaderID(i) + bias;
+      const simd_f colorX = convert(t & moduloX) * scaleX;
+      const simd_f colorY = convert(t & moduloY) * scaleY;
+      const simd_f colorZ = convert(t & moduloZ) * scaleZ;
+      dest[i] = convert_pixels_to_RBGAuchars(colorX,colorY,colorZ);
     }
 }
 
@@ -322,14 +402,14 @@ _INLINE void Shade_Diffuse(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &
 			   const Mesh &mesh,
 			   const RTMaterial *const mat,
 			   RTTextureObject_RGBA_UCHAR **texture,
-			   sse_i *const dest)
+			   simd_i *const dest)
 {
-  RTVec_t<3, sse_f> diffuse;
+  RTVec_t<3, simd_f> diffuse;
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
       RTMaterial::getDiffuse(packet.shaderID(i),mat,diffuse);
       //DBG_PRINT(diffuse);
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(diffuse[0],diffuse[1],diffuse[2]);
+      dest[i] = convert_pixels_to_RBGAuchars(diffuse[0],diffuse[1],diffuse[2]);
     }
 }
 
@@ -338,13 +418,13 @@ _INLINE void Shade_Normal(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &p
 			  const Mesh &mesh,
 			  const RTMaterial *const mat,
 			  RTTextureObject_RGBA_UCHAR **texture,
-			  sse_i *const dest)
+			  simd_i *const dest)
 {
-  RTVec_t<3, sse_f> normal;
+  RTVec_t<3, simd_f> normal;
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
       mesh.getGeometryNormal<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS,false>(packet,i,normal);
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(normal[0],normal[1],normal[2]);
+      dest[i] = convert_pixels_to_RBGAuchars(normal[0],normal[1],normal[2]);
     }
 }
 
@@ -353,19 +433,19 @@ _INLINE void Shade_EyeLight(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>
 			    const Mesh &mesh,
 			    const RTMaterial *const mat,
 			    RTTextureObject_RGBA_UCHAR **texture,
-			    sse_i *const dest)
+			    simd_i *const dest)
 {
-  RTVec_t<3, sse_f> normal;
-  const sse_f fixedColor = convert<sse_f>(0.6f);
-  const sse_f ambient = convert<sse_f>(0.2f);
+  RTVec_t<3, simd_f> normal;
+  const simd_f fixedColor = convert<simd_f>(0.6f);
+  const simd_f ambient = convert<simd_f>(0.2f);
 
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
       mesh.template getGeometryNormal<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS,true>(packet,i,normal);
       // needs normalized ray directions
-      const sse_f dot = abs(normal[0] * packet.directionX(i) + normal[1] * packet.directionY(i) + normal[2] * packet.directionZ(i));
-      const sse_f color = ambient + fixedColor * dot;
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(color,color,color);
+      const simd_f dot = abs(normal[0] * packet.directionX(i) + normal[1] * packet.directionY(i) + normal[2] * packet.directionZ(i));
+      const simd_f color = ambient + fixedColor * dot;
+      dest[i] = convert_pixels_to_RBGAuchars(color,color,color);
     }
 }
 
@@ -374,17 +454,17 @@ _INLINE void Shade_TxtCoord(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>
 			    const Mesh &mesh,
 			    const RTMaterial *const mat,
 			    RTTextureObject_RGBA_UCHAR **texture,
-			    sse_i *const dest)
+			    simd_i *const dest)
 {
-  RTVec_t<2, sse_f> txt;
-  RTVec_t<4, sse_f> texel;
+  RTVec_t<2, simd_f> txt;
+  RTVec_t<4, simd_f> texel;
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
       mesh.getTextureCoordinate<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS,false>(packet,i,txt);
       //DBG_PRINT(mat.m_textureId);
       //texture[mat[0].m_textureId]->getTexel(txt[0],txt[1],texel);
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(txt[0],txt[1],convert<sse_f>(1) - txt[0] - txt[1]);
-      //dest[i] = convert_fourPixels_to_fourRBGAuchars(texel[0],texel[1],texel[2]);
+      dest[i] = convert_pixels_to_RBGAuchars(txt[0],txt[1],convert<simd_f>(1) - txt[0] - txt[1]);
+      //dest[i] = convert_pixels_to_RBGAuchars(texel[0],texel[1],texel[2]);
     }
 }
 
@@ -393,46 +473,38 @@ _INLINE void Shade_Texture(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &
 			   const Mesh &mesh,
 			   const RTMaterial *const mat,
 			   RTTextureObject_RGBA_UCHAR **texture,
-			   sse_i *const dest)
+			   simd_i *const dest)
 {
-  RTVec_t<2, sse_f> txt;
-  RTVec_t<4, sse_f> texel;
-  const sse_i zero = convert<sse_i>(0);
-  const sse_i noHit = convert<sse_i>(-1);
+  RTVec_t<2, simd_f> txt;
+  RTVec_t<4, simd_f> texel;
+  const simd_i zero = convert<simd_i>(0);
+  const simd_i noHit = convert<simd_i>(-1);
   FOR_ALL_SIMD_VECTORS_IN_PACKET
     {
-      texel[0] = _mm_setzero_ps();
-      texel[1] = _mm_setzero_ps();
-      texel[2] = _mm_setzero_ps();
+      texel[0] = convert<simd_f>(0.0f);
+      texel[1] = convert<simd_f>(0.0f);
+      texel[2] = convert<simd_f>(0.0f);
 
-      const sse_f noHitMask = _mm_castsi128_ps(_mm_cmpgt_epi32(packet.id(i), noHit));
-      //if (__builtin_expect(_mm_movemask_ps(noHitMask) == 0x0,0)) continue;
-      const sse_i shaderID = max(packet.shaderID(i),zero); // -1 not allowed
+      const simd_mask hitMask = cmpgt(packet.id(i), noHit);
+      //if (__builtin_expect(movemask(hitMask) == 0x0,0)) continue;
+      const simd_i shaderID = max(packet.shaderID(i),zero); // -1 not allowed
 
       mesh.getTextureCoordinate<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS,false>(packet,i,txt);
 
-      const int txtId0 = mat[CAST_INT(shaderID,0)].m_textureId;
-      const int txtId1 = mat[CAST_INT(shaderID,1)].m_textureId;
-      const int txtId2 = mat[CAST_INT(shaderID,2)].m_textureId;
-      const int txtId3 = mat[CAST_INT(shaderID,3)].m_textureId;
-
-      if (txtId0 != -1) texture[txtId0]->getTexel<0>(txt[0],txt[1],texel);
-      if (txtId1 != -1) texture[txtId1]->getTexel<1>(txt[0],txt[1],texel);
-      if (txtId2 != -1) texture[txtId2]->getTexel<2>(txt[0],txt[1],texel);
-      if (txtId3 != -1) texture[txtId3]->getTexel<3>(txt[0],txt[1],texel);
+      for (int k=0;k<SIMD_WIDTH;k++)
+	{
+	  const int txtId = mat[CAST_INT(shaderID,k)].m_textureId;
+	  if (txtId != -1) texture[txtId]->getTexel(k,txt[0],txt[1],texel);
+	}
 
-      texel[0] &= noHitMask;
-      texel[1] &= noHitMask;
-      texel[2] &= noHitMask;
+      texel[0] = choose(hitMask,texel[0],convert<simd_f>(0.0f));
+      texel[1] = choose(hitMask,texel[1],convert<simd_f>(0.0f));
+      texel[2] = choose(hitMask,texel[2],convert<simd_f>(0.0f));
 
 #if 0
       DBG_PRINT(packet.id(i));
       DBG_PRINT(packet.shaderID(i));
 
-      DBG_PRINT(txtId0);
-      DBG_PRINT(txtId1);
-      DBG_PRINT(txtId2);
-      DBG_PRINT(txtId3);
       DBG_PRINT(txt[0]);
       DBG_PRINT(txt[1]);
 
@@ -443,7 +515,7 @@ _INLINE void Shade_Texture(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &
       exit(0);
 #endif
 
-      dest[i] = convert_fourPixels_to_fourRBGAuchars(texel[0],texel[1],texel[2]);
+      dest[i] = convert_pixels_to_RBGAuchars(texel[0],texel[1],texel[2]);
     }
 }
 
@@ -451,6 +523,27 @@ _INLINE void Shade_Texture(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &
 /* --------------------------------------------------------------------------------------------------- */
 /* --------------------------------------------------------------------------------------------------- */
 
+int LRT::Shading::Options::mode = LRT::Shading::EYE_LIGHT;
+int LRT::Shading::Options::lights = 2;
+int LRT::Shading::Options::aoRays = 4;
+float LRT::Shading::Options::aoDistance = 0.05f;
+bool LRT::Shading::Options::rayStreams = false;
+bool LRT::Shading::Options::sortOctants = true;
+
+/*! the ambient occlusion samples of each pixel are rotated around the
+  normal by a low-discrepancy angle, so that neighboring pixels sample
+  different directions without any random number state per thread */
+static void initAORotation()
+{
+  for (int i=0;i<RAYS_PER_PACKET;i++)
+    {
+      const float r = 0.7548776662f * coordX[i] + 0.5698402910f * coordY[i];
+      const float angle = 2.0f * (float)M_PI * (r - floorf(r));
+      aoRotationCos[i] = cosf(angle);
+      aoRotationSin[i] = sinf(angle);
+    }
+}
+
 void Context::init(const int mode)
 {
 #ifndef RT_EMULATE_SSE
@@ -460,6 +553,7 @@ void Context::init(const int mode)
 #endif
 
   m_geometryMode = mode;
+  initAORotation();
 
   assert(m_mesh == NULL);
 
@@ -545,6 +639,25 @@ void Context::finalize()
       mat.m_diffuse = RTVec3f(0.8f,0.8f,0.8f);
       m_material.push_back(mat);
     }
+
+  /* point lights for secondary ray shading, spread out above (+y)
+     the scene */
+  static const float lightPosition[SHADING_MAX_LIGHTS][3] = {
+    {  0.4f, 0.8f,  0.3f },
+    { -0.5f, 0.7f, -0.4f },
+    {  0.3f, 0.9f, -0.5f },
+    { -0.3f, 0.6f,  0.5f }
+  };
+  const sse_f boxMin = m_mesh->getAABB().min_f();
+  const sse_f boxMax = m_mesh->getAABB().max_f();
+  const RTVec3f lower(M128_FLOAT(boxMin,0),M128_FLOAT(boxMin,1),M128_FLOAT(boxMin,2));
+  const RTVec3f upper(M128_FLOAT(boxMax,0),M128_FLOAT(boxMax,1),M128_FLOAT(boxMax,2));
+  const RTVec3f diagonal = upper - lower;
+  const RTVec3f center = (upper + lower) * 0.5f;
+  for (int l=0;l<SHADING_MAX_LIGHTS;l++)
+    for (int d=0;d<3;d++)
+      m_light[l][d] = center[d] + diagonal[d] * lightPosition[l][d];
+  m_sceneDiagonal = diagonal.length();
 }
 
 void Context::buildSpatialIndexStructure()
@@ -554,21 +667,28 @@ void Context::buildSpatialIndexStructure()
   assert(m_bvh == NULL);
 
   const int numPrimitives = m_mesh->numPrimitives();
-  AABB *box = aligned_malloc<AABB>(numPrimitives);
-  m_mesh->storePrimitiveAABBs(box,numPrimitives);
+  m_bvh = new AABBListBVH(NULL,numPrimitives);
 
-  //for (int i=0;i<mesh->numPrimitives();i++)
-  //  box[i] = static_cast<AABB>(mesh->getAABB(i));
-
-  m_bvh = new AABBListBVH(box,numPrimitives);
-
-  Timer timer;
-  timer.start();
+  if (m_cache.valid())
+    {
+      /* nodes and item lists are used in place from the mapped cache file */
+      assert(m_cache.header().items == numPrimitives);
+      m_bvh->node = m_cache.node();
+      m_bvh->item = m_cache.item();
+      cout << "BVH from scene cache, " << m_cache.header().nodes << " nodes" << endl;
+    }
+  else
+    buildBVH();
 
-  m_bvh->build(m_mesh->getAABB(),m_mesh->getCentroidAABB());
+  m_buildSAH = BVHRefitter::sahCost(m_bvh->node);
 
-  const float t = timer.stop();
-  cout << "build time " << t << endl;
+  if (BVHBuilder::Options::branchingFactor != 2 &&
+      BVHBuilder::Options::branchingFactor != 4 &&
+      BVHBuilder::Options::branchingFactor != 8)
+    FATAL("BVH branching factor has to be 2, 4 or 8");
+  if (BVHBuilder::Options::quantizedNodes && BVHBuilder::Options::branchingFactor == 2)
+    FATAL("quantized BVH nodes need a BVH width of 4 or 8");
+  collapseBVH();
 
 #ifdef USE_GRID
   {
@@ -586,31 +706,152 @@ void Context::buildSpatialIndexStructure()
   }
 #endif
 
+}
+
+void Context::buildBVH()
+{
+  const int numPrimitives = m_mesh->numPrimitives();
+  AABB *box = aligned_malloc<AABB>(numPrimitives);
+  m_mesh->storePrimitiveAABBs(box,numPrimitives);
+
+  //for (int i=0;i<mesh->numPrimitives();i++)
+  //  box[i] = static_cast<AABB>(mesh->getAABB(i));
+
+  m_bvh->primBounds = box;
+
+  // builders that can run in parallel use the render threads
+  BVHBuilder::Options::buildThreads = m_threads;
+
+  Timer timer;
+  timer.start();
+
+  m_bvh->build(m_mesh->getAABB(),m_mesh->getCentroidAABB());
+
+  const float t = timer.stop();
+  cout << "build time " << t << endl;
+
+  m_bvh->primBounds = NULL;
   free_align(box);
+}
 
+/*! (re)create the 4- or 8-wide BVH from the binary one, if any */
+void Context::collapseBVH()
+{
+  if (BVHBuilder::Options::branchingFactor == 2) return;
+
+  /* only report the first collapse, not the one after every refit */
+  const bool first = m_bvh4 == NULL && m_bvh8 == NULL && m_qbvh4 == NULL && m_qbvh8 == NULL;
+  Timer timer;
+  timer.start();
+  size_t nodes, bytes;
+  if (BVHBuilder::Options::branchingFactor == 4)
+    collapseWideBVH(m_bvh4,m_qbvh4,nodes,bytes);
+  else
+    collapseWideBVH(m_bvh8,m_qbvh8,nodes,bytes);
+  if (first)
+    cout << "collapsed to " << BVHBuilder::Options::branchingFactor << "-wide "
+	 << (m_qbvh4 || m_qbvh8 ? "quantized " : "") << "BVH, "
+	 << nodes << " nodes (" << KBytes(bytes) << " KB) " << 1000.0f * timer.stop() << " ms" << endl;
 }
 
-int Context::task(int jobID, int threadId)
+template <int K>
+void Context::collapseWideBVH(WideBVH<K> *&wide, QuantizedWideBVH<K> *&quantized, size_t &nodes, size_t &bytes)
+{
+  if (wide == NULL) wide = new WideBVH<K>;
+  wide->collapse(m_bvh->node);
+  nodes = wide->node.size();
+  bytes = nodes * sizeof(WideBVHNode<K>);
+  if (!BVHBuilder::Options::quantizedNodes) return;
+
+  if (quantized == NULL) quantized = new QuantizedWideBVH<K>;
+  if (!quantized->quantize(*wide))
+    {
+      cout << "BVH leaf too large for quantized nodes, using float nodes" << endl;
+      delete quantized;
+      quantized = NULL;
+      return;
+    }
+  /* traversal only uses the quantized nodes */
+  delete wide;
+  wide = NULL;
+  bytes = nodes * sizeof(QuantizedWideBVHNode<K>);
+}
+
+void Context::updateVertices(const RTVec3f *const v,const int first,const int vertices)
 {
-  const int tilesPerRow = m_threadData.resX >> TILE_WIDTH_SHIFT;
-  while(1)
+  m_mesh->updateVertices((const float*)v,first,vertices);
+}
+
+/*! after updateVertices(): refit the BVH to the moved primitives,
+  or rebuild it if the refit tree got too bad. returns true if the
+  BVH was rebuilt */
+bool Context::refitSpatialIndexStructure()
+{
+  assert(m_bvh);
+  const float sah = m_refitter.refit(m_bvh->node,m_bvh->item,m_mesh,m_threads);
+  const bool rebuild = sah > BVHBuilder::Options::rebuildThreshold * m_buildSAH;
+  if (rebuild)
     {
-      int index = Context::m_tileCounter.inc();
-      if (index >= m_threadData.maxTiles) break;
+      cout << "refit BVH SAH cost " << sah << " vs. " << m_buildSAH << " after build, rebuilding" << endl;
+      if (m_cache.valid() && m_bvh->node == m_cache.node())
+	{
+	  /* the builder allocates its own nodes, the cache's stay mapped */
+	  m_bvh->node = NULL;
+	  m_bvh->item = NULL;
+	}
+      m_mesh->updateBounds();
+      buildBVH();
+      m_buildSAH = BVHRefitter::sahCost(m_bvh->node);
+    }
+  collapseBVH();
+  return rebuild;
+}
 
-      /* todo: get rid of '/' and '%' */
+bool Context::loadSceneCache(const char *fileName, const unsigned long long key)
+{
+  m_cacheFile = fileName;
+  m_cacheKey = key;
+  if (!m_cache.open(fileName,key))
+    return false;
+
+  const BVHCache::Header &header = m_cache.header();
+  addVertices(m_cache.vertex(),NULL,header.vertices);
+  addTriangleMesh(m_cache.triangle(),header.triangles,NULL);
+  return true;
+}
+
+void Context::writeSceneCache(const RTVec3f *const v,const int vertices,const RTVec3i *const t,const int triangles)
+{
+  if (m_cacheFile.empty() || m_cache.valid()) return;
+  assert(m_bvh);
 
-      int sx = (index % tilesPerRow)*TILE_WIDTH;
-      int sy = (index / tilesPerRow)*TILE_WIDTH;
-      int ex = min(sx+TILE_WIDTH,m_threadData.resX);
-      int ey = min(sy+TILE_WIDTH,m_threadData.resY);
+  if (BVHCache::write(m_cacheFile.c_str(),m_cacheKey,v,vertices,t,triangles,*m_bvh,numPrimitives()))
+    cout << "wrote scene cache " << m_cacheFile << endl;
+  else
+    cerr << "could not write scene cache " << m_cacheFile << endl;
+}
+
+int Context::task(int jobID, int threadId)
+{
+  /* every thread has its own queue in the tile scheduler. jobID is
+     only valid in the first frame a thread works on, the thread ID
+     is stable */
+  const int queue = threadId % m_threads;
+  int index;
+  while ((index = m_tileScheduler.next(queue)) >= 0)
+    {
+      const LRT::TileScheduler::Job &job = m_tileScheduler.job(index);
+      Timer timer;
+      timer.start();
 
       if (m_geometryMode == MINIRT_POLYGONAL_GEOMETRY)
-	renderTile<StandardTriangleMesh,RAY_PACKET_LAYOUT_TRIANGLE>(m_threadData.frameBuffer,sx,sy,ex,ey);
+	renderTile<StandardTriangleMesh,RAY_PACKET_LAYOUT_TRIANGLE>(m_threadData.frameBuffer,job.x0,job.y0,job.x1,job.y1);
       else if (m_geometryMode == MINIRT_SUBDIVISION_SURFACE_GEOMETRY)
-	renderTile<DirectedEdgeMesh,RAY_PACKET_LAYOUT_SUBDIVISION>(m_threadData.frameBuffer,sx,sy,ex,ey);
+	renderTile<DirectedEdgeMesh,RAY_PACKET_LAYOUT_SUBDIVISION>(m_threadData.frameBuffer,job.x0,job.y0,job.x1,job.y1);
       else
 	FATAL("unknown mesh type");
+
+      m_tileScheduler.done(index,(float)timer.cycles());
     }
 
   return THREAD_RUNNING;
@@ -643,7 +884,7 @@ void Context::renderFrame(Camera *camera,
 
   if (m_threads>1)
     {
-      Context::m_tileCounter.reset();
+      m_tileScheduler.startFrame(resX,resY,TILE_WIDTH,PACKET_WIDTH,m_threads);
       startThreads();
       waitForAllThreads();
     }
@@ -672,35 +913,33 @@ void Context::renderTile(LRT::FrameBuffer *frameBuffer,
   const int SHADOW_RAYS = 0;
   RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> packet;
 
-  _ALIGN(DEFAULT_ALIGNMENT) sse_i rgb32[SIMD_VECTORS_PER_PACKET];
+  _ALIGN(DEFAULT_ALIGNMENT) simd_i rgb32[SIMD_VECTORS_PER_PACKET];
 
   const MESH &mesh = *dynamic_cast<MESH*>(m_mesh);
   const RTMaterial *const mat = m_material.size() ? &*m_material.begin() : NULL;
   RTTextureObject_RGBA_UCHAR **texture = m_texture.size() ?  &*m_texture.begin() : NULL;
 
+  /* with ray streams, the secondary rays of all packets of the tile
+     are generated first and then traced together */
+  SecondaryRayBatch<LAYOUT> *batch = NULL;
+  if (LRT::Shading::Options::mode == LRT::Shading::SECONDARY_RAYS && LRT::Shading::Options::rayStreams)
+    batch = new (aligned_malloc<SecondaryRayBatch<LAYOUT> >(1)) SecondaryRayBatch<LAYOUT>;
 
   for (int y=startY; y+PACKET_WIDTH<=endY; y+=PACKET_WIDTH)
     for (int x=startX; x+PACKET_WIDTH<=endX; x+=PACKET_WIDTH)
       {
 	/* init all rays within packet */
-	const sse_f sx = _mm_set_ps1((float)x);
-	const sse_f sy = _mm_set_ps1((float)y);
-	const sse_f delta = _mm_set_ps1(PACKET_WIDTH-1);
+	const simd_f sx = convert<simd_f>((float)x);
+	const simd_f sy = convert<simd_f>((float)y);
 	FOR_ALL_SIMD_VECTORS_IN_PACKET
 	  {
-	    const sse_f dx = _mm_add_ps(sx,_mm_load_ps(&coordX[i*SIMD_WIDTH]));
-	    const sse_f dy = _mm_add_ps(sy,_mm_load_ps(&coordY[i*SIMD_WIDTH]));
-	    packet.directionX(i) = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,m_threadData.xAxis[0]),
-							 _mm_mul_ps(dy,m_threadData.zAxis[0])),
-					      m_threadData.imagePlaneOrigin[0]);
-	    packet.directionY(i) = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,m_threadData.xAxis[1]),
-							 _mm_mul_ps(dy,m_threadData.zAxis[1])),
-					      m_threadData.imagePlaneOrigin[1]);
-	    packet.directionZ(i) = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,m_threadData.xAxis[2]),
-							 _mm_mul_ps(dy,m_threadData.zAxis[2])),
-					      m_threadData.imagePlaneOrigin[2]);
+	    const simd_f dx = sx + simd_load(&coordX[i*SIMD_WIDTH]);
+	    const simd_f dy = sy + simd_load(&coordY[i*SIMD_WIDTH]);
+	    packet.directionX(i) = (dx * m_threadData.xAxis[0] + dy * m_threadData.zAxis[0]) + m_threadData.imagePlaneOrigin[0];
+	    packet.directionY(i) = (dx * m_threadData.xAxis[1] + dy * m_threadData.zAxis[1]) + m_threadData.imagePlaneOrigin[1];
+	    packet.directionZ(i) = (dx * m_threadData.xAxis[2] + dy * m_threadData.zAxis[2]) + m_threadData.imagePlaneOrigin[2];
 #if defined(NORMALIZE_PRIMARY_RAYS)
-	    const sse_f invLength = rsqrt(packet.directionX(i) * packet.directionX(i) + packet.directionY(i) * packet.directionY(i) + packet.directionZ(i) * packet.directionZ(i));
+	    const simd_f invLength = rsqrt(packet.directionX(i) * packet.directionX(i) + packet.directionY(i) * packet.directionY(i) + packet.directionZ(i) * packet.directionZ(i));
 	    packet.directionX(i) *= invLength;
 	    packet.directionY(i) *= invLength;
 	    packet.directionZ(i) *= invLength;
@@ -711,15 +950,454 @@ void Context::renderTile(LRT::FrameBuffer *frameBuffer,
 	  }
 	packet.computeReciprocalDirectionsAndInitMinMax();
 	packet.reset();
-	TraverseBVH<SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,m_bvh->node,m_bvh->item,mesh);
+	traverse<MESH, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>(packet,mesh);
 
- 	//SHADE(RandomID);
- 	SHADE(EyeLight);
+	if (batch)
+	  {
+	    batchSecondaryRays<MESH, LAYOUT>(*batch,packet,mesh,x,y);
+	    if (batch->packets == RAY_STREAM_PACKETS)
+	      flushSecondaryRays<MESH, LAYOUT>(*batch,mesh,frameBuffer);
+	    continue;
+	  }
 
-	frameBuffer->writeBlock(x,y,PACKET_WIDTH,PACKET_WIDTH,rgb32);
+	if (LRT::Shading::Options::mode == LRT::Shading::SECONDARY_RAYS)
+	  shadeSecondaryRays<MESH, LAYOUT>(packet,mesh,rgb32);
+	else
+	  {
+	    //SHADE(RandomID);
+	    SHADE(EyeLight);
+	  }
+
+	frameBuffer->writeBlock(x,y,PACKET_WIDTH,PACKET_WIDTH,(sse_i*)rgb32);
       }
+
+  if (batch)
+    {
+      if (batch->packets)
+	flushSecondaryRays<MESH, LAYOUT>(*batch,mesh,frameBuffer);
+      batch->~SecondaryRayBatch<LAYOUT>();
+      free_align(batch);
+    }
 }
 
+template <class MESH, const int LAYOUT, const int MULTIPLE_ORIGINS, const int SHADOW_RAYS>
+void Context::traverse(RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
+		       const MESH &mesh)
+{
+  if (m_qbvh8)
+    TraverseWideBVH<8, SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,&*m_qbvh8->node.begin(),m_bvh->item,mesh);
+  else if (m_qbvh4)
+    TraverseWideBVH<4, SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,&*m_qbvh4->node.begin(),m_bvh->item,mesh);
+  else if (m_bvh8)
+    TraverseWideBVH<8, SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,&*m_bvh8->node.begin(),m_bvh->item,mesh);
+  else if (m_bvh4)
+    TraverseWideBVH<4, SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,&*m_bvh4->node.begin(),m_bvh->item,mesh);
+  else
+    TraverseBVH<SIMD_VECTORS_PER_PACKET, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, MESH>(packet,m_bvh->node,m_bvh->item,mesh);
+}
+
+/* -- secondary rays: a shadow ray to each point light, one reflection
+   bounce, and aoRays ambient occlusion rays per hit. all of them start
+   at the hit points, i.e. have multiple origins. rays of pixels without
+   a primary hit are disabled, but get finite origins and directions so
+   they do not disturb the packet's bounds -- */
+
+static const simd_f shadeBackground   = convert<simd_f>(0.2f);
+static const simd_f shadeAmbient      = convert<simd_f>(0.3f);
+static const simd_f shadeDiffuse      = convert<simd_f>(0.6f);
+static const simd_f shadeReflectivity = convert<simd_f>(0.2f);
+
+/*! what secondary ray shading needs of the hits of a primary packet */
+struct SecondaryHits {
+  simd_f hit[3][SIMD_VECTORS_PER_PACKET];       // moved off the surface
+  simd_f normal[3][SIMD_VECTORS_PER_PACKET];    // facing the incoming ray
+  simd_f tangent[3][SIMD_VECTORS_PER_PACKET];   // frame of the AO rays
+  simd_f bitangent[3][SIMD_VECTORS_PER_PACKET];
+  simd_mask missed[SIMD_VECTORS_PER_PACKET];
+  int anyHit;
+};
+
+template <class MESH, const int LAYOUT>
+_INLINE void initSecondaryHits(RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+			       const MESH &mesh,
+			       const float offset,
+			       SecondaryHits &hits)
+{
+  const int N = SIMD_VECTORS_PER_PACKET;
+  const simd_f zero = convert<simd_f>(0.0f);
+  const simd_f one  = convert<simd_f>(1.0f);
+  const simd_f eps  = convert<simd_f>(offset);
+  const simd_i noHit = convert<simd_i>(0);
+
+  hits.anyHit = 0;
+  RTVec_t<3, simd_f> n;
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      hits.missed[i] = cmpgt(noHit,packet.id(i));
+      hits.anyHit |= RT_SIMD_MASK_ALL & ~movemask(hits.missed[i]);
+
+      mesh.template getGeometryNormal<N, LAYOUT, 0, 0, true>(packet,i,n);
+      const simd_f dot = n[0] * packet.directionX(i) + n[1] * packet.directionY(i) + n[2] * packet.directionZ(i);
+      const simd_mask backFacing = cmplt(zero,dot);
+      const simd_f nx = choose(hits.missed[i],zero,choose(backFacing,zero - n[0],n[0]));
+      const simd_f ny = choose(hits.missed[i],zero,choose(backFacing,zero - n[1],n[1]));
+      const simd_f nz = choose(hits.missed[i],one, choose(backFacing,zero - n[2],n[2]));
+      hits.normal[0][i] = nx;
+      hits.normal[1][i] = ny;
+      hits.normal[2][i] = nz;
+
+      const simd_f t = choose(hits.missed[i],one,packet.maxDistance(i));
+      hits.hit[0][i] = packet.originX() + t * packet.directionX(i) + eps * nx;
+      hits.hit[1][i] = packet.originY() + t * packet.directionY(i) + eps * ny;
+      hits.hit[2][i] = packet.originZ() + t * packet.directionZ(i) + eps * nz;
+
+      const simd_mask useX = cmplt(abs(nz),abs(nx));
+      simd_f tx = choose(useX,zero - ny,zero);
+      simd_f ty = choose(useX,nx,zero - nz);
+      simd_f tz = choose(useX,zero,ny);
+      const simd_f f = rsqrt(tx * tx + ty * ty + tz * tz);
+      tx = tx * f;
+      ty = ty * f;
+      tz = tz * f;
+      hits.tangent[0][i] = tx;
+      hits.tangent[1][i] = ty;
+      hits.tangent[2][i] = tz;
+      hits.bitangent[0][i] = ny * tz - nz * ty;
+      hits.bitangent[1][i] = nz * tx - nx * tz;
+      hits.bitangent[2][i] = nx * ty - ny * tx;
+    }
+}
+
+/*! directions span hit point to light, lambert gets the cosine at the
+  hit point; rays with a zero cosine are disabled */
+template <const int LAYOUT>
+_INLINE void initLightRays(const SecondaryHits &hits,
+			   const RTVec3f &light,
+			   RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 1> &shadow,
+			   simd_f *const lambert)
+{
+  const simd_f zero = convert<simd_f>(0.0f);
+  const simd_f lx = convert<simd_f>(light[0]);
+  const simd_f ly = convert<simd_f>(light[1]);
+  const simd_f lz = convert<simd_f>(light[2]);
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      shadow.originX(i) = hits.hit[0][i];
+      shadow.originY(i) = hits.hit[1][i];
+      shadow.originZ(i) = hits.hit[2][i];
+      shadow.directionX(i) = lx - hits.hit[0][i];
+      shadow.directionY(i) = ly - hits.hit[1][i];
+      shadow.directionZ(i) = lz - hits.hit[2][i];
+      const simd_f cosine = (hits.normal[0][i] * shadow.directionX(i) + hits.normal[1][i] * shadow.directionY(i) + hits.normal[2][i] * shadow.directionZ(i)) *
+	rsqrt(shadow.directionX(i) * shadow.directionX(i) + shadow.directionY(i) * shadow.directionY(i) + shadow.directionZ(i) * shadow.directionZ(i));
+      lambert[i] = max(cosine,zero);
+    }
+  shadow.computeReciprocalDirectionsAndInitMinMax();
+  shadow.reset();
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    shadow.disable(i,hits.missed[i] | cmple(lambert[i],zero));
+}
+
+/*! k'th of aoRays cosine distributed directions around the normal:
+  stratified in the cosine of the angle to the normal, golden angle
+  steps around it, rotated per pixel */
+template <const int LAYOUT>
+_INLINE void initAORays(const SecondaryHits &hits,
+			const int k,
+			const int aoRays,
+			const float length,
+			RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 1> &shadow)
+{
+  const float u = (k + 0.5f) / aoRays;
+  const float g = k * 0.6180339887f;
+  const float phi = 2.0f * (float)M_PI * (g - floorf(g));
+  const simd_f l = convert<simd_f>(length);
+  const simd_f r = convert<simd_f>(sqrtf(u));
+  const simd_f z = l * convert<simd_f>(sqrtf(1.0f - u));
+  const simd_f cosPhi = convert<simd_f>(cosf(phi));
+  const simd_f sinPhi = convert<simd_f>(sinf(phi));
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      const simd_f cosRot = simd_load(&aoRotationCos[i*SIMD_WIDTH]);
+      const simd_f sinRot = simd_load(&aoRotationSin[i*SIMD_WIDTH]);
+      const simd_f x = l * r * (cosPhi * cosRot - sinPhi * sinRot);
+      const simd_f y = l * r * (sinPhi * cosRot + cosPhi * sinRot);
+      shadow.originX(i) = hits.hit[0][i];
+      shadow.originY(i) = hits.hit[1][i];
+      shadow.originZ(i) = hits.hit[2][i];
+      shadow.directionX(i) = x * hits.tangent[0][i] + y * hits.bitangent[0][i] + z * hits.normal[0][i];
+      shadow.directionY(i) = x * hits.tangent[1][i] + y * hits.bitangent[1][i] + z * hits.normal[1][i];
+      shadow.directionZ(i) = x * hits.tangent[2][i] + y * hits.bitangent[2][i] + z * hits.normal[2][i];
+    }
+  shadow.computeReciprocalDirectionsAndInitMinMax();
+  shadow.reset();
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    shadow.disable(i,hits.missed[i]);
+}
+
+template <const int LAYOUT>
+_INLINE void initReflectionRays(const SecondaryHits &hits,
+				RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+				RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 0> &reflection)
+{
+  const simd_f infinity = convert<simd_f>(numeric_limits<float>::infinity());
+  const simd_f negInfinity = convert<simd_f>(-numeric_limits<float>::infinity());
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      const simd_f dot = hits.normal[0][i] * packet.directionX(i) + hits.normal[1][i] * packet.directionY(i) + hits.normal[2][i] * packet.directionZ(i);
+      const simd_f twoDot = dot + dot;
+      reflection.originX(i) = hits.hit[0][i];
+      reflection.originY(i) = hits.hit[1][i];
+      reflection.originZ(i) = hits.hit[2][i];
+      reflection.directionX(i) = packet.directionX(i) - twoDot * hits.normal[0][i];
+      reflection.directionY(i) = packet.directionY(i) - twoDot * hits.normal[1][i];
+      reflection.directionZ(i) = packet.directionZ(i) - twoDot * hits.normal[2][i];
+    }
+  reflection.computeReciprocalDirectionsAndInitMinMax();
+  reflection.reset();
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    reflection.maxDistance(i) = choose(hits.missed[i],negInfinity,infinity);
+}
+
+/*! adds the reflected hit, lit from its ray, to the light and
+  occlusion term in color */
+template <class MESH, const int LAYOUT>
+_INLINE void shadeReflection(const simd_mask *const missed,
+			     RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 0> &reflection,
+			     const MESH &mesh,
+			     const simd_f *const color,
+			     simd_i *const dest)
+{
+  const int N = SIMD_VECTORS_PER_PACKET;
+  const simd_f one = convert<simd_f>(1.0f);
+  const simd_i noHit = convert<simd_i>(0);
+  RTVec_t<3, simd_f> n;
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      mesh.template getGeometryNormal<N, LAYOUT, 1, 0, true>(reflection,i,n);
+      const simd_f dot = abs(n[0] * reflection.directionX(i) + n[1] * reflection.directionY(i) + n[2] * reflection.directionZ(i));
+      const simd_mask reflectionMissed = cmpgt(noHit,reflection.id(i));
+      const simd_f reflected = choose(reflectionMissed,shadeBackground,shadeBackground + shadeDiffuse * dot);
+      const simd_f c = min(color[i] + shadeReflectivity * reflected,one);
+      const simd_f result = choose(missed[i],shadeBackground,c);
+      dest[i] = convert_pixels_to_RBGAuchars(result,result,result);
+    }
+}
+
+/*! secondary rays of a whole tile, traced as ray streams. the shadow
+  and occlusion rays of all packets go into one stream, the
+  reflection rays into another */
+template <const int LAYOUT>
+struct SecondaryRayBatch {
+  RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 0> reflection[RAY_STREAM_PACKETS];
+  simd_f lit[SHADING_MAX_LIGHTS][RAY_STREAM_PACKETS][SIMD_VECTORS_PER_PACKET];
+  simd_f visible[RAY_STREAM_PACKETS][SIMD_VECTORS_PER_PACKET];
+  simd_mask missed[RAY_STREAM_PACKETS][SIMD_VECTORS_PER_PACKET];
+  int anyHit[RAY_STREAM_PACKETS];
+  int x[RAY_STREAM_PACKETS];
+  int y[RAY_STREAM_PACKETS];
+  int packets;
+
+  /* tag of a shadow ray: kind (light, then AO ray) * RAY_STREAM_RAYS + pixel */
+  RayStream<1> shadow;
+  /* tag of a reflection ray: pixel */
+  RayStream<0> reflected;
+
+  SecondaryRayBatch() : packets(0) {}
+};
+
+template <class MESH, const int LAYOUT>
+void Context::shadeSecondaryRays(RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+				 const MESH &mesh,
+				 simd_i *const dest)
+{
+  _ALIGN(DEFAULT_ALIGNMENT) SecondaryHits hits;
+  initSecondaryHits<MESH, LAYOUT>(packet,mesh,1e-4f * m_sceneDiagonal,hits);
+
+  if (hits.anyHit == 0)
+    {
+      FOR_ALL_SIMD_VECTORS_IN_PACKET
+	dest[i] = convert_pixels_to_RBGAuchars(shadeBackground,shadeBackground,shadeBackground);
+      return;
+    }
+
+  const simd_f zero = convert<simd_f>(0.0f);
+  const simd_f one  = convert<simd_f>(1.0f);
+  _ALIGN(DEFAULT_ALIGNMENT) simd_f color[SIMD_VECTORS_PER_PACKET];
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    color[i] = zero;
+
+  /* shadow and occlusion rays stop traversal as soon as the whole
+     packet is occluded */
+  RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 1> shadow;
+  const int lights = LRT::Shading::Options::lights;
+  _ALIGN(DEFAULT_ALIGNMENT) simd_f lambert[SIMD_VECTORS_PER_PACKET];
+  for (int l=0;l<lights;l++)
+    {
+      initLightRays<LAYOUT>(hits,m_light[l],shadow,lambert);
+      traverse<MESH, LAYOUT, 1, 1>(shadow,mesh);
+      FOR_ALL_SIMD_VECTORS_IN_PACKET
+	color[i] = color[i] + choose(shadow.occluded(i),zero,lambert[i]);
+    }
+  if (lights)
+    {
+      const simd_f scale = shadeDiffuse * convert<simd_f>(1.0f / lights);
+      FOR_ALL_SIMD_VECTORS_IN_PACKET
+	color[i] = color[i] * scale;
+    }
+
+  const int aoRays = LRT::Shading::Options::aoRays;
+  if (aoRays)
+    {
+      _ALIGN(DEFAULT_ALIGNMENT) simd_f visible[SIMD_VECTORS_PER_PACKET];
+      FOR_ALL_SIMD_VECTORS_IN_PACKET
+	visible[i] = zero;
+      for (int k=0;k<aoRays;k++)
+	{
+	  initAORays<LAYOUT>(hits,k,aoRays,LRT::Shading::Options::aoDistance * m_sceneDiagonal,shadow);
+	  traverse<MESH, LAYOUT, 1, 1>(shadow,mesh);
+	  FOR_ALL_SIMD_VECTORS_IN_PACKET
+	    visible[i] = visible[i] + choose(shadow.occluded(i),zero,one);
+	}
+      const simd_f scale = shadeAmbient * convert<simd_f>(1.0f / aoRays);
+      FOR_ALL_SIMD_VECTORS_IN_PACKET
+	color[i] = color[i] + visible[i] * scale;
+    }
+  else
+    FOR_ALL_SIMD_VECTORS_IN_PACKET
+      color[i] = color[i] + shadeAmbient;
+
+  RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 0> reflection;
+  initReflectionRays<LAYOUT>(hits,packet,reflection);
+  traverse<MESH, LAYOUT, 1, 0>(reflection,mesh);
+  shadeReflection<MESH, LAYOUT>(hits.missed,reflection,mesh,color,dest);
+}
+
+/*! generates the secondary rays of a primary packet at pixel x,y and
+  adds them to the batch's streams */
+template <class MESH, const int LAYOUT>
+void Context::batchSecondaryRays(SecondaryRayBatch<LAYOUT> &batch,
+				 RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 0, 0> &packet,
+				 const MESH &mesh,
+				 const int x,const int y)
+{
+  const int slot = batch.packets++;
+  batch.x[slot] = x;
+  batch.y[slot] = y;
+
+  _ALIGN(DEFAULT_ALIGNMENT) SecondaryHits hits;
+  initSecondaryHits<MESH, LAYOUT>(packet,mesh,1e-4f * m_sceneDiagonal,hits);
+  batch.anyHit[slot] = hits.anyHit;
+  if (hits.anyHit == 0) return;
+
+  FOR_ALL_SIMD_VECTORS_IN_PACKET
+    {
+      batch.missed[slot][i] = hits.missed[i];
+      batch.visible[slot][i] = convert<simd_f>(0.0f);
+    }
+
+  RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 1> shadow;
+  const int pixel = slot * RAYS_PER_PACKET;
+  const int lights = LRT::Shading::Options::lights;
+  for (int l=0;l<lights;l++)
+    {
+      initLightRays<LAYOUT>(hits,m_light[l],shadow,batch.lit[l][slot]);
+      batch.shadow.append(shadow,l * RAY_STREAM_RAYS + pixel);
+    }
+  const int aoRays = LRT::Shading::Options::aoRays;
+  for (int k=0;k<aoRays;k++)
+    {
+      initAORays<LAYOUT>(hits,k,aoRays,LRT::Shading::Options::aoDistance * m_sceneDiagonal,shadow);
+      batch.shadow.append(shadow,(lights + k) * RAY_STREAM_RAYS + pixel);
+    }
+
+  initReflectionRays<LAYOUT>(hits,packet,batch.reflection[slot]);
+  batch.reflected.append(batch.reflection[slot],pixel);
+}
+
+/*! traces the streams of a batch, shades all of its packets and
+  writes them to the frame buffer */
+template <class MESH, const int LAYOUT>
+void Context::flushSecondaryRays(SecondaryRayBatch<LAYOUT> &batch,
+				 const MESH &mesh,
+				 LRT::FrameBuffer *frameBuffer)
+{
+  const bool sortOctants = LRT::Shading::Options::sortOctants;
+  const int lights = LRT::Shading::Options::lights;
+  const int aoRays = LRT::Shading::Options::aoRays;
+
+  /* shadow and occlusion rays */
+  TraverseRayStream<1, MESH>(batch.shadow,m_bvh->node,m_bvh->item,mesh,sortOctants);
+  for (int r=0;r<batch.shadow.size();r++)
+    {
+      const int tag = batch.shadow.tag(r);
+      const int kind = tag / RAY_STREAM_RAYS;
+      const int slot = (tag % RAY_STREAM_RAYS) / RAYS_PER_PACKET;
+      const int k = tag % RAYS_PER_PACKET;
+      if (kind < lights)
+	{
+	  if (batch.shadow.occluded(r))
+	    CAST_FLOAT(batch.lit[kind][slot],k) = 0.0f;
+	}
+      else if (!batch.shadow.occluded(r))
+	CAST_FLOAT(batch.visible[slot],k) += 1.0f;
+    }
+
+  /* reflection rays, the hits go back to the reflection packets */
+  TraverseRayStream<0, MESH>(batch.reflected,m_bvh->node,m_bvh->item,mesh,sortOctants);
+  for (int r=0;r<batch.reflected.size();r++)
+    {
+      const int tag = batch.reflected.tag(r);
+      RayPacket<SIMD_VECTORS_PER_PACKET, LAYOUT, 1, 0> &reflection = batch.reflection[tag / RAYS_PER_PACKET];
+      const int k = tag % RAYS_PER_PACKET;
+      reflection.floatMaxDistance(k) = batch.reflected.maxDistance(r);
+      reflection.floatU(k) = batch.reflected.u(r);
+      reflection.floatV(k) = batch.reflected.v(r);
+      reflection.intId(k) = batch.reflected.id(r);
+      reflection.intShaderID(k) = batch.reflected.shaderID(r);
+    }
+
+  _ALIGN(DEFAULT_ALIGNMENT) simd_i rgb32[SIMD_VECTORS_PER_PACKET];
+  _ALIGN(DEFAULT_ALIGNMENT) simd_f color[SIMD_VECTORS_PER_PACKET];
+  for (int slot=0;slot<batch.packets;slot++)
+    {
+      if (batch.anyHit[slot] == 0)
+	{
+	  FOR_ALL_SIMD_VECTORS_IN_PACKET
+	    rgb32[i] = convert_pixels_to_RBGAuchars(shadeBackground,shadeBackground,shadeBackground);
+	}
+      else
+	{
+	  /* same order of operations as shadeSecondaryRays() */
+	  FOR_ALL_SIMD_VECTORS_IN_PACKET
+	    color[i] = convert<simd_f>(0.0f);
+	  for (int l=0;l<lights;l++)
+	    FOR_ALL_SIMD_VECTORS_IN_PACKET
+	      color[i] = color[i] + batch.lit[l][slot][i];
+	  if (lights)
+	    {
+	      const simd_f scale = shadeDiffuse * convert<simd_f>(1.0f / lights);
+	      FOR_ALL_SIMD_VECTORS_IN_PACKET
+		color[i] = color[i] * scale;
+	    }
+	  if (aoRays)
+	    {
+	      const simd_f scale = shadeAmbient * convert<simd_f>(1.0f / aoRays);
+	      FOR_ALL_SIMD_VECTORS_IN_PACKET
+		color[i] = color[i] + batch.visible[slot][i] * scale;
+	    }
+	  else
+	    FOR_ALL_SIMD_VECTORS_IN_PACKET
+	      color[i] = color[i] + shadeAmbient;
+	  shadeReflection<MESH, LAYOUT>(batch.missed[slot],batch.reflection[slot],mesh,color,rgb32);
+	}
+      frameBuffer->writeBlock(batch.x[slot],batch.y[slot],PACKET_WIDTH,PACKET_WIDTH,(sse_i*)rgb32);
+    }
+
+  batch.packets = 0;
+  batch.shadow.clear();
+  batch.reflected.clear();
+}
 
 
 LRTContext lrtCreateContext()
@@ -812,41 +1490,49 @@ LRTvoid lrtBuildContext(LRTContext _context)
   //make sure lrtBuildContext hasn't been called yet
   assert(!initialized);
 
-  World *w = World::getDefaultWorld();
-  assert(w);
-
-  // OK, assume we know we have only one object right now ..... aaaargh
-  assert(w->rootNode.size() == 1);
-  RootNode *root = w->rootNode[0];
-
-  // OK, let's further assume there's only one node in that tree, and that it's a mesh ..... uhhhh, how ugly .....
-  cout << "num nodes in scene graph " << root->getNumChildren() << endl;
-  assert(root->getNumChildren() == 1);
-  ISG::BaseMesh *mesh = dynamic_cast<ISG::BaseMesh *>(root->getChild(0));
-  assert(mesh);
-
-  // And since we do such ugly things, anyway, let's assume our
-  // mesh has vertices of type RT_FLOAT3, everything else is not
-  // implemented, yet ...
-  DataArray *vertexArray = mesh->coord;
-  assert(vertexArray);
-  assert(vertexArray->m_ptr != NULL);
-  assert(vertexArray->type == RT_COORDS);
-  if (vertexArray->format != RT_FLOAT3)
-    FATAL("Only support a single mesh with RT_FLOAT3 vertices right now .... ");
-  cout << "adding " << vertexArray->units << " vertices" << endl;
-  context->addVertices((vec3f*)vertexArray->m_ptr,NULL,vertexArray->units);
-
-  // Finally, do the same with the triangle array .. .assume it's there, and it's vec3i's ...
-  DataArray *triangleArray = mesh->index;
-  assert(triangleArray);
-  assert(triangleArray->m_ptr != NULL);
-  assert(triangleArray->type == RT_INDICES);
-  if (triangleArray->format != RT_INT3)
-    FATAL("Only support a single mesh with RT_INT3 indices right now .... ");
-
-  cout << "adding " << triangleArray->units << " triangles" << endl;
-  context->addTriangleMesh((vec3i*)triangleArray->m_ptr,triangleArray->units,NULL);
+  DataArray *vertexArray = NULL;
+  DataArray *triangleArray = NULL;
+
+  if (context->sceneFromCache())
+    cout << "geometry from scene cache" << endl;
+  else
+    {
+      World *w = World::getDefaultWorld();
+      assert(w);
+
+      // OK, assume we know we have only one object right now ..... aaaargh
+      assert(w->rootNode.size() == 1);
+      RootNode *root = w->rootNode[0];
+
+      // OK, let's further assume there's only one node in that tree, and that it's a mesh ..... uhhhh, how ugly .....
+      cout << "num nodes in scene graph " << root->getNumChildren() << endl;
+      assert(root->getNumChildren() == 1);
+      ISG::BaseMesh *mesh = dynamic_cast<ISG::BaseMesh *>(root->getChild(0));
+      assert(mesh);
+
+      // And since we do such ugly things, anyway, let's assume our
+      // mesh has vertices of type RT_FLOAT3, everything else is not
+      // implemented, yet ...
+      vertexArray = mesh->coord;
+      assert(vertexArray);
+      assert(vertexArray->m_ptr != NULL);
+      assert(vertexArray->type == RT_COORDS);
+      if (vertexArray->format != RT_FLOAT3)
+        FATAL("Only support a single mesh with RT_FLOAT3 vertices right now .... ");
+      cout << "adding " << vertexArray->units << " vertices" << endl;
+      context->addVertices((vec3f*)vertexArray->m_ptr,NULL,vertexArray->units);
+
+      // Finally, do the same with the triangle array .. .assume it's there, and it's vec3i's ...
+      triangleArray = mesh->index;
+      assert(triangleArray);
+      assert(triangleArray->m_ptr != NULL);
+      assert(triangleArray->type == RT_INDICES);
+      if (triangleArray->format != RT_INT3)
+        FATAL("Only support a single mesh with RT_INT3 indices right now .... ");
+
+      cout << "adding " << triangleArray->units << " triangles" << endl;
+      context->addTriangleMesh((vec3i*)triangleArray->m_ptr,triangleArray->units,NULL);
+    }
 
   cout << "finalizing geometry" << endl;
   context->finalize();
@@ -854,12 +1540,65 @@ LRTvoid lrtBuildContext(LRTContext _context)
   context->buildSpatialIndexStructure();
   cout << "done" << endl;
 
+  if (!context->sceneFromCache())
+    context->writeSceneCache((vec3f*)vertexArray->m_ptr,vertexArray->units,(vec3i*)triangleArray->m_ptr,triangleArray->units);
+
   RTBoxSSE sceneAABB = context->getSceneAABB();
   PRINT(sceneAABB);
 
   initialized = true;
 }
 
+LRTint lrtLoadSceneCache(LRTContext _context,
+                         const char *cacheFile,
+                         LRTuint sourceFiles,
+                         const char *const *sourceFile)
+{
+  Context *context = (Context*)_context;
+  assert(cacheFile);
+  assert(!initialized);
+
+  /* a BVH built by a different builder would still be valid, but
+     the user asked for a different one */
+  unsigned long long key = BVHCache::hashString(BVHBuilder::Options::defaultBuilder,BVH_CACHE_HASH_SEED);
+  for (unsigned int i=0;i<sourceFiles;i++)
+    key = BVHCache::hashFile(sourceFile[i],key);
+
+  const bool valid = context->loadSceneCache(cacheFile,key);
+  cout << (valid ? "using" : "no valid") << " scene cache " << cacheFile << endl;
+  return valid;
+}
+
+LRTvoid lrtGetSceneBounds(LRTContext _context, RTfloat *lower, RTfloat *upper)
+{
+  Context *context = (Context*)_context;
+  assert(context->sceneFromCache());
+  const BVHCache::Header &header = context->sceneCache().header();
+  for (int i=0;i<3;i++)
+    {
+      lower[i] = header.lower[i];
+      upper[i] = header.upper[i];
+    }
+}
+
+LRTvoid lrtUpdateVertices(LRTContext _context,
+                          const RTfloat *vertex,
+                          LRTuint first,
+                          LRTuint vertices)
+{
+  Context *context = (Context*)_context;
+  assert(initialized);
+  assert(vertex);
+  context->updateVertices((const RTVec3f*)vertex,first,vertices);
+}
+
+LRTint lrtRefitContext(LRTContext _context)
+{
+  Context *context = (Context*)_context;
+  assert(initialized);
+  return context->refitSpatialIndexStructure();
+}
+
 
 LRTvoid lrtRenderFrame(LRTFrameBufferHandle _fb,
                        LRTContext _context,
@@ -4,6 +4,7 @@
 #include "RTTL/common/RTInclude.hxx"
 #include "RTTL/common/RTVec.hxx"
 #include "RTTL/common/RTShader.hxx"
+#include "RTTL/common/RTThread.hxx"
 #include "ImagePPM.hxx"
 #include <map>
 #include <set>
@@ -11,13 +12,22 @@
 #include <vector>
 #include <fstream>
 #include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
 #define NOT_SUPPORTED(x) cout << x << " currently not supported" << endl
 
+/* files smaller than this are parsed on a single thread */
+#define PARSE_MIN_CHUNK_SIZE (1<<20)
 
-class ObjParser {
+/*! parses the file in parallel: the file is mmap'ed and split on line
+  boundaries, every thread parses one chunk into its own arrays, the
+  chunks are then merged in file order */
+class ObjParser : public MultiThreadedTaskQueue {
 private:
   RTBox3f sceneAABB;
   std::vector<RTVec3f> vertex;
@@ -30,6 +40,7 @@ private:
   std::vector<RTVec3f> tmpNor;       
   std::vector<RTVec2f> tmpTxt;
   map<pair<int, pair<int,int> >,int> vertexMap;
+  std::vector<int> vertexRemap; // vertices without normal and texture coordinate
 
   /* ---------------------------- */
 
@@ -138,16 +149,368 @@ private:
 
   _INLINE int getVertexID(int vtxID,int norID, int txtID)
   {
+    if (norID < 0 && txtID < 0)
+      {
+        /* the common case, no need for the map */
+        if (vtxID >= (int)vertexRemap.size()) vertexRemap.resize(tmpVtx.size(),-1);
+        if (vertexRemap[vtxID] < 0)
+          {
+            vertexRemap[vtxID] = vertex.size();
+            vertex.push_back(tmpVtx[vtxID]);
+            normal.push_back(RTVec3f(0.0f,0.0f,0.0f));
+            textureCoord.push_back(RTVec2f(0.0f,0.0f));
+          }
+        return vertexRemap[vtxID];
+      }
+
     pair<int, pair < int, int > > v(vtxID, pair<int, int>(txtID, norID));
-    if (vertexMap.find(v) == vertexMap.end())
+    map<pair<int, pair<int,int> >,int>::iterator it = vertexMap.find(v);
+    if (it == vertexMap.end())
       {
-        vertexMap[v] = vertex.size();
+        it = vertexMap.insert(make_pair(v,(int)vertex.size())).first;
         vertex.push_back(tmpVtx[vtxID]);
         if (norID >= 0) normal.push_back(tmpNor[norID]); else normal.push_back(RTVec3f(0.0f,0.0f,0.0f));
         if (txtID >= 0) textureCoord.push_back(tmpTxt[txtID]); else textureCoord.push_back(RTVec2f(0.0f,0.0f));
       }
-    return vertexMap[v];
+    return it->second;
+  }
+
+  /* ---------------------------- */
+  /* -- parallel parsing       -- */
+  /* ---------------------------- */
+
+  enum { NO_INDEX = -1 };
+
+  /*! face as read from the file, 0-based indices. v[3] == NO_INDEX
+    for triangles. negative (relative) indices in the file are stored
+    relative to the start of the chunk and listed in
+    Chunk::relative, merge() adds the chunk's offset */
+  struct Face {
+    int v[4];
+    int t[4];
+    int n[4];
+  };
+
+  /*! mtllib or usemtl statement, applied before face 'face' of its chunk */
+  struct Statement {
+    int face;
+    bool library;
+    string name;
+  };
+
+  struct Chunk {
+    const char *begin;
+    const char *end;
+    std::vector<RTVec3f> vtx;
+    std::vector<RTVec3f> nor;
+    std::vector<RTVec2f> txt;
+    std::vector<Face> face;
+    std::vector<int> relative; // face*12 + slot of relative indices
+    std::vector<Statement> statement;
+    RTBox3f aabb;
+    const char *error;         // start of the first line that could not be parsed
+
+    Chunk() : begin(NULL), end(NULL), error(NULL) { aabb.reset(); }
+  };
+
+  std::vector<Chunk> chunk;
+  AtomicCounter nextChunk;
+
+  static _INLINE bool isBlank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+  static _INLINE bool isSpace(const char c) { return isBlank(c) || c == '\n'; }
+
+  static _INLINE const char *skipBlanks(const char *p, const char *const end)
+  {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+  }
+
+  static _INLINE const char *nextLine(const char *p, const char *const end)
+  {
+    while (p < end && *p != '\n') p++;
+    return p < end ? p+1 : end;
+  }
+
+  static _INLINE const char *parseWord(const char *p, const char *const end, string &word)
+  {
+    p = skipBlanks(p,end);
+    const char *const begin = p;
+    while (p < end && !isSpace(*p)) p++;
+    word.assign(begin,p);
+    return p;
+  }
+
+  /*! returns NULL if there is no integer at p */
+  static _INLINE const char *parseInt(const char *p, const char *const end, int &i)
+  {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end || *p < '0' || *p > '9') return NULL;
+    int v = 0;
+    for (;p < end && *p >= '0' && *p <= '9';p++)
+      v = 10*v + (*p - '0');
+    i = negative ? -v : v;
+    return p;
+  }
+
+  /*! returns NULL if there is no number at p. numbers with up to 15
+    significant digits and a decimal exponent of at most 22 -- i.e.,
+    everything the usual exporters write -- have a mantissa and power
+    of ten that are exact in double; they are rounded to double and
+    then to float, which can be one ulp off strtof for values close to
+    halfway between two floats. anything else goes through strtof */
+  static _INLINE const char *parseFloat(const char *p, const char *const end, float &f)
+  {
+    static const double pow10[23] = {
+      1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+      1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+    };
+    p = skipBlanks(p,end);
+    const char *const begin = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (;p < end && *p >= '0' && *p <= '9';p++, any = true)
+      if (mantissa || *p != '0')
+        {
+          if (digits < 19) { mantissa = 10*mantissa + (*p - '0'); digits++; }
+          else exponent++;
+        }
+    if (p < end && *p == '.')
+      {
+        for (p++;p < end && *p >= '0' && *p <= '9';p++, any = true)
+          {
+            if (mantissa || *p != '0')
+              {
+                if (digits < 19) { mantissa = 10*mantissa + (*p - '0'); digits++; exponent--; }
+              }
+            else
+              exponent--;
+          }
+      }
+    if (any && p < end && (*p == 'e' || *p == 'E'))
+      {
+        int e;
+        const char *q = parseInt(p+1,end,e);
+        if (q) { exponent += e; p = q; }
+      }
+    if (any && digits <= 15 && exponent >= -22 && exponent <= 22)
+      {
+        double d = (double)mantissa;
+        d = exponent < 0 ? d / pow10[-exponent] : d * pow10[exponent];
+        f = (float)(negative ? -d : d);
+        return p;
+      }
+
+    /* slow path: long mantissas, huge exponents, inf and nan */
+    char buffer[64];
+    const char *q = begin;
+    int len = 0;
+    while (q < end && !isSpace(*q) && len < 63) buffer[len++] = *q++;
+    buffer[len] = 0;
+    char *last;
+    f = strtof(buffer,&last);
+    if (last == buffer) return NULL;
+    return begin + (last - buffer);
+  }
+
+  /*! 0-based index of a vertex, texture coordinate or normal of
+    'face' in its chunk; relative indices are resolved later */
+  static _INLINE int chunkIndex(Chunk &c, const int i, const int count, const int slot)
+  {
+    if (i > 0) return i-1;
+    if (i == 0) return 0;
+    c.relative.push_back(12*c.face.size() + slot);
+    return count + i;
+  }
+
+  /*! v, v/vt, v//vn or v/vt/vn */
+  static _INLINE const char *parseFaceVertex(const char *p, const char *const end, Chunk &c, Face &face, const int k)
+  {
+    int v, t = 0, n = 0;
+    p = parseInt(skipBlanks(p,end),end,v);
+    if (!p) return NULL;
+    if (p < end && *p == '/')
+      {
+        const char *q;
+        if (p+1 < end && p[1] == '/')
+          {
+            if ((q = parseInt(p+2,end,n))) p = q;
+          }
+        else if ((q = parseInt(p+1,end,t)))
+          {
+            p = q;
+            if (p < end && *p == '/' && (q = parseInt(p+1,end,n))) p = q;
+          }
+      }
+    while (p < end && !isSpace(*p)) p++;
+    face.v[k] = chunkIndex(c,v,c.vtx.size(),k);
+    face.t[k] = t ? chunkIndex(c,t,c.txt.size(),4+k) : (int)NO_INDEX;
+    face.n[k] = n ? chunkIndex(c,n,c.nor.size(),8+k) : (int)NO_INDEX;
+    return p;
+  }
 
+  static void parseChunk(Chunk &c)
+  {
+    const char *p = c.begin;
+    const char *const end = c.end;
+    while (p < end)
+      {
+        const char *const line = p;
+        p = skipBlanks(p,end);
+        const char *const key = p;
+        while (p < end && !isSpace(*p)) p++;
+        const int len = p - key;
+
+        if (len == 1 && key[0] == 'v')
+          {
+            RTVec3f v;
+            if (!(p = parseFloat(p,end,v[0])) ||
+                !(p = parseFloat(p,end,v[1])) ||
+                !(p = parseFloat(p,end,v[2])))
+              {
+                c.error = line;
+                return;
+              }
+            c.aabb.extend(v);
+            c.vtx.push_back(v);
+          }
+        else if (len == 2 && key[0] == 'v' && key[1] == 't')
+          {
+            RTVec2f t;
+            if (!(p = parseFloat(p,end,t[0])) ||
+                !(p = parseFloat(p,end,t[1])))
+              {
+                c.error = line;
+                return;
+              }
+            c.txt.push_back(t);
+          }
+        else if (len == 2 && key[0] == 'v' && key[1] == 'n')
+          {
+            RTVec3f n;
+            if (!(p = parseFloat(p,end,n[0])) ||
+                !(p = parseFloat(p,end,n[1])) ||
+                !(p = parseFloat(p,end,n[2])))
+              {
+                c.error = line;
+                return;
+              }
+            c.nor.push_back(n);
+          }
+        else if ((len == 1 && key[0] == 'f') || (len == 2 && key[0] == 'f' && key[1] == 'o'))
+          {
+            Face face;
+            for (int k=0;k<4;k++)
+              face.v[k] = face.t[k] = face.n[k] = NO_INDEX;
+            const int relative = c.relative.size();
+            int k = 0;
+            for (const char *q;k < 4 && (q = parseFaceVertex(p,end,c,face,k));k++)
+              p = q;
+            if (k < 3)
+              {
+                c.relative.resize(relative);
+                c.error = line;
+                return;
+              }
+            /* polygons with more than four vertices: the rest is ignored */
+            c.face.push_back(face);
+          }
+        else if (len == 6 && (strncmp(key,"usemtl",6) == 0 || strncmp(key,"mtllib",6) == 0))
+          {
+            Statement statement;
+            statement.face = c.face.size();
+            statement.library = key[0] == 'm';
+            p = parseWord(p,end,statement.name);
+            c.statement.push_back(statement);
+          }
+        /* comments, groups and everything else we do not support */
+        p = nextLine(p,end);
+      }
+  }
+
+  void addFace(const Face &f, const int shaderId)
+  {
+    const bool isQuad = f.v[3] != NO_INDEX;
+    const int corners = isQuad ? 4 : 3;
+    for (int k=0;k<corners;k++)
+      if (f.v[k] < 0 || f.v[k] >= (int)tmpVtx.size() ||
+          f.t[k] < NO_INDEX || f.t[k] >= (int)tmpTxt.size() ||
+          f.n[k] < NO_INDEX || f.n[k] >= (int)tmpNor.size())
+        {
+          printf("Invalid face %i: (%i,%i,%i,%i) %i %i %i\n",
+                 int(triangle.size() + quad.size()),
+                 f.v[0],f.v[1],f.v[2],f.v[3],
+                 int(tmpVtx.size()),
+                 int(tmpTxt.size()),
+                 int(tmpNor.size()));
+          exit(-1);
+        }
+
+    if (isQuad)
+      {
+        const int newA = getVertexID(f.v[0],f.n[0],f.t[0]);
+        const int newB = getVertexID(f.v[1],f.n[1],f.t[1]);
+        const int newC = getVertexID(f.v[2],f.n[2],f.t[2]);
+        const int newD = getVertexID(f.v[3],f.n[3],f.t[3]);
+        quad.push_back(RTVec4i(newA,newB,newC,newD));
+        quadShaderId.push_back(shaderId);
+      }
+    else
+      {
+        const int newA = getVertexID(f.v[0],f.n[0],f.t[0]);
+        const int newB = getVertexID(f.v[1],f.n[1],f.t[1]);
+        const int newC = getVertexID(f.v[2],f.n[2],f.t[2]);
+        triangle.push_back(RTVec3i(newA,newB,newC));
+        triangleShaderId.push_back(shaderId);
+      }
+  }
+
+  /*! append the chunks' data in file order */
+  void merge(const string &base, const char *const data)
+  {
+    size_t vertices = tmpVtx.size(), faces = 0;
+    for (unsigned int i=0;i<chunk.size();i++)
+      {
+        if (chunk[i].error)
+          {
+            printf("Parsing error in line %i\n", 1 + (int)count(data, chunk[i].error, '\n'));
+            exit(-1);
+          }
+        vertices += chunk[i].vtx.size();
+        faces += chunk[i].face.size();
+      }
+    tmpVtx.reserve(vertices);
+    triangle.reserve(triangle.size() + faces);
+    triangleShaderId.reserve(triangleShaderId.size() + faces);
+
+    int shaderId = 0;
+    for (unsigned int i=0;i<chunk.size();i++)
+      {
+        Chunk &c = chunk[i];
+        const int offset[3] = { (int)tmpVtx.size(), (int)tmpTxt.size(), (int)tmpNor.size() };
+        tmpVtx.insert(tmpVtx.end(),c.vtx.begin(),c.vtx.end());
+        tmpTxt.insert(tmpTxt.end(),c.txt.begin(),c.txt.end());
+        tmpNor.insert(tmpNor.end(),c.nor.begin(),c.nor.end());
+        sceneAABB.extend(c.aabb);
+
+        for (unsigned int r=0;r<c.relative.size();r++)
+          ((int*)&c.face[c.relative[r] / 12])[c.relative[r] % 12] += offset[(c.relative[r] % 12) / 4];
+
+        unsigned int s = 0;
+        for (unsigned int f=0;f<=c.face.size();f++)
+          {
+            for (;s < c.statement.size() && c.statement[s].face == (int)f;s++)
+              if (c.statement[s].library)
+                ParseMTL(base,c.statement[s].name);
+              else
+                shaderId = material_map[c.statement[s].name];
+            if (f < c.face.size())
+              addFace(c.face[f],shaderId);
+          }
+      }
   }
 
 public:
@@ -175,9 +538,12 @@ public:
   // might replace this with a more general texture interface (not restricted to PPM)
   _INLINE ImagePPM *getTexture(const int i) { return texture[i]; }
 
-  ObjParser()
+  /*! threads > 1 parses files larger than PARSE_MIN_CHUNK_SIZE in parallel */
+  ObjParser(const int threads = 1) : MultiThreadedTaskQueue()
   {
     sceneAABB.reset();
+    if (threads > 1)
+      createThreads(threads);
   }
 
   _INLINE void Free()
@@ -186,6 +552,7 @@ public:
     tmpNor.clear();
     tmpTxt.clear();
     vertexMap.clear();
+    vertexRemap.clear();
     vertex.clear();
     triangle.clear();
     normal.clear();
@@ -200,10 +567,7 @@ public:
 
   void Parse(string fileName)
   {
-
-    fstream mFile;
     const char* fn = fileName.c_str();
-    mFile.open(fn, ios_base::in);
 
     /* extrace base directory */
     int p = -1;
@@ -223,243 +587,62 @@ public:
         base = ".";
       }
 
-    if(!mFile.is_open())
+    const int fd = open(fn, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
       {
         cout << "Error: cannot open " << fileName << " for reading!" << endl;
         perror("Error code");
         exit(-1);
       }
-
-    int shaderId = 0;
-
-    int count = 0;
-    while(!mFile.eof())
+    const size_t size = st.st_size;
+    const char *const data = size ? (const char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == (const char*)MAP_FAILED)
       {
-        count++;
-        string s;
-        mFile >> s;
-
-        if (s[0] == '#'){
-          continue;
-        }
-        else if (s == "mtllib")
-          {
-            string mtllib;
-            mFile >> mtllib;
-            ParseMTL(base,mtllib);
-          }
-        else if (s == "g")
-          {
-            string temp;
-            mFile >> temp;
-          }
-        else if (s == "usemtl")
-          {
-            string material;
-            mFile >> material;
-            shaderId = material_map[material];
-            //cout << "using material " << material << " -> active shaderId " << shaderId << endl;
-          }
-        else if (s == "v")
-          {
-            RTVec3f v;
-            mFile >> v[0];
-            mFile >> v[1];
-            mFile >> v[2];
-            sceneAABB.extend(v);
-            tmpVtx.push_back(v);
-          }
-        else if (s == "vt")
-          {
-            RTVec2f c;
-            mFile >> c[0];
-            mFile >> c[1];
-            tmpTxt.push_back(c);
-          }
-        else if (s == "vn")
-          {
-            RTVec3f n;
-            mFile >> n[0];
-            mFile >> n[1];
-            mFile >> n[2];
-            tmpNor.push_back(n);
-          }
-        else if (s == "f" || s == "fo")
-          {
-            string dash;
-            int ta = -1,tta=0,tna=0;
-            int tb = -1,ttb=0,tnb=0;
-            int tc = -1,ttc=0,tnc=0;
-            int td = -1,ttd=0,tnd=0;
-
-            mFile >> dash;
-
-            if (sscanf(dash.c_str(),"%d/%d/%d", &ta ,&tta, &tna) != 3 &&
-                sscanf(dash.c_str(),"%d/%d", &ta ,&tta) != 2 &&
-                sscanf(dash.c_str(),"%d//%d", &ta ,&tna) != 2 &&
-                sscanf(dash.c_str(),"%d", &ta) != 1
-                )
-              {
-                printf("Parsing error v0: %i\n",count);
-                exit(-1);
-              }
-
-            mFile >> dash;
-
-            if (sscanf(dash.c_str(),"%d/%d/%d", &tb, &ttb, &tnb) != 3 &&
-                sscanf(dash.c_str(),"%d/%d", &tb ,&ttb) != 2 &&
-                sscanf(dash.c_str(),"%d//%d", &tb ,&tnb) != 2 &&
-                sscanf(dash.c_str(),"%d", &tb) != 1
-                )
-              {
-                printf("Parsing error v1: %i\n",count);
-                exit(-1);
-              };
-
-            mFile >> dash;
-
-            if (sscanf(dash.c_str(),"%d/%d/%d", &tc, &ttc, &tnc) != 3 &&
-                sscanf(dash.c_str(),"%d/%d", &tc ,&ttc) != 2 &&
-                sscanf(dash.c_str(),"%d//%d", &tc ,&tnc) != 2 &&
-                sscanf(dash.c_str(),"%d", &tc) != 1
-                )
-              {
-                printf("Parsing error v2: %i\n",count);
-                exit(-1);
-              };
-
-
-            bool isQuad = true;
-
-            char c;
-            while (mFile.peek() == ' ') mFile.get(c);
-
-            if (mFile.peek() == 0x0D || mFile.peek() == 0x0A) {
-              while (mFile.peek() == 0x0D || mFile.peek() == 0x0A) mFile.get(c);
-              isQuad = false;
-            }
-            else
-              {
-                mFile >> dash;
-                if (sscanf(dash.c_str(),"%d/%d/%d", &td, &ttd, &tnd) != 3 &&
-                    sscanf(dash.c_str(),"%d/%d", &td ,&ttd) != 2 &&
-                    sscanf(dash.c_str(),"%d//%d", &td ,&tnd) != 2 &&
-                    sscanf(dash.c_str(),"%d", &td) != 1
-                    )
-                  {
-                    isQuad = false;
-                  }
-              }
+        cout << "Error: cannot map " << fileName << endl;
+        perror("Error code");
+        exit(-1);
+      }
 
-            bool has_na = tna != 0;
-            bool has_nb = tnb != 0;
-            bool has_nc = tnc != 0;
-            bool has_nd = tnd != 0;
-
-            bool has_ta = tta != 0;
-            bool has_tb = ttb != 0;
-            bool has_tc = ttc != 0;
-            bool has_td = ttd != 0;
-
-            if (ta > 0) ta--;
-            if (tb > 0) tb--;
-            if (tc > 0) tc--;
-            if (td > 0) td--;
-
-            if (tta > 0) tta--;
-            if (ttb > 0) ttb--;
-            if (ttc > 0) ttc--;
-            if (ttd > 0) ttd--;
-
-            if (tna > 0) tna--;
-            if (tnb > 0) tnb--;
-            if (tnc > 0) tnc--;
-            if (tnd > 0) tnd--;
-
-            if (ta < 0) ta += tmpVtx.size();
-            if (tb < 0) tb += tmpVtx.size();
-            if (tc < 0) tc += tmpVtx.size();
-            if (td < 0) td += tmpVtx.size();
-
-            if (tta < 0) tta += tmpTxt.size();
-            if (ttb < 0) ttb += tmpTxt.size();
-            if (ttc < 0) ttc += tmpTxt.size();
-            if (ttd < 0) ttd += tmpTxt.size();
-
-            if (tna < 0) tna += tmpNor.size();
-            if (tnb < 0) tnb += tmpNor.size();
-            if (tnc < 0) tnc += tmpNor.size();
-            if (tnd < 0) tnc += tmpNor.size();
-
-            /*
-              DBG_PRINT(ta);
-              DBG_PRINT(tb);
-              DBG_PRINT(tc);
-              DBG_PRINT(td);
-              DBG_PRINT(quad);
-            */
-
-            if (ta < 0 || ta >= (int)tmpVtx.size() ||
-                tb < 0 || tb >= (int)tmpVtx.size() ||
-                tc < 0 || tc >= (int)tmpVtx.size() ||
-                (isQuad && (td < 0 || td >= (int)tmpVtx.size())))
-              /*
-                (tta < 0 || tta >= (int)textureCoord.size()) && has_ta ||
-                (ttb < 0 || ttb >= (int)textureCoord.size()) && has_tb ||
-                (ttc < 0 || ttc >= (int)textureCoord.size()) && has_tc ||
-                (ttd < 0 || ttd >= (int)textureCoord.size()) && has_td ||
-                (tna < 0 || tna >= (int)normal.size()) && has_na ||
-                (tnb < 0 || tnb >= (int)normal.size()) && has_nb ||
-                (tnc < 0 || tnc >= (int)normal.size()) && has_nc ||
-                (tnd < 0 || tnd >= (int)normal.size()) && has_nd
-              */
-              {
-                DBG_PRINT(td);
-                DBG_PRINT(tmpVtx.size());
-                printf("Invalid triangle %i: (%i,%i,%i) (%i,%i,%i) (%i,%i,%i) (%i,%i,%i) (%i,%i,%i) %i %i %i\n",
-                       count,ta,tb,tc,tta,ttb,ttc,tna,tnb,tnc,has_na,has_nb,has_nc,has_ta,has_tb,has_tc,
-                       int(tmpVtx.size()),
-                       int(tmpTxt.size()),
-                       int(tmpNor.size()));
-                exit(-1);
-              }
+    /* split the file on line boundaries, one chunk per thread */
+    const int chunks = (numberOfThreads() > 1 && size > PARSE_MIN_CHUNK_SIZE) ? numberOfThreads() : 1;
+    chunk.assign(chunks, Chunk());
+    const char *begin = data;
+    for (int i=0; i<chunks; i++)
+      {
+        const char *end = data + (size_t)((double)size * (i+1) / chunks);
+        while (end < data + size && end[-1] != '\n') end++;
+        if (i == chunks-1) end = data + size;
+        chunk[i].begin = begin;
+        chunk[i].end = max(begin,end);
+        begin = chunk[i].end;
+      }
 
-            if (!has_ta) tta = -1;
-            if (!has_tb) ttb = -1;
-            if (!has_tc) ttc = -1;
-            if (!has_td) ttd = -1;
+    nextChunk.reset();
+    if (chunks > 1)
+      executeAllThreads();
+    else
+      task(0,0);
 
-            if (!has_na) tna = -1;
-            if (!has_nb) tnb = -1;
-            if (!has_nc) tnc = -1;
-            if (!has_nd) tnd = -1;
+    merge(base, data);
 
-            if (isQuad)
-              {
-                const int newA = getVertexID(ta,tna,tta);
-                const int newB = getVertexID(tb,tnb,ttb);
-                const int newC = getVertexID(tc,tnc,ttc);
-                const int newD = getVertexID(td,tnd,ttd);
-                quad.push_back(RTVec4i(newA,newB,newC,newD));
-                quadShaderId.push_back(shaderId);
-              }
-            else
-              {
-                const int newA = getVertexID(ta,tna,tta);
-                const int newB = getVertexID(tb,tnb,ttb);
-                const int newC = getVertexID(tc,tnc,ttc);
-                triangle.push_back(RTVec3i(newA,newB,newC));
-                triangleShaderId.push_back(shaderId);
-              }
-          }
-        else
-          continue;
-      }
+    chunk.clear();
+    if (size) munmap((void*)data, size);
 
     assert( textureCoordinates() == vertices() );
     assert( normals() == vertices() );
   }
 
+  /*! parse chunks until all are taken; the job IDs of the task queue
+    are not reset between calls, so chunks are handed out by a counter */
+  virtual int task(int jobID, int threadID)
+  {
+    for (int i = nextChunk.inc(); i < (int)chunk.size(); i = nextChunk.inc())
+      parseChunk(chunk[i]);
+    return THREAD_RUNNING;
+  }
+
   
 };
 
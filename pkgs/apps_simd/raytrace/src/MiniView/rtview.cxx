@@ -42,6 +42,14 @@ bool glDisplay = true;
 int framesToRender = 1;
 bool autoMoveCamera = false;
 
+/* -animate: the vertices move in a wave of this amplitude (relative
+   to the scene diagonal), the BVH is refit every frame */
+float animateAmplitude = 0.0f;
+int animationFrame = 0;
+RTBox3f animationBox;
+vector<RTVec3f> restVertices;
+vector<RTVec3f> movedVertices;
+
 /* new LRT stuff */
 LRTFrameBufferHandle lrtFrameBuffer;
 LRTContext lrtContext;
@@ -55,8 +63,27 @@ void InitGL()
   glDisable(GL_LIGHTING);
 }
 
+/*! move the vertices for the next frame and refit the BVH to them */
+void animate()
+{
+  const RTVec3f lower = animationBox[0];
+  const RTVec3f upper = animationBox[1];
+  const float amplitude = animateAmplitude * (upper - lower).length();
+  const float frequency = 20.0f / max(upper.x - lower.x, 1e-6f);
+  const float phase = 0.2f * animationFrame++;
+  for (size_t i=0;i<restVertices.size();i++)
+    {
+      movedVertices[i] = restVertices[i];
+      movedVertices[i].y += amplitude * sinf(phase + frequency * (restVertices[i].x - lower.x));
+    }
+  lrtUpdateVertices(lrtContext,(const float*)&movedVertices[0],0,movedVertices.size());
+  lrtRefitContext(lrtContext);
+}
+
 void render()
 {
+  if (!restVertices.empty()) animate();
+
   RTVec3f eye    = camera.getOrigin();
   RTVec3f center = camera.getOrigin()+camera.getDirection();
   RTVec3f up     = camera.getUp();
@@ -265,6 +292,7 @@ void parseCommandLine(int argc, char* argv[])
   glDisplay = options.defined("display");
   framesToRender = options.get("frames", framesToRender);
   autoMoveCamera = options.defined("automove");
+  animateAmplitude = options.get("animate", animateAmplitude);
   if (options.defined("res")) {
     RTVec2i newRes = options.getVec2i("res");
     resX = newRes.x;
@@ -397,62 +425,94 @@ int main(int argc, char* argv[])
     generateUnitCube(root); /* if no obj file is specified use unit cube */
   else
     {
-      ObjParser parser;
-
-      for (int fi = 0; fi < nfiles; fi++) {
-	const string& fn = (*options["files"])[fi];
-	cout << "Adding obj file: " << fn << endl;
-	parser.Parse(fn.c_str());
-      }
+      ObjParser parser(numThreads);
 
-      RTBox3f sceneAABB = parser.getSceneAABB();
-      /* initialize camera */
-      if (!setViewer)
+      /* a valid scene cache holds the geometry and its BVH, so
+	 parsing (and the BVH build) can be skipped altogether */
+      bool cached = false;
+      if (options.defined("scene-cache"))
 	{
-	  cout << "Using auto camera..." << endl;
-	  SetAutoCamera(sceneAABB);
+	  vector<const char *> sourceFile;
+	  for (int fi = 0; fi < nfiles; fi++)
+	    sourceFile.push_back((*options["files"])[fi].c_str());
+	  cached = lrtLoadSceneCache(lrtContext,(*options["scene-cache"])[0].c_str(),nfiles,&*sourceFile.begin());
 	}
 
-      assert(parser.vertices());
-
-      mesh_t mesh = rtTriangleMesh(root);
-
-      data_t vertex_array = rtNewCoordArray(mesh,RT_FLOAT3);
-      assert(rtValidData(vertex_array));
-      rtCoords3f(vertex_array,(const float*)parser.getVertexPtr(),parser.vertices(),RT_PRIVATE);
-
-
-      if (parser.triangles())
+      RTBox3f sceneAABB;
+      if (cached)
 	{
-	  /*! same for the connectivity data */
-	  data_t index_array = rtNewIndexArray(mesh,RT_INT3);
-	  assert(rtValidData(index_array));
-	  rtIndices3i(index_array,(const int*)parser.getTrianglePtr(),parser.triangles(),RT_PRIVATE);
+	  RTVec3f lower, upper;
+	  lrtGetSceneBounds(lrtContext,&lower[0],&upper[0]);
+	  sceneAABB = RTBox3f(lower,upper);
+	}
+      else
+	{
+	  for (int fi = 0; fi < nfiles; fi++) {
+	    const string& fn = (*options["files"])[fi];
+	    cout << "Adding obj file: " << fn << endl;
+	    parser.Parse(fn.c_str());
+	  }
+	  sceneAABB = parser.getSceneAABB();
 	}
 
-      if (parser.quads())
+      /* initialize camera */
+      if (!setViewer)
 	{
-	  /*! same for the connectivity data */
-	  data_t index_array = rtNewIndexArray(mesh,RT_INT4);
-	  assert(rtValidData(index_array));
-	  rtIndices4i(index_array,(const int*)parser.getQuadPtr(),parser.quads(),RT_PRIVATE);
+	  cout << "Using auto camera..." << endl;
+	  SetAutoCamera(sceneAABB);
 	}
 
-      /* -- transfer vertices -- */
-      //miniRT.addVertices(parser.getVertexPtr(),parser.getTextureCoordinatePtr(),parser.vertices());
-      /* -- transfer materials -- */
-      //miniRT.addMaterials(parser.getMaterialPtr(),parser.materials());
-      /* -- transfer textures  -- */
-      for (int i=0;i<parser.textures();i++)
+      if (!cached)
 	{
-	  ImagePPM *txt = parser.getTexture(i);
-	  //miniRT.addTexture(txt->width(),txt->height(),txt->data(),RT_TEXTURE_FORMAT_RGB_UCHAR);
+	  assert(parser.vertices());
+
+	  mesh_t mesh = rtTriangleMesh(root);
+
+	  data_t vertex_array = rtNewCoordArray(mesh,RT_FLOAT3);
+	  assert(rtValidData(vertex_array));
+	  rtCoords3f(vertex_array,(const float*)parser.getVertexPtr(),parser.vertices(),RT_PRIVATE);
+
+
+	  if (parser.triangles())
+	    {
+	      /*! same for the connectivity data */
+	      data_t index_array = rtNewIndexArray(mesh,RT_INT3);
+	      assert(rtValidData(index_array));
+	      rtIndices3i(index_array,(const int*)parser.getTrianglePtr(),parser.triangles(),RT_PRIVATE);
+	    }
+
+	  if (parser.quads())
+	    {
+	      /*! same for the connectivity data */
+	      data_t index_array = rtNewIndexArray(mesh,RT_INT4);
+	      assert(rtValidData(index_array));
+	      rtIndices4i(index_array,(const int*)parser.getQuadPtr(),parser.quads(),RT_PRIVATE);
+	    }
+
+	  /* -- transfer vertices -- */
+	  //miniRT.addVertices(parser.getVertexPtr(),parser.getTextureCoordinatePtr(),parser.vertices());
+	  /* -- transfer materials -- */
+	  //miniRT.addMaterials(parser.getMaterialPtr(),parser.materials());
+	  /* -- transfer textures  -- */
+	  for (int i=0;i<parser.textures();i++)
+	    {
+	      ImagePPM *txt = parser.getTexture(i);
+	      //miniRT.addTexture(txt->width(),txt->height(),txt->data(),RT_TEXTURE_FORMAT_RGB_UCHAR);
+	    }
+	  /* -- transfer triangles -- */
+	  //if (parser.triangles()) miniRT.addTriangleMesh(parser.getTrianglePtr(),parser.triangles(),parser.getTriangleShaderPtr());
+	  /* -- transfer quads -- */
+	  //if (parser.quads()) miniRT.addQuadMesh(parser.getQuadPtr(),parser.quads(),parser.getQuadShaderPtr());
+	  if (animateAmplitude != 0.0f)
+	    {
+	      restVertices.assign(parser.getVertexPtr(),parser.getVertexPtr()+parser.vertices());
+	      movedVertices = restVertices;
+	      animationBox = sceneAABB;
+	    }
+	  parser.Free();
 	}
-      /* -- transfer triangles -- */
-      //if (parser.triangles()) miniRT.addTriangleMesh(parser.getTrianglePtr(),parser.triangles(),parser.getTriangleShaderPtr());
-      /* -- transfer quads -- */
-      //if (parser.quads()) miniRT.addQuadMesh(parser.getQuadPtr(),parser.quads(),parser.getQuadShaderPtr());
-      parser.Free();
+      else if (animateAmplitude != 0.0f)
+	cout << "-animate needs the vertices of the OBJ files, not animating a scene from the cache" << endl;
     }
   if (options.defined("exitafterbuild")) exit(0);
 
@@ -492,6 +552,7 @@ int main(int argc, char* argv[])
     __parsec_roi_end();
 #endif
     cout << "Done" << endl << flush;
+    lrtDestroyFB(lrtFrameBuffer); // waits for frames still being written
     lrtFinishThreads(lrtContext);
   }
 
@@ -0,0 +1,89 @@
+#include "RTTL/common/RTInclude.hxx"
+#include "LRT/include/lrt.h"
+#include "MiniView/ObjParser.hxx"
+#include <stdio.h>
+
+/*! \file TestObjParser.cxx parses the same generated files with one
+    and with several threads and compares the meshes. the parallel
+    parser is given two files and then the same files once more, so
+    that the task queue runs several times for the same client */
+
+/*! writes a grid of n x n vertices, half of the faces use relative
+    indices; large enough to be split into chunks. absolute indices
+    count all vertices the parser has read so far */
+void writeGrid(const char *fileName, const int n, const float z)
+{
+  FILE *f = fopen(fileName, "w");
+  if (!f)
+    {
+      perror(fileName);
+      exit(1);
+    }
+  for (int y=0;y<n;y++)
+    for (int x=0;x<n;x++)
+      fprintf(f, "v %f %f %f\n", (float)x, (float)y, z + 0.01f * ((x*y) % 7));
+  for (int y=0;y<n-1;y++)
+    for (int x=0;x<n-1;x++)
+      {
+        const int i = 1 + y*n + x;
+        if (y & 1)
+          fprintf(f, "f %i %i %i\nf %i %i %i\n", i, i+1, i+n+1, i, i+n+1, i+n);
+        else
+          fprintf(f, "f %i %i %i\nf %i %i %i\n", i-n*n-1, i-n*n, i-n*n+n, i-n*n-1, i-n*n+n, i-n*n+n-1);
+      }
+  fclose(f);
+}
+
+bool sameMesh(ObjParser &a, ObjParser &b)
+{
+  if (a.vertices() != b.vertices() || a.triangles() != b.triangles())
+    return false;
+  for (int i=0;i<a.vertices();i++)
+    for (int k=0;k<3;k++)
+      if (a.getVertexPtr()[i][k] != b.getVertexPtr()[i][k])
+        return false;
+  for (int i=0;i<a.triangles();i++)
+    for (int k=0;k<3;k++)
+      if (a.getTrianglePtr()[i][k] != b.getTrianglePtr()[i][k])
+        return false;
+  return true;
+}
+
+int main(int ac, char **av)
+{
+  const int threads = ac > 1 ? atoi(av[1]) : 4;
+  const char *file[2] = { "TestObjParser0.obj", "TestObjParser1.obj" };
+  writeGrid(file[0], 250, 0.0f);
+  writeGrid(file[1], 200, 10.0f);
+
+  ObjParser serial(1);
+  ObjParser parallel(threads);
+  int result = 0;
+  for (int pass=0;pass<2 && !result;pass++)
+    for (int i=0;i<2 && !result;i++)
+      {
+        serial.Parse(file[i]);
+        parallel.Parse(file[i]);
+        cout << "pass " << pass << " file " << file[i] << ": " << parallel.triangles()
+             << " triangles, expected " << serial.triangles() << endl;
+        if (!sameMesh(serial, parallel))
+          {
+            cout << "error: " << threads << " threads parse a different mesh than one thread" << endl;
+            result = 1;
+          }
+      }
+  const int expected = 2 * (2*249*249 + 2*199*199);
+  if (!result && serial.triangles() != expected)
+    {
+      cout << "error: " << serial.triangles() << " triangles, expected " << expected << endl;
+      result = 2;
+    }
+
+  /* the server threads have to return before the static server is destroyed */
+  parallel.finishThreadsAAA();
+  remove(file[0]);
+  remove(file[1]);
+  if (!result)
+    cout << "passed" << endl;
+  return result;
+}
@@ -12,7 +12,7 @@ namespace RTTL
   void BVH::build(const RTBoxSSE &sceneAABB,const RTBoxSSE &centroidAABB)
   {
     if (builder == NULL)
-      setBuilder("default");
+      setBuilder(BVHBuilder::Options::defaultBuilder);
     builder->build(sceneAABB,centroidAABB);
   }
 
@@ -265,68 +265,68 @@ namespace RTTL {
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int SAME_SIGNS>
     _INLINE unsigned int RayPacketIntersectAABB(const RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
         const int i,
-        const sse_f& bMinX,
-        const sse_f& bMaxX,
-        const sse_f& bMinY,
-        const sse_f& bMaxY,
-        const sse_f& bMinZ,
-        const sse_f& bMaxZ)
+        const simd_f& bMinX,
+        const simd_f& bMaxX,
+        const simd_f& bMinY,
+        const simd_f& bMaxY,
+        const simd_f& bMinZ,
+        const simd_f& bMaxZ)
     {
-        const sse_f clipMinX = (MULTIPLE_ORIGINS ? (bMinX - packet.originX(i)) : bMinX) * packet.reciprocalX(i);
-        const sse_f clipMaxX = (MULTIPLE_ORIGINS ? (bMaxX - packet.originX(i)) : bMaxX) * packet.reciprocalX(i);
-        const sse_f clipMinY = (MULTIPLE_ORIGINS ? (bMinY - packet.originY(i)) : bMinY) * packet.reciprocalY(i);
-        const sse_f clipMaxY = (MULTIPLE_ORIGINS ? (bMaxY - packet.originY(i)) : bMaxY) * packet.reciprocalY(i);
-        const sse_f clipMinZ = (MULTIPLE_ORIGINS ? (bMinZ - packet.originZ(i)) : bMinZ) * packet.reciprocalZ(i);
-        const sse_f clipMaxZ = (MULTIPLE_ORIGINS ? (bMaxZ - packet.originZ(i)) : bMaxZ) * packet.reciprocalZ(i);
+        const simd_f clipMinX = (MULTIPLE_ORIGINS ? (bMinX - packet.originX(i)) : bMinX) * packet.reciprocalX(i);
+        const simd_f clipMaxX = (MULTIPLE_ORIGINS ? (bMaxX - packet.originX(i)) : bMaxX) * packet.reciprocalX(i);
+        const simd_f clipMinY = (MULTIPLE_ORIGINS ? (bMinY - packet.originY(i)) : bMinY) * packet.reciprocalY(i);
+        const simd_f clipMaxY = (MULTIPLE_ORIGINS ? (bMaxY - packet.originY(i)) : bMaxY) * packet.reciprocalY(i);
+        const simd_f clipMinZ = (MULTIPLE_ORIGINS ? (bMinZ - packet.originZ(i)) : bMinZ) * packet.reciprocalZ(i);
+        const simd_f clipMaxZ = (MULTIPLE_ORIGINS ? (bMaxZ - packet.originZ(i)) : bMaxZ) * packet.reciprocalZ(i);
 
         if (SAME_SIGNS)
         {
-            const sse_f near4 = _mm_max_ps(_mm_max_ps(clipMinX,clipMinY),clipMinZ);
-            const sse_f far4  = _mm_min_ps(_mm_min_ps(clipMaxX,clipMaxY),clipMaxZ);
-            return  _mm_movemask_ps(_mm_cmple_ps(_mm_max_ps(packet.minDistance(i),near4),
-                _mm_min_ps(packet.maxDistance(i),far4)));
+            const simd_f near4 = max(max(clipMinX,clipMinY),clipMinZ);
+            const simd_f far4  = min(min(clipMaxX,clipMaxY),clipMaxZ);
+            return  movemask(cmple(max(packet.minDistance(i),near4),
+                min(packet.maxDistance(i),far4)));
         }
         else
         {
-            const sse_f near4 = _mm_max_ps(_mm_max_ps(_mm_min_ps(clipMinX,clipMaxX),
-                _mm_min_ps(clipMinY,clipMaxY)),
-                _mm_min_ps(clipMinZ,clipMaxZ));
-            const sse_f far4  = _mm_min_ps(_mm_min_ps(_mm_max_ps(clipMinX,clipMaxX),
-                _mm_max_ps(clipMinY,clipMaxY)),
-                _mm_max_ps(clipMinZ,clipMaxZ));
-            return  _mm_movemask_ps(_mm_cmple_ps(_mm_max_ps(packet.minDistance(i),near4),
-                _mm_min_ps(packet.maxDistance(i),far4)));
+            const simd_f near4 = max(max(min(clipMinX,clipMaxX),
+                min(clipMinY,clipMaxY)),
+                min(clipMinZ,clipMaxZ));
+            const simd_f far4  = min(min(max(clipMinX,clipMaxX),
+                max(clipMinY,clipMaxY)),
+                max(clipMinZ,clipMaxZ));
+            return  movemask(cmple(max(packet.minDistance(i),near4),
+                min(packet.maxDistance(i),far4)));
         }
 
     }
 
     /* requires that all ray directions have the same sign (per coordinate) */
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS>
-    _INLINE unsigned int RayIntervalIntersectAABB(const sse_f *const min_rcp,
-        const sse_f *const max_rcp,
-        const sse_f& bMinX,
-        const sse_f& bMaxX,
-        const sse_f& bMinY,
-        const sse_f& bMaxY,
-        const sse_f& bMinZ,
-        const sse_f& bMaxZ)
+    _INLINE unsigned int RayIntervalIntersectAABB(const simd_f *const min_rcp,
+        const simd_f *const max_rcp,
+        const simd_f& bMinX,
+        const simd_f& bMaxX,
+        const simd_f& bMinY,
+        const simd_f& bMaxY,
+        const simd_f& bMinZ,
+        const simd_f& bMaxZ)
     {
         if (!MULTIPLE_ORIGINS)
         {
             // uuuuuuhohhhh..... bad naming of variables -- you're
             // assuming the origin has been subtracted from min/max
             // already ...
-            const sse_f nearX = max_rcp[0] * bMinX;
-            const sse_f nearY = max_rcp[1] * bMinY;
-            const sse_f nearZ = max_rcp[2] * bMinZ;
-            const sse_f nearAll  = max(nearX,max(nearY,nearZ));
+            const simd_f nearX = max_rcp[0] * bMinX;
+            const simd_f nearY = max_rcp[1] * bMinY;
+            const simd_f nearZ = max_rcp[2] * bMinZ;
+            const simd_f nearAll  = max(nearX,max(nearY,nearZ));
 
-            const sse_f farX = min_rcp[0] * bMaxX;
-            const sse_f farY = min_rcp[1] * bMaxY;
-            const sse_f farZ = min_rcp[2] * bMaxZ;
-            const sse_f farAll  = min(farX,min(farY,farZ));
+            const simd_f farX = min_rcp[0] * bMaxX;
+            const simd_f farY = min_rcp[1] * bMaxY;
+            const simd_f farZ = min_rcp[2] * bMaxZ;
+            const simd_f farAll  = min(farX,min(farY,farZ));
 
-            return _mm_movemask_ps(_mm_cmple_ps(nearAll,farAll));
+            return movemask(cmple(nearAll,farAll));
         }
         else
         {
@@ -369,25 +369,25 @@ namespace RTTL {
         int raySigns[3];
         int hitID = 0;
 
-        raySigns[0] = _mm_movemask_ps(packet.directionX(0)) == 0 ? 0 : 1;
-        raySigns[1] = _mm_movemask_ps(packet.directionY(0)) == 0 ? 0 : 1;
-        raySigns[2] = _mm_movemask_ps(packet.directionZ(0)) == 0 ? 0 : 1;
+        raySigns[0] = signmask(packet.directionX(0)) == 0 ? 0 : 1;
+        raySigns[1] = signmask(packet.directionY(0)) == 0 ? 0 : 1;
+        raySigns[2] = signmask(packet.directionZ(0)) == 0 ? 0 : 1;
 
         sptr->bvhIndex = 0;
         sptr->fastHitID = hitID;
         sptr++;
 
-        const unsigned int signsMinX = _mm_movemask_ps(packet.reciprocalMin(0));
-        const unsigned int signsMinY = _mm_movemask_ps(packet.reciprocalMin(1));
-        const unsigned int signsMinZ = _mm_movemask_ps(packet.reciprocalMin(2));
-        const unsigned int signsMaxX = _mm_movemask_ps(packet.reciprocalMax(0));
-        const unsigned int signsMaxY = _mm_movemask_ps(packet.reciprocalMax(1));
-        const unsigned int signsMaxZ = _mm_movemask_ps(packet.reciprocalMax(2));
+        const unsigned int signsMinX = signmask(packet.reciprocalMin(0));
+        const unsigned int signsMinY = signmask(packet.reciprocalMin(1));
+        const unsigned int signsMinZ = signmask(packet.reciprocalMin(2));
+        const unsigned int signsMaxX = signmask(packet.reciprocalMax(0));
+        const unsigned int signsMaxY = signmask(packet.reciprocalMax(1));
+        const unsigned int signsMaxZ = signmask(packet.reciprocalMax(2));
 
         const bool sameSigns =
-            (signsMaxX == 0xf || signsMinX == 0x0) &&
-            (signsMaxY == 0xf || signsMinY == 0x0) &&
-            (signsMaxZ == 0xf || signsMinZ == 0x0);
+            (signsMaxX == RT_SIMD_MASK_ALL || signsMinX == 0x0) &&
+            (signsMaxY == RT_SIMD_MASK_ALL || signsMinY == 0x0) &&
+            (signsMaxZ == RT_SIMD_MASK_ALL || signsMinZ == 0x0);
 
         /* --------------------------------------------------------- */
         /* -- different ray directions signs -> skip IA traversal -- */
@@ -408,12 +408,12 @@ start_traverse_diff_signs:
                     const AABB &entry = bvh[index];
                     const sse_f m_min = entry.min_f();
                     const sse_f m_max = entry.max_f();
-                    sse_f min_x = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(m_min,0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(m_min,1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(m_min,2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(m_max,0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(m_max,1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(m_max,2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -460,19 +460,21 @@ start_traverse_diff_signs:
                     const int triID = start[i];
                     mesh.template intersectPrimitive<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>(packet,triID,hitID,N);
                 }
+                // shadow rays: done as soon as all of them are occluded
+                if (packet.terminated()) return;
             }
 
             /* ------------------------------------------------------- */
             /* -- equal ray directions signs -> enable IA traversal -- */
             /* ------------------------------------------------------- */
 
-            const sse_f min_rcp[3] = {
+            const simd_f min_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMin(0) : packet.reciprocalMax(0),
                 raySigns[1] ? packet.reciprocalMin(1) : packet.reciprocalMax(1),
                 raySigns[2] ? packet.reciprocalMin(2) : packet.reciprocalMax(2)
             };
 
-            const sse_f max_rcp[3] = {
+            const simd_f max_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMax(0) : packet.reciprocalMin(0),
                 raySigns[1] ? packet.reciprocalMax(1) : packet.reciprocalMin(1),
                 raySigns[2] ? packet.reciprocalMax(2) : packet.reciprocalMin(2)
@@ -482,9 +484,9 @@ start_traverse_diff_signs:
             sse_f min_rcp_direction, max_rcp_direction, min_origin, max_origin;
             if (MULTIPLE_ORIGINS)
             {
-                min_rcp_direction = setHorizontalMin3f(packet.reciprocalMin(0),packet.reciprocalMin(1),packet.reciprocalMin(2));
-                max_rcp_direction = setHorizontalMax3f(packet.reciprocalMax(0),packet.reciprocalMax(1),packet.reciprocalMax(2));
-                sse_f minX,maxX,minY,maxY,minZ,maxZ;
+                min_rcp_direction = setHorizontalMin3f(reduceMin4(packet.reciprocalMin(0)),reduceMin4(packet.reciprocalMin(1)),reduceMin4(packet.reciprocalMin(2)));
+                max_rcp_direction = setHorizontalMax3f(reduceMax4(packet.reciprocalMax(0)),reduceMax4(packet.reciprocalMax(1)),reduceMax4(packet.reciprocalMax(2)));
+                simd_f minX,maxX,minY,maxY,minZ,maxZ;
                 minX = maxX = packet.originX(0);
                 minY = maxY = packet.originY(0);
                 minZ = maxZ = packet.originZ(0);
@@ -497,8 +499,8 @@ start_traverse_diff_signs:
                   minZ = min(minZ,packet.originZ(i));
                   maxZ = max(maxZ,packet.originZ(i));
                 }
-                min_origin = setHorizontalMin3f(minX,minY,minZ);
-                max_origin = setHorizontalMax3f(maxX,maxY,maxZ);
+                min_origin = setHorizontalMin3f(reduceMin4(minX),reduceMin4(minY),reduceMin4(minZ));
+                max_origin = setHorizontalMax3f(reduceMax4(maxX),reduceMax4(maxY),reduceMax4(maxZ));
             }
 
             while(1)
@@ -514,18 +516,12 @@ start_traverse_same_signs:
                     BVH_STAT_COLLECTOR(BVHStatCollector::global.numTraversalSteps++);
                     const AABB &entry = bvh[index];
                     const sse_f *const t = (sse_f*)&bvh[index];
-                    sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                        _MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                        _MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -591,18 +587,12 @@ start_traverse_same_signs:
                 int rayID[N];
                 int rayIDs = 0;
                 const sse_f *const t = (sse_f*)&bvh[index];
-                sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                    _MM_SHUFFLE(2, 2, 2, 2));
-                sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                    _MM_SHUFFLE(2, 2, 2, 2));
+                simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                 if (!MULTIPLE_ORIGINS)
                 {
                     min_x = min_x - packet.originX(0);
@@ -628,6 +618,7 @@ start_traverse_same_signs:
                     const int triID = start[i];
                     mesh.intersectPrimitive<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>(packet,triID,hitID,N);
                 }
+                if (packet.terminated()) return;
 #else
                 BVH_STAT_COLLECTOR(BVHStatCollector::global.numLeafIntersections++);
                 const AABB &entry = bvh[index];
@@ -639,6 +630,8 @@ start_traverse_same_signs:
                     const int triID = start[i];
                     mesh.template intersectPrimitive<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>(packet,triID,hitID,N);
                 }
+                // shadow rays: done as soon as all of them are occluded
+                if (packet.terminated()) return;
 #endif
             }
     }
@@ -659,25 +652,25 @@ start_traverse_same_signs:
         int raySigns[3];
         int hitID = 0;
 
-        raySigns[0] = _mm_movemask_ps(packet.directionX(0)) == 0 ? 0 : 1;
-        raySigns[1] = _mm_movemask_ps(packet.directionY(0)) == 0 ? 0 : 1;
-        raySigns[2] = _mm_movemask_ps(packet.directionZ(0)) == 0 ? 0 : 1;
+        raySigns[0] = signmask(packet.directionX(0)) == 0 ? 0 : 1;
+        raySigns[1] = signmask(packet.directionY(0)) == 0 ? 0 : 1;
+        raySigns[2] = signmask(packet.directionZ(0)) == 0 ? 0 : 1;
 
         sptr->bvhIndex = 0;
         sptr->fastHitID = hitID;
         sptr++;
 
-        const unsigned int signsMinX = _mm_movemask_ps(packet.reciprocalMin(0));
-        const unsigned int signsMinY = _mm_movemask_ps(packet.reciprocalMin(1));
-        const unsigned int signsMinZ = _mm_movemask_ps(packet.reciprocalMin(2));
-        const unsigned int signsMaxX = _mm_movemask_ps(packet.reciprocalMax(0));
-        const unsigned int signsMaxY = _mm_movemask_ps(packet.reciprocalMax(1));
-        const unsigned int signsMaxZ = _mm_movemask_ps(packet.reciprocalMax(2));
+        const unsigned int signsMinX = signmask(packet.reciprocalMin(0));
+        const unsigned int signsMinY = signmask(packet.reciprocalMin(1));
+        const unsigned int signsMinZ = signmask(packet.reciprocalMin(2));
+        const unsigned int signsMaxX = signmask(packet.reciprocalMax(0));
+        const unsigned int signsMaxY = signmask(packet.reciprocalMax(1));
+        const unsigned int signsMaxZ = signmask(packet.reciprocalMax(2));
 
         const bool sameSigns =
-            (signsMaxX == 0xf || signsMinX == 0x0) &&
-            (signsMaxY == 0xf || signsMinY == 0x0) &&
-            (signsMaxZ == 0xf || signsMinZ == 0x0);
+            (signsMaxX == RT_SIMD_MASK_ALL || signsMinX == 0x0) &&
+            (signsMaxY == RT_SIMD_MASK_ALL || signsMinY == 0x0) &&
+            (signsMaxZ == RT_SIMD_MASK_ALL || signsMinZ == 0x0);
 
         /* --------------------------------------------------------- */
         /* -- different ray directions signs -> skip IA traversal -- */
@@ -698,12 +691,12 @@ start_traverse_diff_signs:
                     const AABB &entry = bvh[index];
                     const sse_f m_min = entry.min_f();
                     const sse_f m_max = entry.max_f();
-                    sse_f min_x = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(m_min,0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(m_min,1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(m_min,2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(m_max,0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(m_max,1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(m_max,2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -756,13 +749,13 @@ start_traverse_diff_signs:
             /* -- equal ray directions signs -> enable IA traversal -- */
             /* ------------------------------------------------------- */
 
-            const sse_f min_rcp[3] = {
+            const simd_f min_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMin(0) : packet.reciprocalMax(0),
                 raySigns[1] ? packet.reciprocalMin(1) : packet.reciprocalMax(1),
                 raySigns[2] ? packet.reciprocalMin(2) : packet.reciprocalMax(2)
             };
 
-            const sse_f max_rcp[3] = {
+            const simd_f max_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMax(0) : packet.reciprocalMin(0),
                 raySigns[1] ? packet.reciprocalMax(1) : packet.reciprocalMin(1),
                 raySigns[2] ? packet.reciprocalMax(2) : packet.reciprocalMin(2)
@@ -772,9 +765,9 @@ start_traverse_diff_signs:
             sse_f min_rcp_direction, max_rcp_direction, min_origin, max_origin;
             if (MULTIPLE_ORIGINS)
             {
-                min_rcp_direction = setHorizontalMin3f(packet.reciprocalMin(0),packet.reciprocalMin(1),packet.reciprocalMin(2));
-                max_rcp_direction = setHorizontalMax3f(packet.reciprocalMax(0),packet.reciprocalMax(1),packet.reciprocalMax(2));
-                sse_f minX,maxX,minY,maxY,minZ,maxZ;
+                min_rcp_direction = setHorizontalMin3f(reduceMin4(packet.reciprocalMin(0)),reduceMin4(packet.reciprocalMin(1)),reduceMin4(packet.reciprocalMin(2)));
+                max_rcp_direction = setHorizontalMax3f(reduceMax4(packet.reciprocalMax(0)),reduceMax4(packet.reciprocalMax(1)),reduceMax4(packet.reciprocalMax(2)));
+                simd_f minX,maxX,minY,maxY,minZ,maxZ;
                 minX = maxX = packet.originX(0);
                 minY = maxY = packet.originY(0);
                 minZ = maxZ = packet.originZ(0);
@@ -787,8 +780,8 @@ start_traverse_diff_signs:
                   minZ = min(minZ,packet.originZ(i));
                   maxZ = max(maxZ,packet.originZ(i));
                 }
-                min_origin = setHorizontalMin3f(minX,minY,minZ);
-                max_origin = setHorizontalMax3f(maxX,maxY,maxZ);
+                min_origin = setHorizontalMin3f(reduceMin4(minX),reduceMin4(minY),reduceMin4(minZ));
+                max_origin = setHorizontalMax3f(reduceMax4(maxX),reduceMax4(maxY),reduceMax4(maxZ));
             }
 
             while(1)
@@ -804,18 +797,12 @@ start_traverse_same_signs:
                     BVH_STAT_COLLECTOR(BVHStatCollector::global.numTraversalSteps++);
                     const AABB &entry = bvh[index];
                     const sse_f *const t = (sse_f*)&bvh[index];
-                    sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                        _MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                        _MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -881,18 +868,12 @@ start_traverse_same_signs:
                 int rayID[N];
                 int rayIDs = 0;
                 const sse_f *const t = (sse_f*)&bvh[index];
-                sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                    _MM_SHUFFLE(2, 2, 2, 2));
-                sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                    _MM_SHUFFLE(2, 2, 2, 2));
+                simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                 if (!MULTIPLE_ORIGINS)
                 {
                     min_x = min_x - packet.originX(0);
@@ -950,25 +931,25 @@ start_traverse_same_signs:
         int raySigns[3];
         int hitID = 0;
 
-        raySigns[0] = _mm_movemask_ps(packet.directionX(0)) == 0 ? 0 : 1;
-        raySigns[1] = _mm_movemask_ps(packet.directionY(0)) == 0 ? 0 : 1;
-        raySigns[2] = _mm_movemask_ps(packet.directionZ(0)) == 0 ? 0 : 1;
+        raySigns[0] = signmask(packet.directionX(0)) == 0 ? 0 : 1;
+        raySigns[1] = signmask(packet.directionY(0)) == 0 ? 0 : 1;
+        raySigns[2] = signmask(packet.directionZ(0)) == 0 ? 0 : 1;
 
         sptr->bvhIndex = 0;
         sptr->fastHitID = hitID;
         sptr++;
 
-        const unsigned int signsMinX = _mm_movemask_ps(packet.reciprocalMin(0));
-        const unsigned int signsMinY = _mm_movemask_ps(packet.reciprocalMin(1));
-        const unsigned int signsMinZ = _mm_movemask_ps(packet.reciprocalMin(2));
-        const unsigned int signsMaxX = _mm_movemask_ps(packet.reciprocalMax(0));
-        const unsigned int signsMaxY = _mm_movemask_ps(packet.reciprocalMax(1));
-        const unsigned int signsMaxZ = _mm_movemask_ps(packet.reciprocalMax(2));
+        const unsigned int signsMinX = signmask(packet.reciprocalMin(0));
+        const unsigned int signsMinY = signmask(packet.reciprocalMin(1));
+        const unsigned int signsMinZ = signmask(packet.reciprocalMin(2));
+        const unsigned int signsMaxX = signmask(packet.reciprocalMax(0));
+        const unsigned int signsMaxY = signmask(packet.reciprocalMax(1));
+        const unsigned int signsMaxZ = signmask(packet.reciprocalMax(2));
 
         const bool sameSigns =
-            (signsMaxX == 0xf || signsMinX == 0x0) &&
-            (signsMaxY == 0xf || signsMinY == 0x0) &&
-            (signsMaxZ == 0xf || signsMinZ == 0x0);
+            (signsMaxX == RT_SIMD_MASK_ALL || signsMinX == 0x0) &&
+            (signsMaxY == RT_SIMD_MASK_ALL || signsMinY == 0x0) &&
+            (signsMaxZ == RT_SIMD_MASK_ALL || signsMinZ == 0x0);
 
         /* --------------------------------------------------------- */
         /* -- different ray directions signs -> skip IA traversal -- */
@@ -989,12 +970,12 @@ start_traverse_diff_signs:
                     const AABB &entry = bvh[index];
                     const sse_f m_min = entry.min_f();
                     const sse_f m_max = entry.max_f();
-                    sse_f min_x = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(m_min,0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(m_min,1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(m_min,2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(m_max,0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(m_max,1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(m_max,2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -1047,13 +1028,13 @@ start_traverse_diff_signs:
             /* -- equal ray directions signs -> enable IA traversal -- */
             /* ------------------------------------------------------- */
 
-            const sse_f min_rcp[3] = {
+            const simd_f min_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMin(0) : packet.reciprocalMax(0),
                 raySigns[1] ? packet.reciprocalMin(1) : packet.reciprocalMax(1),
                 raySigns[2] ? packet.reciprocalMin(2) : packet.reciprocalMax(2)
             };
 
-            const sse_f max_rcp[3] = {
+            const simd_f max_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMax(0) : packet.reciprocalMin(0),
                 raySigns[1] ? packet.reciprocalMax(1) : packet.reciprocalMin(1),
                 raySigns[2] ? packet.reciprocalMax(2) : packet.reciprocalMin(2)
@@ -1063,9 +1044,9 @@ start_traverse_diff_signs:
             sse_f min_rcp_direction, max_rcp_direction, min_origin, max_origin;
             if (MULTIPLE_ORIGINS)
             {
-                min_rcp_direction = setHorizontalMin3f(packet.reciprocalMin(0),packet.reciprocalMin(1),packet.reciprocalMin(2));
-                max_rcp_direction = setHorizontalMax3f(packet.reciprocalMax(0),packet.reciprocalMax(1),packet.reciprocalMax(2));
-                sse_f minX,maxX,minY,maxY,minZ,maxZ;
+                min_rcp_direction = setHorizontalMin3f(reduceMin4(packet.reciprocalMin(0)),reduceMin4(packet.reciprocalMin(1)),reduceMin4(packet.reciprocalMin(2)));
+                max_rcp_direction = setHorizontalMax3f(reduceMax4(packet.reciprocalMax(0)),reduceMax4(packet.reciprocalMax(1)),reduceMax4(packet.reciprocalMax(2)));
+                simd_f minX,maxX,minY,maxY,minZ,maxZ;
                 minX = maxX = packet.originX(0);
                 minY = maxY = packet.originY(0);
                 minZ = maxZ = packet.originZ(0);
@@ -1078,8 +1059,8 @@ start_traverse_diff_signs:
                   minZ = min(minZ,packet.originZ(i));
                   maxZ = max(maxZ,packet.originZ(i));
                 }
-                min_origin = setHorizontalMin3f(minX,minY,minZ);
-                max_origin = setHorizontalMax3f(maxX,maxY,maxZ);
+                min_origin = setHorizontalMin3f(reduceMin4(minX),reduceMin4(minY),reduceMin4(minZ));
+                max_origin = setHorizontalMax3f(reduceMax4(maxX),reduceMax4(maxY),reduceMax4(maxZ));
             }
 
             while(1)
@@ -1095,18 +1076,12 @@ start_traverse_same_signs:
                     BVH_STAT_COLLECTOR(BVHStatCollector::global.numTraversalSteps++);
                     const AABB &entry = bvh[index];
                     const sse_f *const t = (sse_f*)&bvh[index];
-                    sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                        _MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                        _MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -1172,18 +1147,12 @@ start_traverse_same_signs:
                 int rayID[N];
                 int rayIDs = 0;
                 const sse_f *const t = (sse_f*)&bvh[index];
-                sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                    _MM_SHUFFLE(2, 2, 2, 2));
-                sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                    _MM_SHUFFLE(0, 0, 0, 0));
-                sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                    _MM_SHUFFLE(1, 1, 1, 1));
-                sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                    _MM_SHUFFLE(2, 2, 2, 2));
+                simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                 if (!MULTIPLE_ORIGINS)
                 {
                     min_x = min_x - packet.originX(0);
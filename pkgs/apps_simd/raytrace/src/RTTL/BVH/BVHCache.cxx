@@ -0,0 +1,241 @@
+#include "BVHCache.hxx"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace RTTL
+{
+  static const char cacheMagic[8] = { 'R','T','T','L','B','V','H','\0' };
+
+  static _INLINE long long alignOffset(const long long offset)
+  {
+    return (offset + DEFAULT_ALIGNMENT - 1) & ~(long long)(DEFAULT_ALIGNMENT - 1);
+  }
+
+  /* a cache that passed the size checks can still be corrupt; its
+     indices must not take the traversal out of the mapped arrays.
+     walks the tree like numNodes() -- the builders leave unused node
+     slots, so only reachable nodes are checked: inner nodes point to
+     two nodes further down the array, leaves to a range of the item
+     list. items have to index triangles and triangles vertices */
+  static bool validIndices(const BVHCache::Header &header,
+			   const RTVec3i *const triangle,
+			   const AABB *const node,
+			   const int *const item)
+  {
+    if (header.nodes < 1) return false;
+    int stack[MAX_BVH_STACK_DEPTH];
+    int stackPtr = 0;
+    int visited = 0;
+    stack[stackPtr++] = 0;
+    while (stackPtr)
+      {
+	const int index = stack[--stackPtr];
+	/* a tree reaches every node once; more visits mean that
+	   nodes are shared by several parents */
+	if (++visited > header.nodes) return false;
+	if (node[index].isLeaf())
+	  {
+	    if ((long long)node[index].itemOffset() + node[index].items() > header.items) return false;
+	    continue;
+	  }
+	const unsigned int children = node[index].children();
+	if (children <= (unsigned int)index || (long long)children + 1 >= header.nodes) return false;
+	if (stackPtr+2 > MAX_BVH_STACK_DEPTH) return false;
+	stack[stackPtr++] = children;
+	stack[stackPtr++] = children+1;
+      }
+    for (int i=0;i<header.items;i++)
+      if ((unsigned int)item[i] >= (unsigned int)header.triangles) return false;
+    for (int i=0;i<header.triangles;i++)
+      for (int d=0;d<3;d++)
+	if ((unsigned int)triangle[i][d] >= (unsigned int)header.vertices) return false;
+    return true;
+  }
+
+  bool BVHCache::open(const char *fileName, const unsigned long long key)
+  {
+    close();
+    const int fd = ::open(fileName,O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd,&st) != 0 || (size_t)st.st_size < sizeof(Header))
+      {
+	::close(fd);
+	return false;
+      }
+    void *map = mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    Header *header = (Header*)map;
+    bool ok =
+      memcmp(header->magic,cacheMagic,sizeof(cacheMagic)) == 0 &&
+      header->version == BVH_CACHE_VERSION &&
+      header->nodeSize == (int)sizeof(AABB) &&
+      header->key == key &&
+      header->vertices >= 0 && header->triangles >= 0 &&
+      header->nodes >= 0 && header->items >= 0;
+    /* the sizes of all sections have to fit into the file */
+    const long long size[4] = {
+      (long long)(header->vertices * sizeof(RTVec3f)),
+      (long long)(header->triangles * sizeof(RTVec3i)),
+      (long long)(header->nodes * sizeof(AABB)),
+      (long long)(header->items * sizeof(int))
+    };
+    for (int i=0;ok && i<4;i++)
+      ok = header->offset[i] >= (long long)sizeof(Header) && header->offset[i] % DEFAULT_ALIGNMENT == 0 &&
+	header->offset[i] + size[i] <= (long long)st.st_size;
+    if (ok)
+      ok = validIndices(*header,
+			(const RTVec3i*)((const char*)map + header->offset[1]),
+			(const AABB*)((const char*)map + header->offset[2]),
+			(const int*)((const char*)map + header->offset[3]));
+    if (!ok)
+      {
+	munmap(map,st.st_size);
+	return false;
+      }
+    m_header = header;
+    m_size = st.st_size;
+    return true;
+  }
+
+  void BVHCache::close()
+  {
+    if (m_header) munmap(m_header,m_size);
+    m_header = NULL;
+    m_size = 0;
+  }
+
+  bool BVHCache::write(const char *fileName,
+		       const unsigned long long key,
+		       const RTVec3f *const vertex, const int vertices,
+		       const RTVec3i *const triangle, const int triangles,
+		       const BVH &bvh, const int items)
+  {
+    Header header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,cacheMagic,sizeof(cacheMagic));
+    header.version = BVH_CACHE_VERSION;
+    header.nodeSize = sizeof(AABB);
+    header.key = key;
+    header.vertices = vertices;
+    header.triangles = triangles;
+    header.nodes = numNodes(bvh.node);
+    header.items = items;
+
+    const void *data[4] = { vertex, triangle, bvh.node, bvh.item };
+    const long long size[4] = {
+      (long long)(vertices * sizeof(RTVec3f)),
+      (long long)(triangles * sizeof(RTVec3i)),
+      (long long)(header.nodes * sizeof(AABB)),
+      (long long)(items * sizeof(int))
+    };
+    long long offset = sizeof(Header);
+    for (int i=0;i<4;i++)
+      {
+	header.offset[i] = alignOffset(offset);
+	offset = header.offset[i] + size[i];
+      }
+
+    for (int d=0;d<3;d++)
+      {
+	header.lower[d] = vertices ? vertex[0][d] : 0.0f;
+	header.upper[d] = vertices ? vertex[0][d] : 0.0f;
+      }
+    for (int i=1;i<vertices;i++)
+      for (int d=0;d<3;d++)
+	{
+	  header.lower[d] = min(header.lower[d],vertex[i][d]);
+	  header.upper[d] = max(header.upper[d],vertex[i][d]);
+	}
+
+    const string tmpName = string(fileName) + ".tmp";
+    FILE *file = fopen(tmpName.c_str(),"wb");
+    if (file == NULL) return false;
+    static const char zero[DEFAULT_ALIGNMENT] = { 0 };
+    bool ok = fwrite(&header,sizeof(Header),1,file) == 1;
+    long long written = sizeof(Header);
+    for (int i=0;ok && i<4;i++)
+      {
+	ok = fwrite(zero,1,header.offset[i]-written,file) == (size_t)(header.offset[i]-written);
+	if (ok && size[i]) ok = fwrite(data[i],size[i],1,file) == 1;
+	written = header.offset[i] + size[i];
+      }
+    ok = (fclose(file) == 0) && ok;
+    if (ok) ok = rename(tmpName.c_str(),fileName) == 0;
+    if (!ok) remove(tmpName.c_str());
+    return ok;
+  }
+
+  /* 64-bit FNV-1a, a word at a time -- the source files can be
+     several hundred MB, so this has to run at memory speed */
+  static const unsigned long long hashPrime = 0x100000001b3ULL;
+
+  unsigned long long BVHCache::hashFile(const char *fileName, const unsigned long long seed)
+  {
+    const int fd = ::open(fileName,O_RDONLY);
+    if (fd < 0) return seed;
+    struct stat st;
+    if (fstat(fd,&st) != 0)
+      {
+	::close(fd);
+	return seed;
+      }
+    unsigned long long h = (seed ^ (unsigned long long)st.st_size) * hashPrime;
+    if (st.st_size == 0)
+      {
+	::close(fd);
+	return h;
+      }
+    void *map = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (map == MAP_FAILED) return seed;
+    madvise(map,st.st_size,MADV_SEQUENTIAL);
+
+    const unsigned char *p = (const unsigned char*)map;
+    const size_t words = st.st_size / sizeof(unsigned long long);
+    for (size_t i=0;i<words;i++)
+      {
+	unsigned long long w;
+	memcpy(&w,p+i*sizeof(w),sizeof(w));
+	h = (h ^ w) * hashPrime;
+      }
+    for (size_t i=words*sizeof(unsigned long long);i<(size_t)st.st_size;i++)
+      h = (h ^ p[i]) * hashPrime;
+    munmap(map,st.st_size);
+    return h;
+  }
+
+  unsigned long long BVHCache::hashString(const char *s, const unsigned long long seed)
+  {
+    unsigned long long h = seed;
+    for (;*s;s++)
+      h = (h ^ (unsigned char)*s) * hashPrime;
+    return h;
+  }
+
+  int BVHCache::numNodes(const AABB *const node)
+  {
+    int last = 0;
+    int stack[MAX_BVH_STACK_DEPTH];
+    int stackPtr = 0;
+    stack[stackPtr++] = 0;
+    while (stackPtr)
+      {
+	const int index = stack[--stackPtr];
+	if (node[index].isLeaf()) continue;
+	const int children = node[index].children();
+	last = max(last,children+1);
+	assert(stackPtr+2 <= MAX_BVH_STACK_DEPTH);
+	stack[stackPtr++] = children;
+	stack[stackPtr++] = children+1;
+      }
+    return last+1;
+  }
+};
@@ -0,0 +1,89 @@
+/*! \file BVHCache.hxx binary cache file for a triangle mesh and its
+BVH, so that later runs on the same scene can skip parsing the source
+files and building the BVH. all sections of the file are aligned such
+that it can be mmap'ed and the BVH nodes and item lists used in
+place */
+
+#ifndef RTTL_BVHCACHE_HXX
+#define RTTL_BVHCACHE_HXX
+
+#include "BVH.hxx"
+
+#define BVH_CACHE_VERSION 1
+#define BVH_CACHE_HASH_SEED 0xcbf29ce484222325ULL
+
+namespace RTTL {
+
+    class BVHCache
+    {
+    public:
+
+        /*! file layout: header, then vertices, triangles, BVH nodes
+        and item lists, each starting at a multiple of
+        DEFAULT_ALIGNMENT */
+        struct Header
+        {
+            char magic[8];
+            int version;
+            /*! sizeof(AABB) of the writer, rejects caches written
+            with a different node layout */
+            int nodeSize;
+            /*! identifies the scene the cache was written for, see
+            hashFile() */
+            unsigned long long key;
+            int vertices;
+            int triangles;
+            int nodes;
+            int items;
+            long long offset[4];
+            /*! bounds of all vertices */
+            float lower[3];
+            float upper[3];
+        };
+
+        BVHCache() : m_header(NULL), m_size(0) {};
+        ~BVHCache() { close(); };
+
+        /*! map the cache file. returns false if the file does not
+        exist, was not written for this key or has indices outside
+        its arrays */
+        bool open(const char *fileName, const unsigned long long key);
+        void close();
+
+        _INLINE bool valid() const { return m_header != NULL; }
+        _INLINE const Header &header() const { return *m_header; }
+        _INLINE const RTVec3f *vertex() const { return (const RTVec3f*)section(0); }
+        _INLINE const RTVec3i *triangle() const { return (const RTVec3i*)section(1); }
+        /*! nodes and items are mapped copy-on-write, so they can be
+        handed to a BVH directly */
+        _INLINE AABB *node() const { return (AABB*)section(2); }
+        _INLINE int *item() const { return (int*)section(3); }
+
+        /*! write a cache file. the file is written under a temporary
+        name and renamed when complete, so concurrent runs never see
+        a partial cache */
+        static bool write(const char *fileName,
+                          const unsigned long long key,
+                          const RTVec3f *const vertex, const int vertices,
+                          const RTVec3i *const triangle, const int triangles,
+                          const BVH &bvh, const int items);
+
+        /*! hash of a file's contents, chained through 'seed' so several
+        source files can be combined into one key. returns the seed
+        unchanged if the file cannot be read */
+        static unsigned long long hashFile(const char *fileName, const unsigned long long seed);
+        static unsigned long long hashString(const char *s, const unsigned long long seed);
+
+        /*! number of nodes in use in a binary BVH */
+        static int numNodes(const AABB *const node);
+
+    protected:
+        _INLINE const char *section(const int i) const { return (const char*)m_header + m_header->offset[i]; }
+
+        Header *m_header;
+        size_t m_size;
+    };
+
+};
+
+#endif
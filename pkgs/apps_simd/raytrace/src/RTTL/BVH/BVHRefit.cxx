@@ -0,0 +1,104 @@
+#include "BVHRefit.hxx"
+
+namespace RTTL
+{
+  float BVHRefitter::refit(AABB *const node, const int *const item,
+			   const PolygonalBaseMesh *const mesh,
+			   const int threads)
+  {
+    this->node = node;
+    this->item = item;
+    this->mesh = mesh;
+
+    /* open inner nodes breadth first until there are enough subtrees */
+    top.clear();
+    subtree.clear();
+    subtree.push_back(0);
+    while ((int)subtree.size() < REFIT_SUBTREES)
+      {
+	vector<int> next;
+	for (size_t i=0;i<subtree.size();i++)
+	  if (node[subtree[i]].isLeaf())
+	    next.push_back(subtree[i]);
+	  else
+	    {
+	      top.push_back(subtree[i]);
+	      next.push_back(node[subtree[i]].children());
+	      next.push_back(node[subtree[i]].children()+1);
+	    }
+	if (next.size() == subtree.size()) break;
+	subtree.swap(next);
+      }
+    subtreeCost.assign(subtree.size(),0.0f);
+
+    nextJob.reset();
+    if (threads > 1)
+      {
+	createThreads(threads);
+	executeAllThreads();
+      }
+    else
+      task(0,0);
+
+    float cost = 0.0f;
+    for (size_t i=0;i<subtree.size();i++)
+      cost += subtreeCost[i];
+    for (int i=(int)top.size()-1;i>=0;i--)
+      {
+	AABB &n = node[top[i]];
+	RTBoxSSE box = node[n.children()];
+	box.extend(node[n.children()+1]);
+	setBounds(n,box);
+	cost += nodeCost(n);
+      }
+    return cost / node[0].area();
+  }
+
+  int BVHRefitter::task(int jobID, int threadID)
+  {
+    for (int j = nextJob.inc(); j < (int)subtree.size(); j = nextJob.inc())
+      subtreeCost[j] = refitSubtree(subtree[j]);
+    return THREAD_RUNNING;
+  }
+
+  float BVHRefitter::refitSubtree(const int index)
+  {
+    AABB &n = node[index];
+    RTBoxSSE box;
+    box.setEmpty();
+    float cost = 0.0f;
+    if (n.isLeaf())
+      {
+	const int *const prim = item + n.itemOffset();
+	for (int i=0;i<n.items();i++)
+	  box.extend(mesh->getAABB(prim[i]));
+      }
+    else
+      {
+	cost += refitSubtree(n.children());
+	cost += refitSubtree(n.children()+1);
+	box = node[n.children()];
+	box.extend(node[n.children()+1]);
+      }
+    setBounds(n,box);
+    return cost + nodeCost(n);
+  }
+
+  float BVHRefitter::sahCost(const AABB *const node)
+  {
+    float cost = 0.0f;
+    int stack[MAX_BVH_STACK_DEPTH];
+    int stackPtr = 0;
+    stack[stackPtr++] = 0;
+    while (stackPtr)
+      {
+	const AABB &n = node[stack[--stackPtr]];
+	cost += nodeCost(n);
+	if (n.isLeaf()) continue;
+	assert(stackPtr+2 <= MAX_BVH_STACK_DEPTH);
+	stack[stackPtr++] = n.children();
+	stack[stackPtr++] = n.children()+1;
+      }
+    return cost / node[0].area();
+  }
+};
@@ -0,0 +1,74 @@
+/*! \file BVHRefit.hxx updates the node bounds of a binary BVH after
+its primitives moved, keeping the tree topology. much cheaper than a
+rebuild, but the tree gets worse the further the primitives move away
+from where they were at build time -- sahCost() tells how much. not
+for trees of the on-demand builder, whose lazy nodes keep the
+primitive bounds of build time */
+
+#ifndef RTTL_BVHREFIT_HXX
+#define RTTL_BVHREFIT_HXX
+
+#include "BVH.hxx"
+#include "../common/RTThread.hxx"
+
+/*! the top of the tree is split into about this many subtrees, which
+are refit in parallel */
+#define REFIT_SUBTREES 256
+
+namespace RTTL {
+
+    class BVHRefitter : public MultiThreadedTaskQueue
+    {
+    public:
+        BVHRefitter() : MultiThreadedTaskQueue(), node(NULL), item(NULL), mesh(NULL) {};
+
+        /*! recompute the bounds of all nodes bottom-up from the
+        current bounds of the mesh's primitives. returns the SAH cost
+        of the refit tree, see sahCost() */
+        float refit(AABB *const node, const int *const item,
+                    const PolygonalBaseMesh *const mesh,
+                    const int threads);
+
+        /*! SAH cost of a BVH, relative to the surface area of its
+        root, with the builders' traversal and intersection costs */
+        static float sahCost(const AABB *const node);
+
+    protected:
+        virtual int task(int jobID, int threadID);
+
+        /*! refit the subtree below index, returns its unnormalized
+        SAH cost */
+        float refitSubtree(const int index);
+
+        static _INLINE float nodeCost(const AABB &n)
+        {
+            if (n.isLeaf())
+                return n.items() ? n.area() * n.items() * INTERSECTION_COST : 0.0f;
+            return n.area() * TRAVERSAL_COST;
+        }
+
+        /*! the last word of min and max holds children, items etc. */
+        static _INLINE void setBounds(AABB &n, const RTBoxSSE &box)
+        {
+            const unsigned int extMin = n.extMin();
+            const unsigned int extMax = n.extMax();
+            n.min_f() = box.min_f();
+            n.max_f() = box.max_f();
+            n.extMin() = extMin;
+            n.extMax() = extMax;
+        }
+
+        AABB *node;
+        const int *item;
+        const PolygonalBaseMesh *mesh;
+
+        /*! inner nodes above the subtrees, parents before children */
+        vector<int> top;
+        vector<int> subtree;
+        vector<float> subtreeCost;
+        AtomicCounter nextJob;
+    };
+
+};
+
+#endif
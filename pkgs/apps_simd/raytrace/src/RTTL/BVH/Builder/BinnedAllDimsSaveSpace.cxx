@@ -80,65 +80,26 @@ namespace RTTL {
       }
 
     int nextFreeNode = 1;
-    recursiveBuildFast(cdAABB,0,nextFreeNode,0,numAABBs,sceneAABB,centroidAABB,true);
+    recursiveBuildFast(cdAABB,0,nextFreeNode,0,numAABBs,sceneAABB,centroidAABB,binTable,true);
 #endif
 
     bvh->doneWithAllPrimitiveBounds(aabb);
   }
 
-  void BinnedAllDimsSaveSpace::recursiveBuildFast(const CentroidDiffAABB *const cdAABB,
-						  int nodeID, 
-						  int &nextFree,
-						  int begin, 
-						  int end,
-						  const AABB &voxel,
-						  const AABB &centroidBounds,
-						  const bool skipBinning)
+  int BinnedAllDimsSaveSpace::findBestSplit(BinTable &bin,
+					     const int numBins,
+					     const int items,
+					     const AABB &voxel,
+					     const sse_f &distance,
+					     int &bestSplitDim,
+					     AABB &leftTriAABB,
+					     AABB &rightTriAABB)
   {
-    const int items = end-begin;
-    int *const item = bvh->item;
-    if (items <= MIN_ITEMS)
-      {
-      createLeaf:	
-	bvh->node[nodeID] = voxel;
-	bvh->node[nodeID].createLeaf(begin,end-begin);
-	return;
-      }
-    const int numBins = min(maxBins,2 + 2*(int)sqrtf(items)); 
-    const sse_f c_min = centroidBounds.min_f();
-    const sse_f distance = centroidBounds.diameter();
-    const sse_f scale = computeScale(distance,numBins);
-
-//     DBG_PRINT(voxel);
-//     DBG_PRINT(numBins);
-//     DBG_PRINT(centroidBounds);
-//     DBG_PRINT(c_min);
-//     DBG_PRINT(distance);
-//     DBG_PRINT(scale);
-
-    /* --------------------------------------------------- */
-    if (__builtin_expect(skipBinning == false,1))
-      {
-	clearBins3Dim(numBins,binTable);
-	const sse_f centroidBoundsMin = centroidBounds.min_f();
-
-	for (int i=begin;i<end;i++)
-	  updateBinAll3Dim(cdAABB[item[i]],centroidBoundsMin,scale,binTable);
-      }
-    /* --------------------------------------------------- */
-
-    AABB leftTriAABB,rightTriAABB;
-
-
     float voxelArea = voxel.area();
 
-//     DBG_PRINT(voxel);
-//     DBG_PRINT(voxelArea);
-//     DBG_PRINT(voxel.diameter());
-
     assert(voxelArea >= 0.0f);
     int bestSplit = -1;
-    int bestSplitDim = -1;
+    bestSplitDim = -1;
     float bestCost = items * voxelArea;
 
     for (int dim=0;dim<3;dim++)
@@ -148,12 +109,10 @@ namespace RTTL {
 
 	AABB rightBounds;
 	rightBounds.setEmpty();
-	AABB rightCentroidBounds;
-	rightCentroidBounds.setEmpty();
 	for (int i=numBins-1;i>=0;--i)
 	  {
-	    rightBounds.extend(binTable.binBounds[binDim][i]);
-	    binTable.rightBox[i] = rightBounds;
+	    rightBounds.extend(bin.binBounds[binDim][i]);
+	    bin.rightBox[i] = rightBounds;
 	  }
 
 	AABB leftBounds;
@@ -161,8 +120,8 @@ namespace RTTL {
 
 	for (int i=1,count = 0;i<numBins;i++)
 	  {
-	    leftBounds.extend(binTable.binBounds[binDim][i-1]);
-	    count += binTable.binCount[binDim][i-1];
+	    leftBounds.extend(bin.binBounds[binDim][i-1]);
+	    count += bin.binCount[binDim][i-1];
 
 	    const int lnum = count;
 	    const int rnum = items-lnum;
@@ -170,7 +129,7 @@ namespace RTTL {
 	    if (__builtin_expect(lnum == 0 || rnum == 0,0)) continue;
 
 	    const float lsa = leftBounds.area();
-	    const float rsa = binTable.rightBox[i].area(); 
+	    const float rsa = bin.rightBox[i].area(); 
 	    const float cost =  (lsa * lnum + rsa * rnum + 1.0f * voxelArea); // the '1' is the traversal cost...
 	    //float cost =  (lsa * lnum + rsa * rnum) * INTERSECTION_COST + voxel.area() * TRAVERSAL_COST;
 
@@ -180,11 +139,59 @@ namespace RTTL {
 		bestSplit = i;
 		bestSplitDim = dim;
 		leftTriAABB = leftBounds;
-		rightTriAABB = binTable.rightBox[i];
+		rightTriAABB = bin.rightBox[i];
 	      }
 
 	  }
       }
+    return bestSplit;
+  }
+
+  void BinnedAllDimsSaveSpace::recursiveBuildFast(const CentroidDiffAABB *const cdAABB,
+						  int nodeID, 
+						  int &nextFree,
+						  int begin, 
+						  int end,
+						  const AABB &voxel,
+						  const AABB &centroidBounds,
+						  BinTable &bin,
+						  const bool skipBinning)
+  {
+    const int items = end-begin;
+    int *const item = bvh->item;
+    if (items <= MIN_ITEMS)
+      {
+      createLeaf:	
+	bvh->node[nodeID] = voxel;
+	bvh->node[nodeID].createLeaf(begin,end-begin);
+	return;
+      }
+    const int numBins = min(maxBins,2 + 2*(int)sqrtf(items)); 
+    const sse_f c_min = centroidBounds.min_f();
+    const sse_f distance = centroidBounds.diameter();
+    const sse_f scale = computeScale(distance,numBins);
+
+//     DBG_PRINT(voxel);
+//     DBG_PRINT(numBins);
+//     DBG_PRINT(centroidBounds);
+//     DBG_PRINT(c_min);
+//     DBG_PRINT(distance);
+//     DBG_PRINT(scale);
+
+    /* --------------------------------------------------- */
+    if (__builtin_expect(skipBinning == false,1))
+      {
+	clearBins3Dim(numBins,bin);
+	const sse_f centroidBoundsMin = centroidBounds.min_f();
+
+	for (int i=begin;i<end;i++)
+	  updateBinAll3Dim(cdAABB[item[i]],centroidBoundsMin,scale,bin);
+      }
+    /* --------------------------------------------------- */
+
+    AABB leftTriAABB,rightTriAABB;
+    int bestSplitDim;
+    const int bestSplit = findBestSplit(bin,numBins,items,voxel,distance,bestSplitDim,leftTriAABB,rightTriAABB);
 
     if (bestSplit == -1) { goto createLeaf; }
 
@@ -224,8 +231,8 @@ namespace RTTL {
     bvh->node[nodeID].createNode(nextFree,bestSplitDim);
 
     nextFree += 2;
-    recursiveBuildFast(cdAABB,bvh->node[nodeID].children()+0,nextFree,begin,mid,leftTriAABB,leftCentroidBounds);
-    recursiveBuildFast(cdAABB,bvh->node[nodeID].children()+1,nextFree,mid,end,rightTriAABB,rightCentroidBounds);
+    recursiveBuildFast(cdAABB,bvh->node[nodeID].children()+0,nextFree,begin,mid,leftTriAABB,leftCentroidBounds,bin);
+    recursiveBuildFast(cdAABB,bvh->node[nodeID].children()+1,nextFree,mid,end,rightTriAABB,rightCentroidBounds,bin);
   }
 
 
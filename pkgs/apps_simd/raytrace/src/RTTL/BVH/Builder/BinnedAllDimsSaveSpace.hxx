@@ -65,6 +65,18 @@ namespace RTTL {
             AABB &voxel,
             const AABB &centroidBounds);
 
+    /*! sweeps the bins of all three dimensions, returns the best split
+      bin (or -1 if no split is better than a leaf) and sets its
+      dimension and the bounds of both halves */
+    int findBestSplit(BinTable &bin,
+              const int numBins,
+              const int items,
+              const AABB &voxel,
+              const sse_f &distance,
+              int &bestSplitDim,
+              AABB &leftTriAABB,
+              AABB &rightTriAABB);
+
     void recursiveBuildFast(const CentroidDiffAABB *const cdAABB,
                 int nodeID,
                 int &nextFree,
@@ -72,6 +84,7 @@ namespace RTTL {
                 int end,
                 const AABB &voxel,
                 const AABB &centroidBounds,
+                BinTable &bin,
                 const bool skipBinning = false);
 
 
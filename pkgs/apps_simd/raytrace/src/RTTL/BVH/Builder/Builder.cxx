@@ -13,10 +13,15 @@
 #include "BinnedAllDims.hxx"
 #include "BinnedAllDimsSaveSpace.hxx"
 #include "OnDemandBuilder.hxx"
+#include "ParallelBinnedAllDims.hxx"
 
 namespace RTTL
 {
-  const char *BVHBuilder::Options::defaultBuilder = "binnedalldimssavespace";
+  const char *BVHBuilder::Options::defaultBuilder = "parallelbinnedalldims";
+  int BVHBuilder::Options::buildThreads = 1;
+  int BVHBuilder::Options::branchingFactor = 2;
+  float BVHBuilder::Options::rebuildThreshold = 1.5f;
+  bool BVHBuilder::Options::quantizedNodes = false;
 
     // strcasecmp does not exits under windows !!!
   BVHBuilder *BVHBuilder::get(const char *builderType, BVH *bvh)
@@ -26,13 +31,15 @@ namespace RTTL
       return get("default",bvh);
     else if (!strcmp(builderType, "default"))
       //return new SweepBVHBuilder(bvh);
-      return new BinnedAllDimsSaveSpace(bvh);
+      return new ParallelBinnedAllDims(bvh);
     else if (!strcmp(builderType, "sweep"))
       return new SweepBVHBuilder(bvh);
     else if (!strcmp(builderType, "binnedalldims"))
       return new BinnedAllDims(bvh);
     else if (!strcmp(builderType, "binnedalldimssavespace"))
       return new BinnedAllDimsSaveSpace(bvh);
+    else if (!strcmp(builderType, "parallel") || !strcmp(builderType, "parallelbinnedalldims"))
+      return new ParallelBinnedAllDims(bvh);
     else if (!strcmp(builderType, "binned3d"))
       return new BinnedAllDims(bvh);
     else if (!strcmp(builderType, "binned"))
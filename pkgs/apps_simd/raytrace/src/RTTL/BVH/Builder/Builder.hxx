@@ -26,6 +26,17 @@ namespace RTTL {
       /*! string specifying which builder to use by default ... (i.e.,
     if no other one is specified) */
       static const char *defaultBuilder;
+      /*! number of threads used by builders that can build in
+    parallel (set by the renderer to its number of threads) */
+      static int buildThreads;
+      /*! 2 for the binary BVH, 4 or 8 to collapse it into a 4- or
+	8-wide BVH after the build (see WideBVH.hxx) */
+      static int branchingFactor;
+      /*! a refit BVH (see BVHRefit.hxx) is rebuilt once its SAH
+	cost exceeds this multiple of the cost after the last build */
+      static float rebuildThreshold;
+      /*! store the 4- or 8-wide BVH with 8 bit quantized bounds */
+      static bool quantizedNodes;
     };
 
     BVHBuilder(BVH *bvhToBeBuilt) : bvh(bvhToBeBuilt) {};
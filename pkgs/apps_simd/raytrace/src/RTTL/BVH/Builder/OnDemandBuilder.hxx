@@ -76,25 +76,25 @@ namespace RTTL {
         int raySigns[3];
         int hitID = 0;
 
-        raySigns[0] = _mm_movemask_ps(packet.directionX(0)) == 0 ? 0 : 1;
-        raySigns[1] = _mm_movemask_ps(packet.directionY(0)) == 0 ? 0 : 1;
-        raySigns[2] = _mm_movemask_ps(packet.directionZ(0)) == 0 ? 0 : 1;
+        raySigns[0] = signmask(packet.directionX(0)) == 0 ? 0 : 1;
+        raySigns[1] = signmask(packet.directionY(0)) == 0 ? 0 : 1;
+        raySigns[2] = signmask(packet.directionZ(0)) == 0 ? 0 : 1;
 
         sptr->bvhIndex = 0;
         sptr->fastHitID = hitID;
         sptr++;
 
-        const unsigned int signsMinX = _mm_movemask_ps(packet.reciprocalMin(0));
-        const unsigned int signsMinY = _mm_movemask_ps(packet.reciprocalMin(1));
-        const unsigned int signsMinZ = _mm_movemask_ps(packet.reciprocalMin(2));
-        const unsigned int signsMaxX = _mm_movemask_ps(packet.reciprocalMax(0));
-        const unsigned int signsMaxY = _mm_movemask_ps(packet.reciprocalMax(1));
-        const unsigned int signsMaxZ = _mm_movemask_ps(packet.reciprocalMax(2));
+        const unsigned int signsMinX = signmask(packet.reciprocalMin(0));
+        const unsigned int signsMinY = signmask(packet.reciprocalMin(1));
+        const unsigned int signsMinZ = signmask(packet.reciprocalMin(2));
+        const unsigned int signsMaxX = signmask(packet.reciprocalMax(0));
+        const unsigned int signsMaxY = signmask(packet.reciprocalMax(1));
+        const unsigned int signsMaxZ = signmask(packet.reciprocalMax(2));
 
         const bool sameSigns =
-            (signsMaxX == 0xf || signsMinX == 0x0) &&
-            (signsMaxY == 0xf || signsMinY == 0x0) &&
-            (signsMaxZ == 0xf || signsMinZ == 0x0);
+            (signsMaxX == RT_SIMD_MASK_ALL || signsMinX == 0x0) &&
+            (signsMaxY == RT_SIMD_MASK_ALL || signsMinY == 0x0) &&
+            (signsMaxZ == RT_SIMD_MASK_ALL || signsMinZ == 0x0);
 
         /* --------------------------------------------------------- */
         /* -- different ray directions signs -> skip IA traversal -- */
@@ -117,12 +117,12 @@ start_traverse_diff_signs:
                     const AABB &entry = bvh[index];
                     const sse_f m_min = entry.m_min[0];
                     const sse_f m_max = entry.m_max[0];
-                    sse_f min_x = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(m_min,m_min,_MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(m_max,m_max,_MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(m_min,0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(m_min,1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(m_min,2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(m_max,0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(m_max,1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(m_max,2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -180,13 +180,13 @@ start_traverse_diff_signs:
             /* -- equal ray directions signs -> enable IA traversal -- */
             /* ------------------------------------------------------- */
 
-            const sse_f min_rcp[3] = {
+            const simd_f min_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMin(0) : packet.reciprocalMax(0),
                 raySigns[1] ? packet.reciprocalMin(1) : packet.reciprocalMax(1),
                 raySigns[2] ? packet.reciprocalMin(2) : packet.reciprocalMax(2)
             };
 
-            const sse_f max_rcp[3] = {
+            const simd_f max_rcp[3] = {
                 raySigns[0] ? packet.reciprocalMax(0) : packet.reciprocalMin(0),
                 raySigns[1] ? packet.reciprocalMax(1) : packet.reciprocalMin(1),
                 raySigns[2] ? packet.reciprocalMax(2) : packet.reciprocalMin(2)
@@ -208,18 +208,12 @@ start_traverse_same_signs:
                     const AABB &entry = bvh[index];
 
                     const sse_f *const t = (sse_f*)&bvh[index];
-                    sse_f min_x = _mm_shuffle_ps(t[raySigns[0]],t[raySigns[0]],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f min_y = _mm_shuffle_ps(t[raySigns[1]],t[raySigns[1]],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f min_z = _mm_shuffle_ps(t[raySigns[2]],t[raySigns[2]],
-                        _MM_SHUFFLE(2, 2, 2, 2));
-                    sse_f max_x = _mm_shuffle_ps(t[raySigns[0]^1],t[raySigns[0]^1],
-                        _MM_SHUFFLE(0, 0, 0, 0));
-                    sse_f max_y = _mm_shuffle_ps(t[raySigns[1]^1],t[raySigns[1]^1],
-                        _MM_SHUFFLE(1, 1, 1, 1));
-                    sse_f max_z = _mm_shuffle_ps(t[raySigns[2]^1],t[raySigns[2]^1],
-                        _MM_SHUFFLE(2, 2, 2, 2));
+                    simd_f min_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]],0));
+                    simd_f min_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]],1));
+                    simd_f min_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]],2));
+                    simd_f max_x = convert<simd_f>(M128_FLOAT(t[raySigns[0]^1],0));
+                    simd_f max_y = convert<simd_f>(M128_FLOAT(t[raySigns[1]^1],1));
+                    simd_f max_z = convert<simd_f>(M128_FLOAT(t[raySigns[2]^1],2));
                     if (!MULTIPLE_ORIGINS)
                     {
                         min_x = min_x - packet.originX(0);
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cstring>
+
+#include "ParallelBinnedAllDims.hxx"
+#include "../../common/Timer.hxx"
+
+namespace RTTL {
+
+  void ParallelBinnedAllDims::runPhase(const int phase, const int jobs)
+  {
+    this->phase = phase;
+    this->jobs = jobs;
+    nextJob.reset();
+    if (buildThreads > 1)
+      executeAllThreads();
+    else
+      task(0,0);
+  }
+
+  int ParallelBinnedAllDims::task(int jobID, int threadID)
+  {
+    for (int j = nextJob.inc(); j < jobs; j = nextJob.inc())
+      job(phase,j,threadID);
+    return THREAD_RUNNING;
+  }
+
+  void ParallelBinnedAllDims::job(const int phase, const int jobID, const int threadID)
+  {
+    CentroidDiffAABB *cdAABB = (CentroidDiffAABB*)aabb;
+    int *const item = bvh->item;
+
+    if (phase == PHASE_SUBTREES)
+      {
+	const BuildTask &t = subtree[jobID];
+	int nextFree = t.nextFree;
+	recursiveBuildFast(cdAABB,t.nodeID,nextFree,t.begin,t.end,t.voxel,t.centroidBounds,threadBins[threadID]);
+	assert(nextFree <= t.nextFree + 2*(t.end-t.begin) - 2);
+	return;
+      }
+
+    Slice &s = slice[jobID];
+    const BuildTask &t = level[s.task];
+
+    switch (phase)
+      {
+      case PHASE_CONVERT:
+	/* root level: convert the primitive bounds while binning them */
+	clearBins3Dim(t.numBins,sliceBins[jobID]);
+	for (int i=s.begin;i<s.end;i++)
+	  {
+	    item[i] = i;
+	    CentroidDiffAABB cd = aabb[i];
+	    updateBinAll3Dim(cd,t.c_min,t.scale,sliceBins[jobID]);
+	    cdAABB[i] = cd;
+	  }
+	break;
+
+      case PHASE_BIN:
+	clearBins3Dim(t.numBins,sliceBins[jobID]);
+	for (int i=s.begin;i<s.end;i++)
+	  updateBinAll3Dim(cdAABB[item[i]],t.c_min,t.scale,sliceBins[jobID]);
+	break;
+
+      case PHASE_COUNT:
+	{
+	  const float c = M128_FLOAT(t.c_min,t.splitDim);
+	  const float sc = M128_FLOAT(t.scale,t.splitDim);
+	  s.left = 0;
+	  s.leftCentroidBounds.setEmpty();
+	  s.rightCentroidBounds.setEmpty();
+	  for (int i=s.begin;i<s.end;i++)
+	    {
+	      const CentroidDiffAABB &cd = cdAABB[item[i]];
+	      if (int((cd.centroid(t.splitDim) - c) * sc) < t.split)
+		{
+		  s.leftCentroidBounds.extend(cd.centroid());
+		  s.left++;
+		}
+	      else
+		s.rightCentroidBounds.extend(cd.centroid());
+	    }
+	}
+	break;
+
+      case PHASE_SCATTER:
+	{
+	  if (t.split == -1) break;
+	  const float c = M128_FLOAT(t.c_min,t.splitDim);
+	  const float sc = M128_FLOAT(t.scale,t.splitDim);
+	  int l = s.leftDest;
+	  int r = s.rightDest;
+	  for (int i=s.begin;i<s.end;i++)
+	    {
+	      const int id = item[i];
+	      if (int((cdAABB[id].centroid(t.splitDim) - c) * sc) < t.split)
+		tmpItem[l++] = id;
+	      else
+		tmpItem[r++] = id;
+	    }
+	}
+	break;
+
+      case PHASE_COPY:
+	if (t.split == -1) break;
+	memcpy(item + s.begin,tmpItem + s.begin,sizeof(int)*(s.end-s.begin));
+	break;
+      }
+  }
+
+  void ParallelBinnedAllDims::addSlices(const int t)
+  {
+    BuildTask &task = level[t];
+    const int items = task.end - task.begin;
+    task.numBins = min(maxBins,2 + 2*(int)sqrtf(items));
+    task.c_min = task.centroidBounds.min_f();
+    task.scale = computeScale(task.centroidBounds.diameter(),task.numBins);
+    task.split = -1;
+
+    for (int b=task.begin;b<task.end;b+=PARALLEL_SLICE_ITEMS)
+      {
+	Slice s;
+	s.task = t;
+	s.begin = b;
+	s.end = min(b + PARALLEL_SLICE_ITEMS,task.end);
+	slice.push_back(s);
+      }
+  }
+
+  /*! splits all nodes of the current level, then replaces the level
+    by the children that are still large enough for a cooperative
+    split; all other children are added to the subtrees */
+  void ParallelBinnedAllDims::splitLevel(int &nextFree)
+  {
+    const int numAABBs = bvh->numPrimitives();
+    const int minItems = max(PARALLEL_SPLIT_MIN_ITEMS,numAABBs / PARALLEL_SUBTREES);
+
+    /* merge the bins of all slices of a node and look for the best split */
+    for (int t=0,i=0;t<(int)level.size();t++)
+      {
+	BuildTask &task = level[t];
+	clearBins3Dim(task.numBins,binTable);
+	for (;i<(int)slice.size() && slice[i].task == t;i++)
+	  for (int dim=0;dim<3;dim++)
+	    for (int b=0;b<task.numBins;b++)
+	      {
+		binTable.binBounds[dim][b].extend(sliceBins[i].binBounds[dim][b]);
+		binTable.binCount[dim][b] += sliceBins[i].binCount[dim][b];
+	      }
+
+	task.split = findBestSplit(binTable,task.numBins,task.end - task.begin,task.voxel,
+				   task.centroidBounds.diameter(),task.splitDim,
+				   task.childVoxel[0],task.childVoxel[1]);
+	if (task.split == -1)
+	  {
+	    bvh->node[task.nodeID] = task.voxel;
+	    bvh->node[task.nodeID].createLeaf(task.begin,task.end-task.begin);
+	  }
+      }
+
+    runPhase(PHASE_COUNT,slice.size());
+
+    /* the destination of the items of each slice */
+    for (int t=0,i=0;t<(int)level.size();t++)
+      {
+	BuildTask &task = level[t];
+	int left = 0;
+	for (int j=i;j<(int)slice.size() && slice[j].task == t;j++)
+	  left += slice[j].left;
+	task.mid = task.begin + left;
+
+	int l = task.begin, r = task.mid;
+	for (;i<(int)slice.size() && slice[i].task == t;i++)
+	  {
+	    slice[i].leftDest = l;
+	    slice[i].rightDest = r;
+	    l += slice[i].left;
+	    r += slice[i].end - slice[i].begin - slice[i].left;
+	  }
+      }
+
+    runPhase(PHASE_SCATTER,slice.size());
+    runPhase(PHASE_COPY,slice.size());
+
+    /* create the nodes and the next level */
+    vector< BuildTask, Align<BuildTask> > next;
+    for (int t=0,i=0;t<(int)level.size();t++)
+      {
+	const BuildTask &task = level[t];
+	AABB centroidBounds[2];
+	centroidBounds[0].setEmpty();
+	centroidBounds[1].setEmpty();
+	for (;i<(int)slice.size() && slice[i].task == t;i++)
+	  {
+	    centroidBounds[0].extend(slice[i].leftCentroidBounds);
+	    centroidBounds[1].extend(slice[i].rightCentroidBounds);
+	  }
+	if (task.split == -1)
+	  continue;
+
+	const int parent = task.nodeID;
+	bvh->node[parent] = task.voxel;
+	bvh->node[parent].createNode(nextFree,task.splitDim);
+	nextFree += 2;
+
+	for (int k=0;k<2;k++)
+	  {
+	    BuildTask child;
+	    child.nodeID = bvh->node[parent].children()+k;
+	    child.begin = k ? task.mid : task.begin;
+	    child.end = k ? task.end : task.mid;
+	    child.voxel = task.childVoxel[k];
+	    child.centroidBounds = centroidBounds[k];
+	    if (child.end - child.begin > minItems)
+	      next.push_back(child);
+	    else
+	      {
+		child.nextFree = nextFree;
+		nextFree += 2*(child.end - child.begin) - 2;
+		subtree.push_back(child);
+	      }
+	  }
+      }
+
+    level.clear();
+    level.insert(level.end(),next.begin(),next.end());
+    slice.clear();
+    for (int t=0;t<(int)level.size();t++)
+      addSlices(t);
+  }
+
+  void ParallelBinnedAllDims::build(const RTBoxSSE &sceneAABB,const RTBoxSSE &centroidAABB)
+  {
+    const int numAABBs = bvh->numPrimitives();
+    if (numAABBs <= PARALLEL_SPLIT_MIN_ITEMS)
+      {
+	BinnedAllDimsSaveSpace::build(sceneAABB,centroidAABB);
+	return;
+      }
+
+    aabb = bvh->getAllPrimitiveBounds();
+    bvh->reserve(numAABBs);
+
+    buildThreads = max(1,Options::buildThreads);
+    if (buildThreads > 1)
+      createThreads(buildThreads);
+    const int numThreadBins = max(buildThreads,maxNumberOfThreads());
+    const int maxSlices = (numAABBs + PARALLEL_SLICE_ITEMS - 1) / PARALLEL_SLICE_ITEMS + 2 * PARALLEL_SUBTREES;
+    threadBins = aligned_malloc<BinTable>(numThreadBins);
+    sliceBins = aligned_malloc<BinTable>(maxSlices);
+    tmpItem = aligned_malloc<int>(numAABBs);
+
+    level.clear();
+    subtree.clear();
+    slice.clear();
+
+    BuildTask root;
+    root.nodeID = 0;
+    root.begin = 0;
+    root.end = numAABBs;
+    root.voxel = sceneAABB;
+    root.centroidBounds = centroidAABB;
+    level.push_back(root);
+    addSlices(0);
+
+    Timer timer;
+    int nextFreeNode = 1;
+    for (int depth=0;!level.empty();depth++)
+      {
+	const int nodes = level.size();
+	int items = 0;
+	for (int t=0;t<nodes;t++)
+	  items += level[t].end - level[t].begin;
+
+	timer.start();
+	runPhase(depth == 0 ? PHASE_CONVERT : PHASE_BIN,slice.size());
+	splitLevel(nextFreeNode);
+	cout << "  level " << depth << " : " << nodes << " nodes " << items << " items "
+	     << 1000.0f * timer.stop() << " ms" << endl;
+      }
+
+    timer.start();
+    std::sort(subtree.begin(),subtree.end(),largerSubtree);
+    runPhase(PHASE_SUBTREES,subtree.size());
+    cout << "  subtrees : " << subtree.size() << " on " << buildThreads << " threads "
+	 << 1000.0f * timer.stop() << " ms" << endl;
+
+    aligned_free(tmpItem);
+    aligned_free(sliceBins);
+    aligned_free(threadBins);
+    bvh->doneWithAllPrimitiveBounds(aabb);
+  }
+
+} // end namespace
@@ -0,0 +1,115 @@
+#ifndef RTTL__BVH_BUILDER_PARALLELBINNEDALLDIMS_HXX
+#define RTTL__BVH_BUILDER_PARALLELBINNEDALLDIMS_HXX
+
+#include "BinnedAllDimsSaveSpace.hxx"
+#include "../../common/RTThread.hxx"
+
+namespace RTTL {
+
+  /*! nodes with more items than this are split by all threads together */
+#define PARALLEL_SPLIT_MIN_ITEMS 4096
+  /*! ... as long as there are fewer than about this many of them */
+#define PARALLEL_SUBTREES 256
+  /*! items binned/partitioned by one job of a cooperative split */
+#define PARALLEL_SLICE_ITEMS 8192
+
+  /*! multi-threaded version of BinnedAllDimsSaveSpace. the top levels
+    of the tree are built one level at a time, with all threads
+    binning and partitioning slices of the large nodes of a level;
+    the remaining small nodes are then built as independent subtrees
+    (one per job, each with its own bins). all splits are the same as
+    in the serial builder, and the tree does not depend on the number
+    of threads */
+  class ParallelBinnedAllDims : public BinnedAllDimsSaveSpace, public MultiThreadedTaskQueue
+  {
+  protected:
+
+    enum {
+      PHASE_CONVERT,
+      PHASE_BIN,
+      PHASE_COUNT,
+      PHASE_SCATTER,
+      PHASE_COPY,
+      PHASE_SUBTREES
+    };
+
+    /*! a node waiting to be split, by all threads or as a subtree */
+    struct BuildTask {
+      AABB voxel;
+      AABB centroidBounds;
+      int nodeID;
+      int begin, end;
+      int nextFree; // first node reserved for a subtree
+
+      // set by the cooperative split
+      AABB childVoxel[2];
+      sse_f c_min, scale;
+      int numBins;
+      int split, splitDim;
+      int mid;
+
+      BuildTask() : nodeID(0), begin(0), end(0), nextFree(0),
+                    numBins(0), split(-1), splitDim(0), mid(0)
+      {
+        voxel.setEmpty();
+        centroidBounds.setEmpty();
+        childVoxel[0].setEmpty();
+        childVoxel[1].setEmpty();
+        c_min = scale = _mm_setzero_ps();
+      }
+    };
+
+    /*! part of a node that is binned and partitioned by one job */
+    struct Slice {
+      AABB leftCentroidBounds, rightCentroidBounds;
+      int task;
+      int begin, end;
+      int left;                 // # of items going left
+      int leftDest, rightDest;  // where they go in tmpItem
+
+      Slice() : task(0), begin(0), end(0), left(0), leftDest(0), rightDest(0)
+      {
+        leftCentroidBounds.setEmpty();
+        rightCentroidBounds.setEmpty();
+      }
+    };
+
+    static bool largerSubtree(const BuildTask &a, const BuildTask &b)
+    {
+      return a.end - a.begin > b.end - b.begin;
+    }
+
+    vector< BuildTask, Align<BuildTask> > level;
+    vector< BuildTask, Align<BuildTask> > subtree;
+    vector< Slice, Align<Slice> > slice;
+
+    BinTable *sliceBins;   // one per slice of the current level
+    BinTable *threadBins;  // one per thread, for the subtrees
+    int *tmpItem;
+    AABB *aabb;
+
+    int phase;
+    int jobs;
+    AtomicCounter nextJob;
+    int buildThreads;
+
+    /*! run all jobs of a phase on all threads. jobs are handed out
+      via nextJob, so it does not matter which thread gets which
+      jobID */
+    void runPhase(const int phase, const int jobs);
+    virtual int task(int jobID, int threadID);
+
+    void job(const int phase, const int jobID, const int threadID);
+    void addSlices(const int t);
+    void splitLevel(int &nextFree);
+
+  public:
+    ParallelBinnedAllDims(BVH *bvh) : BinnedAllDimsSaveSpace(bvh), MultiThreadedTaskQueue()
+    {
+    }
+
+    virtual void build(const RTBoxSSE &sceneAABB,const RTBoxSSE &centroidAABB);
+  };
+
+} // end namespace
+#endif
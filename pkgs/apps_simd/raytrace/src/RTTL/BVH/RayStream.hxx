@@ -0,0 +1,379 @@
+/*! \file RayStream.hxx ray stream traversal for incoherent rays.
+instead of fixed packets, a large batch of single rays is filtered
+through the BVH: each node only sees the rays that hit its parent.
+rays are tested RT_SIMD_WIDTH at a time and the ones that hit a child
+are compacted into the child's ray list, so SIMD lanes stay busy no
+matter how much the rays diverge. optionally the rays are binned by
+direction octant first, which gives exact front-to-back order and
+the cheaper same-sign box test */
+
+#ifndef RTTL_RAYSTREAM_HXX
+#define RTTL_RAYSTREAM_HXX
+
+#include "BVH.hxx"
+
+/* rays are handed to the mesh as RT_SIMD_WIDTH wide packets with
+   multiple origins */
+#define RAY_STREAM_LAYOUT STORE_NEAR_FAR_DISTANCE
+
+namespace RTTL {
+
+    /*! single rays in SoA form. every ray has a tag, e.g. the pixel
+    it belongs to, since only active rays are added to a stream */
+    template <int SHADOW_RAYS>
+    class RayStream
+    {
+    public:
+        typedef RayPacket<1, RAY_STREAM_LAYOUT, 1, SHADOW_RAYS> Lanes;
+
+        RayStream() : m_rays(0), m_capacity(0), m_data(NULL) {};
+        ~RayStream() { if (m_data) free_align(m_data); };
+
+        _INLINE int size() const { return m_rays; }
+        _INLINE void clear() { m_rays = 0; }
+
+        _INLINE float &origin(const int a, const int r)     { return field(ORIGIN+a)[r]; }
+        _INLINE float &direction(const int a, const int r)  { return field(DIRECTION+a)[r]; }
+        _INLINE float &reciprocal(const int a, const int r) { return field(RECIPROCAL+a)[r]; }
+        _INLINE float &minDistance(const int r) { return field(MIN_DISTANCE)[r]; }
+        _INLINE float &maxDistance(const int r) { return field(MAX_DISTANCE)[r]; }
+        _INLINE int   &tag(const int r)         { return ((int*)field(TAG))[r]; }
+        /*! hit data, not available for shadow rays */
+        _INLINE float &u(const int r)           { return field(U)[r]; }
+        _INLINE float &v(const int r)           { return field(V)[r]; }
+        _INLINE int   &id(const int r)          { return ((int*)field(ID))[r]; }
+        _INLINE int   &shaderID(const int r)    { return ((int*)field(SHADER_ID))[r]; }
+
+        /*! shadow rays: a ray is occluded once its far distance is negative */
+        _INLINE bool occluded(const int r) { return maxDistance(r) < 0.0f; }
+
+        /*! append the active rays (minDistance <= maxDistance) of a
+        packet. ray k of the packet gets the tag tagBase + k */
+        template <int N, int LAYOUT>
+        void append(RayPacket<N, LAYOUT, 1, SHADOW_RAYS> &packet, const int tagBase)
+        {
+            reserve(m_rays + N * RT_SIMD_WIDTH);
+            for (int i=0;i<N;i++)
+            {
+                unsigned int active = movemask(cmple(packet.minDistance(i),packet.maxDistance(i)));
+                while (active)
+                {
+                    const int k = i * RT_SIMD_WIDTH + __builtin_ctz(active);
+                    active &= active - 1;
+                    const int r = m_rays++;
+                    origin(0,r) = packet.floatOriginX(k);
+                    origin(1,r) = packet.floatOriginY(k);
+                    origin(2,r) = packet.floatOriginZ(k);
+                    direction(0,r) = packet.floatDirectionX(k);
+                    direction(1,r) = packet.floatDirectionY(k);
+                    direction(2,r) = packet.floatDirectionZ(k);
+                    reciprocal(0,r) = packet.floatReciprocalX(k);
+                    reciprocal(1,r) = packet.floatReciprocalY(k);
+                    reciprocal(2,r) = packet.floatReciprocalZ(k);
+                    minDistance(r) = packet.floatMinDistance(k);
+                    maxDistance(r) = packet.floatMaxDistance(k);
+                    tag(r) = tagBase + k;
+                    appendHit(packet,k,r);
+                }
+            }
+        }
+
+        /*! load the rays id[0..RT_SIMD_WIDTH-1] into a packet, with
+        directions and hit data only if needed for intersection */
+        _INLINE void gather(Lanes &lanes, const int *const id, const bool intersect)
+        {
+            for (int k=0;k<RT_SIMD_WIDTH;k++)
+            {
+                const int r = id[k];
+                lanes.floatOriginX(k) = origin(0,r);
+                lanes.floatOriginY(k) = origin(1,r);
+                lanes.floatOriginZ(k) = origin(2,r);
+                lanes.floatReciprocalX(k) = reciprocal(0,r);
+                lanes.floatReciprocalY(k) = reciprocal(1,r);
+                lanes.floatReciprocalZ(k) = reciprocal(2,r);
+                lanes.floatMinDistance(k) = minDistance(r);
+                lanes.floatMaxDistance(k) = maxDistance(r);
+                if (intersect)
+                {
+                    lanes.floatDirectionX(k) = direction(0,r);
+                    lanes.floatDirectionY(k) = direction(1,r);
+                    lanes.floatDirectionZ(k) = direction(2,r);
+                    gatherHit(lanes,k,r);
+                }
+            }
+        }
+
+        /*! store the intersection results of the first 'lanes' rays */
+        _INLINE void scatter(Lanes &lanes, const int *const id, const int n)
+        {
+            for (int k=0;k<n;k++)
+            {
+                maxDistance(id[k]) = lanes.floatMaxDistance(k);
+                scatterHit(lanes,k,id[k]);
+            }
+        }
+
+        /*! ray index lists used during traversal */
+        vector<int> list;
+
+    protected:
+        enum {
+            ORIGIN = 0,
+            DIRECTION = 3,
+            RECIPROCAL = 6,
+            MIN_DISTANCE = 9,
+            MAX_DISTANCE,
+            TAG,
+            U,
+            V,
+            ID,
+            SHADER_ID,
+            FIELDS = SHADOW_RAYS ? U : SHADER_ID + 1
+        };
+
+        _INLINE float *field(const int f) { return m_data + f * m_capacity; }
+
+        void reserve(const int rays)
+        {
+            if (rays <= m_capacity) return;
+            int capacity = max(2 * m_capacity,1024);
+            while (capacity < rays) capacity *= 2;
+            float *data = aligned_malloc<float>(FIELDS * capacity);
+            for (int f=0;f<FIELDS && m_data;f++)
+                memcpy(data + f * capacity,field(f),m_rays * sizeof(float));
+            if (m_data) free_align(m_data);
+            m_data = data;
+            m_capacity = capacity;
+        }
+
+        template <int N, int LAYOUT>
+        _INLINE void appendHit(const RayPacket<N, LAYOUT, 1, 0> &packet, const int k, const int r)
+        {
+            u(r) = packet.floatU(k);
+            v(r) = packet.floatV(k);
+            id(r) = packet.intId(k);
+            shaderID(r) = packet.intShaderID(k);
+        }
+        template <int N, int LAYOUT>
+        _INLINE void appendHit(const RayPacket<N, LAYOUT, 1, 1> &packet, const int k, const int r) {}
+
+        _INLINE void gatherHit(RayPacket<1, RAY_STREAM_LAYOUT, 1, 0> &lanes, const int k, const int r)
+        {
+            lanes.floatU(k) = u(r);
+            lanes.floatV(k) = v(r);
+            lanes.intId(k) = id(r);
+            lanes.intShaderID(k) = shaderID(r);
+        }
+        _INLINE void gatherHit(RayPacket<1, RAY_STREAM_LAYOUT, 1, 1> &lanes, const int k, const int r) {}
+
+        _INLINE void scatterHit(RayPacket<1, RAY_STREAM_LAYOUT, 1, 0> &lanes, const int k, const int r)
+        {
+            u(r) = lanes.floatU(k);
+            v(r) = lanes.floatV(k);
+            id(r) = lanes.intId(k);
+            shaderID(r) = lanes.intShaderID(k);
+        }
+        _INLINE void scatterHit(RayPacket<1, RAY_STREAM_LAYOUT, 1, 1> &lanes, const int k, const int r) {}
+
+        int m_rays;
+        int m_capacity;
+        float *m_data;
+    };
+
+    /*! filter the rays list[start..start+count) through the BVH. with
+    SAME_SIGNS, all rays have the direction signs raySigns */
+    template <int SHADOW_RAYS, int SAME_SIGNS, class Mesh>
+    void TraverseRayStreamList(RayStream<SHADOW_RAYS> &stream,
+                               const int start,
+                               const int count,
+                               const int raySigns[3],
+                               const AABB *const bvh,
+                               const int *const item,
+                               const Mesh &mesh)
+    {
+        typedef typename RayStream<SHADOW_RAYS>::Lanes Lanes;
+        vector<int> &list = stream.list;
+
+        /* the list of a node lies behind the lists of all nodes below
+        it on the stack, so its children's lists go behind it */
+        struct StackEntry {
+            int node;
+            int start;
+            int count;
+        } stack[MAX_BVH_STACK_DEPTH+1];
+        StackEntry *sptr = stack;
+
+        sptr->node = 0;
+        sptr->start = start;
+        sptr->count = count;
+        sptr++;
+
+        _ALIGN(DEFAULT_ALIGNMENT) Lanes lanes;
+        while (sptr != stack)
+        {
+            sptr--;
+            const AABB &entry = bvh[sptr->node];
+            const int first = sptr->start;
+            const int rays = sptr->count;
+
+            if (entry.isLeaf())
+            {
+                BVH_STAT_COLLECTOR(BVHStatCollector::global.numLeafIntersections++);
+                const int items = entry.items();
+                const int *const prim = item + entry.itemOffset();
+                for (int c=0;c<rays;c+=RT_SIMD_WIDTH)
+                {
+                    const int *const id = &list[first + c];
+                    stream.gather(lanes,id,true);
+                    for (int i=0;i<items;i++)
+                    {
+                        BVH_STAT_COLLECTOR(BVHStatCollector::global.numPrimitiveIntersections++);
+                        mesh.template intersectPrimitive<1, RAY_STREAM_LAYOUT, 1, SHADOW_RAYS>(lanes,prim[i],0,1);
+                    }
+                    stream.scatter(lanes,id,min(rays - c,RT_SIMD_WIDTH));
+                }
+                continue;
+            }
+
+            BVH_STAT_COLLECTOR(BVHStatCollector::global.numTraversalSteps++);
+            const unsigned int rayDir = raySigns[entry.axis()] & 1;
+            const AABB &nearBox = bvh[entry.children() + rayDir];
+            const AABB &farBox  = bvh[entry.children() + (1^rayDir)];
+
+            /* room for both child lists, plus one SIMD vector of
+            slack that is read but masked out */
+            const int top = first + rays;
+            if ((int)list.size() < top + 2 * rays + RT_SIMD_WIDTH)
+                list.resize(top + 2 * rays + RT_SIMD_WIDTH);
+            int *const farList  = &list[top];
+            int *const nearList = &list[top + rays];
+            int nearRays = 0, farRays = 0;
+
+            const sse_f *const n = (sse_f*)&nearBox;
+            const sse_f *const f = (sse_f*)&farBox;
+            const int s0 = SAME_SIGNS ? raySigns[0] : 0;
+            const int s1 = SAME_SIGNS ? raySigns[1] : 0;
+            const int s2 = SAME_SIGNS ? raySigns[2] : 0;
+            const simd_f nMinX = convert<simd_f>(M128_FLOAT(n[s0],0));
+            const simd_f nMinY = convert<simd_f>(M128_FLOAT(n[s1],1));
+            const simd_f nMinZ = convert<simd_f>(M128_FLOAT(n[s2],2));
+            const simd_f nMaxX = convert<simd_f>(M128_FLOAT(n[s0^1],0));
+            const simd_f nMaxY = convert<simd_f>(M128_FLOAT(n[s1^1],1));
+            const simd_f nMaxZ = convert<simd_f>(M128_FLOAT(n[s2^1],2));
+            const simd_f fMinX = convert<simd_f>(M128_FLOAT(f[s0],0));
+            const simd_f fMinY = convert<simd_f>(M128_FLOAT(f[s1],1));
+            const simd_f fMinZ = convert<simd_f>(M128_FLOAT(f[s2],2));
+            const simd_f fMaxX = convert<simd_f>(M128_FLOAT(f[s0^1],0));
+            const simd_f fMaxY = convert<simd_f>(M128_FLOAT(f[s1^1],1));
+            const simd_f fMaxZ = convert<simd_f>(M128_FLOAT(f[s2^1],2));
+
+            for (int c=0;c<rays;c+=RT_SIMD_WIDTH)
+            {
+                const int *const id = &list[first + c];
+                stream.gather(lanes,id,false);
+                const unsigned int valid = rays - c >= RT_SIMD_WIDTH ? RT_SIMD_MASK_ALL : (1 << (rays - c)) - 1;
+
+                /* stream compaction: the hit masks select the ray ids
+                written to the child lists */
+                unsigned int hitNear = valid & RayPacketIntersectAABB<1, RAY_STREAM_LAYOUT, 1, SHADOW_RAYS, SAME_SIGNS>
+                    (lanes,0,nMinX,nMaxX,nMinY,nMaxY,nMinZ,nMaxZ);
+                unsigned int hitFar = valid & RayPacketIntersectAABB<1, RAY_STREAM_LAYOUT, 1, SHADOW_RAYS, SAME_SIGNS>
+                    (lanes,0,fMinX,fMaxX,fMinY,fMaxY,fMinZ,fMaxZ);
+                while (hitNear)
+                {
+                    nearList[nearRays++] = id[__builtin_ctz(hitNear)];
+                    hitNear &= hitNear - 1;
+                }
+                while (hitFar)
+                {
+                    farList[farRays++] = id[__builtin_ctz(hitFar)];
+                    hitFar &= hitFar - 1;
+                }
+            }
+
+            if (farRays)
+            {
+                sptr->node = entry.children() + (1^rayDir);
+                sptr->start = top;
+                sptr->count = farRays;
+                sptr++;
+            }
+            if (nearRays)
+            {
+                sptr->node = entry.children() + rayDir;
+                sptr->start = top + rays;
+                sptr->count = nearRays;
+                sptr++;
+            }
+        }
+    }
+
+    /*! trace all rays of a stream. with sortOctants, the rays are
+    binned by the signs of their directions and each octant is
+    traversed on its own */
+    template <int SHADOW_RAYS, class Mesh>
+    void TraverseRayStream(RayStream<SHADOW_RAYS> &stream,
+                           const AABB *const bvh,
+                           const int *const item,
+                           const Mesh &mesh,
+                           const bool sortOctants)
+    {
+        const int rays = stream.size();
+        if (rays == 0) return;
+        vector<int> &list = stream.list;
+        if ((int)list.size() < 3 * rays + RT_SIMD_WIDTH)
+            list.resize(3 * rays + RT_SIMD_WIDTH);
+
+        if (!sortOctants)
+        {
+            for (int r=0;r<rays;r++)
+                list[r] = r;
+            const int raySigns[3] = {
+                stream.direction(0,0) < 0.0f,
+                stream.direction(1,0) < 0.0f,
+                stream.direction(2,0) < 0.0f
+            };
+            TraverseRayStreamList<SHADOW_RAYS, false, Mesh>(stream,0,rays,raySigns,bvh,item,mesh);
+            return;
+        }
+
+        /* counting sort by octant */
+        int octantStart[9];
+        for (int o=0;o<9;o++)
+            octantStart[o] = 0;
+        for (int r=0;r<rays;r++)
+        {
+            const int octant =
+                (stream.direction(0,r) < 0.0f) |
+                (stream.direction(1,r) < 0.0f) << 1 |
+                (stream.direction(2,r) < 0.0f) << 2;
+            octantStart[octant+1]++;
+        }
+        for (int o=0;o<8;o++)
+            octantStart[o+1] += octantStart[o];
+        int octantEnd[8];
+        for (int o=0;o<8;o++)
+            octantEnd[o] = octantStart[o];
+        for (int r=0;r<rays;r++)
+        {
+            const int octant =
+                (stream.direction(0,r) < 0.0f) |
+                (stream.direction(1,r) < 0.0f) << 1 |
+                (stream.direction(2,r) < 0.0f) << 2;
+            list[octantEnd[octant]++] = r;
+        }
+
+        /* the octants are traversed back to front, the list of each
+        octant is then the last one in use when it is traversed */
+        for (int o=7;o>=0;o--)
+        {
+            const int count = octantStart[o+1] - octantStart[o];
+            if (count == 0) continue;
+            const int raySigns[3] = { o & 1, (o >> 1) & 1, (o >> 2) & 1 };
+            TraverseRayStreamList<SHADOW_RAYS, true, Mesh>(stream,octantStart[o],count,raySigns,bvh,item,mesh);
+        }
+    }
+
+};
+
+#endif
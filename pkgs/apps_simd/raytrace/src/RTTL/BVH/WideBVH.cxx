@@ -0,0 +1,139 @@
+#include "WideBVH.hxx"
+
+namespace RTTL
+{
+  template <int K>
+  void WideBVH<K>::collapse(const AABB *const bvh)
+  {
+    node.clear();
+    collapseNode(bvh,0);
+  }
+
+  template <int K>
+  int WideBVH<K>::collapseNode(const AABB *const bvh, const int index)
+  {
+    int slot[K];
+    float area[K];
+    int slots = 0;
+    if (bvh[index].isLeaf())
+      slot[slots++] = index; // only for a root that is a leaf
+    else
+      {
+	slot[slots++] = bvh[index].children();
+	slot[slots++] = bvh[index].children()+1;
+      }
+    for (int i=0;i<slots;i++)
+      area[i] = bvh[slot[i]].isLeaf() ? -1.0f : bvh[slot[i]].area();
+
+    /* open the inner child with the largest surface area */
+    while (slots < K)
+      {
+	int best = 0;
+	for (int i=1;i<slots;i++)
+	  if (area[i] > area[best])
+	    best = i;
+	if (area[best] < 0.0f) break;
+	const int children = bvh[slot[best]].children();
+	slot[best] = children;
+	slot[slots] = children+1;
+	area[best] = bvh[slot[best]].isLeaf() ? -1.0f : bvh[slot[best]].area();
+	area[slots] = bvh[slot[slots]].isLeaf() ? -1.0f : bvh[slot[slots]].area();
+	slots++;
+      }
+
+    const int n = node.size();
+    node.push_back(Node());
+
+    int child[K];
+    for (int i=0;i<slots;i++)
+      child[i] = bvh[slot[i]].isLeaf() ? (int)bvh[slot[i]].children() : collapseNode(bvh,slot[i]);
+
+    Node &dest = node[n];
+    for (int i=0;i<K;i++)
+      {
+	const sse_f lower = i < slots ? bvh[slot[i]].min_f() : convert<sse_f>(numeric_limits<float>::infinity());
+	const sse_f upper = i < slots ? bvh[slot[i]].max_f() : convert<sse_f>(-numeric_limits<float>::infinity());
+	for (int d=0;d<3;d++)
+	  {
+	    dest.lower[d][i] = M128_FLOAT(lower,d);
+	    dest.upper[d][i] = M128_FLOAT(upper,d);
+	  }
+      }
+    for (int i=0;i<K;i++)
+      {
+	dest.child[i] = i < slots ? child[i] : (int)(1<<31);
+	dest.items[i] = i < slots && bvh[slot[i]].isLeaf() ? bvh[slot[i]].items() : 0;
+      }
+    return n;
+  }
+
+  template <int K>
+  bool QuantizedWideBVH<K>::quantize(const WideBVH<K> &bvh)
+  {
+    node.resize(bvh.node.size());
+    for (size_t n=0;n<bvh.node.size();n++)
+      {
+	const WideBVHNode<K> &src = bvh.node[n];
+	Node &dest = node[n];
+	dest.valid = 0;
+	for (int i=0;i<K;i++)
+	  {
+	    if (src.isEmpty(i)) continue;
+	    if (src.items[i] > 0xffff) return false;
+	    dest.valid |= 1 << i;
+	  }
+
+	for (int d=0;d<3;d++)
+	  {
+	    float lower = numeric_limits<float>::infinity();
+	    float upper = -numeric_limits<float>::infinity();
+	    for (int i=0;i<K;i++)
+	      if (dest.valid & (1 << i))
+		{
+		  lower = min(lower,src.lower[d][i]);
+		  upper = max(upper,src.upper[d][i]);
+		}
+	    if (dest.valid == 0) lower = upper = 0.0f;
+
+	    /* smallest power of two step that covers the node in 255 steps */
+	    int exponent;
+	    frexpf((upper - lower) / 255.0f,&exponent);
+	    exponent = max(exponent,-126);
+	    dest.origin[d] = lower;
+	    dest.exponent[d] = exponent;
+	    while (lower + 255.0f * dest.scale(d) < upper && exponent < 127)
+	      dest.exponent[d] = ++exponent;
+
+	    const float scale = dest.scale(d);
+	    for (int i=0;i<K;i++)
+	      {
+		if ((dest.valid & (1 << i)) == 0)
+		  {
+		    dest.lower[d][i] = 255;
+		    dest.upper[d][i] = 0;
+		    continue;
+		  }
+		/* round outwards, and make sure the decoded bounds do */
+		int lo = max(0,min(255,(int)floorf((src.lower[d][i] - lower) / scale)));
+		int hi = max(0,min(255,(int)ceilf((src.upper[d][i] - lower) / scale)));
+		while (lo > 0 && lower + (float)lo * scale > src.lower[d][i]) lo--;
+		while (hi < 255 && lower + (float)hi * scale < src.upper[d][i]) hi++;
+		dest.lower[d][i] = lo;
+		dest.upper[d][i] = hi;
+	      }
+	  }
+
+	for (int i=0;i<K;i++)
+	  {
+	    dest.child[i] = src.child[i];
+	    dest.items[i] = src.items[i];
+	  }
+      }
+    return true;
+  }
+
+  template struct WideBVH<4>;
+  template struct WideBVH<8>;
+  template struct QuantizedWideBVH<4>;
+  template struct QuantizedWideBVH<8>;
+};
@@ -0,0 +1,450 @@
+/*! \file WideBVH.hxx 4- and 8-ary BVH, collapsed from the binary
+BVH after it has been built. the bounds of all children of a node
+are stored in SoA form so they can be tested against the packet in
+one SIMD operation. optionally the bounds are quantized to 8 bits
+(QuantizedWideBVH), which halves the size of the nodes */
+
+#ifndef RTTL_WIDEBVH_HXX
+#define RTTL_WIDEBVH_HXX
+
+#include "BVH.hxx"
+
+namespace RTTL {
+
+    /*! origin + q * scale for 8 bit quantized coordinates q */
+    _INLINE void wideDecode(sse_f &v, const unsigned char *const q, const float origin, const float scale)
+    {
+#ifdef RT_EMULATE_SSE
+        _ALIGN(16) float f[4];
+        for (int i=0;i<4;i++) f[i] = origin + (float)q[i] * scale;
+        v = _mm_load_ps(f);
+#else
+        const sse_i zero = _mm_setzero_si128();
+        const sse_i i = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(*(const int*)q),zero),zero);
+        v = _mm_add_ps(_mm_set_ps1(origin),_mm_mul_ps(_mm_cvtepi32_ps(i),_mm_set_ps1(scale)));
+#endif
+    }
+
+    /*! node of a K-ary BVH. children are either inner nodes (index
+    of the node) or leaves (item offset | 1<<31 and the number of
+    items, as in the binary BVH). unused slots have empty bounds and
+    no items */
+    template <int K>
+    struct WideBVHNode
+    {
+        float lower[3][K];
+        float upper[3][K];
+        int child[K];
+        int items[K];
+
+        _INLINE bool isLeaf(const int i) const { return child[i] < 0; }
+        _INLINE bool isEmpty(const int i) const { return child[i] < 0 && items[i] == 0; }
+        _INLINE unsigned int itemOffset(const int i) const { return child[i] & ~(unsigned int)(1<<31); }
+
+        /*! the node with float bounds, see QuantizedWideBVHNode */
+        _INLINE const WideBVHNode &decode(WideBVHNode &) const { return *this; }
+
+        /*! mask of the used slots. the empty bounds of unused slots
+        never hit, so traversal does not have to mask them */
+        _INLINE int occupied() const { return (1 << K) - 1; }
+    };
+
+    /*! K-ary BVH. shares the item lists with the binary BVH it has
+    been collapsed from */
+    template <int K>
+    struct WideBVH
+    {
+        typedef WideBVHNode<K> Node;
+
+        /*! root node is node '0' */
+        vector< Node, Align<Node> > node;
+
+        /*! rebuild from a binary BVH: starting at the root, the child
+        with the largest surface area is replaced by its two children
+        until a node has K children */
+        void collapse(const AABB *const bvh);
+
+    protected:
+        int collapseNode(const AABB *const bvh, const int index);
+    };
+
+    /*! node of a K-ary BVH with the children's bounds quantized to 8
+    bits within the bounds of the node itself: a child's bound is
+    origin + q * 2^exponent, rounded outwards. half the size of a
+    WideBVHNode, one cache line for K = 4 and two for K = 8. children
+    are stored as in WideBVHNode, but leaves hold at most 65535
+    items */
+    template <int K>
+    struct _ALIGN(64) QuantizedWideBVHNode
+    {
+        float origin[3];
+        signed char exponent[3];
+        /*! bit i is set if slot i is used */
+        unsigned char valid;
+        unsigned char lower[3][K];
+        unsigned char upper[3][K];
+        int child[K];
+        unsigned short items[K];
+
+        _INLINE bool isLeaf(const int i) const { return child[i] < 0; }
+        _INLINE bool isEmpty(const int i) const { return (valid & (1 << i)) == 0; }
+        _INLINE unsigned int itemOffset(const int i) const { return child[i] & ~(unsigned int)(1<<31); }
+
+        _INLINE float scale(const int d) const
+        {
+            union { int i; float f; } s;
+            s.i = (exponent[d] + 127) << 23;
+            return s.f;
+        }
+
+        /*! decode the bounds into dest, whose other fields are left
+        alone. returns dest */
+        _INLINE const WideBVHNode<K> &decode(WideBVHNode<K> &dest) const
+        {
+            for (int d=0;d<3;d++)
+            {
+                const float s = scale(d);
+                for (int b=0;b<K;b+=4)
+                {
+                    sse_f lo, hi;
+                    wideDecode(lo,&lower[d][b],origin[d],s);
+                    wideDecode(hi,&upper[d][b],origin[d],s);
+                    _mm_store_ps(&dest.lower[d][b],lo);
+                    _mm_store_ps(&dest.upper[d][b],hi);
+                }
+            }
+            return dest;
+        }
+
+        _INLINE int occupied() const { return valid; }
+    };
+
+    /*! K-ary BVH with quantized nodes, same topology and node order
+    as the WideBVH it has been quantized from */
+    template <int K>
+    struct QuantizedWideBVH
+    {
+        typedef QuantizedWideBVHNode<K> Node;
+
+        vector< Node, Align<Node> > node;
+
+        /*! returns false if the BVH cannot be quantized because a
+        leaf has too many items */
+        bool quantize(const WideBVH<K> &bvh);
+    };
+
+    /* children are tested 4 at a time with SSE; 8-ary nodes are
+    tested with one AVX operation when the ray packets are 8 wide */
+    template <int K> struct WideBVHLanes { typedef sse_f vec; };
+#if RT_SIMD_WIDTH == 8
+    template <> struct WideBVHLanes<8> { typedef simd_f vec; };
+#endif
+
+    _INLINE void wideLoad(sse_f &v, const float *const p) { v = _mm_load_ps(p); }
+    _INLINE void wideSplat(sse_f &v, const float f) { v = _mm_set_ps1(f); }
+    _INLINE int wideLE(const sse_f &a, const sse_f &b) { return _mm_movemask_ps(_mm_cmple_ps(a,b)); }
+#if RT_SIMD_WIDTH == 8
+    _INLINE void wideLoad(simd_f &v, const float *const p) { v = simd_load(p); }
+    _INLINE void wideSplat(simd_f &v, const float f) { v = convert<simd_f>(f); }
+    _INLINE int wideLE(const simd_f &a, const simd_f &b) { return movemask(cmple(a,b)); }
+#endif
+
+    _INLINE float horizontalMin(const simd_f &v)
+    {
+        float m = M128_FLOAT(v,0);
+        for (int i=1;i<RT_SIMD_WIDTH;i++) m = min(m,M128_FLOAT(v,i));
+        return m;
+    }
+
+    _INLINE float horizontalMax(const simd_f &v)
+    {
+        float m = M128_FLOAT(v,0);
+        for (int i=1;i<RT_SIMD_WIDTH;i++) m = max(m,M128_FLOAT(v,i));
+        return m;
+    }
+
+    /*! bounds of all rays of a packet whose directions have the same
+    signs: interval of the reciprocal directions and origins per
+    axis, and of the ray segments. only filled in for such packets,
+    the constructor clears it for all others */
+    template <class V>
+    struct WideBVHFrustum
+    {
+        V rcpMin[3], rcpMax[3];
+        V orgMin[3], orgMax[3];
+        V tMin, tMax;
+        int sign[3];
+
+        WideBVHFrustum()
+        {
+            for (int d=0;d<3;d++)
+            {
+                wideSplat(rcpMin[d],0.0f);
+                wideSplat(rcpMax[d],0.0f);
+                wideSplat(orgMin[d],0.0f);
+                wideSplat(orgMax[d],0.0f);
+                sign[d] = 0;
+            }
+            wideSplat(tMin,0.0f);
+            wideSplat(tMax,0.0f);
+        }
+    };
+
+    /*! conservative test of the children in lanes of V against the
+    frustum; returns the mask of children that may be hit by any ray,
+    and the distance to each of them for sorting */
+    template <int MULTIPLE_ORIGINS, class V>
+    _INLINE int WideIntersectFrustum(const V *const lower,
+        const V *const upper,
+        const WideBVHFrustum<V> &f,
+        V &tNear)
+    {
+        V tn = f.tMin;
+        V tf = f.tMax;
+        for (int d=0;d<3;d++)
+        {
+            const V nearPlane = f.sign[d] ? upper[d] : lower[d];
+            const V farPlane  = f.sign[d] ? lower[d] : upper[d];
+            if (MULTIPLE_ORIGINS)
+            {
+                const V n0 = nearPlane - f.orgMax[d];
+                const V n1 = nearPlane - f.orgMin[d];
+                const V f0 = farPlane - f.orgMax[d];
+                const V f1 = farPlane - f.orgMin[d];
+                tn = max(tn,min(min(n0 * f.rcpMin[d],n0 * f.rcpMax[d]),min(n1 * f.rcpMin[d],n1 * f.rcpMax[d])));
+                tf = min(tf,max(max(f0 * f.rcpMin[d],f0 * f.rcpMax[d]),max(f1 * f.rcpMin[d],f1 * f.rcpMax[d])));
+            }
+            else
+            {
+                const V n0 = nearPlane - f.orgMin[d];
+                const V f0 = farPlane - f.orgMin[d];
+                tn = max(tn,min(n0 * f.rcpMin[d],n0 * f.rcpMax[d]));
+                tf = min(tf,max(f0 * f.rcpMin[d],f0 * f.rcpMax[d]));
+            }
+        }
+        tNear = tn;
+        return wideLE(tn,tf);
+    }
+
+    /*! Node is WideBVHNode<K> or QuantizedWideBVHNode<K> */
+    template <int K, int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS, class Mesh, class Node>
+    _INLINE void TraverseWideBVH(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
+        const Node *const node,
+        const int *const item,
+        const Mesh &mesh)
+    {
+        typedef typename WideBVHLanes<K>::vec V;
+        const int LANES = sizeof(V) / sizeof(float);
+
+        BVH_STAT_COLLECTOR(BVHStatCollector::global.numPackets++);
+
+        struct StackEntry {
+            int child;
+            int items;
+            int fastHitID;
+        } stack[MAX_BVH_STACK_DEPTH * K];
+        StackEntry *sptr = stack;
+
+        /* decoded bounds of the current node, if quantized */
+        _ALIGN(DEFAULT_ALIGNMENT) WideBVHNode<K> scratch;
+
+        int raySigns[3];
+        raySigns[0] = signmask(packet.directionX(0)) == 0 ? 0 : 1;
+        raySigns[1] = signmask(packet.directionY(0)) == 0 ? 0 : 1;
+        raySigns[2] = signmask(packet.directionZ(0)) == 0 ? 0 : 1;
+
+        const unsigned int signsMinX = signmask(packet.reciprocalMin(0));
+        const unsigned int signsMinY = signmask(packet.reciprocalMin(1));
+        const unsigned int signsMinZ = signmask(packet.reciprocalMin(2));
+        const unsigned int signsMaxX = signmask(packet.reciprocalMax(0));
+        const unsigned int signsMaxY = signmask(packet.reciprocalMax(1));
+        const unsigned int signsMaxZ = signmask(packet.reciprocalMax(2));
+
+        const bool sameSigns =
+            (signsMaxX == RT_SIMD_MASK_ALL || signsMinX == 0x0) &&
+            (signsMaxY == RT_SIMD_MASK_ALL || signsMinY == 0x0) &&
+            (signsMaxZ == RT_SIMD_MASK_ALL || signsMinZ == 0x0);
+
+        WideBVHFrustum<V> frustum;
+        if (sameSigns)
+        {
+            for (int d=0;d<3;d++)
+            {
+                frustum.sign[d] = raySigns[d];
+                wideSplat(frustum.rcpMin[d],horizontalMin(packet.reciprocalMin(d)));
+                wideSplat(frustum.rcpMax[d],horizontalMax(packet.reciprocalMax(d)));
+            }
+            simd_f minX,maxX,minY,maxY,minZ,maxZ,tMin;
+            minX = maxX = packet.originX(0);
+            minY = maxY = packet.originY(0);
+            minZ = maxZ = packet.originZ(0);
+            for (int i=1;i<N && MULTIPLE_ORIGINS;i++)
+            {
+                minX = min(minX,packet.originX(i));
+                maxX = max(maxX,packet.originX(i));
+                minY = min(minY,packet.originY(i));
+                maxY = max(maxY,packet.originY(i));
+                minZ = min(minZ,packet.originZ(i));
+                maxZ = max(maxZ,packet.originZ(i));
+            }
+            tMin = packet.minDistance(0);
+            for (int i=1;i<N;i++)
+                tMin = min(tMin,packet.minDistance(i));
+            wideSplat(frustum.orgMin[0],horizontalMin(minX));
+            wideSplat(frustum.orgMin[1],horizontalMin(minY));
+            wideSplat(frustum.orgMin[2],horizontalMin(minZ));
+            wideSplat(frustum.orgMax[0],horizontalMax(maxX));
+            wideSplat(frustum.orgMax[1],horizontalMax(maxY));
+            wideSplat(frustum.orgMax[2],horizontalMax(maxZ));
+            wideSplat(frustum.tMin,horizontalMin(tMin));
+        }
+
+        /* rays leave the frustum test as soon as they have hit something,
+        so the far distance is updated after each leaf */
+        bool updateFar = true;
+
+        /* mixed signs: children are ordered along the first ray */
+        const float dirX = M128_FLOAT(packet.directionX(0),0);
+        const float dirY = M128_FLOAT(packet.directionY(0),0);
+        const float dirZ = M128_FLOAT(packet.directionZ(0),0);
+
+        sptr->child = 0;
+        sptr->items = 0;
+        sptr->fastHitID = 0;
+        sptr++;
+
+        while (sptr != stack)
+        {
+            sptr--;
+            const int hitID = sptr->fastHitID;
+
+            if (sptr->child < 0)
+            {
+                BVH_STAT_COLLECTOR(BVHStatCollector::global.numLeafIntersections++);
+                const int *start = item + (sptr->child & ~(unsigned int)(1<<31));
+                for (int i=0;i<sptr->items;i++)
+                {
+                    BVH_STAT_COLLECTOR(BVHStatCollector::global.numPrimitiveIntersections++);
+                    mesh.template intersectPrimitive<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS>(packet,start[i],hitID,N);
+                }
+                if (packet.terminated()) return;
+                updateFar = true;
+                continue;
+            }
+
+            BVH_STAT_COLLECTOR(BVHStatCollector::global.numTraversalSteps++);
+            const Node &n = node[sptr->child];
+            const WideBVHNode<K> &box = n.decode(scratch);
+
+            _ALIGN(DEFAULT_ALIGNMENT) float dist[K];
+            int mask = 0;
+            if (sameSigns)
+            {
+                if (updateFar)
+                {
+                    simd_f tMax = packet.maxDistance(0);
+                    for (int i=1;i<N;i++)
+                        tMax = max(tMax,packet.maxDistance(i));
+                    wideSplat(frustum.tMax,horizontalMax(tMax));
+                    updateFar = false;
+                }
+                for (int b=0;b<K;b+=LANES)
+                {
+                    V lower[3], upper[3], tNear;
+                    for (int d=0;d<3;d++)
+                    {
+                        wideLoad(lower[d],&box.lower[d][b]);
+                        wideLoad(upper[d],&box.upper[d][b]);
+                    }
+                    mask |= WideIntersectFrustum<MULTIPLE_ORIGINS>(lower,upper,frustum,tNear) << b;
+                    *(V*)&dist[b] = tNear;
+                }
+                mask &= n.occupied();
+            }
+            else
+            {
+                for (int c=0;c<K;c++)
+                {
+                    if (n.isEmpty(c)) continue;
+                    mask |= 1 << c;
+                    dist[c] =
+                        (box.lower[0][c] + box.upper[0][c]) * dirX +
+                        (box.lower[1][c] + box.upper[1][c]) * dirY +
+                        (box.lower[2][c] + box.upper[2][c]) * dirZ;
+                }
+            }
+            if (mask == 0)
+            {
+                BVH_STAT_COLLECTOR(BVHStatCollector::global.numIntervalPruningTests++);
+                continue;
+            }
+
+            /* first ray (vector) of the packet that hits each child */
+            int hitChild[K];
+            int hitRay[K];
+            int hits = 0;
+            for (int c=0;c<K;c++)
+            {
+                if ((mask & (1 << c)) == 0) continue;
+                const int s0 = sameSigns ? raySigns[0] : 0;
+                const int s1 = sameSigns ? raySigns[1] : 0;
+                const int s2 = sameSigns ? raySigns[2] : 0;
+                simd_f min_x = convert<simd_f>(s0 ? box.upper[0][c] : box.lower[0][c]);
+                simd_f min_y = convert<simd_f>(s1 ? box.upper[1][c] : box.lower[1][c]);
+                simd_f min_z = convert<simd_f>(s2 ? box.upper[2][c] : box.lower[2][c]);
+                simd_f max_x = convert<simd_f>(s0 ? box.lower[0][c] : box.upper[0][c]);
+                simd_f max_y = convert<simd_f>(s1 ? box.lower[1][c] : box.upper[1][c]);
+                simd_f max_z = convert<simd_f>(s2 ? box.lower[2][c] : box.upper[2][c]);
+                if (!MULTIPLE_ORIGINS)
+                {
+                    min_x = min_x - packet.originX(0);
+                    min_y = min_y - packet.originY(0);
+                    min_z = min_z - packet.originZ(0);
+                    max_x = max_x - packet.originX(0);
+                    max_y = max_y - packet.originY(0);
+                    max_z = max_z - packet.originZ(0);
+                }
+                int i = hitID;
+                if (sameSigns)
+                {
+                    for (;i<N;i++)
+                        if (RayPacketIntersectAABB<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, true>
+                            (packet,i,min_x,max_x,min_y,max_y,min_z,max_z))
+                            break;
+                }
+                else
+                {
+                    for (;i<N;i++)
+                        if (RayPacketIntersectAABB<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS, false>
+                            (packet,i,min_x,max_x,min_y,max_y,min_z,max_z))
+                            break;
+                }
+                BVH_STAT_COLLECTOR(if (i == hitID) BVHStatCollector::global.numFirstHitTests++);
+                if (i == N) continue;
+
+                /* insertion sort, nearest child last */
+                int j = hits++;
+                for (;j>0 && dist[hitChild[j-1]] < dist[c];j--)
+                {
+                    hitChild[j] = hitChild[j-1];
+                    hitRay[j] = hitRay[j-1];
+                }
+                hitChild[j] = c;
+                hitRay[j] = i;
+            }
+
+            /* push far to near, so the nearest child is visited first */
+            for (int j=0;j<hits;j++)
+            {
+                const int c = hitChild[j];
+                sptr->child = n.child[c];
+                sptr->items = n.items[c];
+                sptr->fastHitID = hitRay[j];
+                sptr++;
+            }
+        }
+    }
+
+}
+
+#endif
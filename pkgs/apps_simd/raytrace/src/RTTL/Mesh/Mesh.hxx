@@ -49,12 +49,30 @@ namespace RTTL {
                              const int type) = 0;
     virtual void addPrimitives(const int *const t,const int primitives, const int type, const int *const shaderID = NULL) = 0;
 
+    /*! overwrite the positions of vertices first..first+vertices-1,
+      for animated geometry. the mesh bounds are left alone, see
+      updateBounds() */
+    virtual void updateVertices(const float *const v, const int first, const int vertices) = 0;
+
+    /*! recompute the mesh bounds from all primitives */
+    void updateBounds()
+    {
+      m_meshAABB.setEmpty();
+      m_meshCentroidAABB.setEmpty();
+      for (int i=0;i<numPrimitives();i++)
+        {
+          const RTBoxSSE box = getAABB(i);
+          m_meshAABB.extend(box);
+          m_meshCentroidAABB.extend(box.center());
+        }
+    }
+
     virtual void finalize() = 0;
 
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int NORMALIZE>    
     _INLINE void getGeometryNormal(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
                                    const int id4,
-                                   RTVec_t<3, sse_f> &normal) const
+                                   RTVec_t<3, simd_f> &normal) const
     {
     }
 
@@ -106,6 +124,13 @@ namespace RTTL {
           }
     }
 
+    virtual void updateVertices(const float *const v, const int first, const int vertices) {
+      assert(v);
+      assert(first >= 0 && first+vertices <= (int)vertex.size());
+      for (int i=0;i<vertices;i++)
+        vertex[first+i] = ((RTVec3f*)v)[i];
+    }
+
     virtual void addPrimitives(const int *const t,const int primitives, const int type, const int *const shaderID = NULL) {
       assert(t);
       switch(type)
@@ -238,30 +263,30 @@ namespace RTTL {
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int NORMALIZE>    
     _INLINE void getGeometryNormal(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
                                    const int id4,
-                                   RTVec_t<3, sse_f> &normal) const
+                                   RTVec_t<3, simd_f> &normal) const
     {
-      const sse_i &fourID = packet.id(id4);
-      if (__builtin_expect(fourID == splat4i<0>(fourID),1))
+      const simd_i &ids = packet.id(id4);
+      if (__builtin_expect(allEqual(ids),1))
         {
-          const int ID = M128_INT(fourID,0);
+          const int ID = M128_INT(ids,0);
           if (__builtin_expect(ID == -1,0))
             {
-              normal[0] = _mm_setzero_ps();
-              normal[1] = _mm_setzero_ps();
-              normal[2] = _mm_setzero_ps();
+              normal[0] = convert<simd_f>(0.0f);
+              normal[1] = convert<simd_f>(0.0f);
+              normal[2] = convert<simd_f>(0.0f);
             }
           else
             {
               const RTVec3f n = getTriangleNormal(ID);
-              normal[0] = convert<sse_f>(n.x);
-              normal[1] = convert<sse_f>(n.y);
-              normal[2] = convert<sse_f>(n.z);
+              normal[0] = convert<simd_f>(n.x);
+              normal[1] = convert<simd_f>(n.y);
+              normal[2] = convert<simd_f>(n.z);
             }
         }
       else
         {
-#pragma unroll(4)
-          for (int i=0;i<4;i++)
+#pragma unroll(RT_SIMD_WIDTH)
+          for (int i=0;i<RT_SIMD_WIDTH;i++)
             {
               const int ID = M128_INT(packet.id(id4),i);
               if (__builtin_expect(ID == -1,0)) 
@@ -281,7 +306,7 @@ namespace RTTL {
         }
       if (NORMALIZE)
         {
-          const sse_f f = rsqrt(normal[0]*normal[0]+normal[1]*normal[1]+normal[2]*normal[2]);
+          const simd_f f = rsqrt(normal[0]*normal[0]+normal[1]*normal[1]+normal[2]*normal[2]);
           normal[0] *= f;
           normal[1] *= f;
           normal[2] *= f;
@@ -291,39 +316,39 @@ namespace RTTL {
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int NORMALIZE>    
     _INLINE void getTextureCoordinate(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
                                       const int id4,
-                                      RTVec_t<2, sse_f> &txt) const
+                                      RTVec_t<2, simd_f> &txt) const
     {
-      const sse_i &fourID = packet.id(id4);
+      const simd_i &ids = packet.id(id4);
 
-      const sse_f u = packet.u(id4);
-      const sse_f v = packet.v(id4);
-      const sse_f uv = _mm_sub_ps(convert<sse_f>(1.0f),_mm_add_ps(u,v));
+      const simd_f u = packet.u(id4);
+      const simd_f v = packet.v(id4);
+      const simd_f uv = convert<simd_f>(1.0f) - (u + v);
 
-      if (__builtin_expect(fourID == splat4i<0>(fourID),1))
+      if (__builtin_expect(allEqual(ids),1))
         {
-          const int ID = M128_INT(fourID,0);
+          const int ID = M128_INT(ids,0);
           if (__builtin_expect(ID == -1,0)) 
             {
-              txt[0] = _mm_setzero_ps();
-              txt[1] = _mm_setzero_ps();
+              txt[0] = convert<simd_f>(0.0f);
+              txt[1] = convert<simd_f>(0.0f);
             }
           else
             {
-              const sse_f u0 = convert<sse_f>(textureCoord[triangle[ID].v[0]][0]);
-              const sse_f v0 = convert<sse_f>(textureCoord[triangle[ID].v[0]][1]);
-              const sse_f u1 = convert<sse_f>(textureCoord[triangle[ID].v[1]][0]);
-              const sse_f v1 = convert<sse_f>(textureCoord[triangle[ID].v[1]][1]);
-              const sse_f u2 = convert<sse_f>(textureCoord[triangle[ID].v[2]][0]);
-              const sse_f v2 = convert<sse_f>(textureCoord[triangle[ID].v[2]][1]);
+              const simd_f u0 = convert<simd_f>(textureCoord[triangle[ID].v[0]][0]);
+              const simd_f v0 = convert<simd_f>(textureCoord[triangle[ID].v[0]][1]);
+              const simd_f u1 = convert<simd_f>(textureCoord[triangle[ID].v[1]][0]);
+              const simd_f v1 = convert<simd_f>(textureCoord[triangle[ID].v[1]][1]);
+              const simd_f u2 = convert<simd_f>(textureCoord[triangle[ID].v[2]][0]);
+              const simd_f v2 = convert<simd_f>(textureCoord[triangle[ID].v[2]][1]);
               txt[0] = uv * u0 + u * u1 + v * u2;
               txt[1] = uv * v0 + u * v1 + v * v2;
             }
         }
       else
         {
-          sse_f u0,v0,u1,v1,u2,v2;
-#pragma unroll(4)
-          for (int i=0;i<4;i++)
+          simd_f u0,v0,u1,v1,u2,v2;
+#pragma unroll(RT_SIMD_WIDTH)
+          for (int i=0;i<RT_SIMD_WIDTH;i++)
             {
               const int ID = M128_INT(packet.id(id4),i);
               if (__builtin_expect(ID == -1,0)) 
@@ -423,6 +448,13 @@ namespace RTTL {
         cout << "texture coordinates currently not supported" << endl;
     }
 
+    virtual void updateVertices(const float *const v, const int first, const int vertices) {
+      assert(v);
+      assert(first >= 0 && first+vertices <= (int)vertex.size());
+      for (int i=0;i<vertices;i++)
+        vertex[first+i] = vec3fToSSE(((RTVec3f*)v)[i]);
+    }
+
     _INLINE void addPrimitives(const int *const t,const int primitives, const int type, const int *const shaderIds = NULL) {
       assert(t);
       assert(type == RT_QUAD);
@@ -462,14 +494,14 @@ namespace RTTL {
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int NORMALIZE>    
     _INLINE void getGeometryNormal(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
                                    const int id4,
-                                   RTVec_t<3, sse_f> &normal) const
+                                   RTVec_t<3, simd_f> &normal) const
     {
     }
 
     template <int N, int LAYOUT, int MULTIPLE_ORIGINS, int SHADOW_RAYS,int NORMALIZE>    
     _INLINE void getTextureCoordinate(RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, SHADOW_RAYS> &packet,
                                       const int id4,
-                                      RTVec_t<2, sse_f> &txt) const
+                                      RTVec_t<2, simd_f> &txt) const
     {
     }
 
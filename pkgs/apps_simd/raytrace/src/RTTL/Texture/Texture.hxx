@@ -38,8 +38,8 @@ namespace RTTL {
           aligned_free(m_textureMem);
     }
 
-    template<int COMPONENT>
-    _INLINE void getTexel(sse_f tu, sse_f tv, RTVec_t<CHANNELS, sse_f> &t)
+    /*! fetch the texel for one lane of a ray packet */
+    _INLINE void getTexel(const int lane, simd_f tu, simd_f tv, RTVec_t<CHANNELS, simd_f> &t)
     {
     }
 
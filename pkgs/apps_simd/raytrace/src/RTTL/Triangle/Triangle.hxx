@@ -37,32 +37,32 @@ _INLINE void IntersectTriangleMoellerTrumbore(const RTVec3f &v0,
   const sse_f e1_y = splat4<1>(e1);
   const sse_f e1_z = splat4<2>(e1);
 #else
-  const sse_f ax = convert(v0[0]);
-  const sse_f ay = convert(v0[1]);
-  const sse_f az = convert(v0[2]);
+  const simd_f ax = convert<simd_f>(v0[0]);
+  const simd_f ay = convert<simd_f>(v0[1]);
+  const simd_f az = convert<simd_f>(v0[2]);
 
-  const sse_f bx = convert(v1[0]);
-  const sse_f by = convert(v1[1]);
-  const sse_f bz = convert(v1[2]);
+  const simd_f bx = convert<simd_f>(v1[0]);
+  const simd_f by = convert<simd_f>(v1[1]);
+  const simd_f bz = convert<simd_f>(v1[2]);
 
-  const sse_f cx = convert(v2[0]);
-  const sse_f cy = convert(v2[1]);
-  const sse_f cz = convert(v2[2]);
+  const simd_f cx = convert<simd_f>(v2[0]);
+  const simd_f cy = convert<simd_f>(v2[1]);
+  const simd_f cz = convert<simd_f>(v2[2]);
 
-  const sse_f e0_x = bx - ax;
-  const sse_f e0_y = by - ay;
-  const sse_f e0_z = bz - az;
+  const simd_f e0_x = bx - ax;
+  const simd_f e0_y = by - ay;
+  const simd_f e0_z = bz - az;
 
-  const sse_f e1_x = cx - ax;
-  const sse_f e1_y = cy - ay;
-  const sse_f e1_z = cz - az;
+  const simd_f e1_x = cx - ax;
+  const simd_f e1_y = cy - ay;
+  const simd_f e1_z = cz - az;
 #endif
 
 
-  const sse_i id = convert(triangleID);
-  const sse_i shader_id = convert(shaderID);
+  const simd_i id = convert<simd_i>(triangleID);
+  const simd_i shader_id = convert<simd_i>(shaderID);
 
-  sse_f offset_x, offset_y, offset_z;
+  simd_f offset_x, offset_y, offset_z;
 
   if (!MULTIPLE_ORIGINS)
     {
@@ -80,47 +80,43 @@ _INLINE void IntersectTriangleMoellerTrumbore(const RTVec3f &v0,
     offset_z = packet.originZ(i) - az;
       }
 
-    const sse_f pvec_x = (packet.directionY(i) * e1_z) - (packet.directionZ(i) * e1_y);
-    const sse_f pvec_y = (packet.directionZ(i) * e1_x) - (packet.directionX(i) * e1_z);
-    const sse_f pvec_z = (packet.directionX(i) * e1_y) - (packet.directionY(i) * e1_x);
+    const simd_f pvec_x = (packet.directionY(i) * e1_z) - (packet.directionZ(i) * e1_y);
+    const simd_f pvec_y = (packet.directionZ(i) * e1_x) - (packet.directionX(i) * e1_z);
+    const simd_f pvec_z = (packet.directionX(i) * e1_y) - (packet.directionY(i) * e1_x);
 
-    const sse_f det = (e0_x*pvec_x) + (e0_y*pvec_y) + (e0_z*pvec_z);
-    const sse_f inv_det = rcp(det);
+    const simd_f det = (e0_x*pvec_x) + (e0_y*pvec_y) + (e0_z*pvec_z);
+    const simd_f inv_det = rcp(det);
 
-    const sse_f u = ((offset_x*pvec_x) + (offset_y*pvec_y) + (offset_z*pvec_z)) * inv_det;
+    const simd_f u = ((offset_x*pvec_x) + (offset_y*pvec_y) + (offset_z*pvec_z)) * inv_det;
 
-    const sse_f zero = _mm_setzero_ps();
-    const sse_f one  = convert(1.0f);
+    const simd_f zero = convert<simd_f>(0.0f);
+    const simd_f one  = convert<simd_f>(1.0f);
 
-    const sse_f u_mask = _mm_and_ps(_mm_cmple_ps(zero,u),_mm_cmplt_ps(u,one));
-    if (_mm_movemask_ps(u_mask) == 0x0) continue;
+    const simd_mask u_mask = cmple(zero,u) & cmplt(u,one);
+    if (movemask(u_mask) == 0x0) continue;
 
-    const sse_f qvec_x = (offset_y*e0_z) - (offset_z*e0_y);
-    const sse_f qvec_y = (offset_z*e0_x) - (offset_x*e0_z);
-    const sse_f qvec_z = (offset_x*e0_y) - (offset_y*e0_x);
+    const simd_f qvec_x = (offset_y*e0_z) - (offset_z*e0_y);
+    const simd_f qvec_y = (offset_z*e0_x) - (offset_x*e0_z);
+    const simd_f qvec_z = (offset_x*e0_y) - (offset_y*e0_x);
 
-    const sse_f v = ((packet.directionX(i)*qvec_x) + (packet.directionY(i)*qvec_y) + (packet.directionZ(i)*qvec_z)) * inv_det;
+    const simd_f v = ((packet.directionX(i)*qvec_x) + (packet.directionY(i)*qvec_y) + (packet.directionZ(i)*qvec_z)) * inv_det;
 
-    const sse_f v_mask = _mm_and_ps(_mm_cmple_ps(zero,v),_mm_cmple_ps(v,one));
+    const simd_mask v_mask = cmple(zero,v) & cmple(v,one);
 
-    if (_mm_movemask_ps(v_mask) == 0x0) continue;
+    if (movemask(v_mask) == 0x0) continue;
 
-    const sse_f uv = u + v;
+    const simd_f uv = u + v;
 
-    const sse_f uv_mask = _mm_and_ps(_mm_cmplt_ps(zero,uv),_mm_cmple_ps(uv,one));
+    const simd_mask uv_mask = cmplt(zero,uv) & cmple(uv,one);
 
-    const sse_f t = ((e1_x*qvec_x)+(e1_y*qvec_y)+(e1_z*qvec_z))*inv_det;
-    const sse_f t_mask = _mm_and_ps(_mm_cmplt_ps(packet.minDistance(i),t),
-                    _mm_cmplt_ps(t,packet.maxDistance(i)));
-    const sse_f mask = u_mask & v_mask & uv_mask & t_mask;
+    const simd_f t = ((e1_x*qvec_x)+(e1_y*qvec_y)+(e1_z*qvec_z))*inv_det;
+    const simd_mask t_mask = cmplt(packet.minDistance(i),t) &
+                    cmplt(t,packet.maxDistance(i));
+    const simd_mask mask = u_mask & v_mask & uv_mask & t_mask;
 
-    if (_mm_movemask_ps(mask) == 0x0) continue;
+    if (movemask(mask) == 0x0) continue;
 
-    packet.u(i)  = _mm_blendv_ps(u,packet.u(i),mask);
-    packet.v(i)  = _mm_blendv_ps(v,packet.v(i),mask);
-    packet.id(i) = _mm_blendv_epi8(id,packet.id(i),_mm_castps_si128(mask));
-    packet.shaderID(i) = _mm_blendv_epi8(shader_id,packet.shaderID(i),_mm_castps_si128(mask));
-    packet.maxDistance(i) = _mm_blendv_ps(t,packet.maxDistance(i),mask);
+    packet.setHit(i,mask,t,u,v,id,shader_id);
   }
 }
 
@@ -139,30 +135,30 @@ _INLINE void IntersectTriangleMoellerTrumbore(const RTVec3f &v0,
                           const int packID[],
                           const int packIDs)
 {
-  const sse_f ax = convert(v0[0]);
-  const sse_f ay = convert(v0[1]);
-  const sse_f az = convert(v0[2]);
+  const simd_f ax = convert<simd_f>(v0[0]);
+  const simd_f ay = convert<simd_f>(v0[1]);
+  const simd_f az = convert<simd_f>(v0[2]);
 
-  const sse_f bx = convert(v1[0]);
-  const sse_f by = convert(v1[1]);
-  const sse_f bz = convert(v1[2]);
+  const simd_f bx = convert<simd_f>(v1[0]);
+  const simd_f by = convert<simd_f>(v1[1]);
+  const simd_f bz = convert<simd_f>(v1[2]);
 
-  const sse_f cx = convert(v2[0]);
-  const sse_f cy = convert(v2[1]);
-  const sse_f cz = convert(v2[2]);
+  const simd_f cx = convert<simd_f>(v2[0]);
+  const simd_f cy = convert<simd_f>(v2[1]);
+  const simd_f cz = convert<simd_f>(v2[2]);
 
-  const sse_f e0_x = bx - ax;
-  const sse_f e0_y = by - ay;
-  const sse_f e0_z = bz - az;
+  const simd_f e0_x = bx - ax;
+  const simd_f e0_y = by - ay;
+  const simd_f e0_z = bz - az;
 
-  const sse_f e1_x = cx - ax;
-  const sse_f e1_y = cy - ay;
-  const sse_f e1_z = cz - az;
+  const simd_f e1_x = cx - ax;
+  const simd_f e1_y = cy - ay;
+  const simd_f e1_z = cz - az;
 
-  const sse_i id = convert(triangleID);
-  const sse_i shader_id = convert(shaderID);
+  const simd_i id = convert<simd_i>(triangleID);
+  const simd_i shader_id = convert<simd_i>(shaderID);
 
-  sse_f offset_x, offset_y, offset_z;
+  simd_f offset_x, offset_y, offset_z;
 
   if (!MULTIPLE_ORIGINS)
     {
@@ -182,47 +178,43 @@ _INLINE void IntersectTriangleMoellerTrumbore(const RTVec3f &v0,
       offset_z = packet.originZ(i) - az;
     }
 
-      const sse_f pvec_x = (packet.directionY(i) * e1_z) - (packet.directionZ(i) * e1_y);
-      const sse_f pvec_y = (packet.directionZ(i) * e1_x) - (packet.directionX(i) * e1_z);
-      const sse_f pvec_z = (packet.directionX(i) * e1_y) - (packet.directionY(i) * e1_x);
+      const simd_f pvec_x = (packet.directionY(i) * e1_z) - (packet.directionZ(i) * e1_y);
+      const simd_f pvec_y = (packet.directionZ(i) * e1_x) - (packet.directionX(i) * e1_z);
+      const simd_f pvec_z = (packet.directionX(i) * e1_y) - (packet.directionY(i) * e1_x);
 
-      const sse_f det = (e0_x*pvec_x) + (e0_y*pvec_y) + (e0_z*pvec_z);
-      const sse_f inv_det = rcp(det);
+      const simd_f det = (e0_x*pvec_x) + (e0_y*pvec_y) + (e0_z*pvec_z);
+      const simd_f inv_det = rcp(det);
 
-      const sse_f u = ((offset_x*pvec_x) + (offset_y*pvec_y) + (offset_z*pvec_z)) * inv_det;
+      const simd_f u = ((offset_x*pvec_x) + (offset_y*pvec_y) + (offset_z*pvec_z)) * inv_det;
 
-      const sse_f zero = _mm_setzero_ps();
-      const sse_f one  = convert(1.0f);
+      const simd_f zero = convert<simd_f>(0.0f);
+      const simd_f one  = convert<simd_f>(1.0f);
 
-      const sse_f u_mask = _mm_and_ps(_mm_cmple_ps(zero,u),_mm_cmplt_ps(u,one));
-      if (_mm_movemask_ps(u_mask) == 0x0) continue;
+      const simd_mask u_mask = cmple(zero,u) & cmplt(u,one);
+      if (movemask(u_mask) == 0x0) continue;
 
-      const sse_f qvec_x = (offset_y*e0_z) - (offset_z*e0_y);
-      const sse_f qvec_y = (offset_z*e0_x) - (offset_x*e0_z);
-      const sse_f qvec_z = (offset_x*e0_y) - (offset_y*e0_x);
+      const simd_f qvec_x = (offset_y*e0_z) - (offset_z*e0_y);
+      const simd_f qvec_y = (offset_z*e0_x) - (offset_x*e0_z);
+      const simd_f qvec_z = (offset_x*e0_y) - (offset_y*e0_x);
 
-      const sse_f v = ((packet.directionX(i)*qvec_x) + (packet.directionY(i)*qvec_y) + (packet.directionZ(i)*qvec_z)) * inv_det;
+      const simd_f v = ((packet.directionX(i)*qvec_x) + (packet.directionY(i)*qvec_y) + (packet.directionZ(i)*qvec_z)) * inv_det;
 
-      const sse_f v_mask = _mm_and_ps(_mm_cmple_ps(zero,v),_mm_cmple_ps(v,one));
+      const simd_mask v_mask = cmple(zero,v) & cmple(v,one);
 
-      if (_mm_movemask_ps(v_mask) == 0x0) continue;
+      if (movemask(v_mask) == 0x0) continue;
 
-      const sse_f uv = u + v;
+      const simd_f uv = u + v;
 
-      const sse_f uv_mask = _mm_and_ps(_mm_cmplt_ps(zero,uv),_mm_cmple_ps(uv,one));
+      const simd_mask uv_mask = cmplt(zero,uv) & cmple(uv,one);
 
-      const sse_f t = ((e1_x*qvec_x)+(e1_y*qvec_y)+(e1_z*qvec_z))*inv_det;
-      const sse_f t_mask = _mm_and_ps(_mm_cmplt_ps(packet.minDistance(i),t),
-                      _mm_cmplt_ps(t,packet.maxDistance(i)));
-      const sse_f mask = u_mask & v_mask & uv_mask & t_mask;
+      const simd_f t = ((e1_x*qvec_x)+(e1_y*qvec_y)+(e1_z*qvec_z))*inv_det;
+      const simd_mask t_mask = cmplt(packet.minDistance(i),t) &
+                      cmplt(t,packet.maxDistance(i));
+      const simd_mask mask = u_mask & v_mask & uv_mask & t_mask;
 
-      if (_mm_movemask_ps(mask) == 0x0) continue;
+      if (movemask(mask) == 0x0) continue;
 
-      packet.u(i)  = _mm_blendv_ps(u,packet.u(i),mask);
-      packet.v(i)  = _mm_blendv_ps(v,packet.v(i),mask);
-      packet.id(i) = _mm_blendv_epi8(id,packet.id(i),_mm_castps_si128(mask));
-      packet.shaderID(i) = _mm_blendv_epi8(shader_id,packet.shaderID(i),_mm_castps_si128(mask));
-      packet.maxDistance(i) = _mm_blendv_ps(t,packet.maxDistance(i),mask);
+      packet.setHit(i,mask,t,u,v,id,shader_id);
     }
 }
 
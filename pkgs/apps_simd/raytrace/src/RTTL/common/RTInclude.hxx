@@ -60,6 +60,12 @@
 #include <iostream>
 #include <algorithm>
 #include <limits>
+#include <cstdlib>
+#include <cmath>
+
+// abs() for float, double and long (RTVecBody.h calls ::abs) comes
+// from the standard library
+using std::abs;
 
 #if defined(__GNUC__)
 #include <sys/times.h>
@@ -150,9 +156,11 @@ __forceinline int __builtin_expect(int a, int p) { return a; }
 
 #ifndef PARSEC_USE_SSE
 #ifndef PARSEC_USE_AVX
+#ifndef PARSEC_USE_AVX512
 #define RT_EMULATE_SSE
 #endif
 #endif
+#endif
 #ifdef  RT_EMULATE_SSE
 #include "RTEmulatedSSE.hxx"
 
@@ -166,13 +174,13 @@ __forceinline int __builtin_expect(int a, int p) { return a; }
 #endif
 #include <xmmintrin.h>
 #include <emmintrin.h>
+#ifdef __AVX__
+// wide ray packets, see RTSIMD.hxx
+#include <immintrin.h>
+#endif
 
 #if defined(__GNUC__) && !defined(__INTEL_COMPILER)
 
-_INLINE float  abs(float v)  { return fabsf(v); }
-_INLINE double abs(double v) { return fabs(v);  }
-_INLINE long   abs(long v)   { return labs(v);  }
-
 // GNU C++ follows strict standard interpretation in which
 // __m128/i are primary data types for which
 // operator overloading is prohibited.
@@ -66,61 +66,61 @@ namespace RTTL {
     USE_CORNER_RAYS         = 1<<0, // first 4 rays define frustum
     STORE_NEAR_FAR_DISTANCE = 1<<1, // near values will be used in addition to far ones
     MIN_MAX_RECIPROCAL      = 1<<2, // store min/max of 1/distance for each coordinate
-    VALID_RAYS_MASK         = 1<<3, // sse_f vector shown validity of each ray (in sign bit)
-    VALID_GROUPS_MASK       = 1<<4, // integer array shown validity of each sse_f groups of rays
+    VALID_RAYS_MASK         = 1<<3, // simd_f vector shown validity of each ray (in sign bit)
+    VALID_GROUPS_MASK       = 1<<4, // integer array shown validity of each simd_f groups of rays
     STORE_VERTEX_NORMALS    = 1<<5  // assumes triangles as base primitives and stores vertex normals in hit structure
   };
 
   // Generic packet (with origins, directions and near/far values).
-  // N                - packet size in sse_f units (4*N total rays).
+  // N                - packet size in simd_f units (RT_SIMD_WIDTH*N total rays).
   // LAYOUT           - how rays are packed: 1 for corner rays.
   // MULTIPLE_ORIGINS - 0 for common origins (primary rays); 1 otherwise.
   template <int N, int LAYOUT, int MULTIPLE_ORIGINS>
   class BaseRayPacket {
   public:
     // Accessing SIMD values.
-    _INLINE sse_f   origin(int a, int i = 0) const { return m_origin[a][MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f&  origin(int a, int i = 0)       { return m_origin[a][MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f   originX(int i = 0) const { return m_origin.x[MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f&  originX(int i = 0)       { return m_origin.x[MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f   originY(int i = 0) const { return m_origin.y[MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f&  originY(int i = 0)       { return m_origin.y[MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f   originZ(int i = 0) const { return m_origin.z[MULTIPLE_ORIGINS? i:0]; }
-    _INLINE sse_f&  originZ(int i = 0)       { return m_origin.z[MULTIPLE_ORIGINS? i:0]; }
-
-    _INLINE sse_f   direction(int a, int i) const { return m_direction[a][i]; }
-    _INLINE sse_f&  direction(int a, int i)       { return m_direction[a][i]; }
-    _INLINE sse_f   directionX(int i) const  { return m_direction.x[i]; }
-    _INLINE sse_f&  directionX(int i)        { return m_direction.x[i]; }
-    _INLINE sse_f   directionY(int i) const  { return m_direction.y[i]; }
-    _INLINE sse_f&  directionY(int i)        { return m_direction.y[i]; }
-    _INLINE sse_f   directionZ(int i) const  { return m_direction.z[i]; }
-    _INLINE sse_f&  directionZ(int i)        { return m_direction.z[i]; }
-
-    _INLINE sse_f   reciprocal(int a, int i) const { return m_reciprocal[a][i]; }
-    _INLINE sse_f&  reciprocal(int a, int i)       { return m_reciprocal[a][i]; }
-    _INLINE sse_f   reciprocalX(int i) const  { return m_reciprocal.x[i]; }
-    _INLINE sse_f&  reciprocalX(int i)        { return m_reciprocal.x[i]; }
-    _INLINE sse_f   reciprocalY(int i) const  { return m_reciprocal.y[i]; }
-    _INLINE sse_f&  reciprocalY(int i)        { return m_reciprocal.y[i]; }
-    _INLINE sse_f   reciprocalZ(int i) const  { return m_reciprocal.z[i]; }
-    _INLINE sse_f&  reciprocalZ(int i)        { return m_reciprocal.z[i]; }
+    _INLINE simd_f   origin(int a, int i = 0) const { return m_origin[a][MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f&  origin(int a, int i = 0)       { return m_origin[a][MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f   originX(int i = 0) const { return m_origin.x[MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f&  originX(int i = 0)       { return m_origin.x[MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f   originY(int i = 0) const { return m_origin.y[MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f&  originY(int i = 0)       { return m_origin.y[MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f   originZ(int i = 0) const { return m_origin.z[MULTIPLE_ORIGINS? i:0]; }
+    _INLINE simd_f&  originZ(int i = 0)       { return m_origin.z[MULTIPLE_ORIGINS? i:0]; }
+
+    _INLINE simd_f   direction(int a, int i) const { return m_direction[a][i]; }
+    _INLINE simd_f&  direction(int a, int i)       { return m_direction[a][i]; }
+    _INLINE simd_f   directionX(int i) const  { return m_direction.x[i]; }
+    _INLINE simd_f&  directionX(int i)        { return m_direction.x[i]; }
+    _INLINE simd_f   directionY(int i) const  { return m_direction.y[i]; }
+    _INLINE simd_f&  directionY(int i)        { return m_direction.y[i]; }
+    _INLINE simd_f   directionZ(int i) const  { return m_direction.z[i]; }
+    _INLINE simd_f&  directionZ(int i)        { return m_direction.z[i]; }
+
+    _INLINE simd_f   reciprocal(int a, int i) const { return m_reciprocal[a][i]; }
+    _INLINE simd_f&  reciprocal(int a, int i)       { return m_reciprocal[a][i]; }
+    _INLINE simd_f   reciprocalX(int i) const  { return m_reciprocal.x[i]; }
+    _INLINE simd_f&  reciprocalX(int i)        { return m_reciprocal.x[i]; }
+    _INLINE simd_f   reciprocalY(int i) const  { return m_reciprocal.y[i]; }
+    _INLINE simd_f&  reciprocalY(int i)        { return m_reciprocal.y[i]; }
+    _INLINE simd_f   reciprocalZ(int i) const  { return m_reciprocal.z[i]; }
+    _INLINE simd_f&  reciprocalZ(int i)        { return m_reciprocal.z[i]; }
 
     // These functions are meaninful only if MIN_MAX_RECIPROCAL bit is set.
-    _INLINE sse_f   reciprocalMin(int i) const  { return m_reciprocal[i][N]; }
-    _INLINE sse_f&  reciprocalMin(int i)        { return m_reciprocal[i][N]; }
-    _INLINE sse_f   reciprocalMax(int i) const  { return m_reciprocal[i][N+1]; }
-    _INLINE sse_f&  reciprocalMax(int i)        { return m_reciprocal[i][N+1]; }
+    _INLINE simd_f   reciprocalMin(int i) const  { return m_reciprocal[i][N]; }
+    _INLINE simd_f&  reciprocalMin(int i)        { return m_reciprocal[i][N]; }
+    _INLINE simd_f   reciprocalMax(int i) const  { return m_reciprocal[i][N+1]; }
+    _INLINE simd_f&  reciprocalMax(int i)        { return m_reciprocal[i][N+1]; }
 
     // All functions with distance keyword define max distance (far value).
     // All functions with minDistance keyword define min distance (near value).
     // minDistances are defined only if STORE_NEAR_FAR_DISTANCE layout bit is set.
-    _INLINE sse_f   distance(int i) const     { return m_distance[i]; }
-    _INLINE sse_f&  distance(int i)           { return m_distance[i]; }
-    _INLINE sse_f   maxDistance(int i) const  { return m_distance[i]; }
-    _INLINE sse_f&  maxDistance(int i)        { return m_distance[i]; }
-    _INLINE sse_f   minDistance(int i) const  { return m_distance[i+N]; }
-    _INLINE sse_f&  minDistance(int i)        { return m_distance[i+N]; }
+    _INLINE simd_f   distance(int i) const     { return m_distance[i]; }
+    _INLINE simd_f&  distance(int i)           { return m_distance[i]; }
+    _INLINE simd_f   maxDistance(int i) const  { return m_distance[i]; }
+    _INLINE simd_f&  maxDistance(int i)        { return m_distance[i]; }
+    _INLINE simd_f   minDistance(int i) const  { return m_distance[i+N]; }
+    _INLINE simd_f&  minDistance(int i)        { return m_distance[i+N]; }
 
     // Accessing float components.
     _INLINE float   floatOrigin(int a, int i = 0) const { return ((float*)&m_origin[a])[MULTIPLE_ORIGINS? i:0]; }
@@ -154,8 +154,8 @@ namespace RTTL {
     _INLINE float&  floatDistance(int i)          { return ((float*)&m_distance)[i]; }
     _INLINE float   floatMaxDistance(int i) const { return ((float*)&m_distance)[i]; }
     _INLINE float&  floatMaxDistance(int i)       { return ((float*)&m_distance)[i]; }
-    _INLINE float   floatMinDistance(int i) const { return ((float*)&m_distance)[i+N*sizeof(sse_f)/sizeof(float)]; }
-    _INLINE float&  floatMinDistance(int i)       { return ((float*)&m_distance)[i+N*sizeof(sse_f)/sizeof(float)]; }
+    _INLINE float   floatMinDistance(int i) const { return ((float*)&m_distance)[i+N*sizeof(simd_f)/sizeof(float)]; }
+    _INLINE float&  floatMinDistance(int i)       { return ((float*)&m_distance)[i+N*sizeof(simd_f)/sizeof(float)]; }
 
 
     _INLINE void computeReciprocalDirections()
@@ -181,7 +181,7 @@ namespace RTTL {
       m_reciprocal.x[0] = rcp_save(m_direction.x[0]);
       m_reciprocal.y[0] = rcp_save(m_direction.y[0]);
       m_reciprocal.z[0] = rcp_save(m_direction.z[0]);
-      sse_f minX,maxX,minY,maxY,minZ,maxZ;
+      simd_f minX,maxX,minY,maxY,minZ,maxZ;
       minX = maxX = m_reciprocal.x[0];
       minY = maxY = m_reciprocal.y[0];
       minZ = maxZ = m_reciprocal.z[0];
@@ -211,17 +211,17 @@ namespace RTTL {
   protected:
 
     // m_origin has different size for packets with common/multiple origins.
-    RTVec_t<3, RTVec_t<1 + (N-1)*MULTIPLE_ORIGINS, sse_f> > m_origin;
+    RTVec_t<3, RTVec_t<1 + (N-1)*MULTIPLE_ORIGINS, simd_f> > m_origin;
 
-    typedef RTVec_t<N, sse_f> ArrayN;
+    typedef RTVec_t<N, simd_f> ArrayN;
     RTVec_t<3, ArrayN> m_direction;  // may be not normalized
     // If MIN_MAX_RECIPROCAL is set,
     // the last 2 entries in m_reciprocal will store global min/max values.
-    RTVec_t<3, RTVec_t<N + ((LAYOUT & MIN_MAX_RECIPROCAL)?2:0), sse_f> > m_reciprocal; // 1/direction
+    RTVec_t<3, RTVec_t<N + ((LAYOUT & MIN_MAX_RECIPROCAL)?2:0), simd_f> > m_reciprocal; // 1/direction
 
     // m_distance has different size for packets with near/far and only far values
     // (defined by STORE_NEAR_FAR_DISTANCE layout bit)
-    RTVec_t<N*((LAYOUT & STORE_NEAR_FAR_DISTANCE)?2:1), sse_f> m_distance;
+    RTVec_t<N*((LAYOUT & STORE_NEAR_FAR_DISTANCE)?2:1), simd_f> m_distance;
 
   };
 
@@ -238,14 +238,14 @@ namespace RTTL {
   public:
     typedef BaseRayPacket<N, LAYOUT, MULTIPLE_ORIGINS> Base;
     // Accessing SIMD values.
-    _INLINE sse_f   u(int i)  const { return m_ut[i]; }
-    _INLINE sse_f&  u(int i)        { return m_ut[i]; }
-    _INLINE sse_f   v(int i)  const { return m_vt[i]; }
-    _INLINE sse_f&  v(int i)        { return m_vt[i]; }
-    _INLINE sse_i  id(int i)  const { return m_id[i]; }
-    _INLINE sse_i& id(int i)        { return m_id[i]; }
-    _INLINE sse_i  shaderID(int i)  const { return m_shaderID[i]; }
-    _INLINE sse_i& shaderID(int i)        { return m_shaderID[i]; }
+    _INLINE simd_f   u(int i)  const { return m_ut[i]; }
+    _INLINE simd_f&  u(int i)        { return m_ut[i]; }
+    _INLINE simd_f   v(int i)  const { return m_vt[i]; }
+    _INLINE simd_f&  v(int i)        { return m_vt[i]; }
+    _INLINE simd_i  id(int i)  const { return m_id[i]; }
+    _INLINE simd_i& id(int i)        { return m_id[i]; }
+    _INLINE simd_i  shaderID(int i)  const { return m_shaderID[i]; }
+    _INLINE simd_i& shaderID(int i)        { return m_shaderID[i]; }
 
     // Accessing float/integer components.
     _INLINE float  floatU(int i) const { return ((float*)&m_ut)[i]; }
@@ -259,33 +259,47 @@ namespace RTTL {
 
     // extended components
 
-    _INLINE sse_f   vertexNormalX(int v, int i) const { return m_vertexNormal[v][0][i]; }
-    _INLINE sse_f&  vertexNormalX(int v, int i)       { return m_vertexNormal[v][0][i]; }
-    _INLINE sse_f   vertexNormalY(int v, int i) const { return m_vertexNormal[v][1][i]; }
-    _INLINE sse_f&  vertexNormalY(int v, int i)       { return m_vertexNormal[v][1][i]; }
-    _INLINE sse_f   vertexNormalZ(int v, int i) const { return m_vertexNormal[v][2][i]; }
-    _INLINE sse_f&  vertexNormalZ(int v, int i)       { return m_vertexNormal[v][2][i]; }
+    _INLINE simd_f   vertexNormalX(int v, int i) const { return m_vertexNormal[v][0][i]; }
+    _INLINE simd_f&  vertexNormalX(int v, int i)       { return m_vertexNormal[v][0][i]; }
+    _INLINE simd_f   vertexNormalY(int v, int i) const { return m_vertexNormal[v][1][i]; }
+    _INLINE simd_f&  vertexNormalY(int v, int i)       { return m_vertexNormal[v][1][i]; }
+    _INLINE simd_f   vertexNormalZ(int v, int i) const { return m_vertexNormal[v][2][i]; }
+    _INLINE simd_f&  vertexNormalZ(int v, int i)       { return m_vertexNormal[v][2][i]; }
+
+    /*! store the hits given by 'mask' for the i'th simd vector */
+    _INLINE void setHit(int i, const simd_mask &mask, const simd_f &t,
+                        const simd_f &u, const simd_f &v,
+                        const simd_i &id, const simd_i &shaderID) {
+      m_ut[i] = choose(mask,u,m_ut[i]);
+      m_vt[i] = choose(mask,v,m_vt[i]);
+      m_id[i] = choose(mask,id,m_id[i]);
+      m_shaderID[i] = choose(mask,shaderID,m_shaderID[i]);
+      Base::maxDistance(i) = choose(mask,t,Base::maxDistance(i));
+    }
+
+    /*! these rays have to find the closest hit, traversal never ends early */
+    _INLINE bool terminated() const { return false; }
 
     _INLINE void reset() {
       int i;
       for (i = 0; i < N; i++)
-        Base::maxDistance(i) = infinity<sse_f>();
+        Base::maxDistance(i) = infinity<simd_f>();
 
       if (LAYOUT & STORE_NEAR_FAR_DISTANCE)
         for (i = 0; i < N; i++)
-          Base::minDistance(i) = convert<sse_f>(0);
+          Base::minDistance(i) = convert<simd_f>(0);
 
       // not sure if we should initialize shaderIDs here
-      m_shaderID = convert<sse_i>(0);
-      m_id = convert<sse_i>(-1);
+      m_shaderID = convert<simd_i>(0);
+      m_id = convert<simd_i>(-1);
     }
 
   protected:
-    RTVec_t<N, sse_f> m_ut; // texture coordinates
-    RTVec_t<N, sse_f> m_vt; // of hit points
-    RTVec_t<N, sse_i> m_id; // id of hit object(s) or -1
-    RTVec_t<N, sse_i> m_shaderID; // shader id of hit object(s) or -1
-    RTVec_t<3, RTVec_t<1+(N-1)*((LAYOUT & STORE_VERTEX_NORMALS)?1:0), sse_f> > m_vertexNormal[3];
+    RTVec_t<N, simd_f> m_ut; // texture coordinates
+    RTVec_t<N, simd_f> m_vt; // of hit points
+    RTVec_t<N, simd_i> m_id; // id of hit object(s) or -1
+    RTVec_t<N, simd_i> m_shaderID; // shader id of hit object(s) or -1
+    RTVec_t<3, RTVec_t<1+(N-1)*((LAYOUT & STORE_VERTEX_NORMALS)?1:0), simd_f> > m_vertexNormal[3];
   };
 
   // Shadow packet (no u,v,id).
@@ -293,14 +307,39 @@ namespace RTTL {
   class RayPacket<N, LAYOUT, MULTIPLE_ORIGINS, 1>: public BaseRayPacket<N, LAYOUT, MULTIPLE_ORIGINS> {
   public:
     typedef BaseRayPacket<N, LAYOUT, MULTIPLE_ORIGINS> Base;
+
+    /*! any hit occludes the ray: its far distance is set to -inf,
+        which removes it from all further box and triangle tests */
+    _INLINE void setHit(int i, const simd_mask &mask, const simd_f &t,
+                        const simd_f &u, const simd_f &v,
+                        const simd_i &id, const simd_i &shaderID) {
+      Base::maxDistance(i) = choose(mask,convert<simd_f>(-numeric_limits<float>::infinity()),Base::maxDistance(i));
+    }
+
+    /*! disable the rays given by 'mask', e.g. those without a primary hit */
+    _INLINE void disable(int i, const simd_mask &mask) {
+      Base::maxDistance(i) = choose(mask,convert<simd_f>(-numeric_limits<float>::infinity()),Base::maxDistance(i));
+    }
+
+    _INLINE simd_mask occluded(int i) const {
+      return cmplt(Base::maxDistance(i),convert<simd_f>(0.0f));
+    }
+
+    /*! true once all rays are occluded, traversal can stop */
+    _INLINE bool terminated() const {
+      for (int i = 0; i < N; i++)
+        if (movemask(occluded(i)) != RT_SIMD_MASK_ALL)
+          return false;
+      return true;
+    }
     _INLINE void reset() {
       int i;
       for (i = 0; i < N; i++)
-        Base::maxDistance(i) = convert<sse_f>(1);
+        Base::maxDistance(i) = convert<simd_f>(1);
 
       if (LAYOUT & STORE_NEAR_FAR_DISTANCE)
         for (i = 0; i < N; i++)
-          Base::minDistance(i) = convert<sse_f>(0);
+          Base::minDistance(i) = convert<simd_f>(0);
     }
   };
 
@@ -0,0 +1,334 @@
+#ifndef RTTL_SIMD_H
+#define RTTL_SIMD_H
+
+/// SIMD vectors used for ray packets. Everything that is a single
+/// point, vector or box (RTBoxSSE, BVH nodes, ...) stays in sse_f;
+/// only the per-ray data of packets uses simd_f/simd_i, which hold
+/// RT_SIMD_WIDTH rays each.
+///
+/// RT_SIMD_WIDTH is 16 for AVX-512 builds, 8 for AVX/AVX2 builds and 4
+/// otherwise (SSE or emulated SSE). It can be forced with
+/// -DRT_SIMD_WIDTH=4 or 8, as long as the compiler targets that ISA.
+///
+/// simd_mask is the result of a comparison: a vector with all bits set
+/// per lane for widths 4 and 8, a bit mask for AVX-512.
+
+#ifndef RT_SIMD_WIDTH
+#if defined(PARSEC_USE_AVX512) && defined(__AVX512F__)
+#define RT_SIMD_WIDTH 16
+#elif (defined(PARSEC_USE_AVX) || defined(PARSEC_USE_AVX512)) && defined(__AVX__)
+#define RT_SIMD_WIDTH 8
+#else
+#define RT_SIMD_WIDTH 4
+#endif
+#endif
+
+#if RT_SIMD_WIDTH == 16 && !defined(__AVX512F__)
+#error "RT_SIMD_WIDTH 16 requires AVX-512F"
+#elif RT_SIMD_WIDTH == 8 && !defined(__AVX__)
+#error "RT_SIMD_WIDTH 8 requires AVX"
+#elif RT_SIMD_WIDTH != 4 && RT_SIMD_WIDTH != 8 && RT_SIMD_WIDTH != 16
+#error "RT_SIMD_WIDTH has to be 4, 8 or 16"
+#endif
+
+/// all lanes set, as returned by movemask() and signmask()
+#define RT_SIMD_MASK_ALL ((1 << RT_SIMD_WIDTH) - 1)
+
+#if RT_SIMD_WIDTH == 4
+
+// ---------------------------------------------------------------------
+// 4 wide: plain sse_f/sse_i, all ops are in RTSSE.hxx
+
+typedef sse_f simd_f;
+typedef sse_i simd_i;
+typedef sse_f simd_mask;
+
+_INLINE simd_f simd_load(const float *p) { return _mm_load_ps(p); }
+
+_INLINE simd_mask cmplt(simd_f a, simd_f b) { return _mm_cmplt_ps(a, b); }
+_INLINE simd_mask cmple(simd_f a, simd_f b) { return _mm_cmple_ps(a, b); }
+_INLINE simd_mask cmpgt(simd_i a, simd_i b) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a, b)); }
+
+_INLINE int movemask(simd_mask m) { return _mm_movemask_ps(m); }
+_INLINE int signmask(simd_f a)    { return _mm_movemask_ps(a); }
+
+_INLINE simd_f choose(simd_mask m, simd_f iftrue, simd_f iffalse) { return _mm_blendv_ps(iftrue, iffalse, m); }
+_INLINE simd_i choose(simd_mask m, simd_i iftrue, simd_i iffalse) { return _mm_blendv_epi8(iftrue, iffalse, _mm_castps_si128(m)); }
+
+_INLINE simd_i operator<<(simd_i a, int n) { return _mm_slli_epi32(a, n); }
+_INLINE simd_i max(simd_i a, simd_i b) { return choose(cmpgt(a, b), a, b); }
+
+/// true if all lanes hold the same value
+_INLINE bool allEqual(simd_i a) { return a == splat4i<0>(a); }
+
+/// componentwise min/max of the 4-wide blocks of a
+_INLINE sse_f reduceMin4(simd_f a) { return a; }
+_INLINE sse_f reduceMax4(simd_f a) { return a; }
+
+#elif RT_SIMD_WIDTH == 8
+
+// ---------------------------------------------------------------------
+// 8 wide: AVX. Integer ops need AVX2; plain AVX works on the two halves.
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+// see sse_f in RTInclude.hxx
+struct simd_f {
+    simd_f() {}
+    simd_f(__m256 a) : t(a) {}
+    operator __m256() const {
+        return t;
+    }
+private:
+    __m256 t;
+};
+struct simd_i {
+    simd_i() {}
+    simd_i(__m256i a) : t(a) {}
+    operator __m256i() const {
+        return t;
+    }
+private:
+    __m256i t;
+};
+#else
+typedef __m256  simd_f;
+typedef __m256i simd_i;
+#endif
+typedef simd_f simd_mask;
+
+#if defined(__AVX2__)
+#define RT_AVX_EPI32(op, a, b) _mm256_##op##_epi32(a, b)
+#define RT_AVX_SLLI(a, n)      _mm256_slli_epi32(a, n)
+#else
+#define RT_AVX_EPI32(op, a, b)                                                          \
+    _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_##op##_epi32(_mm256_castsi256_si128(a), \
+                                                                    _mm256_castsi256_si128(b))), \
+                            _mm_##op##_epi32(_mm256_extractf128_si256(a, 1),             \
+                                             _mm256_extractf128_si256(b, 1)), 1)
+#define RT_AVX_SLLI(a, n)                                                               \
+    _mm256_insertf128_si256(_mm256_castsi128_si256(_mm_slli_epi32(_mm256_castsi256_si128(a), n)), \
+                            _mm_slli_epi32(_mm256_extractf128_si256(a, 1), n), 1)
+#endif
+
+template<> _INLINE simd_f convert<simd_f>(int n)   { return _mm256_set1_ps((float)n); }
+template<> _INLINE simd_f convert<simd_f>(float n) { return _mm256_set1_ps(n); }
+template<> _INLINE simd_i convert<simd_i>(int n)   { return _mm256_set1_epi32(n); }
+template<> _INLINE simd_i convert<simd_i>(float n) { return _mm256_set1_epi32((int)n); }
+
+_INLINE simd_i cast(simd_f v)    { return _mm256_castps_si256(v); }
+_INLINE simd_f cast(simd_i v)    { return _mm256_castsi256_ps(v); }
+_INLINE simd_i convert(simd_f v) { return _mm256_cvtps_epi32(v); }
+_INLINE simd_f convert(simd_i v) { return _mm256_cvtepi32_ps(v); }
+
+_INLINE simd_f simd_load(const float *p) { return _mm256_load_ps(p); }
+
+_INLINE simd_mask cmplt(simd_f a, simd_f b) { return _mm256_cmp_ps(a, b, _CMP_LT_OS); }
+_INLINE simd_mask cmple(simd_f a, simd_f b) { return _mm256_cmp_ps(a, b, _CMP_LE_OS); }
+_INLINE simd_mask cmpgt(simd_i a, simd_i b) { return cast(RT_AVX_EPI32(cmpgt, a, b)); }
+
+_INLINE int movemask(simd_mask m) { return _mm256_movemask_ps(m); }
+_INLINE int signmask(simd_f a)    { return _mm256_movemask_ps(a); }
+
+_INLINE simd_f choose(simd_mask m, simd_f iftrue, simd_f iffalse) { return _mm256_blendv_ps(iffalse, iftrue, m); }
+_INLINE simd_i choose(simd_mask m, simd_i iftrue, simd_i iffalse) { return cast(_mm256_blendv_ps(cast(iffalse), cast(iftrue), m)); }
+
+_INLINE simd_f rcp(const simd_f src) {
+    const simd_f tgt = _mm256_rcp_ps(src);
+    return _mm256_sub_ps(_mm256_add_ps(tgt,tgt), _mm256_mul_ps(_mm256_mul_ps(tgt,tgt), src));
+}
+
+_INLINE simd_f rcp_save(const simd_f src) {
+    return choose(_mm256_cmp_ps(src, _mm256_setzero_ps(), _CMP_NEQ_UQ), rcp(src), _mm256_set1_ps(FLT_MAX));
+}
+
+_INLINE simd_f operator& (simd_f a, simd_f b) { return _mm256_and_ps(a, b); }
+_INLINE simd_f operator| (simd_f a, simd_f b) { return _mm256_or_ps (a, b); }
+_INLINE simd_f operator+ (simd_f a, simd_f b) { return _mm256_add_ps(a, b); }
+_INLINE simd_f operator- (simd_f a, simd_f b) { return _mm256_sub_ps(a, b); }
+_INLINE simd_f operator* (simd_f a, simd_f b) { return _mm256_mul_ps(a, b); }
+
+_INLINE simd_f min(simd_f a, simd_f b) { return _mm256_min_ps(a, b); }
+_INLINE simd_f max(simd_f a, simd_f b) { return _mm256_max_ps(a, b); }
+_INLINE simd_f abs(simd_f a)  { return _mm256_and_ps(a, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff))); }
+_INLINE simd_f sqrt(simd_f a) { return _mm256_sqrt_ps(a); }
+
+/// Returns 1/sqrt(a)
+_INLINE simd_f rsqrt(simd_f a) {
+    const simd_f rsqrta = _mm256_rsqrt_ps(a);
+    return (((a*rsqrta)*rsqrta - convert<simd_f>(3.0f))*convert<simd_f>(-0.5f)*rsqrta);
+}
+
+_INLINE simd_i operator& (simd_i a, simd_i b) { return cast(_mm256_and_ps(cast(a), cast(b))); }
+_INLINE simd_i operator| (simd_i a, simd_i b) { return cast(_mm256_or_ps (cast(a), cast(b))); }
+_INLINE simd_i operator+ (simd_i a, simd_i b) { return RT_AVX_EPI32(add, a, b); }
+_INLINE simd_i operator- (simd_i a, simd_i b) { return RT_AVX_EPI32(sub, a, b); }
+_INLINE simd_i operator<<(simd_i a, int n)    { return RT_AVX_SLLI(a, n); }
+_INLINE simd_i max(simd_i a, simd_i b)        { return RT_AVX_EPI32(max, a, b); }
+
+_INLINE bool allEqual(simd_i a) {
+    return _mm256_movemask_ps(cast(RT_AVX_EPI32(cmpeq, a, _mm256_set1_epi32(M128_INT(a,0))))) == RT_SIMD_MASK_ALL;
+}
+
+_INLINE sse_f reduceMin4(simd_f a) { return _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)); }
+_INLINE sse_f reduceMax4(simd_f a) { return _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)); }
+
+#else
+
+// ---------------------------------------------------------------------
+// 16 wide: AVX-512F
+
+#if defined(__GNUC__) && !defined(__INTEL_COMPILER)
+// see sse_f in RTInclude.hxx
+struct simd_f {
+    simd_f() {}
+    simd_f(__m512 a) : t(a) {}
+    operator __m512() const {
+        return t;
+    }
+private:
+    __m512 t;
+};
+struct simd_i {
+    simd_i() {}
+    simd_i(__m512i a) : t(a) {}
+    operator __m512i() const {
+        return t;
+    }
+private:
+    __m512i t;
+};
+#else
+typedef __m512  simd_f;
+typedef __m512i simd_i;
+#endif
+typedef __mmask16 simd_mask;
+
+template<> _INLINE simd_f convert<simd_f>(int n)   { return _mm512_set1_ps((float)n); }
+template<> _INLINE simd_f convert<simd_f>(float n) { return _mm512_set1_ps(n); }
+template<> _INLINE simd_i convert<simd_i>(int n)   { return _mm512_set1_epi32(n); }
+template<> _INLINE simd_i convert<simd_i>(float n) { return _mm512_set1_epi32((int)n); }
+
+_INLINE simd_i cast(simd_f v)    { return _mm512_castps_si512(v); }
+_INLINE simd_f cast(simd_i v)    { return _mm512_castsi512_ps(v); }
+_INLINE simd_i convert(simd_f v) { return _mm512_cvtps_epi32(v); }
+_INLINE simd_f convert(simd_i v) { return _mm512_cvtepi32_ps(v); }
+
+_INLINE simd_f simd_load(const float *p) { return _mm512_load_ps(p); }
+
+_INLINE simd_mask cmplt(simd_f a, simd_f b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OS); }
+_INLINE simd_mask cmple(simd_f a, simd_f b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OS); }
+_INLINE simd_mask cmpgt(simd_i a, simd_i b) { return _mm512_cmpgt_epi32_mask(a, b); }
+
+_INLINE int movemask(simd_mask m) { return m; }
+_INLINE int signmask(simd_f a)    { return _mm512_cmplt_epi32_mask(cast(a), _mm512_setzero_si512()); }
+
+_INLINE simd_f choose(simd_mask m, simd_f iftrue, simd_f iffalse) { return _mm512_mask_blend_ps(m, iffalse, iftrue); }
+_INLINE simd_i choose(simd_mask m, simd_i iftrue, simd_i iffalse) { return _mm512_mask_blend_epi32(m, iffalse, iftrue); }
+
+_INLINE simd_f rcp(const simd_f src) {
+    const simd_f tgt = _mm512_rcp14_ps(src);
+    return _mm512_sub_ps(_mm512_add_ps(tgt,tgt), _mm512_mul_ps(_mm512_mul_ps(tgt,tgt), src));
+}
+
+_INLINE simd_f rcp_save(const simd_f src) {
+    return choose(_mm512_cmp_ps_mask(src, _mm512_setzero_ps(), _CMP_NEQ_UQ), rcp(src), _mm512_set1_ps(FLT_MAX));
+}
+
+_INLINE simd_f operator& (simd_f a, simd_f b) { return cast(_mm512_and_epi32(cast(a), cast(b))); }
+_INLINE simd_f operator| (simd_f a, simd_f b) { return cast(_mm512_or_epi32 (cast(a), cast(b))); }
+_INLINE simd_f operator+ (simd_f a, simd_f b) { return _mm512_add_ps(a, b); }
+_INLINE simd_f operator- (simd_f a, simd_f b) { return _mm512_sub_ps(a, b); }
+_INLINE simd_f operator* (simd_f a, simd_f b) { return _mm512_mul_ps(a, b); }
+
+_INLINE simd_f min(simd_f a, simd_f b) { return _mm512_min_ps(a, b); }
+_INLINE simd_f max(simd_f a, simd_f b) { return _mm512_max_ps(a, b); }
+_INLINE simd_f abs(simd_f a)  { return cast(_mm512_and_epi32(cast(a), _mm512_set1_epi32(0x7fffffff))); }
+_INLINE simd_f sqrt(simd_f a) { return _mm512_sqrt_ps(a); }
+
+/// Returns 1/sqrt(a)
+_INLINE simd_f rsqrt(simd_f a) {
+    const simd_f rsqrta = _mm512_rsqrt14_ps(a);
+    return (((a*rsqrta)*rsqrta - convert<simd_f>(3.0f))*convert<simd_f>(-0.5f)*rsqrta);
+}
+
+_INLINE simd_i operator& (simd_i a, simd_i b) { return _mm512_and_epi32(a, b); }
+_INLINE simd_i operator| (simd_i a, simd_i b) { return _mm512_or_epi32 (a, b); }
+_INLINE simd_i operator+ (simd_i a, simd_i b) { return _mm512_add_epi32(a, b); }
+_INLINE simd_i operator- (simd_i a, simd_i b) { return _mm512_sub_epi32(a, b); }
+_INLINE simd_i operator<<(simd_i a, int n)    { return _mm512_slli_epi32(a, n); }
+_INLINE simd_i max(simd_i a, simd_i b)        { return _mm512_max_epi32(a, b); }
+
+_INLINE bool allEqual(simd_i a) {
+    return _mm512_cmpeq_epi32_mask(a, _mm512_set1_epi32(M128_INT(a,0))) == RT_SIMD_MASK_ALL;
+}
+
+_INLINE sse_f reduceMin4(simd_f a) {
+    return _mm_min_ps(_mm_min_ps(_mm512_extractf32x4_ps(a, 0), _mm512_extractf32x4_ps(a, 1)),
+                      _mm_min_ps(_mm512_extractf32x4_ps(a, 2), _mm512_extractf32x4_ps(a, 3)));
+}
+_INLINE sse_f reduceMax4(simd_f a) {
+    return _mm_max_ps(_mm_max_ps(_mm512_extractf32x4_ps(a, 0), _mm512_extractf32x4_ps(a, 1)),
+                      _mm_max_ps(_mm512_extractf32x4_ps(a, 2), _mm512_extractf32x4_ps(a, 3)));
+}
+
+#endif
+
+#if RT_SIMD_WIDTH > 4
+
+// ---------------------------------------------------------------------
+// width independent ops of the wide types, see RTSSE.hxx
+
+_INLINE simd_f operator/ (simd_f a, simd_f b) { return a * rcp(b); }
+_INLINE simd_f operator& (simd_f a, float b)  { return a & convert<simd_f>(b); }
+_INLINE simd_f operator| (simd_f a, float b)  { return a | convert<simd_f>(b); }
+_INLINE simd_f operator+ (simd_f a, float b)  { return a + convert<simd_f>(b); }
+_INLINE simd_f operator- (simd_f a, float b)  { return a - convert<simd_f>(b); }
+_INLINE simd_f operator* (simd_f a, float b)  { return a * convert<simd_f>(b); }
+_INLINE simd_f operator/ (simd_f a, float b)  { return a * convert<simd_f>(1.0f/b); }
+_INLINE simd_f operator& (float a, simd_f b)  { return convert<simd_f>(a) & b; }
+_INLINE simd_f operator| (float a, simd_f b)  { return convert<simd_f>(a) | b; }
+_INLINE simd_f operator+ (float a, simd_f b)  { return convert<simd_f>(a) + b; }
+_INLINE simd_f operator- (float a, simd_f b)  { return convert<simd_f>(a) - b; }
+_INLINE simd_f operator* (float a, simd_f b)  { return convert<simd_f>(a) * b; }
+_INLINE simd_f operator/ (float a, simd_f b)  { return convert<simd_f>(a) * rcp(b); }
+
+_INLINE const simd_f& operator&=(simd_f& a, simd_f b) { return (a = a & b); }
+_INLINE const simd_f& operator|=(simd_f& a, simd_f b) { return (a = a | b); }
+_INLINE const simd_f& operator+=(simd_f& a, simd_f b) { return (a = a + b); }
+_INLINE const simd_f& operator-=(simd_f& a, simd_f b) { return (a = a - b); }
+_INLINE const simd_f& operator*=(simd_f& a, simd_f b) { return (a = a * b); }
+_INLINE const simd_f& operator/=(simd_f& a, simd_f b) { return (a = a / b); }
+_INLINE const simd_f& operator+=(simd_f& a, float b)  { return (a = a + b); }
+_INLINE const simd_f& operator-=(simd_f& a, float b)  { return (a = a - b); }
+_INLINE const simd_f& operator*=(simd_f& a, float b)  { return (a = a * b); }
+_INLINE const simd_f& operator/=(simd_f& a, float b)  { return (a = a / b); }
+
+_INLINE simd_i operator&(simd_i a, int b) { return a & convert<simd_i>(b); }
+_INLINE simd_i operator|(simd_i a, int b) { return a | convert<simd_i>(b); }
+_INLINE simd_i operator+(simd_i a, int b) { return a + convert<simd_i>(b); }
+_INLINE simd_i operator-(simd_i a, int b) { return a - convert<simd_i>(b); }
+
+_INLINE const simd_i& operator&=(simd_i& a, simd_i b) { return (a = a & b); }
+_INLINE const simd_i& operator|=(simd_i& a, simd_i b) { return (a = a | b); }
+_INLINE const simd_i& operator+=(simd_i& a, simd_i b) { return (a = a + b); }
+_INLINE const simd_i& operator-=(simd_i& a, simd_i b) { return (a = a - b); }
+
+_INLINE std::ostream& operator<<(std::ostream& out, const simd_f& t) {
+    out << "[" << M128_FLOAT(t,0);
+    for (int i = 1; i < RT_SIMD_WIDTH; i++)
+        out << "," << M128_FLOAT(t,i);
+    out << "] ";
+    return out;
+}
+
+_INLINE std::ostream& operator<<(std::ostream& out, const simd_i& t) {
+    out << "[" << M128_INT(t,0);
+    for (int i = 1; i < RT_SIMD_WIDTH; i++)
+        out << "," << M128_INT(t,i);
+    out << "] ";
+    return out;
+}
+
+#endif
+
+#endif
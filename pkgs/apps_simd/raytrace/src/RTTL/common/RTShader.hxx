@@ -31,20 +31,16 @@ namespace RTTL {
     _INLINE sse_f& diffuse() const { return *(sse_f*)&m_diffuse; }
     _INLINE sse_f& specular() const { return *(sse_f*)&m_specular; }
 
-    _INLINE static void getDiffuse(const sse_i id4, const RTMaterial *const mat, RTVec_t<3, sse_f> &dest)
+    _INLINE static void getDiffuse(const simd_i id4, const RTMaterial *const mat, RTVec_t<3, simd_f> &dest)
     {
       //DBG_PRINT(id4);
-      const RTMaterial &mat0 = mat[M128_INT(id4,0)];
-      const RTMaterial &mat1 = mat[M128_INT(id4,1)];
-      const RTMaterial &mat2 = mat[M128_INT(id4,2)];
-      const RTMaterial &mat3 = mat[M128_INT(id4,3)];
-      //DBG_PRINT(mat0.m_diffuse);
-      //DBG_PRINT(mat1.m_diffuse);
-      //DBG_PRINT(mat2.m_diffuse);
-      //DBG_PRINT(mat3.m_diffuse);
-      dest[0] = _mm_setr_ps(mat0.m_diffuse[0],mat1.m_diffuse[0],mat2.m_diffuse[0],mat3.m_diffuse[0]);
-      dest[1] = _mm_setr_ps(mat0.m_diffuse[1],mat1.m_diffuse[1],mat2.m_diffuse[1],mat3.m_diffuse[1]);
-      dest[2] = _mm_setr_ps(mat0.m_diffuse[2],mat1.m_diffuse[2],mat2.m_diffuse[2],mat3.m_diffuse[2]);
+      for (int i=0;i<RT_SIMD_WIDTH;i++)
+        {
+          const RTMaterial &m = mat[M128_INT(id4,i)];
+          M128_FLOAT(dest[0],i) = m.m_diffuse[0];
+          M128_FLOAT(dest[1],i) = m.m_diffuse[1];
+          M128_FLOAT(dest[2],i) = m.m_diffuse[2];
+        }
       //DBG_PRINT(dest);
     }
   };
@@ -77,7 +77,9 @@ protected:
       // Gently push suspended threads allowing them to discover
       // that they should return from threadFunc.
       for (int i = 0; i < nt; i++) {
+        m_scheduler[i].lock();
         m_scheduler[i].resume();
+        m_scheduler[i].unlock();
       }
       unlock();
 
@@ -130,9 +132,12 @@ public:
     int nt = m_threads;
     m_threads = -1;
     // Gently push suspended threads allowing them to discover
-    // that they should return from threadFunc.
+    // that they should return from threadFunc. The scheduler lock
+    // makes sure a thread about to suspend itself does not miss it.
     for (int i = 0; i < nt; i++) {
+      m_scheduler[i].lock();
       m_scheduler[i].resume();
+      m_scheduler[i].unlock();
     }
     unlock();
 
@@ -280,6 +285,12 @@ private:
       // (after resuming the server if we done).
       if (done)
         m_server.resume();
+      if (m_server.finished()) {
+        // finishThreadsAAA already pushed all threads; don't wait
+        // for a resume that never comes, threadFunc returns instead.
+        code = m_server.unlock();
+        return seqn;
+      }
       m_scheduler[threadID].lock();
       code = m_server.unlock();
       m_scheduler[threadID].suspend(true);
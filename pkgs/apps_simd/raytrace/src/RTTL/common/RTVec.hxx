@@ -24,6 +24,9 @@ _INLINE sse_i convert(int n0,   int n1,   int n2,   int n3)   { return _mm_set_e
 /// SSE ops (outside rttl).
 #include "RTSSE.hxx"
 
+/// Vectors of RT_SIMD_WIDTH rays (SSE, AVX or AVX-512).
+#include "RTSIMD.hxx"
+
 /// Define ops for arrays of basic data types.
 #include "RTData.hxx"
 
@@ -82,6 +85,10 @@ namespace RTTL {
     _INLINE sse_i maxValue<sse_i>()   { return _mm_set1_epi32(INT_MAX); }
     template<>                        
     _INLINE sse_i infinity<sse_i>()   { return _mm_set1_epi32(numeric_limits<int>::infinity()); }
+#if RT_SIMD_WIDTH > 4
+    template<>
+    _INLINE simd_f infinity<simd_f>() { return convert<simd_f>(numeric_limits<float>::infinity()); }
+#endif
 
     /// Two-operand operators. All operations are performed through DataArray class.
     /// Comparison ops are overloaded wrt constantness (with the same semantic).
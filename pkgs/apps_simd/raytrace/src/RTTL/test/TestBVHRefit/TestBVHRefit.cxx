@@ -0,0 +1,256 @@
+#include "RTTL/common/RTInclude.hxx"
+#include "RTTL/Mesh/Mesh.hxx"
+#include "RTTL/BVH/BVH.hxx"
+#include "RTTL/BVH/BVHRefit.hxx"
+#include "RTTL/BVH/Builder/Builder.hxx"
+#include <stdio.h>
+#include <vector>
+
+using namespace RTTL;
+
+/*! \file TestBVHRefit.cxx builds a BVH over a grid mesh, moves the
+    vertices and refits the BVH with one and with several threads. the
+    refit trees have to be tight around the moved triangles, equal for
+    any number of threads, and find the same hits as a BVH built from
+    scratch for the moved mesh. large motion has to push the SAH cost
+    over the rebuild threshold */
+
+#define GRID 120
+
+/*! n x n grid in the xz plane, displaced in y by a wave of the given
+    amplitude; scramble moves every vertex somewhere else in the scene */
+void makeVertices(vector<RTVec3f> &v, const float amplitude, const bool scramble)
+{
+  v.resize(GRID*GRID);
+  for (int z=0;z<GRID;z++)
+    for (int x=0;x<GRID;x++)
+      {
+        const int i = z*GRID+x;
+        v[i] = RTVec3f((float)x, amplitude * sinf(0.2f * x) * cosf(0.3f * z), (float)z);
+        if (scramble)
+          v[i] = RTVec3f((float)((i * 7919) % GRID), (float)((i * 104729) % 17), (float)((i * 1299709) % GRID));
+      }
+}
+
+StandardTriangleMesh *makeMesh(const vector<RTVec3f> &v)
+{
+  vector<RTVec3i> t;
+  for (int z=0;z<GRID-1;z++)
+    for (int x=0;x<GRID-1;x++)
+      {
+        const int i = z*GRID+x;
+        t.push_back(RTVec3i(i, i+1, i+GRID+1));
+        t.push_back(RTVec3i(i, i+GRID+1, i+GRID));
+      }
+  StandardTriangleMesh *mesh = new (aligned_malloc<StandardTriangleMesh>(1)) StandardTriangleMesh;
+  mesh->addVertices((const float*)&v[0],NULL,v.size(),RT_VERTEX_3F);
+  mesh->addPrimitives((const int*)&t[0],t.size(),RT_TRIANGLE);
+  return mesh;
+}
+
+/*! same steps as the renderer's Context::buildBVH */
+AABBListBVH *buildBVH(PolygonalBaseMesh *mesh)
+{
+  const int numPrimitives = mesh->numPrimitives();
+  AABB *box = aligned_malloc<AABB>(numPrimitives);
+  mesh->storePrimitiveAABBs(box,numPrimitives);
+  AABBListBVH *bvh = new AABBListBVH(box,numPrimitives);
+  bvh->build(mesh->getAABB(),mesh->getCentroidAABB());
+  bvh->primBounds = NULL;
+  free_align(box);
+  return bvh;
+}
+
+bool sameBounds(const RTBoxSSE &a, const RTBoxSSE &b)
+{
+  for (int k=0;k<3;k++)
+    if (a.min3f()[k] != b.min3f()[k] || a.max3f()[k] != b.max3f()[k])
+      return false;
+  return true;
+}
+
+/*! every node has to be the union of its children resp. triangles;
+    appends all node bounds in depth first order to bounds */
+bool tight(const BVH *bvh, const PolygonalBaseMesh *mesh, const int index, vector<float> &bounds)
+{
+  const AABB &n = bvh->node[index];
+  for (int k=0;k<3;k++)
+    {
+      bounds.push_back(n.min3f()[k]);
+      bounds.push_back(n.max3f()[k]);
+    }
+  RTBoxSSE box;
+  box.setEmpty();
+  if (n.isLeaf())
+    for (int i=0;i<n.items();i++)
+      box.extend(mesh->getAABB(bvh->item[n.itemOffset()+i]));
+  else
+    {
+      if (!tight(bvh,mesh,n.children(),bounds) ||
+          !tight(bvh,mesh,n.children()+1,bounds))
+        return false;
+      box = bvh->node[n.children()];
+      box.extend(bvh->node[n.children()+1]);
+    }
+  return sameBounds(n,box);
+}
+
+_INLINE float dot3(const RTVec3f &a, const RTVec3f &b)
+{
+  return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/*! distance to the closest triangle along the ray, or FLT_MAX */
+float intersectTriangle(const StandardTriangleMesh *mesh, const int t, const RTVec3f &org, const RTVec3f &dir)
+{
+  const RTVec3f &v0 = mesh->getTriangleVertex(t,0);
+  const RTVec3f e1 = mesh->getTriangleVertex(t,1) - v0;
+  const RTVec3f e2 = mesh->getTriangleVertex(t,2) - v0;
+  const RTVec3f p = dir ^ e2;
+  const float det = dot3(e1,p);
+  if (det == 0.0f) return FLT_MAX;
+  const float inv = 1.0f / det;
+  const RTVec3f s = org - v0;
+  const float u = dot3(s,p) * inv;
+  if (u < 0.0f || u > 1.0f) return FLT_MAX;
+  const RTVec3f q = s ^ e1;
+  const float v = dot3(dir,q) * inv;
+  if (v < 0.0f || u + v > 1.0f) return FLT_MAX;
+  const float d = dot3(e2,q) * inv;
+  return d > 0.0f ? d : FLT_MAX;
+}
+
+bool hitBox(const AABB &n, const RTVec3f &org, const RTVec3f &dir, const float dist)
+{
+  float tmin = 0.0f, tmax = dist;
+  for (int k=0;k<3;k++)
+    {
+      const float inv = 1.0f / dir[k];
+      float t0 = (n.min3f()[k] - org[k]) * inv;
+      float t1 = (n.max3f()[k] - org[k]) * inv;
+      if (t0 > t1) std::swap(t0,t1);
+      tmin = max(tmin,t0);
+      tmax = min(tmax,t1);
+    }
+  return tmin <= tmax;
+}
+
+float traceBVH(const BVH *bvh, const StandardTriangleMesh *mesh, const RTVec3f &org, const RTVec3f &dir)
+{
+  float dist = FLT_MAX;
+  vector<int> stack(1,0);
+  while (!stack.empty())
+    {
+      const AABB &n = bvh->node[stack.back()];
+      stack.pop_back();
+      if (!hitBox(n,org,dir,dist)) continue;
+      if (n.isLeaf())
+        for (int i=0;i<n.items();i++)
+          dist = min(dist,intersectTriangle(mesh,bvh->item[n.itemOffset()+i],org,dir));
+      else
+        {
+          stack.push_back(n.children());
+          stack.push_back(n.children()+1);
+        }
+    }
+  return dist;
+}
+
+/*! rays from above the grid towards random points below it; returns
+    the number of rays whose hits differ */
+int compareHits(const BVH *a, const BVH *b, const StandardTriangleMesh *mesh)
+{
+  int differ = 0;
+  srand(1);
+  for (int r=0;r<20000;r++)
+    {
+      const RTVec3f org(GRID * (rand() / (float)RAND_MAX), 40.0f, GRID * (rand() / (float)RAND_MAX));
+      const RTVec3f to(GRID * (rand() / (float)RAND_MAX), -40.0f, GRID * (rand() / (float)RAND_MAX));
+      const RTVec3f dir = to - org;
+      if (traceBVH(a,mesh,org,dir) != traceBVH(b,mesh,org,dir))
+        differ++;
+    }
+  return differ;
+}
+
+/*! refit bvh to vertices v, returns the SAH cost and the node bounds */
+float refit(BVHRefitter &refitter, BVH *bvh, StandardTriangleMesh *mesh,
+            const vector<RTVec3f> &v, const int threads, vector<float> &bounds, int &result)
+{
+  mesh->updateVertices((const float*)&v[0],0,v.size());
+  const float sah = refitter.refit(bvh->node,bvh->item,mesh,threads);
+  bounds.clear();
+  if (!tight(bvh,mesh,0,bounds))
+    {
+      cout << "error: refit with " << threads << " threads left a node that is not tight" << endl;
+      result = 1;
+    }
+  return sah;
+}
+
+int main(int ac, char **av)
+{
+  const int threads = ac > 1 ? atoi(av[1]) : 4;
+  BVHBuilder::Options::buildThreads = threads;
+
+  vector<RTVec3f> still, wave, scrambled;
+  makeVertices(still,0.0f,false);
+  makeVertices(wave,4.0f,false);
+  makeVertices(scrambled,0.0f,true);
+
+  StandardTriangleMesh *mesh = makeMesh(still);
+  AABBListBVH *bvh = buildBVH(mesh);
+  const float buildSAH = BVHRefitter::sahCost(bvh->node);
+
+  BVHRefitter refitter;
+  vector<float> serial, parallel;
+  int result = 0;
+
+  /* unmoved vertices give back the built tree */
+  refit(refitter,bvh,mesh,still,1,serial,result);
+  const float stillSAH = BVHRefitter::sahCost(bvh->node);
+  cout << "build SAH " << buildSAH << ", refit without motion " << stillSAH << endl;
+  if (stillSAH != buildSAH)
+    {
+      cout << "error: refit without motion changed the SAH cost" << endl;
+      result = 2;
+    }
+
+  /* one and several threads refit the same bounds */
+  const float serialSAH = refit(refitter,bvh,mesh,wave,1,serial,result);
+  refit(refitter,bvh,mesh,still,threads,parallel,result);
+  const float parallelSAH = refit(refitter,bvh,mesh,wave,threads,parallel,result);
+  cout << "refit SAH 1 thread " << serialSAH << ", " << threads << " threads " << parallelSAH << endl;
+  if (serial != parallel || serialSAH != parallelSAH)
+    {
+      cout << "error: refit with " << threads << " threads differs from refit with one thread" << endl;
+      result = 3;
+    }
+
+  /* the refit tree finds the same hits as one built for the moved mesh */
+  StandardTriangleMesh *waveMesh = makeMesh(wave);
+  AABBListBVH *fresh = buildBVH(waveMesh);
+  const int differ = compareHits(bvh,fresh,mesh);
+  cout << "rebuilt SAH " << BVHRefitter::sahCost(fresh->node) << ", " << differ << " rays hit differently" << endl;
+  if (differ)
+    {
+      cout << "error: refit and rebuilt BVH find different hits" << endl;
+      result = 4;
+    }
+
+  /* scrambling the vertices makes the refit tree bad enough for a rebuild */
+  const float scrambledSAH = refit(refitter,bvh,mesh,scrambled,threads,parallel,result);
+  cout << "refit SAH after scrambling " << scrambledSAH << ", rebuild threshold "
+       << BVHBuilder::Options::rebuildThreshold * buildSAH << endl;
+  if (scrambledSAH <= BVHBuilder::Options::rebuildThreshold * buildSAH)
+    {
+      cout << "error: scrambled vertices stay below the rebuild threshold" << endl;
+      result = 5;
+    }
+
+  /* the server threads have to return before the static server is destroyed */
+  refitter.finishThreadsAAA();
+  if (!result)
+    cout << "passed" << endl;
+  return result;
+}
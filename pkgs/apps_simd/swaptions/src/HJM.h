@@ -4,6 +4,8 @@
 #include <cstring>
 
 FTYPE RanUnif( long *s );
+long RanUnif_skip( long s, long n );
+void RanUnif_block( long *s, int n, FTYPE *out );
 FTYPE CumNormalInv( FTYPE u );
 #ifdef SIMD_WIDTH
 void CumNormalInv_simd( FTYPE* u, FTYPE* output );
@@ -19,7 +21,16 @@ int Discount_Factors_opt(FTYPE *pdDiscountFactors, int iN, FTYPE dYears, FTYPE *
 int HJM_SimPath_Forward_Blocking_SSE(FTYPE **ppdHJMPath, int iN, int iFactors, FTYPE dYears, FTYPE *pdForward, FTYPE *pdTotalDrift,
 			    FTYPE **ppdFactors, long *lRndSeed, int BLOCKSIZE);
 int HJM_SimPath_Forward_Blocking(FTYPE **ppdHJMPath, int iN, int iFactors, FTYPE dYears, FTYPE *pdForward, FTYPE *pdTotalDrift,
-			    FTYPE **ppdFactors, long *lRndSeed, int BLOCKSIZE);
+			    FTYPE **ppdFactors, long *lRndSeed, int BLOCKSIZE,
+			    int iSampling, sobol *pSobol, long lBlock, workspace *pWorkspace);
+
+void HJM_Workspace_init(workspace *pWorkspace, int iN, int iFactors, int iSwaptions, int BLOCKSIZE);
+void HJM_Workspace_free(workspace *pWorkspace);
+
+void Sobol_init(sobol *pSobol, int iN, int iFactors, long lSeed);
+void Sobol_free(sobol *pSobol, int iN);
+void Sobol_block(sobol *pSobol, int iReplicate, long lFirst, int iLanes, FTYPE **randZ, int iFactors, int BLOCKSIZE);
+void Sobol_bridge_block(sobol *pSobol, FTYPE **pdZ, FTYPE *pdW, int iN, int iFactors, int iLanes, int BLOCKSIZE);
 
 
 int Discount_Factors_Blocking(FTYPE *pdDiscountFactors, int iN, FTYPE dYears, FTYPE *pdRatePath, int BLOCKSIZE);
@@ -67,6 +78,41 @@ int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will stor
 			      //Simulation Parameters
 			      long iRndSeed, 
 			      long lTrials, int blocksize, int tid);
+int HJM_Swaption_Blocking_Sums(double *pdSums, //Output vector of NUM_SUMS sums of the samples (see HJM_type.h)
+			      //Swaption Parameters (see HJM_Swaption_Blocking)
+			      FTYPE dStrike,
+			      FTYPE dCompounding,
+			      FTYPE dMaturity,
+			      FTYPE dTenor,
+			      FTYPE dPaymentInterval,
+			      int iN,
+			      int iFactors,
+			      FTYPE dYears,
+			      FTYPE *pdYield,
+			      FTYPE **ppdFactors,
+			      //Simulation Parameters
+			      long iRndSeed,
+			      long lFirstTrial, //first trial to simulate, multiple of blocksize
+			      long lTrials,
+			      int iSampling, //combination of VR_* flags
+			      workspace *pWorkspace, //buffers of the calling thread or NULL
+			      int blocksize, int tid);
+
+int HJM_Swaption_Blocking_Batch_Sums(double **ppdSums, //Output: NUM_SUMS sums of the samples of each swaption
+			      parm **ppSwaptions, //swaptions sharing iN, iFactors, dYears, yield curve and factors
+			      int nGroup,
+			      long iRndSeed,
+			      long lFirstTrial, //first trial to simulate, multiple of blocksize
+			      long lTrials,
+			      int iSampling,
+			      workspace *pWorkspace,
+			      int blocksize, int tid);
+
+parm *HJM_Portfolio_load(const char *pcFile, int *pnSwaptions);
+int HJM_Portfolio_same_paths(parm *a, parm *b);
+
+void HJM_Sums_Merge(double *pdSums, const double *pdOther);
+void HJM_Swaption_Result(FTYPE *pdSwaptionPrice, double *pdSums, long lTrials, int iSampling);
 /*
 extern "C" FTYPE *dvector( long nl, long nh );
 extern "C" FTYPE **dmatrix( long nrl, long nrh, long ncl, long nch );
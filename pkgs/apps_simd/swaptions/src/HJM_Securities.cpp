@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <iostream>
 
 #include "nr_routines.h"
@@ -23,6 +24,7 @@
 #include "tbb/blocked_range.h"
 #include "tbb/parallel_for.h"
 #include "tbb/cache_aligned_allocator.h"
+#include "tbb/enumerable_thread_specific.h"
 tbb::cache_aligned_allocator<FTYPE> memory_ftype;
 tbb::cache_aligned_allocator<parm> memory_parm;
 #define TBB_GRAINSIZE 1
@@ -44,36 +46,189 @@ parm *swaptions;
 
 long seed = 1979; //arbitrary (but constant) default value (birth year of Christian Bienia)
 long swaption_seed;
+int iSampling = VR_PSEUDO;
 
 // =================================================
-FTYPE *dSumSimSwaptionPrice_global_ptr;
-FTYPE *dSumSquareSimSwaptionPrice_global_ptr;
-int chunksize;
+// Swaptions are priced in groups which share their simulated paths. With -bp
+// all swaptions with the same iN, iFactors, dYears, yield curve and factors form
+// one group, the paths of a block are generated once and every member evaluates
+// its payoff on them. Otherwise every swaption is a group of its own. A group
+// uses the random number sequence of its first member.
+typedef struct {
+  int iFirst;    // first member in piMembers
+  int nMembers;
+  int iIssued;   // adaptive mode: batches handed out to threads
+  int iMerged;   // adaptive mode: batches added to the sums of the members
+  int bDone;
+} swaption_group;
+
+int bBatchPricing = 0;
+int nGroups = 0;
+int iMaxMembers = 1;
+swaption_group *groups;
+int *piMembers; // swaption indices, the members of a group are contiguous
+
+// The trials of a group are split into nChunks chunks of whole blocks so that
+// there is work for all threads even with fewer groups than threads. A work
+// unit is one chunk of one group, the sums of a member are stored at index
+// (swaption*nChunks + chunk)*NUM_SUMS and reduced in chunk order once all units
+// are done. Every chunk starts at its own position of the random number sequence
+// of the group, so the simulated paths do not depend on the number of chunks.
+double *dSums_global_ptr;
+int nChunks = 1;
+int nUnits = 1;
+
+// Buffers of each thread, sized for the largest swaption and allocated by the
+// thread itself the first time it needs them
+int iMaxN = 0;
+int iMaxFactors = 0;
+#ifdef TBB_VERSION
+struct ThreadWorkspace
+{
+  workspace ws;
+  ThreadWorkspace() { HJM_Workspace_init(&ws, iMaxN, iMaxFactors, iMaxMembers, BLOCK_SIZE); }
+  ~ThreadWorkspace() { HJM_Workspace_free(&ws); }
+};
+tbb::enumerable_thread_specific<ThreadWorkspace> tbb_workspaces;
+#endif
+workspace *workspaces; // pthreads and serial version, indexed by thread id
+
+int gcd(int a, int b) {
+  while(b) { int t = a % b; a = b; b = t; }
+  return a;
+}
+
+// Simulates trials lFirstTrial.. of group g, the sums of member m go to
+// pdSums[(piMembers[iFirst+m]*lStride + lOffset)*NUM_SUMS]
+void price_group(int g, long lFirstTrial, long lTrials, double *pdSums, long lStride, long lOffset,
+                 workspace *pWorkspace) {
+  swaption_group *pGroup = &groups[g];
+  double *ppdSums[pGroup->nMembers];
+  parm *ppSwaptions[pGroup->nMembers];
+
+  for(int m = 0; m < pGroup->nMembers; m++) {
+    int i = piMembers[pGroup->iFirst + m];
+    ppdSums[m] = &pdSums[((long)i*lStride + lOffset)*NUM_SUMS];
+    ppSwaptions[m] = &swaptions[i];
+  }
+  int iSuccess = HJM_Swaption_Blocking_Batch_Sums(ppdSums, ppSwaptions, pGroup->nMembers,
+                                                  swaption_seed+piMembers[pGroup->iFirst],
+                                                  lFirstTrial, lTrials, iSampling,
+                                                  pWorkspace, BLOCK_SIZE, 0);
+  assert(iSuccess == 1);
+}
+
+void price_unit(int u, workspace *pWorkspace) {
+  int g = u / nChunks;
+  int c = u % nChunks;
+  long lBlocks = (NUM_TRIALS + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  long lFirst = lBlocks * c / nChunks;
+  long lLast = lBlocks * (c+1) / nChunks;
+  price_group(g, lFirst*BLOCK_SIZE, (lLast-lFirst)*BLOCK_SIZE, dSums_global_ptr, nChunks, c, pWorkspace);
+}
+
+// =================================================
+// Adaptive mode (-tol): the trials of a swaption are simulated in batches of
+// ADAPTIVE_BATCH blocks until the standard error falls below dTolerance or
+// NUM_TRIALS trials are reached. A thread takes the next batch of the unfinished
+// group with the fewest batches handed out, so threads freed by swaptions which
+// converged go to the ones that still need paths. Batches are merged in order and
+// the test is done for every member after every merged batch, so results do not
+// depend on the number of threads. A group is done once all its members converged,
+// batches finishing after that are dropped.
+#define ADAPTIVE_BATCH SOBOL_REPLICATES //one block per Sobol replicate
+#define ADAPTIVE_MIN_BATCHES 4
+
+typedef struct {
+  int iMerged;   // batches added to pdSums
+  int bDone;
+  double pdSums[NUM_SUMS];
+} adaptive_state;
+
+double dTolerance = 0.0;
+int nBatches = 1;
+adaptive_state *adaptive;
+double *dBatchSums_global_ptr; // NUM_SUMS sums of batch k of swaption i at (i*nBatches + k)*NUM_SUMS
+char *bBatchDone;              // batch k of group g done at g*nBatches + k
+
+#ifdef ENABLE_THREADS
+pthread_mutex_t adaptive_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define ADAPTIVE_LOCK()   pthread_mutex_lock(&adaptive_mutex)
+#define ADAPTIVE_UNLOCK() pthread_mutex_unlock(&adaptive_mutex)
+#else
+#define ADAPTIVE_LOCK()
+#define ADAPTIVE_UNLOCK()
+#endif
+
+void adaptive_worker(workspace *pWorkspace) {
+  long lBatchTrials = ADAPTIVE_BATCH*BLOCK_SIZE;
 
+  while(1) {
+    int g = -1, k;
+
+    ADAPTIVE_LOCK();
+    for(int s = 0; s < nGroups; s++) {
+      if(!groups[s].bDone && groups[s].iIssued < nBatches &&
+         (g < 0 || groups[s].iIssued < groups[g].iIssued))
+        g = s;
+    }
+    if(g >= 0)
+      k = groups[g].iIssued++;
+    ADAPTIVE_UNLOCK();
+    if(g < 0)
+      break;
+
+    price_group(g, k*lBatchTrials, lBatchTrials, dBatchSums_global_ptr, nBatches, k, pWorkspace);
+
+    ADAPTIVE_LOCK();
+    swaption_group *pGroup = &groups[g];
+    bBatchDone[(long)g*nBatches + k] = 1;
+    while(!pGroup->bDone && pGroup->iMerged < pGroup->iIssued &&
+          bBatchDone[(long)g*nBatches + pGroup->iMerged]) {
+      pGroup->bDone = 1;
+      for(int m = 0; m < pGroup->nMembers; m++) {
+        int i = piMembers[pGroup->iFirst + m];
+        adaptive_state *a = &adaptive[i];
+        if(a->bDone)
+          continue;
+
+        HJM_Sums_Merge(a->pdSums, &dBatchSums_global_ptr[((long)i*nBatches + pGroup->iMerged)*NUM_SUMS]);
+        a->iMerged++;
+
+        FTYPE pdSwaptionPrice[2];
+        HJM_Swaption_Result(pdSwaptionPrice, a->pdSums, a->iMerged*lBatchTrials, iSampling);
+        if(a->iMerged == nBatches ||
+           (a->iMerged >= ADAPTIVE_MIN_BATCHES && pdSwaptionPrice[1] <= dTolerance)) {
+          a->bDone = 1;
+          swaptions[i].dSimSwaptionMeanPrice = pdSwaptionPrice[0];
+          swaptions[i].dSimSwaptionStdError = pdSwaptionPrice[1];
+        } else {
+          pGroup->bDone = 0;
+        }
+      }
+      pGroup->iMerged++;
+    }
+    ADAPTIVE_UNLOCK();
+  }
+}
 
 #ifdef TBB_VERSION
+struct AdaptiveWorker {
+  void operator()(const tbb::blocked_range<int> &range) const {
+    adaptive_worker(&tbb_workspaces.local().ws);
+  }
+};
+
 struct Worker {
   Worker(){}
   void operator()(const tbb::blocked_range<int> &range) const {
-    FTYPE pdSwaptionPrice[2];
     int begin = range.begin();
     int end   = range.end();
 
-    for(int i=begin; i!=end; i++) {
-      int iSuccess = HJM_Swaption_Blocking(pdSwaptionPrice,  swaptions[i].dStrike,
-					   swaptions[i].dCompounding, swaptions[i].dMaturity,
-					   swaptions[i].dTenor, swaptions[i].dPaymentInterval,
-					   swaptions[i].iN, swaptions[i].iFactors, swaptions[i].dYears,
-					   swaptions[i].pdYield, swaptions[i].ppdFactors,
-					   swaption_seed+i, NUM_TRIALS, BLOCK_SIZE, 0);
-      assert(iSuccess == 1);
-      swaptions[i].dSimSwaptionMeanPrice = pdSwaptionPrice[0];
-      swaptions[i].dSimSwaptionStdError = pdSwaptionPrice[1];
-
+    workspace *pWorkspace = &tbb_workspaces.local().ws;
+    for(int u=begin; u!=end; u++) {
+      price_unit(u, pWorkspace);
     }
-
-
-
   }
 };
 
@@ -82,7 +237,6 @@ struct Worker {
 
 void * worker(void *arg){
   int tid = *((int *)arg);
-  FTYPE pdSwaptionPrice[2];
 
   int beg, end, chunksize;
 
@@ -90,32 +244,37 @@ void * worker(void *arg){
   __parsec_thread_begin();
 #endif
 
-  if (tid < (nSwaptions % nThreads)) {
-    chunksize = nSwaptions/nThreads + 1;
+  workspace *pWorkspace = &workspaces[tid];
+  HJM_Workspace_init(pWorkspace, iMaxN, iMaxFactors, iMaxMembers, BLOCK_SIZE);
+
+  if (dTolerance > 0.0) {
+    adaptive_worker(pWorkspace);
+#ifdef ENABLE_PARSEC_HOOKS
+    __parsec_thread_end();
+#endif
+    HJM_Workspace_free(pWorkspace);
+    return NULL;
+  }
+
+  if (tid < (nUnits % nThreads)) {
+    chunksize = nUnits/nThreads + 1;
     beg = tid * chunksize;
     end = (tid+1)*chunksize;
   } else {
-    chunksize = nSwaptions/nThreads;
-    int offsetThread = nSwaptions % nThreads;
+    chunksize = nUnits/nThreads;
+    int offsetThread = nUnits % nThreads;
     int offset = offsetThread * (chunksize + 1);
     beg = offset + (tid - offsetThread) * chunksize;
     end = offset + (tid - offsetThread + 1) * chunksize;
   }
 
   if(tid == nThreads -1 )
-    end = nSwaptions;
-
-  for(int i=beg; i < end; i++) {
-     int iSuccess = HJM_Swaption_Blocking(pdSwaptionPrice,  swaptions[i].dStrike,
-                                       swaptions[i].dCompounding, swaptions[i].dMaturity,
-                                       swaptions[i].dTenor, swaptions[i].dPaymentInterval,
-                                       swaptions[i].iN, swaptions[i].iFactors, swaptions[i].dYears,
-                                       swaptions[i].pdYield, swaptions[i].ppdFactors,
-                                       swaption_seed+i, NUM_TRIALS, BLOCK_SIZE, 0);
-     assert(iSuccess == 1);
-     swaptions[i].dSimSwaptionMeanPrice = pdSwaptionPrice[0];
-     swaptions[i].dSimSwaptionStdError = pdSwaptionPrice[1];
+    end = nUnits;
+
+  for(int u=beg; u < end; u++) {
+     price_unit(u, pWorkspace);
    }
+  HJM_Workspace_free(pWorkspace);
 
 #ifdef ENABLE_PARSEC_HOOKS
   __parsec_thread_end();
@@ -129,10 +288,14 @@ void * worker(void *arg){
 void print_usage(char *name) {
   fprintf(stderr,"Usage: %s OPTION [OPTIONS]...\n", name);
   fprintf(stderr,"Options:\n");
-  fprintf(stderr,"\t-ns [number of swaptions (should be > number of threads]\n");
+  fprintf(stderr,"\t-ns [number of swaptions (trials are split among threads if < number of threads)]\n");
   fprintf(stderr,"\t-sm [number of simulations]\n");
   fprintf(stderr,"\t-nt [number of threads]\n");
   fprintf(stderr,"\t-sd [random number seed]\n");
+  fprintf(stderr,"\t-tol [target standard error, simulates until it is reached or for at most -sm simulations]\n");
+  fprintf(stderr,"\t-vr [sampling: any of s (Sobol with Brownian bridge), a (antithetic), c (control variate), default pseudo-random]\n");
+  fprintf(stderr,"\t-pf [portfolio file (CSV or binary, see Portfolio.cpp) with the swaptions to price instead of -ns generated ones]\n");
+  fprintf(stderr,"\t-bp [batched pricing: swaptions with the same curve and factors share their simulated paths]\n");
 }
 
 //Please note: Whenever we type-cast to (int), we add 0.5 to ensure that the value is rounded to the correct number.
@@ -145,6 +308,7 @@ int main(int argc, char *argv[])
 	int i,j;
 
 	FTYPE **factors=NULL;
+	char *pcPortfolio=NULL;
 
 #ifdef PARSEC_VERSION
 #define __PARSEC_STRING(x) #x
@@ -170,6 +334,21 @@ int main(int argc, char *argv[])
 	  else if (!strcmp("-nt", argv[j])) {nThreads = atoi(argv[++j]);}
 	  else if (!strcmp("-ns", argv[j])) {nSwaptions = atoi(argv[++j]);}
 	  else if (!strcmp("-sd", argv[j])) {seed = atoi(argv[++j]);}
+	  else if (!strcmp("-tol", argv[j])) {dTolerance = atof(argv[++j]);}
+	  else if (!strcmp("-pf", argv[j])) {pcPortfolio = argv[++j];}
+	  else if (!strcmp("-bp", argv[j])) {bBatchPricing = 1;}
+	  else if (!strcmp("-vr", argv[j])) {
+	    for (char *c = argv[++j]; *c; c++) {
+	      if (*c == 's') iSampling |= VR_SOBOL;
+	      else if (*c == 'a') iSampling |= VR_ANTITHETIC;
+	      else if (*c == 'c') iSampling |= VR_CONTROL;
+	      else if (*c != 'p') {
+	        fprintf(stderr,"Error: Unknown sampling mode: %c\n", *c);
+	        print_usage(argv[0]);
+	        exit(1);
+	      }
+	    }
+	  }
           else {
             fprintf(stderr,"Error: Unknown option: %s\n", argv[j]);
             print_usage(argv[0]);
@@ -177,11 +356,21 @@ int main(int argc, char *argv[])
           }
         }
 
-        if(nSwaptions < nThreads) {
-          fprintf(stderr,"Error: Fewer swaptions than threads.\n");
+        parm *portfolio = NULL;
+        if(pcPortfolio)
+          portfolio = HJM_Portfolio_load(pcPortfolio, &nSwaptions);
+
+        if(nSwaptions < 1 || NUM_TRIALS < 2) {
+          fprintf(stderr,"Error: Need at least one swaption and two simulations.\n");
           print_usage(argv[0]);
           exit(1);
         }
+        size_t nCount = (size_t)nSwaptions; // element count for the per-swaption arrays
+
+        // trials are simulated in whole blocks, with Sobol sampling the same number
+        // of blocks goes to every replicate
+        int lRound = (iSampling & VR_SOBOL) || dTolerance > 0.0 ? ADAPTIVE_BATCH*BLOCK_SIZE : BLOCK_SIZE;
+        NUM_TRIALS = (NUM_TRIALS + lRound - 1) / lRound * lRound;
 
         printf("Number of Simulations: %d,  Number of threads: %d Number of swaptions: %d\n", NUM_TRIALS, nThreads, nSwaptions);
         swaption_seed = (long)(2147483647L * RanUnif(&seed));
@@ -257,13 +446,15 @@ int main(int argc, char *argv[])
         // setting up multiple swaptions
         swaptions =
 #ifdef TBB_VERSION
-	  (parm *)memory_parm.allocate(sizeof(parm)*nSwaptions, NULL);
+	  (parm *)memory_parm.allocate(sizeof(parm)*nCount, NULL);
 #else
-	  (parm *)malloc(sizeof(parm)*nSwaptions);
+	  (parm *)malloc(sizeof(parm)*nCount);
 #endif
 
         int k;
-        for (i = 0; i < nSwaptions; i++) {
+        for (i = 0; i < nSwaptions && portfolio; i++)
+          swaptions[i] = portfolio[i];
+        for (i = 0; i < nSwaptions && !portfolio; i++) {
           swaptions[i].Id = i;
           swaptions[i].iN = iN;
           swaptions[i].iFactors = iFactors;
@@ -286,6 +477,52 @@ int main(int argc, char *argv[])
                         swaptions[i].ppdFactors[k][j] = factors[k][j];
         }
 
+        for (i = 0; i < nSwaptions; i++) {
+          if(swaptions[i].iN > iMaxN) iMaxN = swaptions[i].iN;
+          if(swaptions[i].iFactors > iMaxFactors) iMaxFactors = swaptions[i].iFactors;
+        }
+
+        // group the swaptions in order of their first member
+        groups = (swaption_group *)calloc(nCount, sizeof(swaption_group));
+        piMembers = (int *)malloc(sizeof(int)*nCount);
+        char *bGrouped = (char *)calloc(nCount, sizeof(char));
+        for (i = 0, k = 0; i < nSwaptions; i++) {
+          if(bGrouped[i])
+            continue;
+          swaption_group *pGroup = &groups[nGroups++];
+          pGroup->iFirst = k;
+          for (j = i; j < nSwaptions && (j == i || bBatchPricing); j++) {
+            if(!bGrouped[j] && HJM_Portfolio_same_paths(&swaptions[i], &swaptions[j])) {
+              bGrouped[j] = 1;
+              piMembers[k++] = j;
+              pGroup->nMembers++;
+            }
+          }
+          if(pGroup->nMembers > iMaxMembers) iMaxMembers = pGroup->nMembers;
+        }
+        free(bGrouped);
+        if(bBatchPricing)
+          printf("Number of swaption groups sharing paths: %d\n", nGroups);
+
+        workspaces = (workspace *)malloc(sizeof(workspace)*nThreads);
+
+
+        // with fewer groups than threads split the trials of every group so
+        // that the number of work units is a multiple of the number of threads
+        if(nGroups < nThreads) {
+          nChunks = nThreads / gcd(nGroups, nThreads);
+          if(nChunks > (NUM_TRIALS + BLOCK_SIZE - 1) / BLOCK_SIZE)
+            nChunks = (NUM_TRIALS + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        }
+        nUnits = nGroups * nChunks;
+        dSums_global_ptr = (double *)malloc(sizeof(double)*nCount*nChunks*NUM_SUMS);
+
+        if(dTolerance > 0.0) {
+          nBatches = NUM_TRIALS / (ADAPTIVE_BATCH*BLOCK_SIZE);
+          adaptive = (adaptive_state *)calloc(nCount, sizeof(adaptive_state));
+          dBatchSums_global_ptr = (double *)malloc(sizeof(double)*nCount*nBatches*NUM_SUMS);
+          bBatchDone = (char *)calloc((long)nGroups*nBatches, sizeof(char));
+        }
 
 	// **********Calling the Swaption Pricing Routine*****************
 #ifdef ENABLE_PARSEC_HOOKS
@@ -295,8 +532,13 @@ int main(int argc, char *argv[])
 #ifdef ENABLE_THREADS
 
 #ifdef TBB_VERSION
-	Worker w;
-	tbb::parallel_for(tbb::blocked_range<int>(0,nSwaptions,TBB_GRAINSIZE),w);
+	if(dTolerance > 0.0) {
+	  AdaptiveWorker w;
+	  tbb::parallel_for(tbb::blocked_range<int>(0,nThreads,1),w);
+	} else {
+	  Worker w;
+	  tbb::parallel_for(tbb::blocked_range<int>(0,nUnits,TBB_GRAINSIZE),w);
+	}
 #else
 
 	int threadIDs[nThreads];
@@ -317,13 +559,29 @@ int main(int argc, char *argv[])
 	worker(&threadID);
 #endif //ENABLE_THREADS
 
+        // reduce the sums of the chunks of each swaption in chunk order
+        for (i = 0; i < nSwaptions && dTolerance <= 0.0; i++) {
+          double *pdSums = &dSums_global_ptr[i*nChunks*NUM_SUMS];
+          for (j = 1; j < nChunks; j++)
+            HJM_Sums_Merge(pdSums, &pdSums[j*NUM_SUMS]);
+          FTYPE pdSwaptionPrice[2];
+          HJM_Swaption_Result(pdSwaptionPrice, pdSums, NUM_TRIALS, iSampling);
+          swaptions[i].dSimSwaptionMeanPrice = pdSwaptionPrice[0];
+          swaptions[i].dSimSwaptionStdError = pdSwaptionPrice[1];
+        }
+
 #ifdef ENABLE_PARSEC_HOOKS
 	__parsec_roi_end();
 #endif
 
         for (i = 0; i < nSwaptions; i++) {
-          fprintf(stderr,"Swaption %d: [SwaptionPrice: %.10lf StdError: %.10lf] \n",
-                   i, swaptions[i].dSimSwaptionMeanPrice, swaptions[i].dSimSwaptionStdError);
+          if(dTolerance > 0.0)
+            fprintf(stderr,"Swaption %d: [SwaptionPrice: %.10lf StdError: %.10lf Simulations: %ld] \n",
+                    i, swaptions[i].dSimSwaptionMeanPrice, swaptions[i].dSimSwaptionStdError,
+                    (long)adaptive[i].iMerged*ADAPTIVE_BATCH*BLOCK_SIZE);
+          else
+            fprintf(stderr,"Swaption %d: [SwaptionPrice: %.10lf StdError: %.10lf] \n",
+                    i, swaptions[i].dSimSwaptionMeanPrice, swaptions[i].dSimSwaptionStdError);
 
         }
 
@@ -338,6 +596,16 @@ int main(int argc, char *argv[])
 #else
         free(swaptions);
 #endif // TBB_VERSION
+        free(portfolio);
+        free(groups);
+        free(piMembers);
+        free(dSums_global_ptr);
+        free(workspaces);
+        if(dTolerance > 0.0) {
+          free(adaptive);
+          free(dBatchSums_global_ptr);
+          free(bBatchDone);
+        }
 
 	//***********************************************************
 
@@ -61,7 +61,7 @@ struct ParallelB {
 
 #endif // TBB_VERSION
 
-void serialB(FTYPE **pdZ, FTYPE **randZ, int BLOCKSIZE, int iN, int iFactors)
+void serialB(FTYPE **pdZ, FTYPE **randZ, int BLOCKSIZE, int iN, int iFactors, int iLanes)
 {
 
   //  fprintf(stderr,"SerialB \n");
@@ -75,11 +75,11 @@ void serialB(FTYPE **pdZ, FTYPE **randZ, int BLOCKSIZE, int iN, int iFactors)
       for (int j=1;j<=iN-1;++j){
 
 #ifndef SIMD_WIDTH
-	for(int b=0; b<BLOCKSIZE; b++){
+	for(int b=0; b<iLanes; b++){
 	  //	  fprintf(stderr,"Index %d\n (bs=%d, j=%d, b=%d",BLOCKSIZE*j + b, BLOCKSIZE, j, b);
 	  pdZ[l][BLOCKSIZE*j + b]= CumNormalInv(randZ[l][BLOCKSIZE*j + b]);  /* 18% of the total executition time */
 #else
-	  for(int b=0; b<BLOCKSIZE; b+=SIMD_WIDTH){
+	  for(int b=0; b<iLanes; b+=SIMD_WIDTH){
 	    // fprintf(stderr,"Index %d\n (bs=%d, j=%d, b=%d",BLOCKSIZE*j + b, BLOCKSIZE, j, b);
 	    CumNormalInv_simd(&(randZ[l][BLOCKSIZE*j + b]), &(pdZ[l][BLOCKSIZE*j + b]));  /* 18% of the total executition time */
 #endif
@@ -97,36 +97,31 @@ int HJM_SimPath_Forward_Blocking(FTYPE **ppdHJMPath,	//Matrix that stores genera
 				 FTYPE *pdTotalDrift,	//Vector containing total drift corrections for different maturities
 				 FTYPE **ppdFactors,	//Factor volatilities
 				 long *lRndSeed,			//Random number seed
-				 int BLOCKSIZE)
+				 int BLOCKSIZE,
+				 int iSampling,			//VR_* flags
+				 sobol *pSobol,			//Sobol sequences (VR_SOBOL only)
+				 long lBlock,			//Index of the block among all blocks of the swaption
+				 workspace *pWorkspace)		//Buffers of the calling thread
 {
 //This function computes and stores an HJM Path for given inputs
+//With VR_ANTITHETIC only the first half of the block is sampled, the second half
+//uses the same normals with opposite sign.
 
 	int iSuccess = 0;
 	int i,j,l; //looping variables
 
-	/* JMCG */
-#ifdef SIMD_WIDTH
-	_MM_ALIGN FTYPE **pdZ; //vector to store random normals
-	_MM_ALIGN FTYPE **randZ; //vector to store random normals
-#else
-	FTYPE **pdZ; //vector to store random normals
-	FTYPE **randZ; //vector to store random normals
-#endif
-	/* JMCG */
+	FTYPE **pdZ = pWorkspace->pdZ; //vector to store random normals
+	FTYPE **randZ = pWorkspace->randZ; //vector to store random normals
+	FTYPE *pdRand = pWorkspace->pdRand; //vector to store uniform random numbers
 
 	FTYPE dTotalShock; //total shock by which the forward curve is hit at (t, T-t)
 	FTYPE ddelt, sqrt_ddelt; //length of time steps
 
+	int iLanes = (iSampling & VR_ANTITHETIC) ? BLOCKSIZE/2 : BLOCKSIZE; //trials sampled
+
 	ddelt = (FTYPE)(dYears/iN);
 	sqrt_ddelt = sqrt(ddelt);
 
-	//#ifdef SIMD_WIDTH
-	pdZ   = dmatrix_align(0, iFactors-1, 0, iN*BLOCKSIZE -1); //assigning memory
-	randZ = dmatrix_align(0, iFactors-1, 0, iN*BLOCKSIZE -1); //assigning memory
-	//#else
-	//	pdZ   = dmatrix(0, iFactors-1, 0, iN*BLOCKSIZE -1); //assigning memory
-	//	randZ = dmatrix(0, iFactors-1, 0, iN*BLOCKSIZE -1); //assigning memory
-	//#endif
 
 	// =====================================================
 	// t=0 forward curve stored iN first row of ppdHJMPath
@@ -167,23 +162,30 @@ int HJM_SimPath_Forward_Blocking(FTYPE **ppdHJMPath,	//Matrix that stores genera
 	// -----------------------------------------------------
 
         // =====================================================
-        // sequentially generating random numbers
+        // generating random numbers
 
 	/* JMCG Another possible point of Vectorization: Problem: lRndSeed is updated every
 	   call with the new value produced by the function. Vectorizing changes the function behaviour
 	   And thus the benchmark outputs. I'm not completely sure if it should be used.
 	*/
-
-        for(int b=0; b<BLOCKSIZE; b++){
-          for(int s=0; s<1; s++){
-            for (j=1;j<=iN-1;++j){
-              for (l=0;l<=iFactors-1;++l){
-                //compute random number in exact same sequence
-                randZ[l][BLOCKSIZE*j + b + s] = RanUnif(lRndSeed);  /* 10% of the total executition time */
-              }
-            }
-          }
-        }
+	/* RanUnif_block generates the whole block at once, in several lanes but in the exact
+	   same sequence, the numbers are then distributed in the original order */
+	if (iSampling & VR_SOBOL) {
+	  //the blocks of a replicate use consecutive points of its sequence
+	  Sobol_block(pSobol, (int)(lBlock % SOBOL_REPLICATES), (lBlock / SOBOL_REPLICATES)*iLanes, iLanes,
+		      randZ, iFactors, BLOCKSIZE);
+	} else {
+	  RanUnif_block(lRndSeed, iLanes*(iN-1)*iFactors, pdRand);  /* 10% of the total executition time */
+
+	  int n = 0;
+	  for(int b=0; b<iLanes; b++){
+	    for (j=1;j<=iN-1;++j){
+	      for (l=0;l<=iFactors-1;++l){
+		randZ[l][BLOCKSIZE*j + b] = pdRand[n++];
+	      }
+	    }
+	  }
+	}
 
 	// =====================================================
 	// shocks to hit various factors for forward curve at t
@@ -192,14 +194,25 @@ int HJM_SimPath_Forward_Blocking(FTYPE **ppdHJMPath,	//Matrix that stores genera
 	ParallelB B(pdZ, randZ, BLOCKSIZE, iN);
 	for(l=0;l<=iFactors-1;++l){
 	  B.set_l(l);
-	  tbb::parallel_for(tbb::blocked_range<int>(0, BLOCKSIZE, PARALLEL_B_GRAINSIZE),B);
+	  tbb::parallel_for(tbb::blocked_range<int>(0, iLanes, PARALLEL_B_GRAINSIZE),B);
 	}
 
 #else
 	/* 18% of the total executition time */
-	serialB(pdZ, randZ, BLOCKSIZE, iN, iFactors);
+	serialB(pdZ, randZ, BLOCKSIZE, iN, iFactors, iLanes);
 #endif
 
+	//uniforms are no longer needed, randZ[0] is the workspace of the bridge
+	if (iSampling & VR_SOBOL)
+	  Sobol_bridge_block(pSobol, pdZ, randZ[0], iN, iFactors, iLanes, BLOCKSIZE);
+
+	if (iSampling & VR_ANTITHETIC) {
+	  for(l=0;l<=iFactors-1;++l)
+	    for (j=1;j<=iN-1;++j)
+	      for(int b=0; b<iLanes; b++)
+		pdZ[l][BLOCKSIZE*j + iLanes + b] = -pdZ[l][BLOCKSIZE*j + b];
+	}
+
 	// =====================================================
 	// Generation of HJM Path1
 	/* JMCG Vectorization point ( About 8% speedup )
@@ -246,13 +259,6 @@ int HJM_SimPath_Forward_Blocking(FTYPE **ppdHJMPath,	//Matrix that stores genera
 #endif
 	// -----------------------------------------------------
 
-	//#ifdef SIMD_WIDTH
-	free_dmatrix_align(pdZ, 0, iFactors -1, 0, iN*BLOCKSIZE -1);
-	free_dmatrix_align(randZ, 0, iFactors -1, 0, iN*BLOCKSIZE -1);
-	//#else
-	//	free_dmatrix(pdZ, 0, iFactors -1, 0, iN*BLOCKSIZE -1);
-	//	free_dmatrix(randZ, 0, iFactors -1, 0, iN*BLOCKSIZE -1);
-	//#endif
 	iSuccess = 1;
 	return iSuccess;
 }
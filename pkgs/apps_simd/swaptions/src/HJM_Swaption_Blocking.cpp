@@ -11,131 +11,141 @@
 #include "HJM.h"
 #include "HJM_type.h"
 
-int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will store simulation results in the form:
-			  //Swaption Price
-			  //Swaption Standard Error
-			  //Swaption Parameters 
-			  FTYPE dStrike,				  
-			  FTYPE dCompounding,     //Compounding convention used for quoting the strike (0 => continuous,
-			  //0.5 => semi-annual, 1 => annual).
-			  FTYPE dMaturity,	      //Maturity of the swaption (time to expiration)
-			  FTYPE dTenor,	      //Tenor of the swap
-			  FTYPE dPaymentInterval, //frequency of swap payments e.g. dPaymentInterval = 0.5 implies a swap payment every half
-			  //year
-			  //HJM Framework Parameters (please refer HJM.cpp for explanation of variables and functions)
-			  int iN,						
-			  int iFactors, 
-			  FTYPE dYears, 
-			  FTYPE *pdYield, 
-			  FTYPE **ppdFactors,
+// Carves the buffers of a workspace from pBase, or only computes the size if pBase
+// is NULL. Returns the number of bytes used.
+static size_t HJM_Workspace_layout(workspace *pWorkspace, char *pBase)
+{
+  char *p = pBase;
+  int iN = pWorkspace->iN;
+  int iFactors = pWorkspace->iFactors;
+  int BLOCKSIZE = pWorkspace->BLOCKSIZE;
+
+#define WS_BYTES(n) (((n) + WORKSPACE_ALIGNMENT - 1) / WORKSPACE_ALIGNMENT * WORKSPACE_ALIGNMENT)
+#define WS_ARRAY(v, type, n) { if (pBase) v = (type *)p; p += WS_BYTES(sizeof(type)*(n)); }
+#define WS_VECTOR(v, n) WS_ARRAY(v, FTYPE, n)
+#define WS_MATRIX(m, nrow, ncol) { \
+    if (pBase) m = (FTYPE **)p; \
+    p += WS_BYTES(sizeof(FTYPE *)*(nrow)); \
+    for (int r=0; r<(nrow); r++) WS_VECTOR(m[r], ncol); }
+
+  WS_MATRIX(pWorkspace->ppdHJMPath, iN, iN*BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdForward, iN);
+  WS_MATRIX(pWorkspace->ppdDrifts, iFactors, iN-1);
+  WS_VECTOR(pWorkspace->pdTotalDrift, iN-1);
+  WS_VECTOR(pWorkspace->pdSwapPayoffs, pWorkspace->iSwaptions*iN);
+  WS_ARRAY(pWorkspace->piSwapVectorLength, int, pWorkspace->iSwaptions);
+  WS_ARRAY(pWorkspace->piSwapStartTimeIndex, int, pWorkspace->iSwaptions);
+  WS_ARRAY(pWorkspace->pdControlMean, double, pWorkspace->iSwaptions);
+  WS_VECTOR(pWorkspace->pdPayoff, BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdControl, BLOCKSIZE);
+#ifndef SIMD_WIDTH
+  WS_VECTOR(pWorkspace->pdPayoffDiscountFactors, iN*BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdDiscountingRatePath, iN*BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdSwapRatePath, iN*BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdSwapDiscountFactors, iN*BLOCKSIZE);
+#endif
+  WS_MATRIX(pWorkspace->pdZ, iFactors, iN*BLOCKSIZE);
+  WS_MATRIX(pWorkspace->randZ, iFactors, iN*BLOCKSIZE);
+  WS_VECTOR(pWorkspace->pdRand, BLOCKSIZE*(iN-1)*iFactors);
+
+#undef WS_MATRIX
+#undef WS_VECTOR
+#undef WS_ARRAY
+#undef WS_BYTES
+  return p - pBase;
+}
+
+void HJM_Workspace_init(workspace *pWorkspace, int iN, int iFactors, int iSwaptions, int BLOCKSIZE)
+{
+  pWorkspace->iN = iN;
+  pWorkspace->iFactors = iFactors;
+  pWorkspace->iSwaptions = iSwaptions;
+  pWorkspace->BLOCKSIZE = BLOCKSIZE;
+  size_t lBytes = HJM_Workspace_layout(pWorkspace, NULL);
+  pWorkspace->pArena = (char *)_mm_malloc(lBytes, WORKSPACE_ALIGNMENT);
+  if (!pWorkspace->pArena) nrerror("allocation failure in HJM_Workspace_init()");
+  HJM_Workspace_layout(pWorkspace, pWorkspace->pArena);
+}
+
+void HJM_Workspace_free(workspace *pWorkspace)
+{
+  _mm_free(pWorkspace->pArena);
+  pWorkspace->pArena = NULL;
+}
+
+//Simulates trials lFirstTrial..lFirstTrial+lTrials-1 of a group of swaptions which share
+//iN, iFactors, dYears, the yield curve and the factor volatilities, rounded up to whole
+//blocks. Every block of paths is used to price all swaptions of the group.
+//lFirstTrial has to be a multiple of BLOCKSIZE, the random number sequence is
+//skipped ahead to the first number used by that block, so any partition of the trials
+//generates exactly the same paths as a single call for all of them. The sums are kept
+//in double precision, so that how the trials are partitioned does not show in the results.
+//The control variate is the discounted value of the underlying swap, its expectation
+//is known from the initial forward curve.
+int HJM_Swaption_Blocking_Batch_Sums(double **ppdSums, //Output: NUM_SUMS sums of the samples of each swaption (see HJM_type.h)
+			  parm **ppSwaptions,   //Swaptions of the group
+			  int nGroup,           //Number of swaptions in the group
 			  //Simulation Parameters
 			  long iRndSeed, 
+			  long lFirstTrial,
 			  long lTrials,
+			  int iSampling,        //combination of VR_* flags
+			  workspace *pWorkspace, //buffers of the calling thread, NULL to allocate them for this call
 			  int BLOCKSIZE, int tid)
   
 {
   int iSuccess = 0;
-  int i; 
+  int i, m; 
   int b; //block looping variable
   long l; //looping variables
+
+  //HJM Framework Parameters (please refer HJM.cpp for explanation of variables and functions)
+  int iN = ppSwaptions[0]->iN;
+  int iFactors = ppSwaptions[0]->iFactors;
+  FTYPE dYears = ppSwaptions[0]->dYears;
+  FTYPE *pdYield = ppSwaptions[0]->pdYield;
+  FTYPE **ppdFactors = ppSwaptions[0]->ppdFactors;
   
   FTYPE ddelt = (FTYPE)(dYears/iN);				//ddelt = HJM matrix time-step width. e.g. if dYears = 5yrs and
                                                                 //iN = no. of time points = 10, then ddelt = step length = 0.5yrs
-  int iFreqRatio = (int)(dPaymentInterval/ddelt + 0.5);		// = ratio of time gap between swap payments and HJM step-width.
-                                                                //e.g. dPaymentInterval = 1 year. ddelt = 0.5year. This implies that a swap
-                                                                //payment will be made after every 2 HJM time steps.
   
-  FTYPE dStrikeCont;				//Strike quoted in continuous compounding convention. 
-                                                //As HJM rates are continuous, the K in max(R-K,0) will be dStrikeCont and not dStrike.
-  if(dCompounding==0) {
-    dStrikeCont = dStrike;		//by convention, dCompounding = 0 means that the strike entered by user has been quoted
-                                        //using continuous compounding convention
-  } else {
-    //converting quoted strike to continuously compounded strike
-    dStrikeCont = (1/dCompounding)*log(1+dStrike*dCompounding);  
+  workspace localWorkspace;
+  if (!pWorkspace) {
+    HJM_Workspace_init(&localWorkspace, iN, iFactors, nGroup, BLOCKSIZE);
+    pWorkspace = &localWorkspace;
   }
-                                         //e.g., let k be strike quoted in semi-annual convention. Therefore, 1$ at the end of
-                                         //half a year would earn = (1+k/2). For converting to continuous compounding, 
-                                         //(1+0.5*k) = exp(K*0.5)
-                                         // => K = (1/0.5)*ln(1+0.5*k)
-  
-  //HJM Framework vectors and matrices
-  int iSwapVectorLength;  // Length of the HJM rate path at the time index corresponding to swaption maturity.
+  assert(iN <= pWorkspace->iN && iFactors <= pWorkspace->iFactors && nGroup <= pWorkspace->iSwaptions &&
+	 BLOCKSIZE == pWorkspace->BLOCKSIZE);
 
-  FTYPE **ppdHJMPath;    // **** per Trial data **** //
+  //HJM Framework vectors and matrices
+  FTYPE **ppdHJMPath = pWorkspace->ppdHJMPath;    // **** per Trial data **** //
 
-  FTYPE *pdForward;
-  FTYPE **ppdDrifts; 
-  FTYPE *pdTotalDrift;
-  
-  // *******************************
-  // ppdHJMPath = dmatrix(0,iN-1,0,iN-1);
-#ifdef SIMD_WIDTH
-  ppdHJMPath = dmatrix_align(0,iN-1,0,iN*BLOCKSIZE-1);    // JMCG **** per Trial data **** //
-#else
-  ppdHJMPath = dmatrix(0,iN-1,0,iN*BLOCKSIZE-1);    // Original **** per Trial data **** //
-#endif
-  pdForward = dvector(0, iN-1);
-  ppdDrifts = dmatrix(0, iFactors-1, 0, iN-2);
-  pdTotalDrift = dvector(0, iN-2);
+  FTYPE *pdForward = pWorkspace->pdForward;
+  FTYPE **ppdDrifts = pWorkspace->ppdDrifts;
+  FTYPE *pdTotalDrift = pWorkspace->pdTotalDrift;
 	
   //==================================
   // **** per Trial data **** //
-  FTYPE *pdDiscountingRatePath;	  //vector to store rate path along which the swaption payoff will be discounted
-  FTYPE *pdPayoffDiscountFactors;  //vector to store discount factors for the rate path along which the swaption 
+#ifndef SIMD_WIDTH
+  FTYPE *pdDiscountingRatePath = pWorkspace->pdDiscountingRatePath;	  //vector to store rate path along which the swaption payoff will be discounted
+  FTYPE *pdPayoffDiscountFactors = pWorkspace->pdPayoffDiscountFactors;  //vector to store discount factors for the rate path along which the swaption 
   //payoff will be discounted
-  FTYPE *pdSwapRatePath;			  //vector to store the rate path along which the swap payments made will be discounted	
-  FTYPE *pdSwapDiscountFactors;	  //vector to store discount factors for the rate path along which the swap
+  FTYPE *pdSwapRatePath = pWorkspace->pdSwapRatePath;			  //vector to store the rate path along which the swap payments made will be discounted	
+  FTYPE *pdSwapDiscountFactors = pWorkspace->pdSwapDiscountFactors;	  //vector to store discount factors for the rate path along which the swap
   //payments made will be discounted	
-  FTYPE *pdSwapPayoffs;			  //vector to store swap payoffs
-
-  
-  int iSwapStartTimeIndex;
-  int iSwapTimePoints;
-  FTYPE dSwapVectorYears;
-
-  FTYPE dSwaptionPayoff;
-  FTYPE dDiscSwaptionPayoff;
   FTYPE dFixedLegValue;
+#endif
 
-  // Accumulators
-  FTYPE dSumSimSwaptionPrice; 
-  FTYPE dSumSquareSimSwaptionPrice;
+  //per swaption of the group
+  FTYPE *pdSwapPayoffs;  //vector to store swap payoffs (row m of pWorkspace->pdSwapPayoffs)
+  int iSwapVectorLength; // Length of the HJM rate path at the time index corresponding to swaption maturity.
+  int iSwapStartTimeIndex;
+  double dControlMean;   //expectation of the discounted swap value
 
-  // Final returned results
-  FTYPE dSimSwaptionMeanPrice;
-  FTYPE dSimSwaptionStdError;
-  
-  // *******************************
-  pdPayoffDiscountFactors = dvector(0, iN*BLOCKSIZE-1);
-  pdDiscountingRatePath = dvector(0, iN*BLOCKSIZE-1);
-  // *******************************
-  
-  iSwapVectorLength = (int) (iN - dMaturity/ddelt + 0.5);	//This is the length of the HJM rate path at the time index
-  //corresponding to swaption maturity.
-  // *******************************
-  pdSwapRatePath = dvector(0, iSwapVectorLength*BLOCKSIZE - 1);
-  pdSwapDiscountFactors  = dvector(0, iSwapVectorLength*BLOCKSIZE - 1);
-  // *******************************
-  pdSwapPayoffs = dvector(0, iSwapVectorLength - 1);
-
-
-  iSwapStartTimeIndex = (int) (dMaturity/ddelt + 0.5);	//Swap starts at swaption maturity
-  iSwapTimePoints = (int) (dTenor/ddelt + 0.5);			//Total HJM time points corresponding to the swap's tenor
-  dSwapVectorYears = (FTYPE) (iSwapVectorLength*ddelt);
-
-
-
-  //now we store the swap payoffs in the swap payoff vector
-  for (i=0;i<=iSwapVectorLength-1;++i)
-    pdSwapPayoffs[i] = 0.0; //initializing to zero
-  for (i=iFreqRatio;i<=iSwapTimePoints;i+=iFreqRatio)
-    {
-      if(i != iSwapTimePoints)
-	pdSwapPayoffs[i] = exp(dStrikeCont*dPaymentInterval) - 1; //the bond pays coupon equal to this amount
-      if(i == iSwapTimePoints)
-	pdSwapPayoffs[i] = exp(dStrikeCont*dPaymentInterval); //at terminal time point, bond pays coupon plus par amount
-    }
+  int iLanes = (iSampling & VR_ANTITHETIC) ? BLOCKSIZE/2 : BLOCKSIZE; //trials sampled per block
+  FTYPE *pdPayoff = pWorkspace->pdPayoff;     //discounted payoffs of the trials of a block
+  FTYPE *pdControl = pWorkspace->pdControl;   //discounted swap values of the trials of a block
+  sobol qmc;
 
   //generating forward curve at t=0 from supplied yield curve
   iSuccess = HJM_Yield_to_Forward(pdForward, iN, pdYield);
@@ -146,18 +156,85 @@ int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will stor
   iSuccess = HJM_Drifts(pdTotalDrift, ppdDrifts, iN, iFactors, dYears, ppdFactors);
   if (iSuccess!=1)
     return iSuccess;
-  
-  dSumSimSwaptionPrice = 0.0;
-  dSumSquareSimSwaptionPrice = 0.0;
+
+  for (m=0;m<nGroup;m++) {
+    FTYPE dStrike = ppSwaptions[m]->dStrike;
+    FTYPE dCompounding = ppSwaptions[m]->dCompounding;  //Compounding convention used for quoting the strike (0 => continuous,
+                                                        //0.5 => semi-annual, 1 => annual).
+    FTYPE dMaturity = ppSwaptions[m]->dMaturity;        //Maturity of the swaption (time to expiration)
+    FTYPE dTenor = ppSwaptions[m]->dTenor;              //Tenor of the swap
+    FTYPE dPaymentInterval = ppSwaptions[m]->dPaymentInterval; //frequency of swap payments e.g. dPaymentInterval = 0.5 implies a swap payment every half
+                                                        //year
+    int iFreqRatio = (int)(dPaymentInterval/ddelt + 0.5);	// = ratio of time gap between swap payments and HJM step-width.
+                                                                //e.g. dPaymentInterval = 1 year. ddelt = 0.5year. This implies that a swap
+                                                                //payment will be made after every 2 HJM time steps.
+    int iSwapTimePoints;
+
+    FTYPE dStrikeCont;				//Strike quoted in continuous compounding convention. 
+                                                //As HJM rates are continuous, the K in max(R-K,0) will be dStrikeCont and not dStrike.
+    if(dCompounding==0) {
+      dStrikeCont = dStrike;		//by convention, dCompounding = 0 means that the strike entered by user has been quoted
+                                        //using continuous compounding convention
+    } else {
+      //converting quoted strike to continuously compounded strike
+      dStrikeCont = (1/dCompounding)*log(1+dStrike*dCompounding);  
+    }
+                                         //e.g., let k be strike quoted in semi-annual convention. Therefore, 1$ at the end of
+                                         //half a year would earn = (1+k/2). For converting to continuous compounding, 
+                                         //(1+0.5*k) = exp(K*0.5)
+                                         // => K = (1/0.5)*ln(1+0.5*k)
+
+    iSwapVectorLength = (int) (iN - dMaturity/ddelt + 0.5);	//This is the length of the HJM rate path at the time index
+                                                                //corresponding to swaption maturity.
+    iSwapStartTimeIndex = (int) (dMaturity/ddelt + 0.5);	//Swap starts at swaption maturity
+    iSwapTimePoints = (int) (dTenor/ddelt + 0.5);		//Total HJM time points corresponding to the swap's tenor
+    pdSwapPayoffs = &pWorkspace->pdSwapPayoffs[m*pWorkspace->iN];
+
+    //now we store the swap payoffs in the swap payoff vector
+    for (i=0;i<=iSwapVectorLength-1;++i)
+      pdSwapPayoffs[i] = 0.0; //initializing to zero
+    for (i=iFreqRatio;i<=iSwapTimePoints;i+=iFreqRatio)
+      {
+	if(i != iSwapTimePoints)
+	  pdSwapPayoffs[i] = exp(dStrikeCont*dPaymentInterval) - 1; //the bond pays coupon equal to this amount
+	if(i == iSwapTimePoints)
+	  pdSwapPayoffs[i] = exp(dStrikeCont*dPaymentInterval); //at terminal time point, bond pays coupon plus par amount
+      }
+
+    //value of the swap at t=0: fixed leg minus par, both discounted along the initial curve
+    double dRateSum = 0.0;
+    for (i=0;i<=iSwapStartTimeIndex-1;++i)
+      dRateSum += pdForward[i];
+    dControlMean = -exp(-ddelt*dRateSum);
+    for (i=0;i<=iSwapVectorLength-1;++i){
+      dControlMean += pdSwapPayoffs[i]*exp(-ddelt*dRateSum);
+      dRateSum += pdForward[iSwapStartTimeIndex + i];
+    }
+
+    pWorkspace->piSwapVectorLength[m] = iSwapVectorLength;
+    pWorkspace->piSwapStartTimeIndex[m] = iSwapStartTimeIndex;
+    pWorkspace->pdControlMean[m] = dControlMean;
+
+    for (i=0;i<NUM_SUMS;++i)
+      ppdSums[m][i] = 0.0;
+  }
+
+  if (iSampling & VR_SOBOL)
+    Sobol_init(&qmc, iN, iFactors, iRndSeed);
+
+  //every block of trials consumes the same amount of random numbers
+  iRndSeed = RanUnif_skip(iRndSeed, (lFirstTrial/BLOCKSIZE)*iLanes*(iN-1)*iFactors);
 
   //Simulations begin:
   for (l=0;l<=lTrials-1;l+=BLOCKSIZE) {
       //For each trial a new HJM Path is generated
-      iSuccess = HJM_SimPath_Forward_Blocking(ppdHJMPath, iN, iFactors, dYears, pdForward, pdTotalDrift,ppdFactors, &iRndSeed, BLOCKSIZE); /* GC: 51% of the time goes here */
+      iSuccess = HJM_SimPath_Forward_Blocking(ppdHJMPath, iN, iFactors, dYears, pdForward, pdTotalDrift,ppdFactors, &iRndSeed, BLOCKSIZE,
+					      iSampling, &qmc, (lFirstTrial + l)/BLOCKSIZE, pWorkspace); /* GC: 51% of the time goes here */
        if (iSuccess!=1)
 	return iSuccess;
-      
-      //now we compute the discount factor vector
+
+#ifndef SIMD_WIDTH
+      //now we compute the discount factor vector, the same for all swaptions
 
       for(i=0;i<=iN-1;++i){
 	for(b=0;b<=BLOCKSIZE-1;b++){
@@ -168,7 +245,39 @@ int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will stor
 
      if (iSuccess!=1)
 	return iSuccess;
-        
+#endif
+
+      for (m=0;m<nGroup;m++) {
+      iSwapVectorLength = pWorkspace->piSwapVectorLength[m];
+      iSwapStartTimeIndex = pWorkspace->piSwapStartTimeIndex[m];
+      dControlMean = pWorkspace->pdControlMean[m];
+      pdSwapPayoffs = &pWorkspace->pdSwapPayoffs[m*pWorkspace->iN];
+      
+#ifdef SIMD_WIDTH
+      // Fused SIMD version: the payoffs are computed directly from the path. A discount
+      // factor is the exp of the sum of the rates instead of the product of the exps,
+      // so the payoff needs one exp and the fixed leg one exp per swap payment.
+      for(b=0;b<BLOCKSIZE;b+=SIMD_WIDTH){
+	//discount factor along the short rates of the path until swaption maturity
+	_MM_TYPE _mm_dRateSum = _MM_SETZERO();
+	for (i=0;i<=iSwapStartTimeIndex-1;++i)
+	  _mm_dRateSum = _MM_ADD(_mm_dRateSum, _MM_LOAD(&(ppdHJMPath[i][b])));
+	_MM_TYPE _mm_dPayoffDiscountFactor = _MM_EXP(_MM_MUL(_MM_SET(-ddelt), _mm_dRateSum));
+
+	//swap payments discounted along the forward curve at swaption maturity
+	_MM_TYPE _mm_dFixedLegValue = _MM_SETZERO();
+	_mm_dRateSum = _MM_SETZERO();
+	for (i=0;i<=iSwapVectorLength-1;++i){
+	  if(pdSwapPayoffs[i] != 0.0)
+	    _mm_dFixedLegValue = _MM_ADD(_mm_dFixedLegValue, _MM_MUL(_MM_SET(pdSwapPayoffs[i]), _MM_EXP(_MM_MUL(_MM_SET(-ddelt), _mm_dRateSum))));
+	  _mm_dRateSum = _MM_ADD(_mm_dRateSum, _MM_LOAD(&(ppdHJMPath[iSwapStartTimeIndex][i*BLOCKSIZE + b])));
+	}
+
+	_MM_TYPE _mm_dSwapValue = _MM_SUB(_mm_dFixedLegValue, _MM_SET(1.0));
+	_MM_STORE(&pdPayoff[b], _MM_MUL(_MM_MAX(_mm_dSwapValue, _MM_SETZERO()), _mm_dPayoffDiscountFactor));
+	_MM_STORE(&pdControl[b], _MM_MUL(_mm_dSwapValue, _mm_dPayoffDiscountFactor));
+      } // END BLOCK simulation
+#else
       //now we compute discount factors along the swap path
       for (i=0;i<=iSwapVectorLength-1;++i){
 	for(b=0;b<BLOCKSIZE;b++){
@@ -176,7 +285,7 @@ int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will stor
 	    ppdHJMPath[iSwapStartTimeIndex][i*BLOCKSIZE + b];
 	}
       }
-      iSuccess = Discount_Factors_Blocking(pdSwapDiscountFactors, iSwapVectorLength, dSwapVectorYears, pdSwapRatePath, BLOCKSIZE);
+      iSuccess = Discount_Factors_Blocking(pdSwapDiscountFactors, iSwapVectorLength, (FTYPE)(iSwapVectorLength*ddelt), pdSwapRatePath, BLOCKSIZE);
       if (iSuccess!=1)
 	return iSuccess;
 
@@ -188,28 +297,199 @@ int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will stor
 	for (i=0;i<=iSwapVectorLength-1;++i){
 	  dFixedLegValue += pdSwapPayoffs[i]*pdSwapDiscountFactors[i*BLOCKSIZE + b];
 	}
-	dSwaptionPayoff = dMax(dFixedLegValue - 1.0, 0);
-
-	dDiscSwaptionPayoff = dSwaptionPayoff*pdPayoffDiscountFactors[iSwapStartTimeIndex*BLOCKSIZE + b];
-
+	pdPayoff[b] = dMax(dFixedLegValue - 1.0, 0)*pdPayoffDiscountFactors[iSwapStartTimeIndex*BLOCKSIZE + b];
+	pdControl[b] = (dFixedLegValue - 1.0)*pdPayoffDiscountFactors[iSwapStartTimeIndex*BLOCKSIZE + b];
 	// ========= end simulation ======================================
-	
-	// accumulate into the aggregating variables =====================
-	dSumSimSwaptionPrice += dDiscSwaptionPayoff;
-	dSumSquareSimSwaptionPrice += dDiscSwaptionPayoff*dDiscSwaptionPayoff;
       } // END BLOCK simulation
+#endif
+
+      // accumulate into the aggregating variables =====================
+      // the moments of the block are taken about its own mean (two passes over
+      // the lanes) and then merged into the sums of the swaption
+      int r = (int)(((lFirstTrial + l)/BLOCKSIZE) % SOBOL_REPLICATES);
+      double pdBlock[NUM_SUMS];
+      for (i=0;i<NUM_SUMS;++i)
+	pdBlock[i] = 0.0;
+      for (int pass=0;pass<2;pass++) {
+	double dMeanY = pdBlock[SUM_Y]/iLanes;
+	double dMeanC = pdBlock[SUM_C]/iLanes;
+	for (b=0;b<iLanes;b++){
+	  double dY = pdPayoff[b];
+	  double dC = pdControl[b];
+	  if (iSampling & VR_ANTITHETIC) {
+	    dY = 0.5*(dY + pdPayoff[iLanes + b]);
+	    dC = 0.5*(dC + pdControl[iLanes + b]);
+	  }
+	  dC -= dControlMean;
+	  if (pass == 0) {
+	    pdBlock[SUM_Y] += dY;
+	    pdBlock[SUM_C] += dC;
+	  } else {
+	    pdBlock[SUM_YY] += (dY - dMeanY)*(dY - dMeanY);
+	    pdBlock[SUM_CC] += (dC - dMeanC)*(dC - dMeanC);
+	    pdBlock[SUM_YC] += (dY - dMeanY)*(dC - dMeanC);
+	  }
+	}
+      }
+      pdBlock[SUM_N] = iLanes;
+      pdBlock[SUM_REP_Y + r] = pdBlock[SUM_Y];
+      pdBlock[SUM_REP_C + r] = pdBlock[SUM_C];
+      HJM_Sums_Merge(ppdSums[m], pdBlock);
+      } // END group
+    }
+
+  if (iSampling & VR_SOBOL)
+    Sobol_free(&qmc, iN);
+
+  if (pWorkspace == &localWorkspace)
+    HJM_Workspace_free(&localWorkspace);
+
+  iSuccess = 1;
+  return iSuccess;
+}
+
+//Single swaption version of HJM_Swaption_Blocking_Batch_Sums
+int HJM_Swaption_Blocking_Sums(double *pdSums, //Output vector of NUM_SUMS sums of the samples (see HJM_type.h)
+			  //Swaption Parameters 
+			  FTYPE dStrike,				  
+			  FTYPE dCompounding,
+			  FTYPE dMaturity,
+			  FTYPE dTenor,
+			  FTYPE dPaymentInterval,
+			  //HJM Framework Parameters (please refer HJM.cpp for explanation of variables and functions)
+			  int iN,						
+			  int iFactors, 
+			  FTYPE dYears, 
+			  FTYPE *pdYield, 
+			  FTYPE **ppdFactors,
+			  //Simulation Parameters
+			  long iRndSeed, 
+			  long lFirstTrial,
+			  long lTrials,
+			  int iSampling,        //combination of VR_* flags
+			  workspace *pWorkspace, //buffers of the calling thread, NULL to allocate them for this call
+			  int BLOCKSIZE, int tid)
+{
+  parm swaption;
+  parm *pSwaption = &swaption;
+
+  swaption.dStrike = dStrike;
+  swaption.dCompounding = dCompounding;
+  swaption.dMaturity = dMaturity;
+  swaption.dTenor = dTenor;
+  swaption.dPaymentInterval = dPaymentInterval;
+  swaption.iN = iN;
+  swaption.iFactors = iFactors;
+  swaption.dYears = dYears;
+  swaption.pdYield = pdYield;
+  swaption.ppdFactors = ppdFactors;
+
+  return HJM_Swaption_Blocking_Batch_Sums(&pdSums, &pSwaption, 1, iRndSeed, lFirstTrial, lTrials,
+					  iSampling, pWorkspace, BLOCKSIZE, tid);
+}
+
+//Adds the samples summed in pdOther to pdSums. The second moments are combined with
+//the pairwise update of Chan, Golub and LeVeque, which only needs the difference of
+//the two means, so no precision is lost to cancellation however the samples were
+//split into chunks.
+void HJM_Sums_Merge(double *pdSums, const double *pdOther)
+{
+  double nA = pdSums[SUM_N];
+  double nB = pdOther[SUM_N];
+  double n = nA + nB;
+
+  if (nB == 0.0)
+    return;
+  if (nA > 0.0) {
+    double dDeltaY = pdOther[SUM_Y]/nB - pdSums[SUM_Y]/nA;
+    double dDeltaC = pdOther[SUM_C]/nB - pdSums[SUM_C]/nA;
+    double dWeight = nA*nB/n;
+    pdSums[SUM_YY] += pdOther[SUM_YY] + dDeltaY*dDeltaY*dWeight;
+    pdSums[SUM_CC] += pdOther[SUM_CC] + dDeltaC*dDeltaC*dWeight;
+    pdSums[SUM_YC] += pdOther[SUM_YC] + dDeltaY*dDeltaC*dWeight;
+  } else {
+    pdSums[SUM_YY] = pdOther[SUM_YY];
+    pdSums[SUM_CC] = pdOther[SUM_CC];
+    pdSums[SUM_YC] = pdOther[SUM_YC];
+  }
+  pdSums[SUM_N] = n;
+  pdSums[SUM_Y] += pdOther[SUM_Y];
+  pdSums[SUM_C] += pdOther[SUM_C];
+  for (int r=0;r<SOBOL_REPLICATES;r++) {
+    pdSums[SUM_REP_Y + r] += pdOther[SUM_REP_Y + r];
+    pdSums[SUM_REP_C + r] += pdOther[SUM_REP_C + r];
+  }
+}
+
+//Computes mean price and standard error of a swaption from the sums over lTrials trials
+//With VR_CONTROL the payoff is corrected by the control with the regression coefficient
+//estimated from the same samples. With VR_SOBOL the standard error is that of the mean
+//of the SOBOL_REPLICATES independent estimates, which needs the trials to be split
+//evenly among the replicates.
+void HJM_Swaption_Result(FTYPE *pdSwaptionPrice, double *pdSums, long lTrials, int iSampling)
+{
+  double n = (iSampling & VR_ANTITHETIC) ? lTrials/2 : lTrials; //number of samples
+  double dBeta = 0.0;
+  double dVariance = pdSums[SUM_YY]/(n-1.0);
+
+  if (iSampling & VR_CONTROL) {
+    double dVarianceC = pdSums[SUM_CC]/(n-1.0);
+    double dCovariance = pdSums[SUM_YC]/(n-1.0);
+    if (dVarianceC > 0.0) {
+      dBeta = dCovariance/dVarianceC;
+      dVariance -= dBeta*dCovariance;
     }
+  }
 
   // Simulation Results Stored
-  dSimSwaptionMeanPrice = dSumSimSwaptionPrice/lTrials;
-  dSimSwaptionStdError = sqrt((dSumSquareSimSwaptionPrice-dSumSimSwaptionPrice*dSumSimSwaptionPrice/lTrials)/
-			      (lTrials-1.0))/sqrt((FTYPE)lTrials);
+  double dSimSwaptionMeanPrice = (pdSums[SUM_Y] - dBeta*pdSums[SUM_C])/n;
+  double dSimSwaptionStdError = sqrt((dVariance > 0.0 ? dVariance : 0.0)/n);
+
+  if (iSampling & VR_SOBOL) {
+    double nr = n/SOBOL_REPLICATES;
+    dVariance = 0.0;
+    for (int r=0;r<SOBOL_REPLICATES;r++) {
+      double dEstimate = (pdSums[SUM_REP_Y + r] - dBeta*pdSums[SUM_REP_C + r])/nr;
+      dVariance += (dEstimate - dSimSwaptionMeanPrice)*(dEstimate - dSimSwaptionMeanPrice);
+    }
+    dSimSwaptionStdError = sqrt(dVariance/(SOBOL_REPLICATES - 1.0)/SOBOL_REPLICATES);
+  }
 
   //results returned
   pdSwaptionPrice[0] = dSimSwaptionMeanPrice;
   pdSwaptionPrice[1] = dSimSwaptionStdError;
-  
-  iSuccess = 1;
+}
+
+int HJM_Swaption_Blocking(FTYPE *pdSwaptionPrice, //Output vector that will store simulation results in the form:
+			  //Swaption Price
+			  //Swaption Standard Error
+			  //Swaption Parameters 
+			  FTYPE dStrike,				  
+			  FTYPE dCompounding,     //Compounding convention used for quoting the strike (0 => continuous,
+			  //0.5 => semi-annual, 1 => annual).
+			  FTYPE dMaturity,	      //Maturity of the swaption (time to expiration)
+			  FTYPE dTenor,	      //Tenor of the swap
+			  FTYPE dPaymentInterval, //frequency of swap payments e.g. dPaymentInterval = 0.5 implies a swap payment every half
+			  //year
+			  //HJM Framework Parameters (please refer HJM.cpp for explanation of variables and functions)
+			  int iN,						
+			  int iFactors, 
+			  FTYPE dYears, 
+			  FTYPE *pdYield, 
+			  FTYPE **ppdFactors,
+			  //Simulation Parameters
+			  long iRndSeed, 
+			  long lTrials,
+			  int BLOCKSIZE, int tid)
+{
+  double pdSums[NUM_SUMS];
+  int iSuccess = HJM_Swaption_Blocking_Sums(pdSums, dStrike, dCompounding, dMaturity, dTenor, dPaymentInterval,
+					    iN, iFactors, dYears, pdYield, ppdFactors,
+					    iRndSeed, 0, lTrials, VR_PSEUDO, NULL, BLOCKSIZE, tid);
+  if (iSuccess!=1)
+    return iSuccess;
+
+  HJM_Swaption_Result(pdSwaptionPrice, pdSums, lTrials, VR_PSEUDO);
   return iSuccess;
 }
 
@@ -23,6 +23,82 @@
 #define RANDSEEDVAL 100
 #define DEFAULT_NUM_TRIALS  102400
 
+// Largest swaptions accepted from a portfolio file (-pf). Every thread keeps a path
+// buffer of iN*iN*BLOCK_SIZE values, and the block sizes are computed in int.
+#define MAX_N        1024 // time steps
+#define MAX_FACTORS  64
+
+// Sampling modes (-vr), can be combined
+#define VR_PSEUDO     0 // Park-Miller pseudo-random numbers
+#define VR_SOBOL      1 // randomized Sobol points with Brownian bridge construction
+#define VR_ANTITHETIC 2 // the second half of a block mirrors the normals of the first half
+#define VR_CONTROL    4 // discounted value of the underlying swap as control variate
+
+#define SOBOL_BITS 32
+#define SOBOL_REPLICATES 16 // independently shifted Sobol sequences, block b belongs to b % SOBOL_REPLICATES
+
+// Sums of the samples of a swaption (a sample is the mean of an antithetic pair),
+// Y is the discounted payoff and C the control minus its expectation. The second
+// moments are taken about the mean of the samples summed so far, so that they do
+// not cancel when the variance is small next to the mean. Sums of disjoint sets
+// of samples are combined with HJM_Sums_Merge.
+#define SUM_N        0                            // number of samples
+#define SUM_Y        1
+#define SUM_C        2
+#define SUM_YY       3                            // sum of (Y - mean Y)^2
+#define SUM_CC       4                            // sum of (C - mean C)^2
+#define SUM_YC       5                            // sum of (Y - mean Y)*(C - mean C)
+#define SUM_REP_Y    6                            // sum of Y of each replicate
+#define SUM_REP_C    (SUM_REP_Y+SOBOL_REPLICATES) // sum of C of each replicate
+#define NUM_SUMS     (SUM_REP_C+SOBOL_REPLICATES)
+
+typedef struct
+{
+  int iDims;                   // (iN-1)*iFactors
+  unsigned int *puiDirections; // SOBOL_BITS direction numbers per dimension
+  unsigned int *puiShift;      // digital shift of every replicate and dimension
+  int *piBridgeIndex;          // Brownian bridge: step computed at level k
+  int *piLeftIndex;            // left and right step it is interpolated from
+  int *piRightIndex;
+  FTYPE *pdLeftWeight;
+  FTYPE *pdRightWeight;
+  FTYPE *pdStdDev;
+} sobol;
+
+// Memory used by the simulation of a swaption, one per thread. All buffers are
+// carved from one allocation (pArena), every buffer and matrix row starts on a
+// WORKSPACE_ALIGNMENT boundary. Sized for the largest iN and iFactors and reused
+// by all calls, for groups of up to iSwaptions swaptions.
+#define WORKSPACE_ALIGNMENT 64 // cache line, multiple of every _MM_ALIGNMENT
+
+typedef struct
+{
+  char *pArena;
+  int iN;                    // maximum sizes the buffers were made for
+  int iFactors;
+  int iSwaptions;
+  int BLOCKSIZE;
+  FTYPE **ppdHJMPath;        // iN x iN*BLOCKSIZE
+  FTYPE *pdForward;          // iN
+  FTYPE **ppdDrifts;         // iFactors x iN-1
+  FTYPE *pdTotalDrift;       // iN-1
+  FTYPE *pdSwapPayoffs;      // iSwaptions x iN, row m for swaption m of the group
+  int *piSwapVectorLength;   // iSwaptions
+  int *piSwapStartTimeIndex; // iSwaptions
+  double *pdControlMean;     // iSwaptions
+  FTYPE *pdPayoff;           // BLOCKSIZE
+  FTYPE *pdControl;          // BLOCKSIZE
+#ifndef SIMD_WIDTH
+  FTYPE *pdPayoffDiscountFactors; // iN*BLOCKSIZE each
+  FTYPE *pdDiscountingRatePath;
+  FTYPE *pdSwapRatePath;
+  FTYPE *pdSwapDiscountFactors;
+#endif
+  FTYPE **pdZ;               // iFactors x iN*BLOCKSIZE
+  FTYPE **randZ;             // iFactors x iN*BLOCKSIZE
+  FTYPE *pdRand;             // BLOCKSIZE*(iN-1)*iFactors
+} workspace;
+
 typedef struct
 {
   int Id;
@@ -0,0 +1,243 @@
+// Portfolio.cpp
+// Loads the swaptions to price from a file (-pf) instead of generating them.
+//
+// Every swaption is described by, in this order:
+//   strike, compounding, maturity, tenor, payment interval, years, iN, iFactors,
+//   the yield curve (iN values) and the factor volatilities (iFactors rows of iN-1 values)
+// with the same meaning as the fields of parm (see HJM_Swaption_Blocking.cpp).
+//
+// CSV file: one swaption per line, values separated by commas or white space,
+// empty lines and lines starting with '#' are ignored.
+// Binary file: PORTFOLIO_MAGIC, PORTFOLIO_VERSION and the number of swaptions as
+// 32 bit integers, followed by the swaptions with iN and iFactors as 32 bit integers
+// and all other values as 32 bit floats, in little endian byte order.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "nr_routines.h"
+#include "HJM.h"
+#include "HJM_type.h"
+
+#define PORTFOLIO_MAGIC   0x54505753 // "SWPT"
+#define PORTFOLIO_VERSION 1
+
+#define PORTFOLIO_STR(x)  #x
+#define PORTFOLIO_XSTR(x) PORTFOLIO_STR(x)
+
+static void Portfolio_error(const char *pcFile, int iSwaption, const char *pcError)
+{
+  fprintf(stderr, "Error: %s, swaption %d: %s\n", pcFile, iSwaption, pcError);
+  exit(1);
+}
+
+// Checks the values of a swaption and allocates its curve and factors
+static void Portfolio_check(const char *pcFile, int iSwaption, parm *pSwaption)
+{
+  if (pSwaption->iN < 2 || pSwaption->iN > MAX_N ||
+      pSwaption->iFactors < 1 || pSwaption->iFactors > MAX_FACTORS || !(pSwaption->dYears > 0))
+    Portfolio_error(pcFile, iSwaption, "need 2 <= iN <= " PORTFOLIO_XSTR(MAX_N)
+                    ", 1 <= iFactors <= " PORTFOLIO_XSTR(MAX_FACTORS) " and years > 0");
+
+  FTYPE ddelt = pSwaption->dYears/pSwaption->iN;
+  int iSwapStartTimeIndex = (int)(pSwaption->dMaturity/ddelt + 0.5);
+  int iSwapTimePoints = (int)(pSwaption->dTenor/ddelt + 0.5);
+  int iFreqRatio = (int)(pSwaption->dPaymentInterval/ddelt + 0.5);
+  if (iFreqRatio < 1 || iSwapTimePoints < iFreqRatio)
+    Portfolio_error(pcFile, iSwaption, "payment interval shorter than years/iN or longer than the tenor");
+  if (iSwapStartTimeIndex < 0 || iSwapStartTimeIndex + iSwapTimePoints > pSwaption->iN - 1)
+    Portfolio_error(pcFile, iSwaption, "maturity plus tenor exceeds the simulated years");
+
+  pSwaption->pdYield = dvector(0, pSwaption->iN-1);
+  pSwaption->ppdFactors = dmatrix(0, pSwaption->iFactors-1, 0, pSwaption->iN-2);
+}
+
+static int32_t Portfolio_int(int32_t x)
+{
+  const int32_t iOne = 1;
+  if (*(const char *)&iOne) return x; //little endian host
+  uint32_t u = (uint32_t)x;
+  return (int32_t)((u >> 24) | ((u >> 8) & 0xff00) | ((u << 8) & 0xff0000) | (u << 24));
+}
+
+static FTYPE Portfolio_float(float f)
+{
+  int32_t x;
+  memcpy(&x, &f, sizeof(x));
+  x = Portfolio_int(x);
+  memcpy(&f, &x, sizeof(x));
+  return f;
+}
+
+// Bytes left to read in the file
+static long Portfolio_remaining(FILE *file)
+{
+  long lPos = ftell(file);
+  fseek(file, 0, SEEK_END);
+  long lSize = ftell(file);
+  fseek(file, lPos, SEEK_SET);
+  return lSize - lPos;
+}
+
+static parm *Portfolio_load_binary(FILE *file, const char *pcFile, int *pnSwaptions)
+{
+  //the magic number was already read
+  int32_t piHeader[2];
+  if (fread(piHeader, sizeof(int32_t), 2, file) != 2 || Portfolio_int(piHeader[0]) != PORTFOLIO_VERSION)
+    Portfolio_error(pcFile, 0, "unsupported portfolio file");
+
+  //the smallest swaption has iN = 2 and iFactors = 1: 8 values, 2 yields and 1 factor
+  const long lMinBytes = sizeof(int32_t)*2 + sizeof(float)*(6 + 2 + 1);
+  int nSwaptions = Portfolio_int(piHeader[1]);
+  if (nSwaptions <= 0)
+    Portfolio_error(pcFile, 0, "file contains no swaptions");
+  if (nSwaptions > Portfolio_remaining(file) / lMinBytes)
+    Portfolio_error(pcFile, 0, "file is too short for the number of swaptions in its header");
+  parm *swaptions = (parm *)malloc(sizeof(parm)*nSwaptions);
+  for (int i = 0; i < nSwaptions; i++) {
+    int32_t piSize[2];
+    float pfValues[6];
+    if (fread(piSize, sizeof(int32_t), 2, file) != 2 || fread(pfValues, sizeof(float), 6, file) != 6)
+      Portfolio_error(pcFile, i, "file is truncated");
+    parm *p = &swaptions[i];
+    p->iN = Portfolio_int(piSize[0]);
+    p->iFactors = Portfolio_int(piSize[1]);
+    p->dStrike = Portfolio_float(pfValues[0]);
+    p->dCompounding = Portfolio_float(pfValues[1]);
+    p->dMaturity = Portfolio_float(pfValues[2]);
+    p->dTenor = Portfolio_float(pfValues[3]);
+    p->dPaymentInterval = Portfolio_float(pfValues[4]);
+    p->dYears = Portfolio_float(pfValues[5]);
+    Portfolio_check(pcFile, i, p);
+
+    //curve and factors are read with one call each
+    int n = p->iN + p->iFactors*(p->iN-1);
+    if ((long)sizeof(float)*n > Portfolio_remaining(file))
+      Portfolio_error(pcFile, i, "file is truncated");
+    float *pfCurve = (float *)malloc(sizeof(float)*n);
+    if (fread(pfCurve, sizeof(float), n, file) != (size_t)n)
+      Portfolio_error(pcFile, i, "file is truncated");
+    for (int j = 0; j < p->iN; j++)
+      p->pdYield[j] = Portfolio_float(pfCurve[j]);
+    for (int k = 0; k < p->iFactors; k++)
+      for (int j = 0; j < p->iN-1; j++)
+        p->ppdFactors[k][j] = Portfolio_float(pfCurve[p->iN + k*(p->iN-1) + j]);
+    free(pfCurve);
+  }
+  *pnSwaptions = nSwaptions;
+  return swaptions;
+}
+
+// Next number of a CSV line, returns 0 at the end of the line
+static int Portfolio_number(char **ppc, double *pd)
+{
+  char *pc = *ppc;
+  while (*pc && (isspace((unsigned char)*pc) || *pc == ','))
+    pc++;
+  if (!*pc)
+    return 0;
+  char *pcEnd;
+  *pd = strtod(pc, &pcEnd);
+  if (pcEnd == pc)
+    return 0;
+  *ppc = pcEnd;
+  return 1;
+}
+
+static parm *Portfolio_load_csv(FILE *file, const char *pcFile, int *pnSwaptions)
+{
+  int nSwaptions = 0, nAllocated = 16;
+  parm *swaptions = (parm *)malloc(sizeof(parm)*nAllocated);
+  char *pcLine = NULL;
+  size_t lLine = 0;
+
+  while (getline(&pcLine, &lLine, file) != -1) {
+    char *pc = pcLine;
+    double pdValues[8];
+    int n = 0;
+    while (*pc && isspace((unsigned char)*pc))
+      pc++;
+    if (!*pc || *pc == '#')
+      continue;
+    while (n < 8 && Portfolio_number(&pc, &pdValues[n]))
+      n++;
+    if (n < 8)
+      Portfolio_error(pcFile, nSwaptions, "expected strike, compounding, maturity, tenor, payment interval, years, iN, iFactors");
+
+    if (nSwaptions == nAllocated) {
+      nAllocated *= 2;
+      swaptions = (parm *)realloc(swaptions, sizeof(parm)*nAllocated);
+    }
+    parm *p = &swaptions[nSwaptions];
+    p->dStrike = pdValues[0];
+    p->dCompounding = pdValues[1];
+    p->dMaturity = pdValues[2];
+    p->dTenor = pdValues[3];
+    p->dPaymentInterval = pdValues[4];
+    p->dYears = pdValues[5];
+    //out of range sizes are set to 0 for Portfolio_check to reject them
+    p->iN = pdValues[6] >= 2 && pdValues[6] <= MAX_N ? (int)pdValues[6] : 0;
+    p->iFactors = pdValues[7] >= 1 && pdValues[7] <= MAX_FACTORS ? (int)pdValues[7] : 0;
+    Portfolio_check(pcFile, nSwaptions, p);
+
+    double d;
+    for (int j = 0; j < p->iN; j++) {
+      if (!Portfolio_number(&pc, &d))
+        Portfolio_error(pcFile, nSwaptions, "yield curve needs iN values");
+      p->pdYield[j] = d;
+    }
+    for (int k = 0; k < p->iFactors; k++)
+      for (int j = 0; j < p->iN-1; j++) {
+        if (!Portfolio_number(&pc, &d))
+          Portfolio_error(pcFile, nSwaptions, "factor volatilities need iFactors*(iN-1) values");
+        p->ppdFactors[k][j] = d;
+      }
+    nSwaptions++;
+  }
+  free(pcLine);
+  *pnSwaptions = nSwaptions;
+  return swaptions;
+}
+
+parm *HJM_Portfolio_load(const char *pcFile, int *pnSwaptions)
+{
+  FILE *file = fopen(pcFile, "rb");
+  if (!file) {
+    fprintf(stderr, "Error: Cannot open portfolio file %s\n", pcFile);
+    exit(1);
+  }
+
+  int32_t iMagic = 0;
+  parm *swaptions;
+  if (fread(&iMagic, sizeof(int32_t), 1, file) == 1 && Portfolio_int(iMagic) == PORTFOLIO_MAGIC) {
+    swaptions = Portfolio_load_binary(file, pcFile, pnSwaptions);
+  } else {
+    rewind(file);
+    swaptions = Portfolio_load_csv(file, pcFile, pnSwaptions);
+    if (*pnSwaptions == 0)
+      Portfolio_error(pcFile, 0, "file contains no swaptions");
+  }
+  fclose(file);
+
+  for (int i = 0; i < *pnSwaptions; i++) {
+    swaptions[i].Id = i;
+    swaptions[i].dSimSwaptionMeanPrice = 0;
+    swaptions[i].dSimSwaptionStdError = 0;
+  }
+  return swaptions;
+}
+
+// Two swaptions can share their paths if these are generated from the same inputs
+int HJM_Portfolio_same_paths(parm *a, parm *b)
+{
+  if (a->iN != b->iN || a->iFactors != b->iFactors || a->dYears != b->dYears)
+    return 0;
+  if (memcmp(a->pdYield, b->pdYield, sizeof(FTYPE)*a->iN))
+    return 0;
+  for (int k = 0; k < a->iFactors; k++)
+    if (memcmp(a->ppdFactors[k], b->ppdFactors[k], sizeof(FTYPE)*(a->iN-1)))
+      return 0;
+  return 1;
+}
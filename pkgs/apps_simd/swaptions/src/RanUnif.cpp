@@ -28,3 +28,88 @@ FTYPE RanUnif( long *s )
   return (dRes);
   
 } // end of RanUnif
+
+// Skip-ahead for the generator above: returns the seed RanUnif leaves behind after
+// n calls starting from seed s, i.e. s*16807^n mod (2^31-1), in O(log n) steps.
+// Used to start independent blocks of trials at their position in the sequence.
+long RanUnif_skip( long s, long n )
+{
+  const long long m = 2147483647LL;
+  long long a = 16807LL;
+  long long p = 1;
+
+  if (n <= 0) return s;
+  while (n > 0) {
+    if (n & 1) p = (p * a) % m;
+    a = (a * a) % m;
+    n >>= 1;
+  }
+  return (long)((s % m) * p % m);
+
+} // end of RanUnif_skip
+
+// Block version of RanUnif: stores the next n numbers of the sequence in out[0..n-1]
+// and leaves *s as n calls of RanUnif would.
+// SIMD version: the numbers are split into RANUNIF_LANES consecutive ranges of L
+// numbers, lane k starts at 16807^(k*L)*s and steps with the usual multiplier
+// 16807, so the lanes generate independent parts of the exact same sequence.
+// 16807*ix mod (2^31-1) is computed with 32 bit lanes by splitting ix in 16 bit
+// halves and folding bit 31 back (2^31 = 1 mod 2^31-1). Several vectors are
+// processed at once to hide the latency of the multiplications.
+#ifdef SIMD_WIDTH
+#define RANUNIF_VECTORS 4
+#define RANUNIF_LANES (RANUNIF_VECTORS*SIMD_WIDTH)
+#endif
+
+void RanUnif_block( long *s, int n, FTYPE *out )
+{
+#ifndef SIMD_WIDTH
+  for (int i=0; i<n; i++)
+    out[i] = RanUnif(s);
+#else
+  if (n <= 0)
+    return;
+  if (*s < 0 || *s >= 2147483647L) { // the lanes need a reduced seed
+    for (int i=0; i<n; i++)
+      out[i] = RanUnif(s);
+    return;
+  }
+
+  int L = (n + RANUNIF_LANES - 1) / RANUNIF_LANES;
+  int *iRand = (int *)_mm_malloc(sizeof(int)*L*RANUNIF_LANES, _MM_ALIGNMENT);
+  _MM_ALIGN int iSeed[RANUNIF_LANES];
+
+  long long pL = RanUnif_skip(1, L); // 16807^L
+  iSeed[0] = (int)*s;
+  for (int k=1; k<RANUNIF_LANES; k++)
+    iSeed[k] = (int)(iSeed[k-1] * pL % 2147483647LL);
+
+  _MM_TYPE_I ix[RANUNIF_VECTORS];
+  for (int v=0; v<RANUNIF_VECTORS; v++)
+    ix[v] = _MM_LOADU_I((_MM_TYPE_I *)&iSeed[v*SIMD_WIDTH]);
+  _MM_TYPE_I a = _MM_SET_I(16807);
+  for (int t=0; t<L; t++) {
+    for (int v=0; v<RANUNIF_VECTORS; v++) {
+      _MM_TYPE_I hi = _MM_SRLI_I(ix[v], 16);
+      _MM_TYPE_I lo = _MM_SUB_I(ix[v], _MM_SLLI_I(hi, 16));
+      _MM_TYPE_I p = _MM_MUL_I(hi, a);   // < 2^30, multiplied by 2^16
+      _MM_TYPE_I q = _MM_MUL_I(lo, a);   // < 2^31
+      // p*2^16 = (p>>15)*2^31 + (p & 0x7fff)*2^16
+      _MM_TYPE_I r = _MM_ADD_I(_MM_ADD_I(_MM_SRLI_I(p, 15), _MM_SRLI_I(_MM_SLLI_I(p, 17), 1)), q);
+      // fold twice, the first fold can leave 2^31
+      r = _MM_ADD_I(_MM_SRLI_I(_MM_SLLI_I(r, 1), 1), _MM_SRLI_I(r, 31));
+      ix[v] = _MM_ADD_I(_MM_SRLI_I(_MM_SLLI_I(r, 1), 1), _MM_SRLI_I(r, 31));
+      _MM_STOREU((FTYPE *)&iRand[t*RANUNIF_LANES + v*SIMD_WIDTH], _MM_CAST_I_TO_FP(ix[v]));
+    }
+  }
+
+  // conversion as in RanUnif (in double precision) so that the values are identical
+  for (int k=0; k<RANUNIF_LANES; k++)
+    for (int t=0; t<L && k*L+t<n; t++)
+      out[k*L+t] = iRand[t*RANUNIF_LANES + k] * 4.656612875e-10;
+
+  // the seed is the last number generated
+  *s = iRand[((n-1) % L)*RANUNIF_LANES + (n-1) / L];
+  _mm_free(iRand);
+#endif
+} // end of RanUnif_block
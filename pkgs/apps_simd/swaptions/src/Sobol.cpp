@@ -0,0 +1,212 @@
+// Sobol.cpp
+// Randomized Sobol sequences and Brownian bridge construction for the
+// quasi-random sampling mode of swaptions (-vr s).
+
+/* A trial needs (iN-1)*iFactors normals, one Sobol dimension each. The normals of
+   a factor are used as the Brownian bridge of its iN-1 time steps, so the first
+   dimensions (coarsest bridge levels) carry most of the variance of the payoff.
+   Dimension d = k*iFactors + l drives bridge level k of factor l.
+
+   Direction numbers use primitive polynomials in increasing order of degree as in
+   Joe & Kuo, "Constructing Sobol sequences with better two-dimensional
+   projections", SIAM J. Sci. Comput. 30 (2008). Their initial direction numbers
+   are used for the first dimensions, later dimensions use odd random ones.
+
+   The points are randomized with a random digital shift, one per replicate, so
+   the SOBOL_REPLICATES replicates are independent estimates and the spread of
+   their means gives the standard error. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "nr_routines.h"
+#include "HJM.h"
+#include "HJM_type.h"
+
+#define SOBOL_JOE_KUO_DIMS 13
+
+// initial direction numbers m_1..m_s of dimensions 2..13 (dimension 1 is all 1)
+static const unsigned int uiJoeKuo[SOBOL_JOE_KUO_DIMS-1][5] = {
+  {1}, {1,3}, {1,3,1}, {1,1,1}, {1,1,3,3}, {1,3,5,13},
+  {1,1,5,5,17}, {1,1,5,5,5}, {1,1,7,11,19}, {1,1,5,1,1}, {1,1,1,3,11}, {1,3,5,5,31}
+};
+
+// x^s + a_1 x^(s-1) + ... + a_(s-1) x + 1 is primitive, the a_i are the bits of a
+static int Sobol_primitive(int s, unsigned int a)
+{
+  unsigned int p = (1u << s) | (a << 1) | 1u;
+  unsigned int n = (1u << s) - 1;
+  unsigned int x = 1;
+
+  for (unsigned int k=1; k<=n; ++k) {
+    x <<= 1;
+    if (x & (1u << s)) x ^= p;
+    if (x == 1) return k == n;
+  }
+  return 0;
+}
+
+// Direction numbers of iDims dimensions, SOBOL_BITS per dimension
+static void Sobol_directions(unsigned int *puiV, int iDims, long lSeed)
+{
+  int d = 0, s = 0;
+  unsigned int a = 0;
+  int i, k;
+
+  for (k=0; k<SOBOL_BITS; ++k)
+    puiV[k] = 1u << (SOBOL_BITS-1-k);
+
+  for (d=1; d<iDims; ++d) {
+    unsigned int *v = &puiV[d*SOBOL_BITS];
+
+    //next primitive polynomial
+    do {
+      if (++a >= (1u << (s > 0 ? s-1 : 0))) { ++s; a = 0; }
+    } while (!Sobol_primitive(s, a));
+
+    for (k=0; k<s && k<SOBOL_BITS; ++k) {
+      unsigned int m;
+      if (d < SOBOL_JOE_KUO_DIMS)
+	m = uiJoeKuo[d-1][k];
+      else
+	m = ((unsigned int)(RanUnif(&lSeed)*(1u << k)) << 1) | 1u; //odd, below 2^(k+1)
+      v[k] = m << (SOBOL_BITS-1-k);
+    }
+    for (k=s; k<SOBOL_BITS; ++k) {
+      v[k] = v[k-s] ^ (v[k-s] >> s);
+      for (i=1; i<s; ++i)
+	if ((a >> (s-1-i)) & 1)
+	  v[k] ^= v[k-i];
+    }
+  }
+}
+
+// Brownian bridge over iSteps unit time steps, W at step i is built from the
+// already known values at steps piLeft[k]-1 and piRight[k] (see Sobol_bridge_block)
+static void Sobol_bridge(sobol *pSobol, int iSteps)
+{
+  int *piMap = (int *)calloc(iSteps, sizeof(int));
+  int i, j, k, l;
+
+  piMap[iSteps-1] = 1;
+  pSobol->piBridgeIndex[0] = iSteps-1;
+  pSobol->piLeftIndex[0] = 0;
+  pSobol->piRightIndex[0] = 0;
+  pSobol->pdLeftWeight[0] = 0;
+  pSobol->pdRightWeight[0] = 0;
+  pSobol->pdStdDev[0] = sqrt((FTYPE)iSteps);
+
+  for (i=1, j=0; i<iSteps; ++i) {
+    while (piMap[j]) ++j;
+    k = j;
+    while (!piMap[k]) ++k;
+    l = j + ((k-1-j) >> 1);  //middle of the gap [j, k-1]
+    piMap[l] = i;
+    pSobol->piBridgeIndex[i] = l;
+    pSobol->piLeftIndex[i] = j;
+    pSobol->piRightIndex[i] = k;
+    //times are index+1, the left end is at time j (0 for j == 0)
+    pSobol->pdLeftWeight[i] = (FTYPE)(k-l)/(k+1-j);
+    pSobol->pdRightWeight[i] = (FTYPE)(l+1-j)/(k+1-j);
+    pSobol->pdStdDev[i] = sqrt((FTYPE)(l+1-j)*(k-l)/(k+1-j));
+    j = k+1;
+    if (j >= iSteps) j = 0;
+  }
+  free(piMap);
+}
+
+void Sobol_init(sobol *pSobol, int iN, int iFactors, long lSeed)
+{
+  int iSteps = iN-1;
+  int i;
+
+  pSobol->iDims = iSteps*iFactors;
+  pSobol->puiDirections = (unsigned int *)malloc(sizeof(unsigned int)*pSobol->iDims*SOBOL_BITS);
+  pSobol->puiShift = (unsigned int *)malloc(sizeof(unsigned int)*pSobol->iDims*SOBOL_REPLICATES);
+  pSobol->piBridgeIndex = ivector(0, iSteps-1);
+  pSobol->piLeftIndex = ivector(0, iSteps-1);
+  pSobol->piRightIndex = ivector(0, iSteps-1);
+  pSobol->pdLeftWeight = dvector(0, iSteps-1);
+  pSobol->pdRightWeight = dvector(0, iSteps-1);
+  pSobol->pdStdDev = dvector(0, iSteps-1);
+
+  Sobol_directions(pSobol->puiDirections, pSobol->iDims, RANDSEEDVAL);
+  //32 bit shifts from two 16 bit halves of the generator
+  for (i=0; i<pSobol->iDims*SOBOL_REPLICATES; ++i)
+    pSobol->puiShift[i] = ((unsigned int)(RanUnif(&lSeed)*65536.0) << 16) ^ (unsigned int)(RanUnif(&lSeed)*65536.0);
+  Sobol_bridge(pSobol, iSteps);
+}
+
+void Sobol_free(sobol *pSobol, int iN)
+{
+  int iSteps = iN-1;
+
+  free(pSobol->puiDirections);
+  free(pSobol->puiShift);
+  free_ivector(pSobol->piBridgeIndex, 0, iSteps-1);
+  free_ivector(pSobol->piLeftIndex, 0, iSteps-1);
+  free_ivector(pSobol->piRightIndex, 0, iSteps-1);
+  free_dvector(pSobol->pdLeftWeight, 0, iSteps-1);
+  free_dvector(pSobol->pdRightWeight, 0, iSteps-1);
+  free_dvector(pSobol->pdStdDev, 0, iSteps-1);
+}
+
+// Points lFirst..lFirst+iLanes-1 (in Gray code order) of replicate iReplicate as
+// uniforms in randZ[l][BLOCKSIZE*(k+1) + b], the layout used for pseudo-random numbers
+void Sobol_block(sobol *pSobol, int iReplicate, long lFirst, int iLanes,
+		 FTYPE **randZ, int iFactors, int BLOCKSIZE)
+{
+  unsigned long g = (unsigned long)lFirst ^ ((unsigned long)lFirst >> 1);
+
+  for (int d=0; d<pSobol->iDims; ++d) {
+    unsigned int *v = &pSobol->puiDirections[d*SOBOL_BITS];
+    unsigned int x = pSobol->puiShift[iReplicate*pSobol->iDims + d];
+    FTYPE *pdOut = &randZ[d % iFactors][BLOCKSIZE*(d/iFactors + 1)];
+
+    for (int k=0; k<SOBOL_BITS; ++k)
+      if ((g >> k) & 1) x ^= v[k];
+
+    for (int b=0; b<iLanes; ++b) {
+      //upper 23 bits centered in their interval, exact in single precision and never 0 or 1
+      pdOut[b] = (FTYPE)(((x >> 9) + 0.5) * (1.0/8388608.0));
+      unsigned long n = lFirst + b + 1;
+      int c = 0;
+      while (!((n >> c) & 1)) ++c;
+      if (c < SOBOL_BITS) x ^= v[c];
+    }
+  }
+}
+
+// Replaces the normals of bridge levels k in pdZ[l][BLOCKSIZE*(k+1) + b] by the
+// normals of time steps j in pdZ[l][BLOCKSIZE*j + b], pdW holds iN*BLOCKSIZE values
+void Sobol_bridge_block(sobol *pSobol, FTYPE **pdZ, FTYPE *pdW, int iN, int iFactors,
+			int iLanes, int BLOCKSIZE)
+{
+  int iSteps = iN-1;
+  int i, b, l;
+
+  for (l=0; l<iFactors; ++l) {
+    FTYPE *z = &pdZ[l][BLOCKSIZE];
+
+    //pdW[BLOCKSIZE*(i+1) + b] is W at time i+1, pdW[b] is W(0) = 0
+    for (b=0; b<iLanes; ++b) {
+      pdW[b] = 0;
+      pdW[BLOCKSIZE*iSteps + b] = pSobol->pdStdDev[0]*z[b];
+    }
+    for (i=1; i<iSteps; ++i) {
+      FTYPE *w = &pdW[BLOCKSIZE*(pSobol->piBridgeIndex[i]+1)];
+      FTYPE *wl = &pdW[BLOCKSIZE*pSobol->piLeftIndex[i]];
+      FTYPE *wr = &pdW[BLOCKSIZE*(pSobol->piRightIndex[i]+1)];
+      FTYPE dLeft = pSobol->pdLeftWeight[i];
+      FTYPE dRight = pSobol->pdRightWeight[i];
+      FTYPE dStdDev = pSobol->pdStdDev[i];
+      for (b=0; b<iLanes; ++b)
+	w[b] = dLeft*wl[b] + dRight*wr[b] + dStdDev*z[BLOCKSIZE*i + b];
+    }
+
+    //unit time steps: the increments are the standard normals
+    for (i=1; i<=iSteps; ++i)
+      for (b=0; b<iLanes; ++b)
+	pdZ[l][BLOCKSIZE*i + b] = pdW[BLOCKSIZE*i + b] - pdW[BLOCKSIZE*(i-1) + b];
+  }
+}
@@ -77,6 +77,68 @@ typedef VipsColourCodeClass VipsLab2LabQClass;
 
 G_DEFINE_TYPE( VipsLab2LabQ, vips_Lab2LabQ, VIPS_TYPE_COLOUR_CODE );
 
+/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+
+//#define DEBUG_SIMD
+#ifdef DEBUG_SIMD
+static int diff_labq = 0;
+static int max_diff_labq = 0;
+
+// Validation function for vips_Lab2LabQ_simd
+static void inline validate_Lab2LabQ( VipsPel *q, float *p, int width ) {
+  int i, lsbs, intv;
+
+  for( i = 0; i < width; i++ ) {
+    intv = 10.23 * p[0] + 0.5;
+    intv = VIPS_CLIP( 0, intv, 1023 );
+    lsbs = (intv & 0x3) << 6;
+    q[0] = intv >> 2;
+    intv = VIPS_RINT( 8.0 * p[1] );
+    intv = VIPS_CLIP( -1024, intv, 1023 );
+    lsbs |= (intv & 0x7) << 3;
+    q[1] = intv >> 3;
+    intv = VIPS_RINT( 8.0 * p[2] );
+    intv = VIPS_CLIP( -1024, intv, 1023 );
+    lsbs |= (intv & 0x7);
+    q[2] = intv >> 3;
+    q[3] = lsbs;
+    p += 3;
+    q += 4;
+  }
+}
+#endif
+
+// JMCG Returns the number of pixels done, the caller does the leftovers
+static int inline vips_Lab2LabQ_simd( VipsPel *q, float *p, int width ) {
+  _MM_TYPE L, A, B;
+  int x;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    _MM_LOADU3( &L, &A, &B, &p[3 * x] );
+    _MM_STOREU_I( (void *) &q[4 * x], vips__colour_Lab2LabQ( L, A, B ) );
+  }
+
+#ifdef DEBUG_SIMD
+  VipsPel test_out[4 * x + 1];
+  int i;
+  validate_Lab2LabQ( &test_out[0], p, x );
+  for( i = 0; i < 4 * x; i++ ) {
+    diff_labq = abs(q[i] - test_out[i]);
+    if (diff_labq > max_diff_labq) {
+      max_diff_labq = diff_labq;
+      printf("Maxdiff Lab2LabQ = %d\n",max_diff_labq);
+      fflush(stdout);
+    }
+  }
+#endif
+
+  return( x );
+}
+
+#endif /*VIPS_COLOUR_SIMD*/
+/* JMCG END */
+
 /* @(#) convert float Lab to packed Lab32 format 10 11 11 bits
  * works only on buffers, not IMAGEs
  * Copyright 1993 K.Martinez
@@ -90,7 +152,17 @@ vips_Lab2LabQ_line( VipsColour *colour, VipsPel *out, VipsPel **in, int width )
 
 	int i;
 
-	for( i = 0; i < width; i++ ) {
+	/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+	i = vips_Lab2LabQ_simd( q, p, width );
+	p += 3 * i;
+	q += 4 * i;
+#else
+	i = 0;
+#endif /*VIPS_COLOUR_SIMD*/
+	/* JMCG END */
+
+	for( ; i < width; i++ ) {
 		float fval;
 		int lsbs;
 		int intv;
@@ -80,6 +80,79 @@ typedef VipsColourTransformClass VipsLab2XYZClass;
 
 G_DEFINE_TYPE( VipsLab2XYZ, vips_Lab2XYZ, VIPS_TYPE_COLOUR_TRANSFORM );
 
+/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+
+//#define DEBUG_SIMD
+#ifdef DEBUG_SIMD
+static float diff_lab2xyz = 0.0f;
+static float max_diff_lab2xyz = 0.0f;
+
+// Validation function for vips_Lab2XYZ_simd
+static void inline validate_Lab2XYZ( float *q, float *p, int width,
+	double X0, double Y0, double Z0 ) {
+  int x;
+
+  for( x = 0; x < width; x++ ) {
+    float L = p[0], a = p[1], b = p[2];
+    float X, Y, Z;
+    double cby, tmp;
+
+    if( L < 8.0 ) {
+      Y = (L * Y0) / 903.3;
+      cby = 7.787 * (Y / Y0) + 16.0 / 116.0;
+    }
+    else {
+      cby = (L + 16.0) / 116.0;
+      Y = Y0 * cby * cby * cby;
+    }
+    tmp = a / 500.0 + cby;
+    X = tmp < 0.2069 ? X0 * (tmp - 0.13793) / 7.787 : X0 * tmp * tmp * tmp;
+    tmp = cby - b / 200.0;
+    Z = tmp < 0.2069 ? Z0 * (tmp - 0.13793) / 7.787 : Z0 * tmp * tmp * tmp;
+
+    q[0] = X;
+    q[1] = Y;
+    q[2] = Z;
+    p += 3;
+    q += 3;
+  }
+}
+#endif
+
+// JMCG Returns the number of pixels done, the caller does the leftovers
+static int inline vips_Lab2XYZ_simd( float *q, float *p, int width,
+	double X0, double Y0, double Z0 ) {
+  _MM_TYPE L, A, B;
+  _MM_TYPE X, Y, Z;
+  int x;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    _MM_LOADU3( &L, &A, &B, &p[3 * x] );
+    vips__colour_Lab2XYZ( L, A, B, &X, &Y, &Z, X0, Y0, Z0 );
+    _MM_STOREU3( &q[3 * x], X, Y, Z );
+  }
+
+#ifdef DEBUG_SIMD
+  float test_out[3 * x + 1];
+  int i;
+  validate_Lab2XYZ( &test_out[0], p, x, X0, Y0, Z0 );
+  for( i = 0; i < 3 * x; i += 3 ) {
+    diff_lab2xyz = fabs(q[i] - test_out[i]) + fabs(q[i+1] - test_out[i+1]) + fabs(q[i+2] - test_out[i+2]);
+    if (diff_lab2xyz > max_diff_lab2xyz) {
+      max_diff_lab2xyz = diff_lab2xyz;
+      printf("Maxdiff Lab2XYZ = %f\n",max_diff_lab2xyz);
+      fflush(stdout);
+    }
+  }
+#endif
+
+  return( x );
+}
+
+#endif /*VIPS_COLOUR_SIMD*/
+/* JMCG END */
+
 /* Process a buffer of data.
  */
 static void
@@ -94,7 +167,18 @@ vips_Lab2XYZ_line( VipsColour *colour, VipsPel *out, VipsPel **in, int width )
 	VIPS_DEBUG_MSG( "vips_Lab2XYZ_line: X0 = %g, Y0 = %g, Z0 = %g\n",
 		Lab2XYZ->X0, Lab2XYZ->Y0, Lab2XYZ->Z0 );
 
-	for( x = 0; x < width; x++ ) {
+	/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+	x = vips_Lab2XYZ_simd( q, p, width, 
+		Lab2XYZ->X0, Lab2XYZ->Y0, Lab2XYZ->Z0 );
+	p += 3 * x;
+	q += 3 * x;
+#else
+	x = 0;
+#endif /*VIPS_COLOUR_SIMD*/
+	/* JMCG END */
+
+	for( ; x < width; x++ ) {
 		float L, a, b;
 		float X, Y, Z;
 		double cby, tmp;
@@ -63,6 +63,90 @@ typedef VipsColourCodeClass VipsLabQ2LabClass;
 
 G_DEFINE_TYPE( VipsLabQ2Lab, vips_LabQ2Lab, VIPS_TYPE_COLOUR_CODE );
 
+/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+
+//#define DEBUG_SIMD
+#ifdef DEBUG_SIMD
+#include <math.h>
+static float diff_labq = 0.0f;
+static float max_diff_labq = 0.0f;
+
+// Validation function for vips_LabQ2Lab_simd
+static void inline validate_LabQ2Lab( float *q, signed char *p, int width ) {
+  int i, l, lsbs;
+
+  for( i = 0; i < width; i++ ) {
+    lsbs = ((unsigned char *) p)[3];
+    l = ((unsigned char *)p)[0];
+    l = (l << 2) | (lsbs >> 6);
+    q[0] = (float) l * (100.0 / 1023.0);
+    l = (p[1] << 3) | ((lsbs >> 3) & 0x7);
+    q[1] = (float) l * 0.125;
+    l = (p[2] << 3) | (lsbs & 0x7);
+    q[2] = (float) l * 0.125;
+    p += 4;
+    q += 3;
+  }
+}
+#endif
+
+// JMCG A LabQ pixel is one 32-bit word: L in bits 0-7, a in 8-15, b in
+// 16-23 and the low bits of all three in 24-31, so SIMD_WIDTH pixels fill
+// an integer vector. Returns the number of pixels done, the caller does the
+// leftovers
+static int inline vips_LabQ2Lab_simd( float *q, VipsPel *p, int width ) {
+  const _MM_TYPE_I byte = _MM_SET_I( 0xff );
+  const _MM_TYPE_I three = _MM_SET_I( 0x3 );
+  const _MM_TYPE_I seven = _MM_SET_I( 0x7 );
+
+  _MM_TYPE_I v, l, a, b;
+  _MM_TYPE L, A, B;
+  int x;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    v = _MM_LOADU_I( (void *) &p[4 * x] );
+
+    l = _MM_ADD_I( _MM_SLLI_I( VIPS_COLOUR_AND_I( v, byte ), 2 ),
+		   VIPS_COLOUR_AND_I( _MM_SRLI_I( v, 30 ), three ) );
+    a = _MM_ADD_I( _MM_SLLI_I( VIPS_COLOUR_AND_I( _MM_SRLI_I( v, 8 ), byte ), 3 ),
+		   VIPS_COLOUR_AND_I( _MM_SRLI_I( v, 27 ), seven ) );
+    b = _MM_ADD_I( _MM_SLLI_I( VIPS_COLOUR_AND_I( _MM_SRLI_I( v, 16 ), byte ), 3 ),
+		   VIPS_COLOUR_AND_I( _MM_SRLI_I( v, 24 ), seven ) );
+
+    // JMCG a and b are 11-bit two's complement, sign extend as float
+    A = _MM_CVT_I_TO_FP( a );
+    A = _MM_SUB( A, _MM_AND( _MM_CMPGT( A, _MM_SET( 1023.5f ) ), _MM_SET( 2048.0f ) ) );
+    B = _MM_CVT_I_TO_FP( b );
+    B = _MM_SUB( B, _MM_AND( _MM_CMPGT( B, _MM_SET( 1023.5f ) ), _MM_SET( 2048.0f ) ) );
+
+    L = _MM_MUL( _MM_CVT_I_TO_FP( l ), _MM_SET( 100.0 / 1023.0 ) );
+    A = _MM_MUL( A, _MM_SET( 0.125f ) );
+    B = _MM_MUL( B, _MM_SET( 0.125f ) );
+
+    _MM_STOREU3( &q[3 * x], L, A, B );
+  }
+
+#ifdef DEBUG_SIMD
+  float test_out[3 * x + 1];
+  int i;
+  validate_LabQ2Lab( &test_out[0], (signed char *) p, x );
+  for( i = 0; i < 3 * x; i += 3 ) {
+    diff_labq = fabs(q[i] - test_out[i]) + fabs(q[i+1] - test_out[i+1]) + fabs(q[i+2] - test_out[i+2]);
+    if (diff_labq > max_diff_labq) {
+      max_diff_labq = diff_labq;
+      printf("Maxdiff LabQ2Lab = %f\n",max_diff_labq);
+      fflush(stdout);
+    }
+  }
+#endif
+
+  return( x );
+}
+
+#endif /*VIPS_COLOUR_SIMD*/
+/* JMCG END */
+
 /* imb_LabQ2Lab: CONVERT n pels from packed 32bit Lab to float values
  * in a buffer
  * ARGS:   VipsPel *inp       pointer to first byte of Lab32 buffer
@@ -80,9 +164,19 @@ vips_LabQ2Lab_line( VipsColour *colour, VipsPel *out, VipsPel **in, int width )
 	int lsbs;               /* for lsbs byte */
 	int i;                  /* counter      */
 
+	/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+	i = vips_LabQ2Lab_simd( q, (VipsPel *) p, width );
+	p += 4 * i;
+	q += 3 * i;
+#else
+	i = 0;
+#endif /*VIPS_COLOUR_SIMD*/
+	/* JMCG END */
+
 	/* Read input with a signed pointer to get signed ab easily.
 	 */
-	for( i = 0; i < width; i++ ) {
+	for( ; i < width; i++ ) {
 		/* Get extra bits.
 		 */
 		lsbs = ((unsigned char *) p)[3];
@@ -67,7 +67,7 @@
 
 /* Lookup table size.
  */
-#define QUANT_ELEMENTS (100000)
+#define QUANT_ELEMENTS VIPS__XYZ2LAB_QUANT
 
 float cbrt_table[QUANT_ELEMENTS];
 
@@ -107,6 +107,92 @@ table_init( void *client )
 	return( NULL );
 }
 
+/* JMCG BEGIN */
+// JMCG The two table entries the lookup extrapolates from, worked out as
+// table_init() does, so callers don't need the table
+void
+vips__XYZ2Lab_tail( float *top, float *slope )
+{
+	float Y0 = (double) (QUANT_ELEMENTS - 2) / QUANT_ELEMENTS;
+	float Y1 = (double) (QUANT_ELEMENTS - 1) / QUANT_ELEMENTS;
+	float t0 = cbrt( Y0 );
+	float t1 = cbrt( Y1 );
+
+	*top = t0;
+	*slope = t1 - t0;
+}
+
+#ifdef VIPS_COLOUR_SIMD
+
+//#define DEBUG_SIMD
+#ifdef DEBUG_SIMD
+static float diff_xyz2lab = 0.0f;
+static float max_diff_xyz2lab = 0.0f;
+
+// Validation function for vips_XYZ2Lab_simd
+static void inline validate_XYZ2Lab( float *q, float *p, int width,
+	double X0, double Y0, double Z0 ) {
+  int x, i;
+  float nX, nY, nZ, f, cbx, cby, cbz;
+
+  for( x = 0; x < width; x++ ) {
+    nX = QUANT_ELEMENTS * p[0] / X0;
+    nY = QUANT_ELEMENTS * p[1] / Y0;
+    nZ = QUANT_ELEMENTS * p[2] / Z0;
+    i = VIPS_FCLIP( 0, nX, QUANT_ELEMENTS - 2 );
+    f = nX - i;
+    cbx = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
+    i = VIPS_FCLIP( 0, nY, QUANT_ELEMENTS - 2 );
+    f = nY - i;
+    cby = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
+    i = VIPS_FCLIP( 0, nZ, QUANT_ELEMENTS - 2 );
+    f = nZ - i;
+    cbz = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
+    q[0] = 116.0 * cby - 16.0;
+    q[1] = 500.0 * (cbx - cby);
+    q[2] = 200.0 * (cby - cbz);
+    p += 3;
+    q += 3;
+  }
+}
+#endif
+
+// JMCG Returns the number of pixels done, the caller does the leftovers
+static int inline vips_XYZ2Lab_simd( float *q, float *p, int width,
+	double X0, double Y0, double Z0 ) {
+  const float top = cbrt_table[QUANT_ELEMENTS - 2];
+  const float slope = cbrt_table[QUANT_ELEMENTS - 1] - top;
+
+  _MM_TYPE X, Y, Z;
+  _MM_TYPE L, A, B;
+  int x;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    _MM_LOADU3( &X, &Y, &Z, &p[3 * x] );
+    vips__colour_XYZ2Lab( X, Y, Z, &L, &A, &B, X0, Y0, Z0, top, slope );
+    _MM_STOREU3( &q[3 * x], L, A, B );
+  }
+
+#ifdef DEBUG_SIMD
+  float test_out[3 * x + 1];
+  int i;
+  validate_XYZ2Lab( &test_out[0], p, x, X0, Y0, Z0 );
+  for( i = 0; i < 3 * x; i += 3 ) {
+    diff_xyz2lab = fabs(q[i] - test_out[i]) + fabs(q[i+1] - test_out[i+1]) + fabs(q[i+2] - test_out[i+2]);
+    if (diff_xyz2lab > max_diff_xyz2lab) {
+      max_diff_xyz2lab = diff_xyz2lab;
+      printf("Maxdiff XYZ2Lab = %f\n",max_diff_xyz2lab);
+      fflush(stdout);
+    }
+  }
+#endif
+
+  return( x );
+}
+
+#endif /*VIPS_COLOUR_SIMD*/
+/* JMCG END */
+
 /* Process a buffer of data.
  */
 static void
@@ -122,7 +208,18 @@ vips_XYZ2Lab_line( VipsColour *colour, VipsPel *out, VipsPel **in, int width )
 
 	(void) g_once( &once, table_init, NULL );
 
-	for( x = 0; x < width; x++ ) {
+	/* JMCG BEGIN */
+#ifdef VIPS_COLOUR_SIMD
+	x = vips_XYZ2Lab_simd( q, p, width, 
+		XYZ2Lab->X0, XYZ2Lab->Y0, XYZ2Lab->Z0 );
+	p += 3 * x;
+	q += 3 * x;
+#else
+	x = 0;
+#endif /*VIPS_COLOUR_SIMD*/
+	/* JMCG END */
+
+	for( ; x < width; x++ ) {
 		float nX, nY, nZ;
 		int i;
 		float f;
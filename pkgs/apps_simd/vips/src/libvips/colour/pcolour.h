@@ -31,6 +31,11 @@
 #ifndef VIPS_PCOLOUR_H
 #define VIPS_PCOLOUR_H
 
+/* JMCG BEGIN */
+//#define DFTYPE
+#include "simd_defines.h"
+/* JMCG END */
+
 #ifdef __cplusplus
 extern "C" {
 #endif /*__cplusplus*/
@@ -205,6 +210,171 @@ GType vips_colour_difference_get_type( void );
 void vips__pythagoras_line( VipsColour *colour, 
 	VipsPel *out, VipsPel **in, int width );
 
+/* JMCG BEGIN */
+// JMCG Size of the XYZ2Lab cube root table, and its last entry and slope,
+// which the lookup extrapolates from for XYZ above the white point
+#define VIPS__XYZ2LAB_QUANT (100000)
+
+void vips__XYZ2Lab_tail( float *top, float *slope );
+
+// JMCG Vector kernels for the colour conversions, SIMD_WIDTH pixels at a
+// time with one vector per band. Not for NEON, where the floor and compare
+// emulation in simd_defines.h is not exact enough for them.
+#if defined (SIMD_WIDTH) && !defined (PARSEC_USE_NEON)
+#define VIPS_COLOUR_SIMD
+
+// JMCG A where MASK is set, B elsewhere. _MM_BLENDV takes a different mask
+// type on AVX512, this works with _MM_CMPLT everywhere
+#define VIPS_COLOUR_SELECT( MASK, A, B ) \
+	_MM_OR( _MM_AND( MASK, A ), _MM_ANDNOT( MASK, B ) )
+
+// JMCG There is no integer AND, go through the float one
+#define VIPS_COLOUR_AND_I( A, B ) \
+	_MM_CAST_FP_TO_I( _MM_AND( _MM_CAST_I_TO_FP( A ), \
+		_MM_CAST_I_TO_FP( B ) ) )
+
+// JMCG The conversions on one vector per band, shared by the line kernels
+// of each operation and by fused chains of point operations (see
+// deprecated/im_benchmark.c)
+
+// JMCG Lab to XYZ. The inverse of the companding function is worked out
+// on both branches for all lanes and one is picked
+static _MM_TYPE inline vips__colour_Lab2XYZ_f( _MM_TYPE t ) {
+  _MM_TYPE cube = _MM_MUL( _MM_MUL( t, t ), t );
+  _MM_TYPE lin = _MM_MUL( _MM_SUB( t, _MM_SET( 0.13793f ) ),
+			  _MM_SET( (float) (1.0 / 7.787) ) );
+
+  return( VIPS_COLOUR_SELECT( _MM_CMPLT( t, _MM_SET( 0.2069f ) ), lin, cube ) );
+}
+
+static void inline vips__colour_Lab2XYZ( _MM_TYPE L, _MM_TYPE A, _MM_TYPE B,
+	_MM_TYPE *X, _MM_TYPE *Y, _MM_TYPE *Z,
+	double X0, double Y0, double Z0 ) {
+  _MM_TYPE cby, cby_lin, cby_cube, dark;
+
+  // JMCG L < 8 is on the linear part of the curve
+  dark = _MM_CMPLT( L, _MM_SET( 8.0f ) );
+  cby_lin = _MM_ADD( _MM_MUL( L, _MM_SET( (float) (7.787 / 903.3) ) ), _MM_SET( (float) (16.0 / 116.0) ) );
+  cby_cube = _MM_MUL( _MM_ADD( L, _MM_SET( 16.0f ) ),
+		      _MM_SET( (float) (1.0 / 116.0) ) );
+  cby = VIPS_COLOUR_SELECT( dark, cby_lin, cby_cube );
+  *Y = VIPS_COLOUR_SELECT( dark,
+			   _MM_MUL( L, _MM_SET( (float) (Y0 / 903.3) ) ),
+			   _MM_MUL( _MM_SET( (float) Y0 ),
+				    _MM_MUL( _MM_MUL( cby_cube, cby_cube ), cby_cube ) ) );
+
+  *X = _MM_MUL( _MM_SET( (float) X0 ),
+		vips__colour_Lab2XYZ_f( _MM_ADD( _MM_MUL( A, _MM_SET( (float) (1.0 / 500.0) ) ), cby ) ) );
+  *Z = _MM_MUL( _MM_SET( (float) Z0 ),
+		vips__colour_Lab2XYZ_f( _MM_SUB( cby, _MM_MUL( B, _MM_SET( (float) (1.0 / 200.0) ) ) ) ) );
+}
+
+// JMCG cbrt() without the XYZ2Lab table, which would need a gather per
+// band. A guess from the float bits (exponent / 3) is within a few
+// percent, two Halley steps take it to full float precision
+static _MM_TYPE inline vips__colour_cbrt( _MM_TYPE y ) {
+  _MM_TYPE r, r3;
+
+  // JMCG No integer divide, but the bits are exact enough as float
+  r = _MM_CAST_I_TO_FP( _MM_ADD_I( _MM_CVT_FP_TO_I( _MM_MUL( _MM_CVT_I_TO_FP( _MM_CAST_FP_TO_I( y ) ),
+							   _MM_SET( (float) (1.0 / 3.0) ) ) ),
+				   _MM_SET_I( 709921077 ) ) );
+
+  r3 = _MM_MUL( _MM_MUL( r, r ), r );
+  r = _MM_DIV( _MM_MUL( r, _MM_ADD( _MM_MUL( _MM_SET( 2.0f ), y ), r3 ) ),
+	       _MM_ADD( _MM_MUL( _MM_SET( 2.0f ), r3 ), y ) );
+  r3 = _MM_MUL( _MM_MUL( r, r ), r );
+  r = _MM_DIV( _MM_MUL( r, _MM_ADD( _MM_MUL( _MM_SET( 2.0f ), y ), r3 ) ),
+	       _MM_ADD( _MM_MUL( _MM_SET( 2.0f ), r3 ), y ) );
+
+  return( r );
+}
+
+// JMCG What the XYZ2Lab table lookup gives for n = QUANT_ELEMENTS * Y / Y0:
+// the linear segment below 0.008856 (and for negative n, where the scalar
+// code extrapolates the first table entry), cbrt() above, and the last
+// table entry extrapolated from QUANT_ELEMENTS - 2 on, where the scalar
+// index is clipped. top and slope come from vips__XYZ2Lab_tail()
+static _MM_TYPE inline vips__colour_XYZ2Lab_f( _MM_TYPE n,
+	float top, float slope ) {
+  _MM_TYPE y = _MM_MUL( n, _MM_SET( (float) (1.0 / VIPS__XYZ2LAB_QUANT) ) );
+  _MM_TYPE lin = _MM_ADD( _MM_MUL( y, _MM_SET( 7.787f ) ), _MM_SET( (float) (16.0 / 116.0) ) );
+  _MM_TYPE above = _MM_ADD( _MM_MUL( _MM_SUB( n, _MM_SET( (float) (VIPS__XYZ2LAB_QUANT - 2) ) ), _MM_SET( slope ) ), _MM_SET( top ) );
+  _MM_TYPE f;
+
+  f = VIPS_COLOUR_SELECT( _MM_CMPLT( y, _MM_SET( 0.008856f ) ), lin, vips__colour_cbrt( y ) );
+  f = VIPS_COLOUR_SELECT( _MM_CMPLT( n, _MM_SET( (float) (VIPS__XYZ2LAB_QUANT - 2) ) ), f, above );
+
+  return( f );
+}
+
+static void inline vips__colour_XYZ2Lab( _MM_TYPE X, _MM_TYPE Y, _MM_TYPE Z,
+	_MM_TYPE *L, _MM_TYPE *A, _MM_TYPE *B,
+	double X0, double Y0, double Z0, float top, float slope ) {
+  _MM_TYPE cbx, cby, cbz;
+
+  cbx = vips__colour_XYZ2Lab_f( _MM_MUL( X, _MM_SET( (float) (VIPS__XYZ2LAB_QUANT / X0) ) ), top, slope );
+  cby = vips__colour_XYZ2Lab_f( _MM_MUL( Y, _MM_SET( (float) (VIPS__XYZ2LAB_QUANT / Y0) ) ), top, slope );
+  cbz = vips__colour_XYZ2Lab_f( _MM_MUL( Z, _MM_SET( (float) (VIPS__XYZ2LAB_QUANT / Z0) ) ), top, slope );
+
+  *L = _MM_ADD( _MM_MUL( cby, _MM_SET( 116.0f ) ), _MM_SET( -16.0f ) );
+  *A = _MM_MUL( _MM_SET( 500.0f ), _MM_SUB( cbx, cby ) );
+  *B = _MM_MUL( _MM_SET( 200.0f ), _MM_SUB( cby, cbz ) );
+}
+
+// JMCG Lab to LabQ. A LabQ pixel is one 32-bit word: L in bits 0-7, a in
+// 8-15, b in 16-23 and the low bits of all three in 24-31, so this gives
+// SIMD_WIDTH pixels ready to store. The fields don't overlap, so they are
+// put together with adds
+static _MM_TYPE_I inline vips__colour_Lab2LabQ( _MM_TYPE L, _MM_TYPE A, _MM_TYPE B ) {
+  const _MM_TYPE_I byte = _MM_SET_I( 0xff );
+  const _MM_TYPE_I three = _MM_SET_I( 0x3 );
+  const _MM_TYPE_I seven = _MM_SET_I( 0x7 );
+
+  _MM_TYPE t, f, d, near;
+  _MM_TYPE_I l, a, b, v;
+  _MM_ALIGN float Ls[SIMD_WIDTH];
+  _MM_ALIGN int fix[SIMD_WIDTH];
+  int i;
+
+  // JMCG L is truncated after adding 0.5, as the scalar code does.
+  // a and b go through VIPS_RINT(), round to nearest like the
+  // conversion
+  t = _MM_ADD( _MM_MUL( L, _MM_SET( 10.23f ) ), _MM_SET( 0.5f ) );
+  f = _MM_FLOOR( t );
+  l = _MM_CVT_FP_TO_I( f );
+
+  // JMCG Whole L values such as 50 land on an integer here, where the
+  // float product may be a hair under the double one of the scalar code
+  // and truncate one step down. Redo those vectors in double
+  d = _MM_SUB( t, f );
+  near = _MM_OR( _MM_CMPLT( d, _MM_SET( 1e-3f ) ),
+		 _MM_CMPLT( _MM_SET( 1.0f - 1e-3f ), d ) );
+  if( _MM_REDUCE_ADD( _MM_AND( near, _MM_SET( 1.0f ) ) ) > 0.0f ) {
+    _MM_STORE( Ls, L );
+    for( i = 0; i < SIMD_WIDTH; i++ )
+      fix[i] = 10.23 * Ls[i] + 0.5;
+    l = _MM_LOADU_I( (void *) fix );
+  }
+
+  l = _MM_MAX_I( _MM_SET_I( 0 ), _MM_MIN_I( _MM_SET_I( 1023 ), l ) );
+  a = _MM_CVT_FP_TO_I( _MM_MUL( A, _MM_SET( 8.0f ) ) );
+  a = _MM_MAX_I( _MM_SET_I( -1024 ), _MM_MIN_I( _MM_SET_I( 1023 ), a ) );
+  b = _MM_CVT_FP_TO_I( _MM_MUL( B, _MM_SET( 8.0f ) ) );
+  b = _MM_MAX_I( _MM_SET_I( -1024 ), _MM_MIN_I( _MM_SET_I( 1023 ), b ) );
+
+  v = _MM_SRLI_I( l, 2 );
+  v = _MM_ADD_I( v, _MM_SLLI_I( VIPS_COLOUR_AND_I( _MM_SRLI_I( a, 3 ), byte ), 8 ) );
+  v = _MM_ADD_I( v, _MM_SLLI_I( VIPS_COLOUR_AND_I( _MM_SRLI_I( b, 3 ), byte ), 16 ) );
+  v = _MM_ADD_I( v, _MM_SLLI_I( VIPS_COLOUR_AND_I( l, three ), 30 ) );
+  v = _MM_ADD_I( v, _MM_SLLI_I( VIPS_COLOUR_AND_I( a, seven ), 27 ) );
+  v = _MM_ADD_I( v, _MM_SLLI_I( VIPS_COLOUR_AND_I( b, seven ), 24 ) );
+
+  return( v );
+}
+#endif /*VIPS_COLOUR_SIMD*/
+/* JMCG END */
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
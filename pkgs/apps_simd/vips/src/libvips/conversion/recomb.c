@@ -54,6 +54,17 @@
 
 #include "pconversion.h"
 
+/* JMCG BEGIN */
+//#define DFTYPE
+#include "simd_defines.h"
+
+//#define DEBUG_SIMD
+#ifdef DEBUG_SIMD
+float diff_recomb = 0.0f;
+float max_diff_recomb = 0.0f;
+#endif
+/* JMCG END */
+
 typedef struct _VipsRecomb {
 	VipsConversion parent_instance;
 
@@ -96,6 +107,78 @@ G_DEFINE_TYPE( VipsRecomb, vips_recomb, VIPS_TYPE_CONVERSION );
 	} \
 }
 
+/* JMCG BEGIN */
+// JMCG Vectorization of the float 3x3 case (colourspace matrices), one vector
+// per band. Not for NEON, as in the colour package
+#if defined (SIMD_WIDTH) && !defined (PARSEC_USE_NEON)
+#define VIPS_RECOMB_SIMD
+
+#ifdef DEBUG_SIMD
+// Validation function for recomb_3x3_simd
+static void inline validate_recomb_3x3( const double *m, const float *p, float *q, int width ) {
+  int x, u, v;
+
+  for( x = 0; x < width; x++ ) {
+    for( v = 0; v < 3; v++ ) {
+      double t = 0.0;
+      for( u = 0; u < 3; u++ )
+	t += m[3 * v + u] * p[u];
+      q[v] = (float) t;
+    }
+    p += 3;
+    q += 3;
+  }
+}
+#endif
+
+// JMCG The matrix is broadcast once per line, products are summed in float
+static void inline recomb_3x3_simd( const double *m, const float *p, float *q, int width ) {
+  _MM_TYPE m00 = _MM_SET( (float) m[0] ), m01 = _MM_SET( (float) m[1] ), m02 = _MM_SET( (float) m[2] );
+  _MM_TYPE m10 = _MM_SET( (float) m[3] ), m11 = _MM_SET( (float) m[4] ), m12 = _MM_SET( (float) m[5] );
+  _MM_TYPE m20 = _MM_SET( (float) m[6] ), m21 = _MM_SET( (float) m[7] ), m22 = _MM_SET( (float) m[8] );
+  _MM_TYPE b0, b1, b2;
+  int x, u, v;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    _MM_LOADU3( &b0, &b1, &b2, p );
+    _MM_STOREU3( q,
+		 _MM_ADD( _MM_ADD( _MM_MUL( m00, b0 ), _MM_MUL( m01, b1 ) ), _MM_MUL( m02, b2 ) ),
+		 _MM_ADD( _MM_ADD( _MM_MUL( m10, b0 ), _MM_MUL( m11, b1 ) ), _MM_MUL( m12, b2 ) ),
+		 _MM_ADD( _MM_ADD( _MM_MUL( m20, b0 ), _MM_MUL( m21, b1 ) ), _MM_MUL( m22, b2 ) ) );
+    p += 3 * SIMD_WIDTH;
+    q += 3 * SIMD_WIDTH;
+  }
+
+#ifdef DEBUG_SIMD
+  float test_out[3 * x + 1];
+  int i;
+  validate_recomb_3x3( m, p - 3 * x, &test_out[0], x );
+  for( i = 0; i < 3 * x; i += 3 ) {
+    diff_recomb = fabs(q[i - 3 * x] - test_out[i]) + fabs(q[i + 1 - 3 * x] - test_out[i+1]) + fabs(q[i + 2 - 3 * x] - test_out[i+2]);
+    if (diff_recomb > max_diff_recomb) {
+      max_diff_recomb = diff_recomb;
+      printf("Maxdiff recomb = %f\n",max_diff_recomb);
+      fflush(stdout);
+    }
+  }
+#endif
+
+  // Compute leftovers
+  for( ; x < width; x++ ) {
+    for( v = 0; v < 3; v++ ) {
+      double t = 0.0;
+      for( u = 0; u < 3; u++ )
+	t += m[3 * v + u] * p[u];
+      q[v] = (float) t;
+    }
+    p += 3;
+    q += 3;
+  }
+}
+
+#endif
+/* JMCG END */
+
 static int
 vips_recomb_gen( VipsRegion *or, 
 	void *seq, void *a, void *b, gboolean *stop )
@@ -124,7 +207,19 @@ vips_recomb_gen( VipsRegion *or,
 		case VIPS_FORMAT_SHORT: LOOP( signed short, float ); break; 
 		case VIPS_FORMAT_UINT: 	LOOP( unsigned int, float ); break; 
 		case VIPS_FORMAT_INT: 	LOOP( signed int, float );  break; 
-		case VIPS_FORMAT_FLOAT: LOOP( float, float ); break; 
+		case VIPS_FORMAT_FLOAT: 
+			/* JMCG BEGIN */
+#ifdef VIPS_RECOMB_SIMD
+			if( mwidth == 3 && mheight == 3 ) {
+				recomb_3x3_simd( 
+					VIPS_MATRIX( recomb->coeff, 0, 0 ),
+					(float *) in, (float *) out, 
+					or->valid.width );
+				break;
+			}
+#endif
+			/* JMCG END */
+			LOOP( float, float ); break; 
 		case VIPS_FORMAT_DOUBLE:LOOP( double, double ); break; 
 
 		default:
@@ -42,10 +42,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
 
+/* JMCG BEGIN */
+// JMCG Run the point-wise middle of the benchmark (white point and shadow
+// adjustment, white surround, Lab to LabQ) as one operation instead of a
+// chain of thirteen, each with its own image. Comment out for the original
+// chain
+#define BENCHMARK_FUSE
+
+#ifdef BENCHMARK_FUSE
+#include <vips/internal.h>
+
+#include "../colour/pcolour.h"
+#endif /*BENCHMARK_FUSE*/
+/* JMCG END */
+
 /*
 
 VIPS SMP benchmark
@@ -161,6 +176,339 @@ main = (get_image @ stage_srgb @
 
  */
 
+/* JMCG BEGIN */
+#ifdef BENCHMARK_FUSE
+
+// JMCG A chain of point operations on three-band float Lab, ending in LabQ.
+// Every pixel goes through all the steps before the next one is read, so
+// the intermediate values stay in registers and nothing is written back
+// to an image between the steps.
+typedef enum {
+  FUSE_LINEAR,		// out = matrix * in + offset: lintra, lintra_vec, recomb
+  FUSE_LAB2XYZ,		// D65, as im_Lab2XYZ()
+  FUSE_XYZ2LAB		// D65, as im_XYZ2Lab()
+} FuseType;
+
+typedef struct {
+  FuseType type;
+
+  double matrix[9];
+  double offset[3];
+
+  // JMCG The same, for the vector path
+  float fmatrix[9];
+  float foffset[3];
+} FuseStage;
+
+#define FUSE_MAX_STAGES (16)
+
+// JMCG Pixels per block on the scalar path, which goes through a small Lab
+// buffer for the LabQ packer
+#define FUSE_BLOCK (64)
+
+typedef struct {
+  int n;
+  FuseStage stage[FUSE_MAX_STAGES];
+
+  // JMCG Where the input L is above white_L the output is white, as
+  // im_moreconst() and im_ifthenelse() do in the original chain
+  double white_L;
+  float white[3];
+
+  // JMCG Tail of the XYZ2Lab table, see vips__XYZ2Lab_tail()
+  float top, slope;
+} Fuse;
+
+static void
+fuse_set_linear( FuseStage *stage, const double *matrix, const double *offset )
+{
+  int i;
+
+  stage->type = FUSE_LINEAR;
+  for( i = 0; i < 9; i++ ) {
+    stage->matrix[i] = matrix[i];
+    stage->fmatrix[i] = matrix[i];
+  }
+  for( i = 0; i < 3; i++ ) {
+    stage->offset[i] = offset[i];
+    stage->foffset[i] = offset[i];
+  }
+}
+
+static FuseStage *
+fuse_new_stage( Fuse *fuse )
+{
+  if( fuse->n >= FUSE_MAX_STAGES ) {
+    im_error( "im_benchmark", "%s", _( "too many fused operations" ) );
+    return( NULL );
+  }
+
+  return( &fuse->stage[fuse->n++] );
+}
+
+// JMCG Append a linear step. A linear step straight after another one is
+// folded into it, so lintra_vec, recomb, lintra_vec, lintra in a row is a
+// single matrix
+static int
+fuse_linear( Fuse *fuse, const double *matrix, const double *offset )
+{
+  FuseStage *last = fuse->n > 0 ? &fuse->stage[fuse->n - 1] : NULL;
+  FuseStage *stage;
+
+  if( last && last->type == FUSE_LINEAR ) {
+    double m[9], o[3];
+    int i, j, k;
+
+    for( i = 0; i < 3; i++ ) {
+      for( j = 0; j < 3; j++ ) {
+	m[3 * i + j] = 0.0;
+	for( k = 0; k < 3; k++ )
+	  m[3 * i + j] += matrix[3 * i + k] * last->matrix[3 * k + j];
+      }
+
+      o[i] = offset[i];
+      for( k = 0; k < 3; k++ )
+	o[i] += matrix[3 * i + k] * last->offset[k];
+    }
+    fuse_set_linear( last, m, o );
+
+    return( 0 );
+  }
+
+  if( !(stage = fuse_new_stage( fuse )) )
+    return( -1 );
+  fuse_set_linear( stage, matrix, offset );
+
+  return( 0 );
+}
+
+// JMCG out[i] = a[i] * in[i] + b[i], as im_lintra_vec() with three bands
+static int
+fuse_lintra_vec( Fuse *fuse, const double *a, const double *b )
+{
+  double matrix[9] = {
+    a[0], 0.0, 0.0,
+    0.0, a[1], 0.0,
+    0.0, 0.0, a[2]
+  };
+
+  return( fuse_linear( fuse, matrix, b ) );
+}
+
+static int
+fuse_lintra( Fuse *fuse, double a, double b )
+{
+  double av[3] = { a, a, a };
+  double bv[3] = { b, b, b };
+
+  return( fuse_lintra_vec( fuse, av, bv ) );
+}
+
+static int
+fuse_recomb( Fuse *fuse, DOUBLEMASK *recomb )
+{
+  double zero[3] = { 0.0, 0.0, 0.0 };
+
+  if( recomb->xsize != 3 || recomb->ysize != 3 ) {
+    im_error( "im_benchmark", "%s", _( "only 3x3 recombination fuses" ) );
+    return( -1 );
+  }
+
+  return( fuse_linear( fuse, recomb->coeff, zero ) );
+}
+
+static int
+fuse_colour( Fuse *fuse, FuseType type )
+{
+  FuseStage *stage;
+
+  if( !(stage = fuse_new_stage( fuse )) )
+    return( -1 );
+  stage->type = type;
+
+  return( 0 );
+}
+
+// JMCG One pixel through the chain, up to float Lab
+static void
+fuse_pixel( Fuse *fuse, const float *p, float *q )
+{
+  float v[3];
+  int s, i;
+
+  if( p[0] > fuse->white_L ) {
+    q[0] = fuse->white[0];
+    q[1] = fuse->white[1];
+    q[2] = fuse->white[2];
+    return;
+  }
+
+  v[0] = p[0];
+  v[1] = p[1];
+  v[2] = p[2];
+
+  for( s = 0; s < fuse->n; s++ ) {
+    const FuseStage *stage = &fuse->stage[s];
+    float t[3];
+
+    switch( stage->type ) {
+    case FUSE_LINEAR:
+      for( i = 0; i < 3; i++ )
+	t[i] = stage->matrix[3 * i] * v[0] +
+	  stage->matrix[3 * i + 1] * v[1] +
+	  stage->matrix[3 * i + 2] * v[2] +
+	  stage->offset[i];
+      break;
+
+    case FUSE_LAB2XYZ:
+      vips_col_Lab2XYZ( v[0], v[1], v[2], &t[0], &t[1], &t[2] );
+      break;
+
+    case FUSE_XYZ2LAB:
+      vips_col_XYZ2Lab( v[0], v[1], v[2], &t[0], &t[1], &t[2] );
+      break;
+
+    default:
+      g_assert( 0 );
+    }
+
+    v[0] = t[0];
+    v[1] = t[1];
+    v[2] = t[2];
+  }
+
+  q[0] = v[0];
+  q[1] = v[1];
+  q[2] = v[2];
+}
+
+#ifdef VIPS_COLOUR_SIMD
+// JMCG SIMD_WIDTH pixels at a time through the chain, one vector per band
+// from the load to the packed LabQ store. Returns the number of pixels
+// done, the caller does the leftovers
+static int inline fuse_simd( Fuse *fuse, float *p, VipsPel *q, int width ) {
+  _MM_TYPE v0, v1, v2;
+  _MM_TYPE t0, t1, t2;
+  _MM_TYPE white;
+  int x, s;
+
+  for( x = 0; x + SIMD_WIDTH <= width; x += SIMD_WIDTH ) {
+    _MM_LOADU3( &v0, &v1, &v2, &p[3 * x] );
+    white = _MM_CMPLT( _MM_SET( (float) fuse->white_L ), v0 );
+
+    for( s = 0; s < fuse->n; s++ ) {
+      const FuseStage *stage = &fuse->stage[s];
+      const float *m = stage->fmatrix;
+      const float *o = stage->foffset;
+
+      switch( stage->type ) {
+      case FUSE_LINEAR:
+	t0 = _MM_ADD( _MM_ADD( _MM_MUL( _MM_SET( m[0] ), v0 ), _MM_MUL( _MM_SET( m[1] ), v1 ) ),
+		      _MM_ADD( _MM_MUL( _MM_SET( m[2] ), v2 ), _MM_SET( o[0] ) ) );
+	t1 = _MM_ADD( _MM_ADD( _MM_MUL( _MM_SET( m[3] ), v0 ), _MM_MUL( _MM_SET( m[4] ), v1 ) ),
+		      _MM_ADD( _MM_MUL( _MM_SET( m[5] ), v2 ), _MM_SET( o[1] ) ) );
+	t2 = _MM_ADD( _MM_ADD( _MM_MUL( _MM_SET( m[6] ), v0 ), _MM_MUL( _MM_SET( m[7] ), v1 ) ),
+		      _MM_ADD( _MM_MUL( _MM_SET( m[8] ), v2 ), _MM_SET( o[2] ) ) );
+	break;
+
+      case FUSE_LAB2XYZ:
+	vips__colour_Lab2XYZ( v0, v1, v2, &t0, &t1, &t2,
+			      VIPS_D65_X0, VIPS_D65_Y0, VIPS_D65_Z0 );
+	break;
+
+      case FUSE_XYZ2LAB:
+	vips__colour_XYZ2Lab( v0, v1, v2, &t0, &t1, &t2,
+			      VIPS_D65_X0, VIPS_D65_Y0, VIPS_D65_Z0,
+			      fuse->top, fuse->slope );
+	break;
+
+      default:
+	g_assert( 0 );
+      }
+
+      v0 = t0;
+      v1 = t1;
+      v2 = t2;
+    }
+
+    v0 = VIPS_COLOUR_SELECT( white, _MM_SET( fuse->white[0] ), v0 );
+    v1 = VIPS_COLOUR_SELECT( white, _MM_SET( fuse->white[1] ), v1 );
+    v2 = VIPS_COLOUR_SELECT( white, _MM_SET( fuse->white[2] ), v2 );
+
+    _MM_STOREU_I( (void *) &q[4 * x], vips__colour_Lab2LabQ( v0, v1, v2 ) );
+  }
+
+  return( x );
+}
+#endif /*VIPS_COLOUR_SIMD*/
+
+static void
+fuse_buffer( float *p, VipsPel *q, int width, Fuse *fuse, void *b )
+{
+  float lab[3 * FUSE_BLOCK];
+  int x, n, i;
+
+#ifdef VIPS_COLOUR_SIMD
+  x = fuse_simd( fuse, p, q, width );
+#else
+  x = 0;
+#endif /*VIPS_COLOUR_SIMD*/
+
+  for( ; x < width; x += n ) {
+    n = VIPS_MIN( FUSE_BLOCK, width - x );
+    for( i = 0; i < n; i++ )
+      fuse_pixel( fuse, &p[3 * (x + i)], &lab[3 * i] );
+    vips__Lab2LabQ_vec( &q[4 * x], lab, n );
+  }
+}
+
+// JMCG From the shrunk Lab image to the LabQ image that gets sharpened, in
+// one pass. The steps are the ones of the original chain in benchmark()
+static int
+benchmark_fused( IMAGE *in, IMAGE *out, double *one, double *zero,
+	double *darken, DOUBLEMASK *d652d50, double *whitepoint,
+	double *shadow, double *white )
+{
+  IMAGE *t[1];
+  Fuse *fuse;
+
+  if( im_check_uncoded( "im_benchmark", in ) ||
+      im_check_bands( "im_benchmark", in, 3 ) ||
+      !(fuse = IM_NEW( out, Fuse )) )
+    return( -1 );
+
+  memset( fuse, 0, sizeof( Fuse ) );
+  fuse->white_L = 99;
+  fuse->white[0] = white[0];
+  fuse->white[1] = white[1];
+  fuse->white[2] = white[2];
+  vips__XYZ2Lab_tail( &fuse->top, &fuse->slope );
+
+  if( fuse_lintra_vec( fuse, darken, zero ) ||
+      fuse_colour( fuse, FUSE_LAB2XYZ ) ||
+      fuse_recomb( fuse, d652d50 ) ||
+      fuse_lintra_vec( fuse, whitepoint, zero ) ||
+      fuse_lintra( fuse, 1.5, 0.0 ) ||
+      fuse_colour( fuse, FUSE_XYZ2LAB ) ||
+      fuse_lintra_vec( fuse, one, shadow ) )
+    return( -1 );
+
+  if( im_open_local_array( out, t, 1, "im_benchmark", "p" ) ||
+      im_clip2fmt( in, t[0], IM_BANDFMT_FLOAT ) ||
+      im_cp_desc( out, t[0] ) )
+    return( -1 );
+  out->Bands = 4;
+  out->BandFmt = IM_BANDFMT_UCHAR;
+  out->Coding = IM_CODING_LABQ;
+  out->Type = IM_TYPE_LABQ;
+
+  return( im_wrapone( t[0], out,
+		      (im_wrapone_fn) fuse_buffer, fuse, NULL ) );
+}
+
+#endif /*BENCHMARK_FUSE*/
+/* JMCG END */
+
 /* The main part of the benchmark ... transform labq to labq. Chain several of
  * these together to get a CPU-bound operation.
  */
@@ -203,6 +551,14 @@ benchmark( IMAGE *in, IMAGE *out )
 			0.9, 0, 0, 0.9, 
 			0, 0 ) || 
 
+		/* JMCG BEGIN */
+#ifdef BENCHMARK_FUSE
+		/* Everything from here to LabQ is point-wise, run it as one
+		 * operation.
+		 */
+		benchmark_fused( t[2], t[15], one, zero,
+			darken, d652d50, whitepoint, shadow, white ) ||
+#else
 		/* Find L ~= 100 areas (white surround).
 		 */
 		im_extract_band( t[2], t[3], 0 ) ||
@@ -230,6 +586,8 @@ benchmark( IMAGE *in, IMAGE *out )
 		/* Sharpen.
 		 */
 		im_Lab2LabQ( t[14], t[15] ) ||
+#endif /*BENCHMARK_FUSE*/
+		/* JMCG END */
 		im_sharpen( t[15], out, 11, 2.5, 40, 20, 0.5, 1.5 ) 
 	);
 }
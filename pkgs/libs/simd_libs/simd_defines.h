@@ -1276,6 +1276,8 @@ static inline _MM_TYPE _mm512_atan_pd(_MM_TYPE A) {
 #define _MM_LOADU_I  _mm_loadu_si128
 #define _MM_LOADU_hI(A)  _custom_load_half_int(A)
 #define _MM_LOAD3 _custom_mm_load_st3
+#define _MM_LOADU3 _custom_mm_loadu_st3
+#define _MM_STOREU3 _custom_mm_storeu_st3
 #define _MM_STORE _mm_store_ps
 #define _MM_STOREU _mm_storeu_ps
 #define _MM_STOREU_I _mm_storeu_si128
@@ -1404,6 +1406,36 @@ static inline void _custom_mm_load_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, fl
   *B = _mm_shuffle_ps(bb,bb,_MM_SHUFFLE(2,3,0,1)); // B = b4,b3,b2,b1
 }
 
+// Unaligned version, any stride 3 address. Shuffles only, no blends
+static inline void _custom_mm_loadu_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, const float* address) {
+  _MM_TYPE a_temp, b_temp, c_temp;
+  _MM_TYPE t0, t1;
+
+  a_temp = _MM_LOADU(address); // a2,c1,b1,a1
+  b_temp = _MM_LOADU(address+4); // b3,a3,c2,b2
+  c_temp = _MM_LOADU(address+8); // c4,b4,a4,c3
+
+  t0 = _mm_shuffle_ps(b_temp,c_temp,_MM_SHUFFLE(2,1,3,2)); // t0 = b4,a4,b3,a3
+  t1 = _mm_shuffle_ps(a_temp,b_temp,_MM_SHUFFLE(1,0,2,1)); // t1 = c2,b2,c1,b1
+
+  *A = _mm_shuffle_ps(a_temp,t0,_MM_SHUFFLE(2,0,3,0)); // A = a4,a3,a2,a1
+  *B = _mm_shuffle_ps(t1,t0,_MM_SHUFFLE(3,1,2,0)); // B = b4,b3,b2,b1
+  *C = _mm_shuffle_ps(t1,c_temp,_MM_SHUFFLE(3,0,3,1)); // C = c4,c3,c2,c1
+}
+
+// And back, unaligned
+static inline void _custom_mm_storeu_st3(float* address, _MM_TYPE A, _MM_TYPE B, _MM_TYPE C) {
+  _MM_TYPE t0, t1, t2;
+
+  t0 = _mm_shuffle_ps(A,B,_MM_SHUFFLE(2,0,2,0)); // t0 = b3,b1,a3,a1
+  t1 = _mm_shuffle_ps(C,A,_MM_SHUFFLE(3,1,2,0)); // t1 = a4,a2,c3,c1
+  t2 = _mm_shuffle_ps(B,C,_MM_SHUFFLE(3,1,3,1)); // t2 = c4,c2,b4,b2
+
+  _MM_STOREU(address,_mm_shuffle_ps(t0,t1,_MM_SHUFFLE(2,0,2,0))); // a2,c1,b1,a1
+  _MM_STOREU(address+4,_mm_shuffle_ps(t2,t0,_MM_SHUFFLE(3,1,2,0))); // b3,a3,c2,b2
+  _MM_STOREU(address+8,_mm_shuffle_ps(t1,t2,_MM_SHUFFLE(3,1,3,1))); // c4,b4,a4,c3
+}
+
 // Algorithm taken from vecmathlib and SLEEF 2.80
 static inline _MM_TYPE _mm_atan_ps(_MM_TYPE A) {
   _MM_TYPE q1 = A;
@@ -1494,6 +1526,8 @@ static inline _MM_TYPE _mm_atan_ps(_MM_TYPE A) {
 #define _MM_LOADU_I  _mm256_loadu_si256
 #define _MM_LOADU_hI(A)  _custom_load_half_int(A)
 #define _MM_LOAD3 _custom_mm_load_st3
+#define _MM_LOADU3 _custom_mm_loadu_st3
+#define _MM_STOREU3 _custom_mm_storeu_st3
 #define _MM_STORE _mm256_store_ps
 #define _MM_STOREU _mm256_storeu_ps
 #define _MM_STOREU_I _mm256_storeu_si256
@@ -1718,6 +1752,45 @@ static inline void _custom_mm_load_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, fl
   *C = _mm256_blend_ps(cc,cp,0b00100010); // C = c8,c7,c6,c5,c4,c3,c2,c1
 }
 
+// Unaligned version, any stride 3 address. Each 128-bit lane gets four
+// elements (1-4 low, 5-8 high), then the in-lane shuffles of the SSE version
+static inline void _custom_mm_loadu_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, const float* address) {
+  _MM_TYPE a_temp, b_temp, c_temp;
+  _MM_TYPE t0, t1;
+
+  a_temp = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(address)),_mm_loadu_ps(address+12),1); // a6,c5,b5,a5 | a2,c1,b1,a1
+  b_temp = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(address+4)),_mm_loadu_ps(address+16),1); // b7,a7,c6,b6 | b3,a3,c2,b2
+  c_temp = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(address+8)),_mm_loadu_ps(address+20),1); // c8,b8,a8,c7 | c4,b4,a4,c3
+
+  t0 = _mm256_shuffle_ps(b_temp,c_temp,_MM_SHUFFLE(2,1,3,2));
+  t1 = _mm256_shuffle_ps(a_temp,b_temp,_MM_SHUFFLE(1,0,2,1));
+
+  *A = _mm256_shuffle_ps(a_temp,t0,_MM_SHUFFLE(2,0,3,0)); // A = a8,a7,a6,a5,a4,a3,a2,a1
+  *B = _mm256_shuffle_ps(t1,t0,_MM_SHUFFLE(3,1,2,0)); // B = b8,b7,b6,b5,b4,b3,b2,b1
+  *C = _mm256_shuffle_ps(t1,c_temp,_MM_SHUFFLE(3,0,3,1)); // C = c8,c7,c6,c5,c4,c3,c2,c1
+}
+
+// And back, unaligned
+static inline void _custom_mm_storeu_st3(float* address, _MM_TYPE A, _MM_TYPE B, _MM_TYPE C) {
+  _MM_TYPE t0, t1, t2;
+  _MM_TYPE a_temp, b_temp, c_temp;
+
+  t0 = _mm256_shuffle_ps(A,B,_MM_SHUFFLE(2,0,2,0));
+  t1 = _mm256_shuffle_ps(C,A,_MM_SHUFFLE(3,1,2,0));
+  t2 = _mm256_shuffle_ps(B,C,_MM_SHUFFLE(3,1,3,1));
+
+  a_temp = _mm256_shuffle_ps(t0,t1,_MM_SHUFFLE(2,0,2,0)); // a6,c5,b5,a5 | a2,c1,b1,a1
+  b_temp = _mm256_shuffle_ps(t2,t0,_MM_SHUFFLE(3,1,2,0)); // b7,a7,c6,b6 | b3,a3,c2,b2
+  c_temp = _mm256_shuffle_ps(t1,t2,_MM_SHUFFLE(3,1,3,1)); // c8,b8,a8,c7 | c4,b4,a4,c3
+
+  _mm_storeu_ps(address,_mm256_castps256_ps128(a_temp));
+  _mm_storeu_ps(address+4,_mm256_castps256_ps128(b_temp));
+  _mm_storeu_ps(address+8,_mm256_castps256_ps128(c_temp));
+  _mm_storeu_ps(address+12,_mm256_extractf128_ps(a_temp,1));
+  _mm_storeu_ps(address+16,_mm256_extractf128_ps(b_temp,1));
+  _mm_storeu_ps(address+20,_mm256_extractf128_ps(c_temp,1));
+}
+
 
 static inline _MM_TYPE_I _custom_mm256_cmpeq_epi32(_MM_TYPE_I A, _MM_TYPE_I B) {
   return (_MM_TYPE_I)_MM_CMPEQ((_MM_TYPE)A,(_MM_TYPE)B);
@@ -1803,6 +1876,8 @@ static inline _MM_TYPE _mm256_atan_ps(_MM_TYPE A) {
 #define _MM_LOADU_I  _mm512_loadu_si512
 #define _MM_LOADU_hI(A)  _custom_load_half_int(A)
 #define _MM_LOAD3 _custom_mm_load_st3
+#define _MM_LOADU3 _custom_mm_loadu_st3
+#define _MM_STOREU3 _custom_mm_storeu_st3
 #define _MM_STORE _mm512_store_ps
 #define _MM_STOREU _mm512_storeu_ps
 #define _MM_STOREU_I _mm512_storeu_si512
@@ -1980,6 +2055,52 @@ static inline void _custom_mm_load_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, fl
   *C = _mm512_permutexvar_ps(_mm512_set_epi32(15,12,9,6,3,0,13,10,7,4,1,14,11,8,5,2), cc); // C = c16,c15,c14,c13,c12,c11,c10,c9,c8,c7,c6,c5,c4,c3,c2,c1
 }
 
+// Unaligned version, any stride 3 address. Each 128-bit lane gets four
+// elements (lane k holds 4k+1 to 4k+4), then the in-lane shuffles of the
+// SSE version
+static inline _MM_TYPE _custom_mm512_loadu_lanes(const float* address) {
+  _MM_TYPE v = _mm512_castps128_ps512(_mm_loadu_ps(address));
+  v = _mm512_insertf32x4(v,_mm_loadu_ps(address+12),1);
+  v = _mm512_insertf32x4(v,_mm_loadu_ps(address+24),2);
+  return _mm512_insertf32x4(v,_mm_loadu_ps(address+36),3);
+}
+
+static inline void _custom_mm512_storeu_lanes(float* address, _MM_TYPE v) {
+  _mm_storeu_ps(address,_mm512_castps512_ps128(v));
+  _mm_storeu_ps(address+12,_mm512_extractf32x4_ps(v,1));
+  _mm_storeu_ps(address+24,_mm512_extractf32x4_ps(v,2));
+  _mm_storeu_ps(address+36,_mm512_extractf32x4_ps(v,3));
+}
+
+static inline void _custom_mm_loadu_st3(_MM_TYPE* A, _MM_TYPE* B, _MM_TYPE* C, const float* address) {
+  _MM_TYPE a_temp, b_temp, c_temp;
+  _MM_TYPE t0, t1;
+
+  a_temp = _custom_mm512_loadu_lanes(address);
+  b_temp = _custom_mm512_loadu_lanes(address+4);
+  c_temp = _custom_mm512_loadu_lanes(address+8);
+
+  t0 = _mm512_shuffle_ps(b_temp,c_temp,_MM_SHUFFLE(2,1,3,2));
+  t1 = _mm512_shuffle_ps(a_temp,b_temp,_MM_SHUFFLE(1,0,2,1));
+
+  *A = _mm512_shuffle_ps(a_temp,t0,_MM_SHUFFLE(2,0,3,0));
+  *B = _mm512_shuffle_ps(t1,t0,_MM_SHUFFLE(3,1,2,0));
+  *C = _mm512_shuffle_ps(t1,c_temp,_MM_SHUFFLE(3,0,3,1));
+}
+
+// And back, unaligned
+static inline void _custom_mm_storeu_st3(float* address, _MM_TYPE A, _MM_TYPE B, _MM_TYPE C) {
+  _MM_TYPE t0, t1, t2;
+
+  t0 = _mm512_shuffle_ps(A,B,_MM_SHUFFLE(2,0,2,0));
+  t1 = _mm512_shuffle_ps(C,A,_MM_SHUFFLE(3,1,2,0));
+  t2 = _mm512_shuffle_ps(B,C,_MM_SHUFFLE(3,1,3,1));
+
+  _custom_mm512_storeu_lanes(address,_mm512_shuffle_ps(t0,t1,_MM_SHUFFLE(2,0,2,0)));
+  _custom_mm512_storeu_lanes(address+4,_mm512_shuffle_ps(t2,t0,_MM_SHUFFLE(3,1,2,0)));
+  _custom_mm512_storeu_lanes(address+8,_mm512_shuffle_ps(t1,t2,_MM_SHUFFLE(3,1,3,1)));
+}
+
 
 // Algorithm taken from vecmathlib and SLEEF 2.80
 static inline _MM_TYPE _mm512_atan_ps(_MM_TYPE A) {